@@ -0,0 +1 @@
+"""Performance benchmarks for PASP. See `benchmarks/run.py`."""
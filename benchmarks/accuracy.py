@@ -0,0 +1,79 @@
+"""Reports the accuracy of belief propagation against exact inference on the shipped examples.
+
+Usage (from the package root, with extensions built in place):
+
+    python -m benchmarks.accuracy
+    python -m benchmarks.accuracy --damping 0.3 --scale 1000 10000
+
+For every example `pasp.bp` applies to, prints the largest absolute difference between its
+probabilities and those of `pasp.exact` (which by default enumerates total choices), and the time
+each took. `--scale` also times `pasp.bp` alone on chains of that many annotated disjunctions (see
+`generators.many_ads`)."""
+
+import argparse
+import glob
+import json
+import os
+import sys
+import time
+
+def accuracy(path: str, args) -> dict:
+  import pasp
+  P = pasp.parse(path)
+  R = {"case": os.path.splitext(os.path.basename(path))[0]}
+  t = time.perf_counter()
+  try: B = pasp.bp(P, psemantics = args.psemantics, damping = args.damping,
+                   max_iters = args.max_iters, tol = args.tol, quiet = True)
+  except NotImplementedError:
+    R["error"] = "not applicable"
+    return R
+  R["bp_s"] = time.perf_counter() - t
+  t = time.perf_counter()
+  E = pasp.exact(pasp.parse(path), psemantics = args.psemantics, quiet = True)
+  R["exact_s"] = time.perf_counter() - t
+  R["queries"] = len(E)
+  R["max_abs_err"] = float(abs(B - E).max()) if len(E) else 0.0
+  return R
+
+def scale(n: int, args) -> dict:
+  import pasp
+  from .generators import many_ads
+  P = pasp.parse(many_ads(n).program, from_str = True)
+  t = time.perf_counter()
+  pasp.bp(P, psemantics = args.psemantics, damping = args.damping, max_iters = args.max_iters,
+          tol = args.tol, quiet = True)
+  return {"case": "many_ads", "params": {"n": n}, "bp_s": time.perf_counter() - t}
+
+def summary(R: dict) -> str:
+  name = R["case"] + "".join(f" {k}={v}" for k, v in R.get("params", {}).items())
+  if "error" in R: return f"{name:<28} {R['error']}"
+  if "max_abs_err" not in R: return f"{name:<28} bp {R['bp_s']:9.4f}s"
+  return f"{name:<28} bp {R['bp_s']:9.4f}s  exact {R['exact_s']:9.4f}s  " \
+         f"max |err| {R['max_abs_err']:.3g} over {R['queries']} queries"
+
+def main():
+  parser = argparse.ArgumentParser(description = "Belief propagation accuracy report.")
+  parser.add_argument("--psemantics", choices = ["credal", "maxent"], default = "maxent")
+  parser.add_argument("--damping", type = float, default = 0.5)
+  parser.add_argument("--max-iters", type = int, default = 200)
+  parser.add_argument("--tol", type = float, default = 1e-8)
+  parser.add_argument("--scale", nargs = "*", type = int, default = [],
+                      help = "Also time belief propagation on chains of these many ADs.")
+  parser.add_argument("--out", help = "Path to write JSON results to.")
+  args = parser.parse_args()
+
+  results = []
+  for f in sorted(glob.glob("examples/*.plp")):
+    text = open(f).read()
+    # Neural programs need torch, and dynamic programs are unrolled by pasp.dynamic.
+    if "#python" in text or "#program" in text: continue
+    results.append(accuracy(f, args))
+    print(summary(results[-1]), file = sys.stderr)
+  for n in args.scale:
+    results.append(scale(n, args))
+    print(summary(results[-1]), file = sys.stderr)
+  if args.out is not None:
+    with open(args.out, "w") as f: json.dump(results, f, indent = 2)
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,93 @@
+"""Reports the iterations fixpoint learning takes to converge, with and without SQUAREM acceleration.
+
+Usage (from the package root, with extensions built in place):
+
+    python -m benchmarks.convergence
+    python -m benchmarks.convergence --tol 1e-6 --samples 2000 --out convergence.json
+
+For each learning test case (see `tests/learning.py`), samples observations from the original
+program, learns the parameters by plain fixpoint for `--ref-iters` iterations as the reference, and
+then finds the fewest iterations after which plain and accelerated fixpoint (`accel = True`) are
+both within `--tol` of the reference, along with the time each took for that many iterations."""
+
+import argparse
+import json
+import sys
+import time
+
+def earthquake(P):
+  P.PF[0].p = 0.5; P.PF[0].learnable = True
+  P.PR[-1].p = 0.5; P.PR[-1].learnable = True
+  P.PR[-2].p = 0.5; P.PR[-2].learnable = True
+
+def insomnia(P):
+  P.AD[0].P = [1/3, 1/3, 1/3]; P.AD[0].learnable = True
+
+CASES = [
+  ("earthquake_ad", "examples/earthquake_ad.plp", ["alarm", "calls(a)", "calls(b)"], earthquake),
+  ("insomnia_ad", "examples/insomnia_ad.plp", ["work(anna)", "work(bill)", "sleep(anna)",
+                                               "sleep(bill)"], insomnia),
+]
+
+def params(P) -> list:
+  return [f.p for f in P.PF if f.learnable] + [p for a in P.AD if a.learnable for p in a.P] + \
+         [r.p for r in P.PR if r.learnable]
+
+def learned(path: str, init, D, A, niters: int, accel: bool) -> tuple:
+  import pasp
+  P = pasp.parse(path)
+  init(P)
+  t = time.perf_counter()
+  pasp.learn(P, D, A, niters = niters, accel = accel, display = "none")
+  return params(P), time.perf_counter() - t
+
+def iterations(path: str, init, D, A, ref: list, accel: bool, args) -> tuple:
+  "Fewest iterations within tol of ref, by doubling and then bisection; None if over max_iters."
+  def err(n: int) -> float:
+    return max(abs(u - v) for u, v in zip(learned(path, init, D, A, n, accel)[0], ref))
+  hi = 1
+  while err(hi) > args.tol:
+    if hi >= args.max_iters: return None
+    hi = min(2*hi, args.max_iters)
+  lo = hi//2
+  while hi - lo > 1:
+    mid = (lo + hi)//2
+    if err(mid) > args.tol: lo = mid
+    else: hi = mid
+  return hi
+
+def convergence(name: str, path: str, A: list, init, args) -> dict:
+  import pasp
+  D = pasp.sample(pasp.parse(path), A, n = args.samples)
+  ref, _ = learned(path, init, D, A, args.ref_iters, False)
+  R = {"case": name}
+  for key, accel in (("plain", False), ("accel", True)):
+    n = iterations(path, init, D, A, ref, accel, args)
+    R[f"{key}_iters"] = n
+    if n is not None: R[f"{key}_s"] = learned(path, init, D, A, n, accel)[1]
+  return R
+
+def summary(R: dict) -> str:
+  def show(key: str) -> str:
+    n = R[f"{key}_iters"]
+    return f"{key} {'-':>5}{'':12}" if n is None else f"{key} {n:5d} ({R[f'{key}_s']:8.4f}s)"
+  return f"{R['case']:<16} {show('plain')}  {show('accel')}"
+
+def main():
+  parser = argparse.ArgumentParser(description = "Fixpoint learning convergence report.")
+  parser.add_argument("--samples", type = int, default = 500)
+  parser.add_argument("--tol", type = float, default = 1e-4)
+  parser.add_argument("--max-iters", type = int, default = 2000)
+  parser.add_argument("--ref-iters", type = int, default = 5000)
+  parser.add_argument("--out", help = "Path to write JSON results to.")
+  args = parser.parse_args()
+
+  results = []
+  for name, path, A, init in CASES:
+    results.append(convergence(name, path, A, init, args))
+    print(summary(results[-1]), file = sys.stderr)
+  if args.out is not None:
+    with open(args.out, "w") as f: json.dump(results, f, indent = 2)
+
+if __name__ == "__main__":
+  main()
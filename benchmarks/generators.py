@@ -0,0 +1,156 @@
+"""Scalable synthetic program generators for benchmarking.
+
+Every generator returns a `Case`: the program text, the (ground) number of total choices it induces,
+the atoms to be observed when sampling or learning, and an optional learnable variant of the same
+program sharing its structure."""
+
+import random
+from dataclasses import dataclass, field
+
+@dataclass
+class Case:
+  name: str
+  # Parameters the case was generated with, reported as is.
+  params: dict
+  # Program text.
+  program: str
+  # Number of total choices, or None if unknown (e.g. for non-ground probabilistic rules).
+  total_choices: int
+  # Atoms observed when sampling and learning.
+  atoms: list = field(default_factory = list)
+  # Same program with (some) probabilistic facts made learnable; None if not learnable.
+  learnable: str = None
+  # Whether the program has neural components (and thus requires torch).
+  neural: bool = False
+
+def coloring(n: int, p: float = 0.5) -> Case:
+  "Random graphs on `n` vertices and their 3-colorability, in the style of `3coloring.plp`."
+  P = f"""
+#const n = {n}.
+v(1..n).
+{p}::e(X, Y) :- v(X), v(Y), X < Y.
+e(X, Y) :- e(Y, X).
+c(X, r) :- not c(X, g), not c(X, b), v(X).
+c(X, g) :- not c(X, r), not c(X, b), v(X).
+c(X, b) :- not c(X, r), not c(X, g), v(X).
+f :- not f, e(X, Y), c(X, Z), c(Y, Z).
+#query(c(1, r)).
+#query(e(1, 2) | undef f).
+#query(undef f).
+"""
+  return Case("coloring", {"n": n, "p": p}, P, 2**(n*(n-1)//2))
+
+def smokers(n: int, seed: int = 0) -> Case:
+  "A chain of `n` people influencing their neighbours, in the style of `smokers.plp`."
+  R = random.Random(seed)
+  S = [round(R.uniform(0.1, 0.9), 3) for _ in range(n)]
+  I = []
+  for i in range(1, n):
+    I.append(f"{round(R.uniform(0.1, 0.9), 3)}::influences({i}, {i+1}).")
+    I.append(f"{round(R.uniform(0.1, 0.9), 3)}::influences({i+1}, {i}).")
+  rules = ["smokes(X) :- stress(X).", "smokes(X) :- influences(Y, X), smokes(Y)."]
+  Q = ["#query(smokes(1)).", f"#query(smokes({n}))."]
+  if n > 1: Q.append(f"#query(smokes({n}) | smokes(1)).")
+  A = [f"smokes({i})" for i in range(1, n+1)]
+  P = "\n".join([f"{p}::stress({i+1})." for i, p in enumerate(S)] + I + rules + Q)
+  # Only stress is learnable; influences stay fixed so as to keep the program identifiable.
+  L = "\n".join([f"?::stress({i+1})." for i in range(n)] + I + rules + Q)
+  return Case("smokers", {"n": n, "seed": seed}, P, 2**(n + 2*(n-1)), A, L)
+
+def fault_tree(n: int, seed: int = 0) -> Case:
+  """A fault tree over `n` basic events, each with a three-valued m-function (fail, work, either),
+  in the style of `fault_tree.plp`. Internal nodes alternate between or- and and-gates."""
+  R = random.Random(seed)
+  L = []
+  for i in range(1, n+1):
+    a, b = R.uniform(0.001, 0.05), R.uniform(0.001, 0.05)
+    L.append(f"{round(a, 4)}::p({i},1); {round(1-a-b, 4)}::p({i},0); {round(b, 4)}::p({i},all).")
+  L += ["x(V) :- p(V,1).", "y(V) :- p(V,0).", "x(V); y(V) :- p(V,all)."]
+  # Build a balanced binary tree bottom-up over the basic events.
+  level, k, depth = [f"x({i})" for i in range(1, n+1)], 0, 0
+  while len(level) > 1:
+    nxt = []
+    for j in range(0, len(level), 2):
+      if j+1 == len(level):
+        nxt.append(level[j])
+        continue
+      g = f"g{k}"; k += 1
+      if depth % 2: L.append(f"{g} :- {level[j]}, {level[j+1]}.")
+      else: L += [f"{g} :- {level[j]}.", f"{g} :- {level[j+1]}."]
+      nxt.append(g)
+    level, depth = nxt, depth+1
+  top = level[0]
+  L += [f"#query({top}).", f"#query(x(1) | {top})."]
+  return Case("fault_tree", {"n": n, "seed": seed}, "\n".join(L), 3**n)
+
+def many_ads(n: int, k: int = 3, seed: int = 0) -> Case:
+  "Programs with `n` annotated disjunctions of `k` values each, chained by rules."
+  R = random.Random(seed)
+  def ads(learnable: bool) -> list:
+    L = []
+    for i in range(1, n+1):
+      W = [R.random() for _ in range(k)]
+      s = sum(W)
+      L.append("; ".join(f"{'?' if learnable else round(w/s, 4)}::a({i},{j})" for j, w in enumerate(W)) + ".")
+    return L
+  rules = ["b(1) :- a(1,0)."] + [f"b({i}) :- a({i},0). b({i}) :- b({i-1}), a({i},1)." for i in range(2, n+1)]
+  Q = [f"#query(b({n})).", f"#query(a(1,0) | b({n}))."]
+  A = [f"b({i})" for i in range(1, n+1)]
+  R.seed(seed); P = "\n".join(ads(False) + rules + Q)
+  R.seed(seed); L = "\n".join(ads(True) + rules + Q)
+  return Case("many_ads", {"n": n, "k": k, "seed": seed}, P, k**n, A, L)
+
+def credal(n: int, seed: int = 0) -> Case:
+  "Chains mixing `n` credal facts with `n` probabilistic facts."
+  R = random.Random(seed)
+  L = []
+  for i in range(1, n+1):
+    l = round(R.uniform(0.1, 0.5), 3)
+    L.append(f"[{l}, {round(l + R.uniform(0.05, 0.4), 3)}]::c({i}). {round(R.uniform(0.1, 0.9), 3)}::d({i}).")
+  L += ["e(1) :- c(1), d(1)."] + [f"e({i}) :- c({i}), d({i}). e({i}) :- e({i-1}), d({i})." for i in range(2, n+1)]
+  L += [f"#query(e({n})).", f"#query(e({n}) | d(1))."]
+  return Case("credal", {"n": n, "seed": seed}, "\n".join(L), 4**n)
+
+def neural(n: int, d: int = 4, seed: int = 0) -> Case:
+  """A neural rule over a synthetic single-layer network with `d` inputs, evaluated on `n` random
+  test points."""
+  P = f"""
+#python
+import random
+def net():
+  torch.manual_seed({seed})
+  return torch.nn.Sequential(torch.nn.Linear({d}, 1), torch.nn.Sigmoid())
+def test():
+  R = random.Random({seed})
+  return [[R.random() for _ in range({d})] for _ in range({n})]
+def train(): return test()
+#end.
+g(x) ~ test(@test), train(@train).
+?::f(X) as @net :- g(X).
+h :- f(x).
+#query(h).
+"""
+  return Case("neural", {"n": n, "d": d, "seed": seed}, P, 2*n, neural = True)
+
+"Generators and their parameter sweeps, per suite."
+SUITES = {
+  "quick": [
+    (coloring, [{"n": 4}, {"n": 5}]),
+    (smokers, [{"n": 3}, {"n": 4}]),
+    (fault_tree, [{"n": 4}]),
+    (many_ads, [{"n": 4}]),
+    (credal, [{"n": 3}]),
+    (neural, [{"n": 16}]),
+  ],
+  "full": [
+    (coloring, [{"n": n} for n in range(4, 8)]),
+    (smokers, [{"n": n} for n in range(3, 8)]),
+    (fault_tree, [{"n": n} for n in range(4, 11, 2)]),
+    (many_ads, [{"n": n} for n in range(4, 11, 2)]),
+    (credal, [{"n": n} for n in range(3, 8)]),
+    (neural, [{"n": n} for n in (64, 256, 1024)]),
+  ],
+}
+
+def generate(suite: str) -> list:
+  return [f(**A) for f, S in SUITES[suite] for A in S]
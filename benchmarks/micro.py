@@ -0,0 +1,91 @@
+"""Builds and runs the micro-benchmarks of the C kernels in `benchmarks/micro/kernels.c`.
+
+Usage (from the package root, with clingo, numpy and the bitvector submodule available):
+
+    python -m benchmarks.micro --save baseline.json
+    python -m benchmarks.micro --baseline baseline.json --threshold 0.1
+
+The kernels are compiled into a standalone binary linking the same sources (and macros) as the
+`exact` extension plus an embedded Python, needed for numpy observations and error reporting. Each
+benchmark reports nanoseconds per kernel call over `--reps` repetitions (after `--warmup` unmeasured
+ones), as the median, mean, minimum, standard deviation and median absolute deviation (MAD).
+
+With `--baseline`, a benchmark is flagged as a regression if its median is more than `--threshold`
+slower than the baseline's and the difference exceeds three times the larger MAD, so that noisy
+kernels are not flagged spuriously. The exit status is then 1 if any regression was flagged."""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import sysconfig
+
+SOURCES = ["benchmarks/micro/kernels.c", "thpool/thpool.c", "pasp/cinf.c", "pasp/cground.c",
+           "bitvector/bitvector.c", "pasp/cutils.c", "pasp/coptimize.c", "pasp/carray.c",
+           "pasp/cprogram.c", "pasp/cdata.c", "pasp/ccheckpoint.c", "pasp/cprofile.c",
+           "pasp/ctrace.c", "pasp/cprogress.c", "pasp/cmem.c", "pasp/ccache.c",
+           "pasp/csharpsat.c", "pasp/creduce.c", "pasp/cjtree.c", "pasp/cfactor.c", "pasp/cbp.c",
+           "progressbar/progressbar.c"]
+LIBRARIES = ["m", "clingo", "pthread", "ncurses"]
+
+def build(out: str, cflags: list) -> str:
+  import numpy as np
+  os.makedirs(os.path.dirname(out) or ".", exist_ok = True)
+  nproc = os.cpu_count() or 1
+  cc = os.environ.get("CC", sysconfig.get_config_var("CC") or "cc").split()
+  py = sysconfig.get_config_var("LDVERSION") or sysconfig.get_config_var("VERSION")
+  cmd = cc + cflags + [f"-DNUM_PROCS={nproc-1 if nproc > 1 else nproc}", "-D_GNU_SOURCE",
+        f"-I{sysconfig.get_paths()['include']}", f"-I{np.get_include()}", "-o", out] + SOURCES + \
+        [f"-L{sysconfig.get_config_var('LIBDIR')}", f"-lpython{py}"] + [f"-l{l}" for l in LIBRARIES]
+  subprocess.run(cmd, check = True)
+  return out
+
+def run(binary: str, args) -> list:
+  cmd = [binary, "--reps", str(args.reps), "--warmup", str(args.warmup), "--min-ms", str(args.min_ms)]
+  if args.filter: cmd += ["--filter", args.filter]
+  out = subprocess.run(cmd, check = True, capture_output = True, text = True)
+  return [json.loads(l) for l in out.stdout.splitlines() if l.strip()]
+
+def compare(base: list, new: list, threshold: float) -> bool:
+  "Prints new against base and returns whether any benchmark regressed."
+  B, regressed = {R["name"]: R for R in base}, False
+  print(f"{'benchmark':<30} {'base ns':>12} {'new ns':>12} {'ratio':>8}")
+  for R in new:
+    if (S := B.get(R["name"])) is None: continue
+    ratio = R["median_ns"]/S["median_ns"]
+    noise = 3*max(R["mad_ns"], S["mad_ns"])
+    bad = (ratio > 1 + threshold) and (R["median_ns"] - S["median_ns"] > noise)
+    regressed |= bad
+    print(f"{R['name']:<30} {S['median_ns']:12.2f} {R['median_ns']:12.2f} {ratio:8.3f}"
+          f"{'  REGRESSION' if bad else ''}")
+  return regressed
+
+def main():
+  parser = argparse.ArgumentParser(description = "PASP kernel micro-benchmarks.")
+  parser.add_argument("--reps", type = int, default = 15)
+  parser.add_argument("--warmup", type = int, default = 3)
+  parser.add_argument("--min-ms", type = float, default = 10,
+                      help = "Minimum duration of a single repetition, in milliseconds.")
+  parser.add_argument("--filter", help = "Only run benchmarks whose name contains this.")
+  parser.add_argument("--binary", default = "build/micro/kernels",
+                      help = "Where to build the benchmark binary to.")
+  parser.add_argument("--no-build", action = "store_true", help = "Reuse an already built binary.")
+  parser.add_argument("--cflags", default = "-O3", help = "Compiler flags.")
+  parser.add_argument("--save", help = "Path to write results to, e.g. as a baseline.")
+  parser.add_argument("--baseline", help = "Results to compare against.")
+  parser.add_argument("--threshold", type = float, default = 0.1,
+                      help = "Relative slowdown of the median above which to flag a regression.")
+  args = parser.parse_args()
+
+  binary = args.binary if args.no_build else build(args.binary, args.cflags.split())
+  R = run(os.path.abspath(binary), args)
+  if args.save is not None:
+    with open(args.save, "w") as f: json.dump(R, f, indent = 2)
+  if args.baseline is None:
+    for r in R: print(f"{r['name']:<30} {r['median_ns']:12.2f} ns  (mad {r['mad_ns']:.2f})")
+    return
+  if compare(json.load(open(args.baseline)), R, args.threshold): sys.exit(1)
+
+if __name__ == "__main__":
+  main()
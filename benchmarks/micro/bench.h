@@ -0,0 +1,72 @@
+#ifndef _PASP_BENCH
+#define _PASP_BENCH
+
+/* A minimal micro-benchmark harness. Each benchmark is a function running its kernel n times. The
+ * harness first calibrates n so that a single repetition takes at least min_ms milliseconds, runs
+ * warmup unmeasured repetitions, then measures reps repetitions and prints one JSON object per
+ * benchmark to stdout, with times in nanoseconds per kernel call. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+typedef void (*bench_fn_t)(void *data, size_t n);
+
+typedef struct {
+  size_t warmup, reps;
+  double min_ms;
+  /* Only benchmarks whose name contains filter are run. */
+  const char *filter;
+} bench_opts_t;
+
+/* Sink for kernel results, so that the compiler does not optimize kernels away. */
+static volatile double bench_sink;
+
+static inline uint64_t bench_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec*1000000000ull + (uint64_t) t.tv_nsec;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+  double x = *(const double*) a, y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+static inline double bench_time(bench_fn_t fn, void *data, size_t n) {
+  uint64_t t = bench_now();
+  fn(data, n);
+  return (double) (bench_now() - t);
+}
+
+static void bench_run(bench_opts_t *o, const char *name, bench_fn_t fn, void *data) {
+  size_t n = 1, i;
+  if (o->filter && !strstr(name, o->filter)) return;
+  /* Calibrate. */
+  while ((bench_time(fn, data, n) < o->min_ms*1e6) && (n < ((size_t) 1 << 40))) n *= 2;
+  for (i = 0; i < o->warmup; ++i) fn(data, n);
+
+  double *T = (double*) malloc(o->reps*sizeof(double)), mean = 0, var = 0;
+  if (!T) { fprintf(stderr, "could not allocate memory for %s!\n", name); exit(1); }
+  for (i = 0; i < o->reps; ++i) mean += (T[i] = bench_time(fn, data, n)/n);
+  mean /= o->reps;
+  for (i = 0; i < o->reps; ++i) var += (T[i]-mean)*(T[i]-mean);
+  var = o->reps > 1 ? var/(o->reps-1) : 0;
+  qsort(T, o->reps, sizeof(double), bench_cmp);
+  double min = T[0], median = (T[(o->reps-1)/2] + T[o->reps/2])/2;
+  /* Median absolute deviation, which unlike the standard deviation is robust to outliers. */
+  for (i = 0; i < o->reps; ++i) T[i] = fabs(T[i]-median);
+  qsort(T, o->reps, sizeof(double), bench_cmp);
+  double mad = (T[(o->reps-1)/2] + T[o->reps/2])/2;
+  printf("{\"name\": \"%s\", \"n\": %zu, \"reps\": %zu, \"min_ns\": %.4f, \"median_ns\": %.4f, "
+      "\"mean_ns\": %.4f, \"stddev_ns\": %.4f, \"mad_ns\": %.4f}\n", name, n, o->reps, min, median,
+      mean, sqrt(var), mad);
+  fflush(stdout);
+  free(T);
+}
+
+#endif
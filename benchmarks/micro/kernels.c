@@ -0,0 +1,403 @@
+/* Micro-benchmarks of the building blocks that inference costs depend on. Built and run by
+ * benchmarks/micro.py; see there for usage.
+ *
+ * cexact.c is included (rather than linked) so that its static inline kernels, such as
+ * model_contains, can be benchmarked as they are compiled into the enumeration loops. */
+#include "../../pasp/cexact.c"
+
+#include "bench.h"
+
+/* Defined in coptimize.c, but not exported by coptimize.h. */
+double f(double *X, bool *S, double *C, size_t n, size_t m);
+
+/* Sizes of the synthetic programs benchmarked. */
+#define BENCH_PF_N  64
+#define BENCH_AD_N  8
+#define BENCH_AD_K  3
+#define BENCH_NR_N  16
+#define BENCH_NR_O  2
+#define BENCH_POLY_M 10
+#define BENCH_POLY_N 32
+#define BENCH_QUERY_N 8
+#define BENCH_EVI_N 4
+#define BENCH_OBS_N 1024
+#define BENCH_OBS_M 8
+#define BENCH_OBS_BATCH 64
+#define BENCH_APPEND_N 4096
+#define BENCH_RANK1_M 1024
+#define BENCH_RANK1_N 256
+
+static double urand(void) { return rand()/(RAND_MAX+1.0); }
+
+static bool symbol(const char *name, int i, clingo_symbol_t *s) {
+  clingo_symbol_t n;
+  clingo_symbol_create_number(i, &n);
+  return clingo_symbol_create_function(name, &n, 1, true, s);
+}
+
+/* A program of BENCH_PF_N probabilistic facts p(i), BENCH_AD_N annotated disjunctions of
+ * BENCH_AD_K values a(i) and, if neural, a neural rule of BENCH_NR_N groundings with BENCH_NR_O
+ * outcomes each. Only the tables read by the benchmarked kernels are filled. */
+static bool synthetic_program(program_t *P, bool neural) {
+  *P = (program_t) {0};
+  P->PF_n = BENCH_PF_N; P->AD_n = BENCH_AD_N;
+  P->PF = (prob_fact_t*) calloc(P->PF_n, sizeof(prob_fact_t));
+  P->AD = (annot_disj_t*) calloc(P->AD_n, sizeof(annot_disj_t));
+  if (!P->PF || !P->AD) return false;
+  for (size_t i = 0; i < P->PF_n; ++i) {
+    P->PF[i].p = urand();
+    if (!symbol("p", i, &P->PF[i].cl_f)) return false;
+  }
+  for (size_t i = 0; i < P->AD_n; ++i) {
+    annot_disj_t *A = &P->AD[i];
+    double s = 0;
+    A->n = BENCH_AD_K;
+    A->P = (double*) malloc(A->n*sizeof(double));
+    A->cl_F = (clingo_symbol_t*) malloc(A->n*sizeof(clingo_symbol_t));
+    if (!A->P || !A->cl_F) return false;
+    for (size_t j = 0; j < A->n; ++j) {
+      s += (A->P[j] = urand());
+      if (!symbol("a", i*A->n+j, &A->cl_F[j])) return false;
+    }
+    for (size_t j = 0; j < A->n; ++j) A->P[j] /= s;
+  }
+  if (!neural) return true;
+  P->NR_n = 1; P->m_test = 1;
+  P->NR = (neural_rule_t*) calloc(1, sizeof(neural_rule_t));
+  if (!P->NR) return false;
+  P->NR->n = BENCH_NR_N; P->NR->o = BENCH_NR_O;
+  P->NR->P = (float*) malloc(BENCH_NR_N*BENCH_NR_O*sizeof(float));
+  if (!P->NR->P) return false;
+  for (size_t i = 0; i < BENCH_NR_N*BENCH_NR_O; ++i) P->NR->P[i] = urand();
+  return true;
+}
+
+static bool random_total_choice(total_choice_t *theta, program_t *P) {
+  if (!init_total_choice(theta, get_num_facts(P), P)) return false;
+  for (size_t i = 0; i < theta->pf.n; ++i) bitvec_SET(&theta->pf, i, rand() & 1);
+  for (size_t i = 0; i < P->AD_n; ++i) theta->theta_ad[i] = rand() % P->AD[i].n;
+  return true;
+}
+
+typedef struct {
+  program_t *P;
+  total_choice_t theta;
+} choice_bench_t;
+
+static void b_incr_total_choice(void *d, size_t n) {
+  choice_bench_t *B = d;
+  for (size_t i = 0; i < n; ++i) incr_total_choice(&B->theta);
+}
+static void b_incr_total_choice_ad(void *d, size_t n) {
+  choice_bench_t *B = d;
+  for (size_t i = 0; i < n; ++i) incr_total_choice_ad(&B->theta, B->P);
+}
+static void b_prob_total_choice(void *d, size_t n) {
+  choice_bench_t *B = d;
+  double s = 0;
+  for (size_t i = 0; i < n; ++i) s += prob_total_choice(B->P, &B->theta);
+  bench_sink = s;
+}
+static void b_prob_total_choice_neural(void *d, size_t n) {
+  choice_bench_t *B = d;
+  double s = 0;
+  for (size_t i = 0; i < n; ++i) s += prob_total_choice_neural(B->P, &B->theta, 0, false);
+  bench_sink = s;
+}
+
+typedef struct {
+  double X[BENCH_POLY_M], L[BENCH_POLY_M], U[BENCH_POLY_M];
+  bool S[4][BENCH_POLY_N*BENCH_POLY_M];
+  double C[4][BENCH_POLY_N];
+} poly_bench_t;
+
+static void init_poly(poly_bench_t *B) {
+  for (size_t j = 0; j < BENCH_POLY_M; ++j) {
+    B->X[j] = urand();
+    B->L[j] = urand()/2; B->U[j] = B->L[j] + urand()/2;
+  }
+  for (size_t k = 0; k < 4; ++k) {
+    for (size_t i = 0; i < BENCH_POLY_N*BENCH_POLY_M; ++i) B->S[k][i] = rand() & 1;
+    for (size_t i = 0; i < BENCH_POLY_N; ++i) B->C[k][i] = urand();
+  }
+}
+
+static void b_f(void *d, size_t n) {
+  poly_bench_t *B = d;
+  double s = 0;
+  for (size_t i = 0; i < n; ++i) s += f(B->X, B->S[0], B->C[0], BENCH_POLY_N, BENCH_POLY_M);
+  bench_sink = s;
+}
+static void b_bf(void *d, size_t n) {
+  poly_bench_t *B = d;
+  double l, u;
+  for (size_t i = 0; i < n; ++i)
+    bf(B->X, B->S[0], B->S[1], B->C[0], B->C[1], B->L, B->U, BENCH_POLY_N, BENCH_POLY_N,
+        BENCH_POLY_M, &l, &u, false);
+  bench_sink = l + u;
+}
+/* As b_bf, but over an objective a/(a+b) increasing in every variable, so that bf fixes them all
+ * instead of enumerating 2^m vertices. */
+static void b_bf_monotone(void *d, size_t n) {
+  poly_bench_t *B = d;
+  bool S[2][BENCH_POLY_N*BENCH_POLY_M];
+  double l, u;
+  for (size_t i = 0; i < BENCH_POLY_N*BENCH_POLY_M; ++i) S[0][i] = true, S[1][i] = false;
+  for (size_t i = 0; i < n; ++i)
+    bf(B->X, S[0], S[1], B->C[0], B->C[1], B->L, B->U, BENCH_POLY_N, BENCH_POLY_N, BENCH_POLY_M,
+        &l, &u, false);
+  bench_sink = l + u;
+}
+static void b_bf_minmax(void *d, size_t n) {
+  poly_bench_t *B = d;
+  double l, u;
+  for (size_t i = 0; i < n; ++i)
+    bf_minmax(B->X, B->S[0], B->S[1], B->S[2], B->S[3], B->C[0], B->C[1], B->C[2], B->C[3], B->L,
+        B->U, BENCH_POLY_N, BENCH_POLY_N, BENCH_POLY_N, BENCH_POLY_N, BENCH_POLY_M, &l, &u);
+  bench_sink = l + u;
+}
+
+typedef struct {
+  double D[BENCH_RANK1_M*BENCH_RANK1_N], x[BENCH_RANK1_M], y[BENCH_RANK1_N];
+} rank1_bench_t;
+
+/* Every other observation is consistent with the total choice. */
+static void init_rank1(rank1_bench_t *B) {
+  for (size_t i = 0; i < BENCH_RANK1_M; ++i) B->x[i] = (i % 2) ? urand() : 0;
+  for (size_t j = 0; j < BENCH_RANK1_N; ++j) B->y[j] = urand();
+  memset(B->D, 0, sizeof(B->D));
+}
+
+static void b_rank1_update(void *d, size_t n) {
+  rank1_bench_t *B = d;
+  for (size_t i = 0; i < n; ++i)
+    rank1_update(B->D, B->x, BENCH_RANK1_M, B->y, BENCH_RANK1_N);
+  bench_sink = B->D[BENCH_RANK1_N+1];
+}
+
+typedef struct {
+  clingo_control_t *C;
+  clingo_solve_handle_t *H;
+  const clingo_model_t *M;
+  query_t q;
+  clingo_symbol_t Q[BENCH_QUERY_N], Q_u[BENCH_QUERY_N], E[BENCH_EVI_N], E_u[BENCH_EVI_N];
+  uint8_t Q_s[BENCH_QUERY_N], E_s[BENCH_EVI_N];
+  /* One query per queried atom, each given all of E, as checked against every model. */
+  query_t P_Q[BENCH_QUERY_N];
+} model_bench_t;
+
+/* Solves a program with a single model of BENCH_PF_N atoms and keeps the model around. Half of
+ * the queried atoms are in the model, as are all evidence atoms. Each p(i) has a partial
+ * counterpart _p(i). */
+static bool init_model(model_bench_t *B) {
+  clingo_part_t part = {"base", NULL, 0};
+  char prog[64];
+  snprintf(prog, sizeof(prog), "p(0..%d). _p(X) :- p(X).", BENCH_PF_N/2-1);
+  if (!clingo_control_new(NULL, 0, NULL, NULL, 20, &B->C)) return false;
+  if (!clingo_control_add(B->C, "base", NULL, 0, prog)) return false;
+  if (!clingo_control_ground(B->C, &part, 1, NULL, NULL)) return false;
+  if (!clingo_control_solve(B->C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &B->H))
+    return false;
+  if (!clingo_solve_handle_resume(B->H) || !clingo_solve_handle_model(B->H, &B->M) || !B->M)
+    return false;
+  for (size_t i = 0; i < BENCH_QUERY_N; ++i) {
+    if (!symbol("p", i*BENCH_PF_N/BENCH_QUERY_N, &B->Q[i])) return false;
+    if (!symbol("_p", i*BENCH_PF_N/BENCH_QUERY_N, &B->Q_u[i])) return false;
+    B->Q_s[i] = QUERY_TERM_POS;
+  }
+  for (size_t i = 0; i < BENCH_EVI_N; ++i) {
+    if (!symbol("p", i, &B->E[i]) || !symbol("_p", i, &B->E_u[i])) return false;
+    B->E_s[i] = QUERY_TERM_POS;
+  }
+  B->q = (query_t) { .Q = B->Q, .Q_s = B->Q_s, .Q_n = BENCH_QUERY_N, .Q_u = B->Q_u };
+  for (size_t i = 0; i < BENCH_QUERY_N; ++i)
+    B->P_Q[i] = (query_t) { .Q = B->Q+i, .Q_s = B->Q_s+i, .Q_n = 1, .Q_u = B->Q_u+i, .E = B->E,
+      .E_s = B->E_s, .E_n = BENCH_EVI_N, .E_u = B->E_u };
+  return true;
+}
+
+static void b_model_contains(void *d, size_t n) {
+  model_bench_t *B = d;
+  size_t s = 0;
+  for (size_t i = 0; i < n; ++i) {
+    bool c;
+    model_contains(B->M, &B->q, i % BENCH_QUERY_N, &c, MODEL_CONTAINS_QUERY, false);
+    s += c;
+  }
+  bench_sink = s;
+}
+
+/* model_contains as it was before the enumeration kernels were specialized: out of line, with
+ * its flags as arguments. */
+__attribute__((noinline)) static bool model_contains_generic(const clingo_model_t *M, query_t *q,
+    size_t i, bool *c, bool query_or_evi, bool is_partial) {
+  return model_contains(M, q, i, c, query_or_evi, is_partial);
+}
+
+/* The per-model loop of _compute_total_choice over every query, either specialized on is_partial
+ * (as the kernels are now) or through model_contains_generic with is_partial only known at run
+ * time (as they were). Returns how many queries hold in the model. */
+KERNEL_INLINE size_t model_queries(model_bench_t *B, const bool is_partial, const bool generic) {
+  size_t s = 0;
+  bool f = is_partial;
+  /* Hide the flag's value from the compiler, so that the generic loop cannot specialize on it. */
+  if (generic) __asm__ volatile ("" : "+r" (f));
+#define CONTAINS(q, j, c, query_or_evi) (generic ? \
+    model_contains_generic(B->M, q, j, c, query_or_evi, f) : \
+    model_contains(B->M, q, j, c, query_or_evi, is_partial))
+  for (size_t i = 0; i < BENCH_QUERY_N; ++i) {
+    query_t *q = B->P_Q+i;
+    bool all_e = true, all_q = true, c;
+    for (size_t j = 0; j < q->E_n; ++j) {
+      if (!CONTAINS(q, j, &c, MODEL_CONTAINS_EVI)) return 0;
+      if (!c) { all_e = false; break; }
+    }
+    if (!all_e) continue;
+    for (size_t j = 0; j < q->Q_n; ++j) {
+      if (!CONTAINS(q, j, &c, MODEL_CONTAINS_QUERY)) return 0;
+      if (!c) { all_q = false; break; }
+    }
+    s += all_q;
+  }
+#undef CONTAINS
+  return s;
+}
+
+#define MODEL_QUERIES_BENCH(name, is_partial, generic) \
+  static void name(void *d, size_t n) { \
+    size_t s = 0; \
+    for (size_t i = 0; i < n; ++i) s += model_queries(d, is_partial, generic); \
+    bench_sink = s; \
+  }
+
+MODEL_QUERIES_BENCH(b_model_queries, false, false)
+MODEL_QUERIES_BENCH(b_model_queries_generic, false, true)
+MODEL_QUERIES_BENCH(b_model_queries_partial, true, false)
+MODEL_QUERIES_BENCH(b_model_queries_partial_generic, true, true)
+
+static void b_clingo_control_new(void *d, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    clingo_control_t *C;
+    if (clingo_control_new(NULL, 0, NULL, NULL, 20, &C)) clingo_control_free(C);
+  }
+}
+/* Each call needs a fresh control, so this includes the cost of b_clingo_control_new. */
+static void b_add_atoms_from_total_choice(void *d, size_t n) {
+  choice_bench_t *B = d;
+  for (size_t i = 0; i < n; ++i) {
+    clingo_control_t *C;
+    if (!clingo_control_new(NULL, 0, NULL, NULL, 20, &C)) continue;
+    add_atoms_from_total_choice(C, B->P, &B->theta);
+    clingo_control_free(C);
+  }
+}
+
+typedef struct {
+  observations_t O;
+  PyArrayObject *obs;
+} obs_bench_t;
+
+static bool init_obs(obs_bench_t *B) {
+  PyObject *np = PyImport_ImportModule("numpy"), *L = PyList_New(BENCH_OBS_N);
+  if (!np || !L) return false;
+  for (size_t i = 0; i < BENCH_OBS_N; ++i) {
+    PyObject *R = PyList_New(BENCH_OBS_M);
+    if (!R) return false;
+    for (size_t j = 0; j < BENCH_OBS_M; ++j) {
+      char a[32];
+      snprintf(a, sizeof(a), "%sp(%zu)", rand() & 1 ? "" : "~", j);
+      PyList_SET_ITEM(R, j, PyBytes_FromString(a));
+    }
+    PyList_SET_ITEM(L, i, R);
+  }
+  B->obs = (PyArrayObject*) PyObject_CallMethod(np, "array", "(O)", L);
+  Py_DECREF(L); Py_DECREF(np);
+  return B->obs && init_dense_observations(&B->O, B->obs, BENCH_OBS_BATCH);
+}
+
+static void b_next_dense_observations(void *d, size_t n) {
+  obs_bench_t *B = d;
+  for (size_t i = 0; i < n; ++i) next_dense_observations(&B->O, B->obs);
+}
+
+static void b_array_double_append(void *d, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    array_double_t A;
+    if (!array_double_init(&A)) continue;
+    for (size_t j = 0; j < BENCH_APPEND_N; ++j) array_double_append(&A, j);
+    bench_sink = A.d[A.n-1];
+    array_double_free_contents(&A);
+  }
+}
+static void b_array_bool_append(void *d, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    array_bool_t A;
+    if (!array_bool_init(&A)) continue;
+    for (size_t j = 0; j < BENCH_APPEND_N; ++j) array_bool_append(&A, j & 1);
+    bench_sink = A.d[A.n-1];
+    array_bool_free_contents(&A);
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [--reps N] [--warmup N] [--min-ms MS] [--filter SUBSTRING]\n", argv0);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  bench_opts_t o = { .warmup = 3, .reps = 15, .min_ms = 10, .filter = NULL };
+  for (int i = 1; i < argc; ++i) {
+    if (i+1 == argc) usage(argv[0]);
+    if (!strcmp(argv[i], "--reps")) o.reps = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--warmup")) o.warmup = strtoul(argv[++i], NULL, 10);
+    else if (!strcmp(argv[i], "--min-ms")) o.min_ms = strtod(argv[++i], NULL);
+    else if (!strcmp(argv[i], "--filter")) o.filter = argv[++i];
+    else usage(argv[0]);
+  }
+  if (!o.reps) usage(argv[0]);
+  srand(0);
+
+  /* Observations are numpy arrays, and errors are reported through Python exceptions. */
+  Py_Initialize();
+  if (_import_array() < 0) goto error;
+
+  program_t P, P_nr;
+  choice_bench_t T, T_nr;
+  poly_bench_t Y;
+  model_bench_t M;
+  obs_bench_t O;
+  static rank1_bench_t K;
+  if (!synthetic_program(&P, false) || !synthetic_program(&P_nr, true)) goto error;
+  T.P = &P; T_nr.P = &P_nr;
+  if (!random_total_choice(&T.theta, &P) || !random_total_choice(&T_nr.theta, &P_nr)) goto error;
+  init_poly(&Y);
+  init_rank1(&K);
+  if (!init_model(&M)) goto error;
+  if (!init_obs(&O)) goto error;
+
+  bench_run(&o, "incr_total_choice", b_incr_total_choice, &T);
+  bench_run(&o, "incr_total_choice_ad", b_incr_total_choice_ad, &T);
+  bench_run(&o, "prob_total_choice", b_prob_total_choice, &T);
+  bench_run(&o, "prob_total_choice_neural", b_prob_total_choice_neural, &T_nr);
+  bench_run(&o, "f", b_f, &Y);
+  bench_run(&o, "bf", b_bf, &Y);
+  bench_run(&o, "bf_monotone", b_bf_monotone, &Y);
+  bench_run(&o, "bf_minmax", b_bf_minmax, &Y);
+  bench_run(&o, "model_contains", b_model_contains, &M);
+  bench_run(&o, "model_queries", b_model_queries, &M);
+  bench_run(&o, "model_queries_generic", b_model_queries_generic, &M);
+  bench_run(&o, "model_queries_partial", b_model_queries_partial, &M);
+  bench_run(&o, "model_queries_partial_generic", b_model_queries_partial_generic, &M);
+  bench_run(&o, "clingo_control_new", b_clingo_control_new, NULL);
+  bench_run(&o, "add_atoms_from_total_choice", b_add_atoms_from_total_choice, &T);
+  bench_run(&o, "next_dense_observations", b_next_dense_observations, &O);
+  bench_run(&o, "rank1_update", b_rank1_update, &K);
+  bench_run(&o, "array_double_append", b_array_double_append, NULL);
+  bench_run(&o, "array_bool_append", b_array_bool_append, NULL);
+  return 0;
+error:
+  if (PyErr_Occurred()) PyErr_Print();
+  if (clingo_error_code() != clingo_error_success) fprintf(stderr, "%s\n", clingo_error_message());
+  fprintf(stderr, "could not set up micro-benchmarks!\n");
+  return 1;
+}
@@ -0,0 +1,190 @@
+"""Runs the PASP benchmark suite and emits machine-readable JSON.
+
+Usage (from the package root, with extensions built in place):
+
+    python -m benchmarks.run --suite quick --threads 1 2 4 --out results.json
+    python -m benchmarks.run --compare baseline.json results.json
+
+Each (case, task, thread count) triple is measured in a fresh subprocess, so that peak RSS is that
+of the single measurement and the thread count can be capped through the `PASP_NUM_PROCS`
+environment variable (which can only lower the compile-time `NUM_PROCS`). The `kernels` task times
+exact inference with the unspecialized total choice kernels (`PASP_GENERIC_KERNELS=1`) against the
+specialized ones, reporting the ratio as `kernel_speedup`."""
+
+import argparse
+import datetime
+import glob
+import json
+import os
+import platform
+import resource
+import statistics
+import subprocess
+import sys
+import time
+
+TASKS = ["exact", "count", "sample", "learn", "bp", "kernels"]
+
+def has_torch() -> bool:
+  try:
+    import torch
+    return True
+  except ImportError:
+    return False
+
+def measure(spec: dict) -> dict:
+  "Runs a single measurement in the current process. Called by the child subprocess."
+  import pasp
+  task, repeat = spec["task"], spec["repeat"]
+  t = time.perf_counter()
+  text = spec["learnable"] if task in ("count", "learn") else spec["program"]
+  P = pasp.parse(spec["file"]) if spec.get("file") else pasp.parse(text, from_str = True)
+  parse_s = time.perf_counter() - t
+
+  models, T, G = None, [], []
+  if task == "learn":
+    # Sample the observations from the original program, then learn the learnable variant.
+    D = pasp.sample(pasp.parse(spec["program"], from_str = True), spec["atoms"], n = spec["samples"])
+  for _ in range(repeat):
+    if task == "learn": P = pasp.parse(text, from_str = True)
+    t = time.perf_counter()
+    if task == "exact": pasp.exact(P, quiet = True)
+    elif task == "count":
+      F = pasp.count(P)[0]
+      if F is not None: models = int(F[0].sum())
+    elif task == "sample": pasp.sample(P, spec["atoms"], n = spec["samples"])
+    elif task == "learn": pasp.learn(P, D, spec["atoms"], niters = spec["niters"])
+    elif task == "bp": pasp.bp(P, quiet = True)
+    elif task == "kernels":
+      # Before/after: exact inference with the unspecialized total choice kernels, then with the
+      # specialized ones that every other task runs.
+      os.environ["PASP_GENERIC_KERNELS"] = "1"
+      try: pasp.exact(P, quiet = True)
+      finally: del os.environ["PASP_GENERIC_KERNELS"]
+      G.append(time.perf_counter() - t)
+      t = time.perf_counter()
+      pasp.exact(P, quiet = True)
+    T.append(time.perf_counter() - t)
+
+  best, total_choices = min(T), spec["total_choices"]
+  R = {"parse_s": parse_s, "seconds": T, "best_s": best, "median_s": statistics.median(T),
+       "peak_rss_kb": resource.getrusage(resource.RUSAGE_SELF).ru_maxrss}
+  if task in ("exact", "kernels") and total_choices is not None:
+    R["total_choices_per_s"] = total_choices/best
+  if task == "kernels":
+    R["generic_seconds"], R["generic_best_s"] = G, min(G)
+    R["kernel_speedup"] = min(G)/best
+  if task == "count" and models is not None:
+    R["models"] = models
+    R["models_per_s"] = models/best
+  if task == "sample": R["samples_per_s"] = spec["samples"]/best
+  return R
+
+def run_child(spec: dict, threads: int, timeout: float) -> dict:
+  env = dict(os.environ, PASP_NUM_PROCS = str(threads))
+  try:
+    out = subprocess.run([sys.executable, "-m", "benchmarks.run", "--child", json.dumps(spec)],
+                         env = env, capture_output = True, text = True, timeout = timeout)
+  except subprocess.TimeoutExpired:
+    return {"error": f"timed out after {timeout}s"}
+  if out.returncode != 0:
+    return {"error": (out.stderr.strip().splitlines() or ["unknown error"])[-1]}
+  return json.loads(out.stdout.strip().splitlines()[-1])
+
+def cases(suite: str, examples: bool) -> list:
+  from .generators import generate
+  C = []
+  for c in generate(suite):
+    if c.neural and not has_torch(): continue
+    C.append({"name": c.name, "params": c.params, "program": c.program, "learnable": c.learnable,
+              "atoms": c.atoms, "total_choices": c.total_choices, "neural": c.neural})
+  if examples:
+    for f in sorted(glob.glob("examples/*.plp")):
+      text = open(f).read()
+      neural = "#python" in text
+      if (neural and not has_torch()) or "#program" in text: continue
+      C.append({"name": os.path.splitext(os.path.basename(f))[0], "params": {}, "file": f,
+                "program": None, "learnable": None, "atoms": [], "total_choices": None,
+                "neural": neural})
+  return C
+
+def tasks_for(c: dict, tasks: list) -> list:
+  T = []
+  for t in tasks:
+    if t in ("count", "learn") and not c["learnable"]: continue
+    if t == "sample" and (not c["atoms"] or c["neural"]): continue
+    if t == "bp" and c["neural"]: continue
+    T.append(t)
+  return T
+
+def run(args) -> dict:
+  results = []
+  for c in cases(args.suite, args.examples):
+    for task in tasks_for(c, args.tasks):
+      for threads in args.threads:
+        spec = dict(c, task = task, repeat = args.repeat, samples = args.samples, niters = args.niters)
+        R = run_child(spec, threads, args.timeout)
+        R.update({"case": c["name"], "params": c["params"], "task": task, "threads": threads,
+                  "total_choices": c["total_choices"]})
+        results.append(R)
+        if not args.quiet: print(summary(R), file = sys.stderr)
+  return {"meta": meta(args), "results": results}
+
+def meta(args) -> dict:
+  import pasp
+  return {"date": datetime.datetime.now().isoformat(timespec = "seconds"),
+          "pasp": pasp.__version__, "python": platform.python_version(),
+          "machine": platform.machine(), "cpus": os.cpu_count(), "suite": args.suite,
+          "repeat": args.repeat}
+
+def summary(R: dict) -> str:
+  name = R["case"] + "".join(f" {k}={v}" for k, v in R["params"].items())
+  if "error" in R: return f"{name:<28} {R['task']:<7} t={R['threads']:<3} error: {R['error']}"
+  rate = next((f"{R[k]:.1f} {k[:-6]}/s" for k in ("total_choices_per_s", "models_per_s",
+               "samples_per_s") if k in R), "")
+  if "kernel_speedup" in R: rate += f" (specialized {R['kernel_speedup']:.3f}x faster)"
+  return f"{name:<28} {R['task']:<7} t={R['threads']:<3} {R['best_s']:9.4f}s " \
+         f"{R['peak_rss_kb']/1024:8.1f}MiB {rate}"
+
+def key(R: dict) -> tuple:
+  return (R["case"], json.dumps(R["params"], sort_keys = True), R["task"], R["threads"])
+
+def compare(base: str, new: str):
+  "Prints the speedup (> 1 is faster) and RSS ratio of every measurement common to both runs."
+  A = {key(R): R for R in json.load(open(base))["results"] if "error" not in R}
+  for R in json.load(open(new))["results"]:
+    if "error" in R or (S := A.get(key(R))) is None: continue
+    print(f"{summary(R)}\n  speedup {S['best_s']/R['best_s']:6.3f}x  "
+          f"rss {R['peak_rss_kb']/S['peak_rss_kb']:6.3f}x")
+
+def main():
+  parser = argparse.ArgumentParser(description = "PASP benchmark suite.")
+  parser.add_argument("--suite", choices = ["quick", "full"], default = "quick")
+  parser.add_argument("--tasks", nargs = "+", choices = TASKS, default = TASKS)
+  parser.add_argument("--threads", nargs = "+", type = int, default = [os.cpu_count() or 1],
+                      help = "Thread counts to measure scaling curves over.")
+  parser.add_argument("--examples", action = "store_true", help = "Also run the shipped examples.")
+  parser.add_argument("--repeat", type = int, default = 3)
+  parser.add_argument("--samples", type = int, default = 1000)
+  parser.add_argument("--niters", type = int, default = 10)
+  parser.add_argument("--timeout", type = float, default = 600)
+  parser.add_argument("--out", help = "Path to write JSON results to (default: stdout).")
+  parser.add_argument("--quiet", action = "store_true")
+  parser.add_argument("--compare", nargs = 2, metavar = ("BASE", "NEW"))
+  parser.add_argument("--child", help = argparse.SUPPRESS)
+  args = parser.parse_args()
+
+  if args.child is not None:
+    print(json.dumps(measure(json.loads(args.child))))
+    return
+  if args.compare is not None:
+    compare(*args.compare)
+    return
+
+  R = run(args)
+  if args.out is None: print(json.dumps(R, indent = 2))
+  else:
+    with open(args.out, "w") as f: json.dump(R, f, indent = 2)
+
+if __name__ == "__main__":
+  main()
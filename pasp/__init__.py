@@ -3,11 +3,12 @@
 """
 
 from .grammar import parse
-from exact import exact, count
+from exact import exact, count, merge, cache_stats, cache_clear, decide, marginals, bp
 from ground import ground
 from .program import Program
 from sample import sample
 from .wlearn import learn
+from .dynamic import dynamic, DynamicProgram
 
 import numpy as np
 
@@ -5,13 +5,13 @@
 
 #define CARRAY_ARRAY_EXTEND_NP_DECLARE(type) CARRAY_ARRAY_EXTEND_DECLARE(type, type)
 
-ARRAY_IMPL(bool)
+ARRAY_IMPL(bool, MEM_CREDAL)
 /* CARRAY_ARRAY_EXTEND_DECLARE(bool, int); */
 
-ARRAY_IMPL(double)
+ARRAY_IMPL(double, MEM_CREDAL)
 /* CARRAY_ARRAY_EXTEND_NP_DECLARE(double); */
 
-ARRAY_IMPL(clingo_symbol_t)
+ARRAY_IMPL(clingo_symbol_t, MEM_OTHER)
 
 /* Finds the next highest power of two integer.
  * See https://graphics.stanford.edu/~seander/bithacks.html#RoundUpPowerOf2Float */
@@ -21,7 +21,7 @@ ARRAY_IMPL(clingo_symbol_t)
 #undef ARRAY_MAGIC_MULTIPLIER
 #define ARRAY_MAGIC_MULTIPLIER 2
 
-ARRAY_IMPL(char)
+ARRAY_IMPL(char, MEM_GROUND)
 
 bool array_char_from(array_char_t *a, const char *s) {
   size_t n = strlen(s)+1;
@@ -29,7 +29,7 @@ bool array_char_from(array_char_t *a, const char *s) {
     size_t c = n;
     char *z;
     NEXT_HIGHEST_2_POW(c);
-    z = (char*) realloc(a->d, c);
+    z = (char*) mem_realloc(MEM_GROUND, a->d, c);
     if (!z) return false;
     a->d = z;
     a->c = c;
@@ -44,7 +44,7 @@ bool array_char_writeln(array_char_t *a, char *s, size_t n) {
     size_t c = a->n + n;
     char *z;
     NEXT_HIGHEST_2_POW(c);
-    z = (char*) realloc(a->d, c);
+    z = (char*) mem_realloc(MEM_GROUND, a->d, c);
     if (!z) return false;
     a->d = z;
     a->c = c;
@@ -57,4 +57,4 @@ bool array_char_writeln(array_char_t *a, char *s, size_t n) {
 #undef ARRAY_MAGIC_MULTIPLIER
 #define ARRAY_MAGIC_MULTIPLIER 1.5
 
-ARRAY_IMPL(uint8_t)
+ARRAY_IMPL(uint8_t, MEM_GROUND)
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include <clingo.h>
 
+#include "cmem.h"
+
 #define ARRAY_MAGIC_MULTIPLIER 1.5
 #define ARRAY_MAGIC_INIT_CAP   16
 
@@ -22,9 +24,9 @@ ret_type array_##type##_##func(array_##type##_t *a, type o)
 #define CARRAY_ARRAY_HEADER_ARG(type, ret_type, arg_type, func) \
 ret_type array_##type##_##func(array_##type##_t *a, arg_type o)
 
-#define CARRAY_ARRAY_INIT_DECLARE(type) \
+#define CARRAY_ARRAY_INIT_DECLARE(type, sys) \
 bool array_##type##_init(array_##type##_t *a) { \
-  a->d = (type*) malloc(ARRAY_MAGIC_INIT_CAP*sizeof(type)); \
+  a->d = (type*) mem_malloc(sys, ARRAY_MAGIC_INIT_CAP*sizeof(type)); \
   if (!a->d) { \
     a->c = 0; \
     return false; \
@@ -34,9 +36,9 @@ bool array_##type##_init(array_##type##_t *a) { \
   return true; \
 }
 
-#define CARRAY_ARRAY_INITN_DECLARE(type) \
+#define CARRAY_ARRAY_INITN_DECLARE(type, sys) \
 bool array_##type##_initn(array_##type##_t *a, size_t c) { \
-  a->d = (type*) malloc(c*sizeof(type)); \
+  a->d = (type*) mem_malloc(sys, c*sizeof(type)); \
   if (!a->d) { \
     a->c = 0; \
     return false; \
@@ -46,19 +48,19 @@ bool array_##type##_initn(array_##type##_t *a, size_t c) { \
   return true; \
 }
 
-#define CARRAY_ARRAY_FREE_CONTENTS_DECLARE(type) \
+#define CARRAY_ARRAY_FREE_CONTENTS_DECLARE(type, sys) \
 void array_##type##_free_contents(array_##type##_t *a) { \
-  if (a->d) { free(a->d); a->d = NULL; a->c = 0; a->n = 0; } \
+  if (a->d) { mem_free(sys, a->d); a->d = NULL; a->c = 0; a->n = 0; } \
 }
 
 #define CARRAY_ARRAY_FREE_DECLARE(type) \
 void array_##type##_free(array_##type##_t *a) { array_##type##_free_contents(a); free(a); }
 
-#define CARRAY_ARRAY_GROW_DECLARE(type) \
+#define CARRAY_ARRAY_GROW_DECLARE(type, sys) \
 bool array_##type##_grow(array_##type##_t *a) { \
   size_t nc = ARRAY_MAGIC_MULTIPLIER*a->c; \
   size_t nb = sizeof(type)*nc; \
-  type *d = (type*) realloc(a->d, nb); \
+  type *d = (type*) mem_realloc(sys, a->d, nb); \
   if (!d) return false; \
   a->d = d; \
   a->c = nc; \
@@ -85,12 +87,13 @@ bool array_##type##_extend(array_##type##_t *a, size_t argc, ...) { \
 
 #define CARRAY_ARRAY_CLEAR_DECLARE(type) void array_##type##_clear(array_##type##_t *a) { a->n = 0; }
 
-#define ARRAY_IMPL(t) \
-  CARRAY_ARRAY_INIT_DECLARE(t) \
-  CARRAY_ARRAY_INITN_DECLARE(t) \
-  CARRAY_ARRAY_FREE_CONTENTS_DECLARE(t) \
+/* Instantiates arrays of type t whose memory is accounted to subsystem sys (see cmem.h). */
+#define ARRAY_IMPL(t, sys) \
+  CARRAY_ARRAY_INIT_DECLARE(t, sys) \
+  CARRAY_ARRAY_INITN_DECLARE(t, sys) \
+  CARRAY_ARRAY_FREE_CONTENTS_DECLARE(t, sys) \
   CARRAY_ARRAY_FREE_DECLARE(t) \
-  CARRAY_ARRAY_GROW_DECLARE(t) \
+  CARRAY_ARRAY_GROW_DECLARE(t, sys) \
   CARRAY_ARRAY_APPEND_DECLARE(t) \
   CARRAY_ARRAY_CLEAR_DECLARE(t)
 
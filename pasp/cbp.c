@@ -0,0 +1,302 @@
+#include "cbp.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cinf.h"
+#include "cmem.h"
+#include "cfactor.h"
+
+/* Clamp of a variable that is not evidence. */
+#define BP_FREE -1
+
+typedef struct {
+  factor_graph_t *G;
+  /* Offset of the table of each factor in G->FT. */
+  size_t *TO;
+  /* Edges (positions in G->FV) of variable v are VE[VO[v]..VO[v+1]). */
+  size_t *VO;
+  uint32_t *VE;
+  /* Factor-to-variable and variable-to-factor messages of each edge, as pairs (false, true). */
+  double *mf, *mv;
+  /* Value each variable is clamped to, or BP_FREE. */
+  int8_t *c;
+  double damping;
+} bp_t;
+
+typedef struct {
+  bp_t *B;
+  /* Factors or variables of this chunk. */
+  size_t lo, hi;
+  /* Largest change of a message of this chunk. */
+  double delta;
+  /* Whether some message of this chunk is zero in both states, i.e. contradicts the evidence. */
+  bool zero;
+} bp_job_t;
+
+static void free_bp_contents(bp_t *B) {
+  mem_free(MEM_STORAGE, B->TO); mem_free(MEM_STORAGE, B->VO); mem_free(MEM_STORAGE, B->VE);
+  mem_free(MEM_STORAGE, B->mf); mem_free(MEM_STORAGE, B->mv); mem_free(MEM_STORAGE, B->c);
+}
+
+/* Sums of the logarithms of the nonzero incoming messages of v in each state, and counts of the
+ * zero ones, the clamp counting as a zero message in the state it excludes. */
+static inline void bp_gather(bp_t *B, size_t v, double *s, size_t *z) {
+  s[0] = s[1] = 0;
+  z[0] = B->c[v] == 1;
+  z[1] = B->c[v] == 0;
+  for (size_t i = B->VO[v]; i < B->VO[v+1]; ++i) {
+    double *m = B->mf + 2*B->VE[i];
+    for (size_t x = 0; x < 2; ++x) {
+      if (m[x] > 0) s[x] += log(m[x]);
+      else ++z[x];
+    }
+  }
+}
+
+/* Normalizes the message of logarithms l and zero counts z into m, returning false (and writing
+ * the uniform message) if it is zero in both states. */
+static inline bool bp_normalize(const double *l, const size_t *z, double *m) {
+  if (z[0] && z[1]) { m[0] = m[1] = 0.5; return false; }
+  if (z[0]) { m[0] = 0; m[1] = 1; return true; }
+  if (z[1]) { m[0] = 1; m[1] = 0; return true; }
+  double t = exp(l[1] - l[0]);
+  if (isinf(t)) { m[0] = 0; m[1] = 1; return true; }
+  m[0] = 1/(1+t); m[1] = t/(1+t);
+  return true;
+}
+
+/* Variable-to-factor messages of variables lo..hi, each the product of the messages of the other
+ * factors of its variable, left out of the sums of logarithms so as not to divide by zero. */
+static void bp_variables(void *data) {
+  bp_job_t *J = (bp_job_t*) data;
+  bp_t *B = J->B;
+  double s[2], l[2];
+  size_t z[2], y[2];
+
+  for (size_t v = J->lo; v < J->hi; ++v) {
+    bp_gather(B, v, s, z);
+    for (size_t i = B->VO[v]; i < B->VO[v+1]; ++i) {
+      double *m = B->mf + 2*B->VE[i];
+      for (size_t x = 0; x < 2; ++x) {
+        l[x] = m[x] > 0 ? s[x] - log(m[x]) : s[x];
+        y[x] = z[x] - !(m[x] > 0);
+      }
+      if (!bp_normalize(l, y, B->mv + 2*B->VE[i])) J->zero = true;
+    }
+  }
+}
+
+/* Damped factor-to-variable messages of factors lo..hi. Each entry of a table contributes its
+ * value times the messages of every other variable of the scope, taken from prefix and suffix
+ * products. */
+static void bp_factors(void *data) {
+  bp_job_t *J = (bp_job_t*) data;
+  bp_t *B = J->B;
+  factor_graph_t *G = B->G;
+  double pre[BP_MAX_WIDTH+1], suf[BP_MAX_WIDTH+1], out[2*BP_MAX_WIDTH], a = B->damping;
+
+  for (size_t f = J->lo; f < J->hi; ++f) {
+    size_t o = G->FO.d[f], k = G->FO.d[f+1] - o, j;
+    double *T = G->FT + B->TO[f], *m = B->mv + 2*o;
+    memset(out, 0, 2*k*sizeof(double));
+    for (size_t x = 0; x < ((size_t) 1 << k); ++x) {
+      if (T[x] == 0) continue;
+      pre[0] = suf[k] = 1;
+      for (j = 0; j < k; ++j) pre[j+1] = pre[j]*m[2*j + ((x >> j) & 1)];
+      for (j = k; j > 0; --j) suf[j-1] = suf[j]*m[2*(j-1) + ((x >> (j-1)) & 1)];
+      for (j = 0; j < k; ++j) out[2*j + ((x >> j) & 1)] += T[x]*pre[j]*suf[j+1];
+    }
+    for (j = 0; j < k; ++j) {
+      double *d = B->mf + 2*(o+j), w = out[2*j] + out[2*j+1], n[2];
+      if (w > 0) { n[0] = out[2*j]/w; n[1] = out[2*j+1]/w; }
+      else { n[0] = n[1] = 0.5; J->zero = true; }
+      for (size_t x = 0; x < 2; ++x) {
+        n[x] = (1-a)*n[x] + a*d[x];
+        if (fabs(n[x] - d[x]) > J->delta) J->delta = fabs(n[x] - d[x]);
+        d[x] = n[x];
+      }
+    }
+  }
+}
+
+/* Splits 0..n into c chunks of about the same cost, where O[i] is the cost of 0..i. */
+static void bp_split(bp_job_t *J, size_t c, bp_t *B, const size_t *O, size_t n) {
+  size_t i = 0;
+  for (size_t t = 0; t < c; ++t) {
+    J[t] = (bp_job_t) { .B = B, .lo = i };
+    while (i < n && O[i] < O[n]*(t+1)/c) ++i;
+    J[t].hi = t+1 == c ? n : i;
+    i = J[t].hi;
+  }
+}
+
+/* Runs jobs J[0..c) of func, on pool if there is more than one, returning the largest change of a
+ * message and whether some message was zero. */
+static bool bp_run_jobs(threadpool pool, void (*func)(void*), bp_job_t *J, size_t c, double *delta,
+    bool *zero) {
+  for (size_t t = 0; t < c; ++t) {
+    J[t].delta = 0; J[t].zero = false;
+    if (c == 1) func(J+t);
+    else if (thpool_add_work(pool, func, J+t)) {
+      thpool_wait(pool);
+      PyErr_SetString(PyExc_RuntimeError, "could not add belief propagation to the thread pool!");
+      return false;
+    }
+  }
+  if (c > 1) thpool_wait(pool);
+  for (size_t t = 0; t < c; ++t) {
+    if (J[t].delta > *delta) *delta = J[t].delta;
+    *zero |= J[t].zero;
+  }
+  return true;
+}
+
+/* Propagates from uniform messages under the current clamps, setting *consistent to false if the
+ * clamps contradict the factors. */
+static bool bp_propagate(bp_t *B, threadpool pool, bp_job_t *JV, bp_job_t *JF, size_t c,
+    size_t max_iters, double tol, size_t *iters, bool *converged, bool *consistent) {
+  size_t E = B->G->FV.n, it;
+  bool zero = false;
+  for (size_t i = 0; i < 2*E; ++i) B->mf[i] = B->mv[i] = 0.5;
+  for (it = 0; it < max_iters; ++it) {
+    double delta = 0;
+    zero = false;
+    if (!bp_run_jobs(pool, bp_variables, JV, c, &delta, &zero)) return false;
+    if (!bp_run_jobs(pool, bp_factors, JF, c, &delta, &zero)) return false;
+    if (delta < tol) break;
+  }
+  if (it == max_iters) *converged = false;
+  else ++it;
+  if (it > *iters) *iters = it;
+  *consistent = !zero;
+  return true;
+}
+
+/* Probability of variable v being true, or -1 if its belief is zero in both states. */
+static double bp_belief(bp_t *B, size_t v) {
+  double s[2], m[2];
+  size_t z[2];
+  bp_gather(B, v, s, z);
+  return bp_normalize(s, z, m) ? m[1] : -1;
+}
+
+/* Clamps the variables of the n literals L, returning false if two of them disagree. */
+static bool bp_clamp(bp_t *B, const int32_t *L, size_t n) {
+  memset(B->c, BP_FREE, B->G->n);
+  for (size_t i = 0; i < n; ++i) {
+    size_t u = abs(L[i])-1;
+    if (B->c[u] != BP_FREE && B->c[u] != (L[i] > 0)) return false;
+    B->c[u] = L[i] > 0;
+  }
+  return true;
+}
+
+bool bp_query(program_t *P, double damping, size_t max_iters, double tol, double *q, bool *e,
+    bool *done, size_t *iters, bool *converged) {
+  factor_graph_t G = {0};
+  bp_t B = { .G = &G, .damping = damping };
+  bp_job_t *JV = NULL, *JF = NULL;
+  threadpool pool = NULL;
+  size_t Q_n = P->Q_n, n, F_n, E, c = 1, i, j;
+  bool *handled = NULL, ok = false, applies;
+
+  *done = false;
+  *iters = 0;
+  *converged = true;
+  if (!factor_graph_compile(P, BP_MAX_WIDTH, &G, &applies)) return false;
+  if (!applies) return true;
+  n = G.n; F_n = G.FO.n - 1; E = G.FV.n;
+  int32_t *L = G.L;
+  size_t *LO = G.LO;
+  bool *never = G.never;
+
+  if (E >= BP_MIN_PARALLEL) c = max_nprocs();
+  B.TO = (size_t*) mem_malloc(MEM_STORAGE, (F_n+1)*sizeof(size_t));
+  B.VO = (size_t*) mem_calloc(MEM_STORAGE, n+1, sizeof(size_t));
+  B.VE = (uint32_t*) mem_malloc(MEM_STORAGE, (E ? E : 1)*sizeof(uint32_t));
+  B.mf = (double*) mem_malloc(MEM_STORAGE, (E ? 2*E : 1)*sizeof(double));
+  B.mv = (double*) mem_malloc(MEM_STORAGE, (E ? 2*E : 1)*sizeof(double));
+  B.c = (int8_t*) mem_malloc(MEM_STORAGE, n ? n : 1);
+  JV = (bp_job_t*) mem_malloc(MEM_STORAGE, c*sizeof(bp_job_t));
+  JF = (bp_job_t*) mem_malloc(MEM_STORAGE, c*sizeof(bp_job_t));
+  handled = (bool*) mem_calloc(MEM_STORAGE, Q_n, sizeof(bool));
+  if (!(B.TO && B.VO && B.VE && B.mf && B.mv && B.c && JV && JF && handled)) {
+    mem_raise("belief propagation");
+    goto cleanup;
+  }
+
+  /* Variable to edges, and the cost of each chunk: table entries of factors and edges of
+   * variables. */
+  B.TO[0] = 0;
+  for (i = 0; i < F_n; ++i) B.TO[i+1] = B.TO[i] + ((size_t) 1 << (G.FO.d[i+1] - G.FO.d[i]));
+  for (i = 0; i < E; ++i) ++B.VO[G.FV.d[i]+1];
+  for (i = 0; i < n; ++i) B.VO[i+1] += B.VO[i];
+  for (i = 0; i < E; ++i) B.VE[B.VO[G.FV.d[i]]++] = i;
+  for (i = n; i > 0; --i) B.VO[i] = B.VO[i-1];
+  B.VO[0] = 0;
+  bp_split(JV, c, &B, B.VO, n);
+  bp_split(JF, c, &B, B.TO, F_n);
+  if (c > 1 && !(pool = thpool_init(c))) {
+    PyErr_SetString(PyExc_RuntimeError, "could not create thread pool for belief propagation!");
+    goto cleanup;
+  }
+
+  /* Propagate once per distinct evidence, reading single atom queries off the beliefs; queries of
+   * several atoms then each propagate once more per atom beyond the first. */
+  for (i = 0; i < Q_n; ++i) {
+    if (handled[i]) continue;
+    int32_t *EL = L + LO[2*i];
+    size_t E_n = LO[2*i+1] - LO[2*i];
+    bool consistent = !never[2*i] && bp_clamp(&B, EL, E_n), calibrated = false;
+    for (size_t pass = 0; pass < 2; ++pass) {
+      for (size_t k = i; k < Q_n; ++k) {
+        if (handled[k] || !query_same_evidence(P->Q+i, P->Q+k)) continue;
+        int32_t *QL = L + LO[2*k+1];
+        size_t m = LO[2*k+2] - LO[2*k+1];
+        if ((m > 1) != pass) continue;
+        if (consistent && !calibrated) {
+          if (!bp_propagate(&B, pool, JV, JF, c, max_iters, tol, iters, converged, &consistent))
+            goto cleanup;
+          calibrated = true;
+        }
+        handled[k] = true;
+        e[k] = consistent;
+        q[k] = 0;
+        if (!consistent || never[2*k+1]) continue;
+        /* ℙ(Q_1..Q_m | E) = ℙ(Q_1 | E) ℙ(Q_2 | E, Q_1) ... ℙ(Q_m | E, Q_1..Q_m-1). */
+        double p = 1;
+        bool clamped = false;
+        for (j = 0; j < m && p > 0; ++j) {
+          size_t u = abs(QL[j])-1;
+          if (B.c[u] != BP_FREE) { p *= B.c[u] == (QL[j] > 0); continue; }
+          if (clamped) {
+            bool r;
+            if (!bp_propagate(&B, pool, JV, JF, c, max_iters, tol, iters, converged, &r))
+              goto cleanup;
+            if (!r) { p = 0; break; }
+          }
+          double b = bp_belief(&B, u);
+          p *= b < 0 ? 0 : QL[j] > 0 ? b : 1-b;
+          B.c[u] = QL[j] > 0;
+          clamped = true;
+        }
+        q[k] = p;
+        if (clamped && m > 1) {
+          bp_clamp(&B, EL, E_n);
+          calibrated = false;
+        } else if (clamped) B.c[abs(QL[0])-1] = BP_FREE;
+      }
+    }
+  }
+
+  *done = true;
+  ok = true;
+cleanup:
+  if (pool) thpool_destroy(pool);
+  free_bp_contents(&B);
+  free_factor_graph_contents(&G);
+  mem_free(MEM_STORAGE, JV); mem_free(MEM_STORAGE, JF); mem_free(MEM_STORAGE, handled);
+  return ok;
+}
@@ -0,0 +1,32 @@
+#ifndef _PASP_CBP
+#define _PASP_CBP
+
+#include <stdbool.h>
+
+#include "cprogram.h"
+
+/* Default weight of the previous message in each damped update. */
+#define BP_DEFAULT_DAMPING 0.5
+/* Default largest number of iterations of each propagation. */
+#define BP_DEFAULT_MAX_ITERS 200
+/* Default largest change of any message under which propagation has converged. */
+#define BP_DEFAULT_TOL 1e-8
+/* Largest number of atoms in the scope of a factor. */
+#define BP_MAX_WIDTH 16
+/* Smallest number of edges of a factor graph whose messages are updated in parallel. */
+#define BP_MIN_PARALLEL (1 << 14)
+
+/* Approximates the queries of P by loopy belief propagation over the factor graph of its ground
+ * program (see factor_graph_t), which must be normal, acyclic and free of integrity constraints.
+ * Every iteration updates all variable-to-factor messages and then all factor-to-variable
+ * messages, each in parallel over chunks of the graph, mixing the latter with a weight of damping
+ * of their previous value, until no message changes by more than tol or max_iters is reached.
+ * Evidence atoms are clamped; a query of several atoms is answered by the chain rule, clamping
+ * one more atom per propagation. Propagation is exact if the factor graph is a tree. Writes
+ * ℙ(Q_i | E_i) to q[i] and whether ℙ(E_i) > 0 to e[i], the largest number of iterations of a
+ * propagation to *iters and whether all of them converged to *converged. If P is not as above,
+ * sets *done to false and returns true. */
+bool bp_query(program_t *P, double damping, size_t max_iters, double tol, double *q, bool *e,
+    bool *done, size_t *iters, bool *converged);
+
+#endif
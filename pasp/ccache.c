@@ -0,0 +1,243 @@
+#include "ccache.h"
+#include "cmem.h"
+#include "cutils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+  cache_key_t key;
+  /* Number of results; 0 if the slot is empty. */
+  size_t n;
+  double *R;
+  /* Value of cache_tick when the entry was last used. */
+  uint64_t used;
+} cache_entry_t;
+
+static cache_entry_t cache_entries[CACHE_CAPACITY];
+static uint64_t cache_tick = 0;
+static size_t cache_hits = 0, cache_disk_hits = 0, cache_misses = 0, cache_stores = 0;
+
+/* Lane 0 is FNV-1a; lane 1 is a multiply-xorshift mix with a different prime, so that the two lanes
+ * do not collide together. */
+static inline void hash_bytes(cache_key_t *key, const void *d, size_t n) {
+  const uint8_t *b = (const uint8_t*) d;
+  uint64_t x = key->h[0], y = key->h[1];
+  for (size_t i = 0; i < n; ++i) {
+    x = (x ^ b[i]) * 0x100000001b3ULL;
+    y = (y ^ b[i]) * 0x9e3779b97f4a7c15ULL;
+    y ^= y >> 29;
+  }
+  key->h[0] = x; key->h[1] = y;
+}
+
+static inline void hash_u64(cache_key_t *key, uint64_t v) { hash_bytes(key, &v, sizeof(uint64_t)); }
+static inline void hash_double(cache_key_t *key, double v) { hash_bytes(key, &v, sizeof(double)); }
+
+/* Strings are prefixed by their length so that consecutive strings cannot be confused for one. */
+static inline void hash_str(cache_key_t *key, const char *s) {
+  size_t n = s ? strlen(s) : 0;
+  hash_u64(key, s ? n : UINT64_MAX);
+  hash_bytes(key, s, n);
+}
+
+static bool hash_symbols(cache_key_t *key, clingo_symbol_t *S, uint8_t *S_s, size_t n,
+    string_t *buf) {
+  hash_u64(key, n);
+  for (size_t i = 0; i < n; ++i) {
+    if (!string_from_symbol(S[i], buf)) return false;
+    hash_str(key, buf->s);
+    hash_u64(key, S_s[i]);
+  }
+  return true;
+}
+
+bool cache_key(program_t *P, psemantics_t psem, bool lstable_sat, cache_key_t *key) {
+  string_t buf = {0};
+  bool ok = false;
+
+  key->h[0] = 0xcbf29ce484222325ULL; key->h[1] = 0x84222325cbf29ce4ULL;
+  hash_bytes(key, CACHE_MAGIC, sizeof(CACHE_MAGIC)-1);
+  hash_u64(key, P->sem); hash_u64(key, psem); hash_u64(key, lstable_sat);
+  hash_str(key, P->P);
+  hash_str(key, P->gr_P);
+
+  hash_u64(key, P->PF_n);
+  for (size_t i = 0; i < P->PF_n; ++i) { hash_str(key, P->PF[i].f); hash_double(key, P->PF[i].p); }
+  hash_u64(key, P->AD_n);
+  for (size_t i = 0; i < P->AD_n; ++i) {
+    hash_u64(key, P->AD[i].n);
+    for (size_t j = 0; j < P->AD[i].n; ++j) {
+      hash_str(key, P->AD[i].F[j]);
+      hash_double(key, P->AD[i].P[j]);
+    }
+  }
+  hash_u64(key, P->CF_n);
+  for (size_t i = 0; i < P->CF_n; ++i) {
+    hash_str(key, P->CF[i].f);
+    hash_double(key, P->CF[i].l); hash_double(key, P->CF[i].u);
+  }
+  hash_u64(key, P->PR_n);
+  for (size_t i = 0; i < P->PR_n; ++i) {
+    hash_str(key, P->PR[i].f);
+    hash_double(key, P->PR[i].p);
+    hash_u64(key, P->PR[i].is_prop);
+  }
+
+  hash_u64(key, P->Q_n);
+  for (size_t i = 0; i < P->Q_n; ++i) {
+    if (!hash_symbols(key, P->Q[i].Q, P->Q[i].Q_s, P->Q[i].Q_n, &buf)) goto cleanup;
+    if (!hash_symbols(key, P->Q[i].E, P->Q[i].E_s, P->Q[i].E_n, &buf)) goto cleanup;
+  }
+
+  ok = true;
+cleanup:
+  if (!ok) raise_clingo_error("could not hash queries for the result cache!");
+  string_free(&buf);
+  return ok;
+}
+
+static char* cache_path(cache_key_t *key, const char *dir, const char *suffix) {
+  size_t n = strlen(dir) + 1 + 32 + strlen(suffix) + 1;
+  char *p = (char*) mem_malloc(MEM_OTHER, n);
+  if (!p) return NULL;
+  snprintf(p, n, "%s/%016llx%016llx%s", dir, (unsigned long long) key->h[0],
+      (unsigned long long) key->h[1], suffix);
+  return p;
+}
+
+static cache_entry_t* cache_find(cache_key_t *key, size_t n) {
+  for (size_t i = 0; i < CACHE_CAPACITY; ++i)
+    if ((cache_entries[i].n == n) && !memcmp(&cache_entries[i].key, key, sizeof(cache_key_t)))
+      return &cache_entries[i];
+  return NULL;
+}
+
+/* Returns the slot to overwrite: an empty one if any, else the least recently used. */
+static cache_entry_t* cache_victim(void) {
+  cache_entry_t *v = &cache_entries[0];
+  for (size_t i = 0; i < CACHE_CAPACITY; ++i) {
+    if (!cache_entries[i].n) return &cache_entries[i];
+    if (cache_entries[i].used < v->used) v = &cache_entries[i];
+  }
+  return v;
+}
+
+static void cache_put_memory(cache_key_t *key, size_t n, double *R) {
+  cache_entry_t *e = cache_find(key, n);
+  if (!e) {
+    double *C = (double*) mem_malloc(MEM_RESULTS, n*sizeof(double));
+    if (!C) return;
+    e = cache_victim();
+    mem_free(MEM_RESULTS, e->R);
+    e->key = *key;
+    e->n = n;
+    e->R = C;
+  }
+  memcpy(e->R, R, n*sizeof(double));
+  e->used = ++cache_tick;
+}
+
+/* Reads an entry written by cache_put_disk, checking that it matches key and n. */
+static bool cache_get_disk(cache_key_t *key, const char *dir, size_t n, double *R) {
+  char magic[sizeof(CACHE_MAGIC)-1];
+  uint32_t version;
+  cache_key_t k;
+  uint64_t m;
+  bool ok = false;
+  char *path = cache_path(key, dir, ".cache");
+  if (!path) return false;
+  FILE *f = fopen(path, "rb");
+  mem_free(MEM_OTHER, path);
+  if (!f) return false;
+  if ((fread(magic, 1, sizeof(magic), f) != sizeof(magic)) ||
+      memcmp(magic, CACHE_MAGIC, sizeof(magic)))
+    goto cleanup;
+  if ((fread(&version, sizeof(uint32_t), 1, f) != 1) || (version != CACHE_VERSION)) goto cleanup;
+  if ((fread(&k, sizeof(cache_key_t), 1, f) != 1) || memcmp(&k, key, sizeof(cache_key_t)))
+    goto cleanup;
+  if ((fread(&m, sizeof(uint64_t), 1, f) != 1) || (m != n)) goto cleanup;
+  ok = fread(R, sizeof(double), n, f) == n;
+cleanup:
+  fclose(f);
+  return ok;
+}
+
+static void cache_put_disk(cache_key_t *key, const char *dir, size_t n, double *R) {
+  uint32_t version = CACHE_VERSION;
+  uint64_t m = n;
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long) getpid());
+  char *path = cache_path(key, dir, ".cache"), *t = cache_path(key, dir, suffix);
+  if (!path || !t) goto cleanup;
+  FILE *f = fopen(t, "wb");
+  if (!f) goto cleanup;
+  fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC)-1, f);
+  fwrite(&version, sizeof(uint32_t), 1, f);
+  fwrite(key, sizeof(cache_key_t), 1, f);
+  fwrite(&m, sizeof(uint64_t), 1, f);
+  fwrite(R, sizeof(double), n, f);
+  bool ok = !ferror(f);
+  ok = !fclose(f) && ok;
+  if (!(ok && !rename(t, path))) remove(t);
+cleanup:
+  mem_free(MEM_OTHER, path);
+  mem_free(MEM_OTHER, t);
+}
+
+/* Writes an in-process entry to dir if it is not there yet, e.g. when it was first computed without
+ * an on-disk tier. */
+static void cache_sync_disk(cache_key_t *key, const char *dir, size_t n, double *R) {
+  char *path = cache_path(key, dir, ".cache");
+  if (!path) return;
+  bool missing = access(path, F_OK) != 0;
+  mem_free(MEM_OTHER, path);
+  if (missing) cache_put_disk(key, dir, n, R);
+}
+
+bool cache_get(cache_key_t *key, const char *dir, size_t n, double **R) {
+  cache_entry_t *e = cache_find(key, n);
+  double *C = (double*) mem_malloc(MEM_RESULTS, n*sizeof(double));
+  if (!C) goto miss;
+  if (e) {
+    memcpy(C, e->R, n*sizeof(double));
+    e->used = ++cache_tick;
+    if (dir) cache_sync_disk(key, dir, n, e->R);
+    ++cache_hits;
+    *R = C;
+    return true;
+  }
+  if (dir && cache_get_disk(key, dir, n, C)) {
+    /* Promote to the in-process tier so that the next lookup does not touch the disk. */
+    cache_put_memory(key, n, C);
+    ++cache_disk_hits;
+    *R = C;
+    return true;
+  }
+  mem_free(MEM_RESULTS, C);
+miss:
+  ++cache_misses;
+  return false;
+}
+
+void cache_put(cache_key_t *key, const char *dir, size_t n, double *R) {
+  if (!n) return;
+  cache_put_memory(key, n, R);
+  if (dir) cache_put_disk(key, dir, n, R);
+  ++cache_stores;
+}
+
+PyObject* cache_stats(void) {
+  size_t entries = 0;
+  for (size_t i = 0; i < CACHE_CAPACITY; ++i) entries += cache_entries[i].n > 0;
+  return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n}", "hits", cache_hits, "disk_hits",
+      cache_disk_hits, "misses", cache_misses, "stores", cache_stores, "entries", entries,
+      "capacity", (size_t) CACHE_CAPACITY);
+}
+
+void cache_clear(void) {
+  for (size_t i = 0; i < CACHE_CAPACITY; ++i) mem_free(MEM_RESULTS, cache_entries[i].R);
+  memset(cache_entries, 0, sizeof(cache_entries));
+  cache_tick = cache_hits = cache_disk_hits = cache_misses = cache_stores = 0;
+}
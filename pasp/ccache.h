@@ -0,0 +1,44 @@
+#ifndef _PASP_CCACHE
+#define _PASP_CCACHE
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cprogram.h"
+#include "cinf.h"
+
+#define CACHE_MAGIC "PASPCACH"
+#define CACHE_VERSION 1
+/* Number of results kept in the in-process tier. */
+#define CACHE_CAPACITY 64
+
+/* Content hash of an exact inference query. Two independent 64-bit lanes make accidental
+ * collisions between cached programs negligible. */
+typedef struct {
+  uint64_t h[2];
+} cache_key_t;
+
+/* Hashes everything the result of exact inference depends on: the logic program (and its ground
+ * counterpart, if any), the parameters of probabilistic facts, annotated disjunctions, credal facts
+ * and probabilistic rules, the queries and evidence, and the semantics. Symbols are hashed by their
+ * string representation, so keys are stable across processes. */
+bool cache_key(program_t *P, psemantics_t psem, bool lstable_sat, cache_key_t *key);
+
+/* Looks up the n results of key, first in memory and then, if dir is not NULL, on disk. On a hit,
+ * returns true and sets *R to a newly allocated copy. */
+bool cache_get(cache_key_t *key, const char *dir, size_t n, double **R);
+/* Stores a copy of the n results R under key, evicting the least recently used entry if the
+ * in-process tier is full. If dir is not NULL, the result is also written to a file in dir; the
+ * file is written under a temporary name and renamed, so that concurrent processes never read a
+ * partial entry. Failing to cache is not an error. */
+void cache_put(cache_key_t *key, const char *dir, size_t n, double *R);
+
+/* Returns the hit and miss counters as a Python dict. */
+PyObject* cache_stats(void);
+/* Drops every in-process entry and resets the counters. Files on disk are left untouched. */
+void cache_clear(void);
+
+#endif
@@ -0,0 +1,230 @@
+#include "ccheckpoint.h"
+#include "ccache.h"
+#include "cmem.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "../bitvector/bitvector.h"
+
+/* Shape of a program as recorded in a checkpoint header. Resuming is refused if any differ. */
+#define CHECKPOINT_SHAPE_N 9
+
+static void program_shape(program_t *P, uint64_t S[CHECKPOINT_SHAPE_N]) {
+  size_t ad_v = 0;
+  for (size_t i = 0; i < P->AD_n; ++i) ad_v += P->AD[i].n;
+  S[0] = P->PF_n; S[1] = P->CF_n; S[2] = P->AD_n; S[3] = ad_v; S[4] = P->PR_n;
+  S[5] = P->Q_n; S[6] = P->NR_n; S[7] = P->NA_n; S[8] = P->m_test;
+}
+
+void init_checkpoint(checkpoint_t *ck, const char *path, const char *resume, size_t interval) {
+  ck->path = path;
+  ck->resume = resume;
+  ck->interval = interval;
+  ck->last = time(NULL);
+}
+
+bool checkpoint_due(checkpoint_t *ck) {
+  if (!ck || !ck->path) return false;
+  time_t now = time(NULL);
+  if (difftime(now, ck->last) < (double) ck->interval) return false;
+  ck->last = now;
+  return true;
+}
+
+static char* temp_path(const char *path) {
+  size_t n = strlen(path);
+  char *t = (char*) mem_malloc(MEM_OTHER, n + sizeof(".tmp"));
+  if (!t) return NULL;
+  memcpy(t, path, n);
+  memcpy(t + n, ".tmp", sizeof(".tmp"));
+  return t;
+}
+
+FILE* checkpoint_open_write(checkpoint_t *ck, program_t *P, uint8_t kind) {
+  uint64_t S[CHECKPOINT_SHAPE_N];
+  uint32_t version = CHECKPOINT_VERSION;
+  char *t = temp_path(ck->path);
+  if (!t) {
+    mem_raise("checkpoint path");
+    return NULL;
+  }
+  FILE *f = fopen(t, "wb");
+  mem_free(MEM_OTHER, t);
+  if (!f) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, ck->path);
+    return NULL;
+  }
+  program_shape(P, S);
+  fwrite(CHECKPOINT_MAGIC, 1, sizeof(CHECKPOINT_MAGIC)-1, f);
+  fwrite(&version, sizeof(uint32_t), 1, f);
+  fwrite(&kind, sizeof(uint8_t), 1, f);
+  fwrite(S, sizeof(uint64_t), CHECKPOINT_SHAPE_N, f);
+  return f;
+}
+
+bool checkpoint_commit(checkpoint_t *ck, FILE *f) {
+  bool ok = !ferror(f);
+  ok = !fflush(f) && ok;
+  ok = !fclose(f) && ok;
+  char *t = temp_path(ck->path);
+  if (!t) {
+    mem_raise("checkpoint path");
+    return false;
+  }
+  if (ok) ok = !rename(t, ck->path);
+  if (!ok) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, ck->path);
+    remove(t);
+  }
+  mem_free(MEM_OTHER, t);
+  return ok;
+}
+
+FILE* checkpoint_open_read(checkpoint_t *ck, program_t *P, uint8_t kind) {
+  char magic[sizeof(CHECKPOINT_MAGIC)-1];
+  uint64_t S[CHECKPOINT_SHAPE_N], T[CHECKPOINT_SHAPE_N];
+  uint32_t version;
+  uint8_t k;
+  FILE *f = fopen(ck->resume, "rb");
+  if (!f) {
+    PyErr_SetFromErrnoWithFilename(PyExc_OSError, ck->resume);
+    return NULL;
+  }
+  if ((fread(magic, 1, sizeof(magic), f) != sizeof(magic)) || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic))) {
+    PyErr_SetString(PyExc_ValueError, "file is not a PASP checkpoint!");
+    goto error;
+  }
+  if ((fread(&version, sizeof(uint32_t), 1, f) != 1) || (version != CHECKPOINT_VERSION)) {
+    PyErr_SetString(PyExc_ValueError, "unsupported checkpoint version!");
+    goto error;
+  }
+  if (fread(&k, sizeof(uint8_t), 1, f) != 1) {
+    PyErr_SetString(PyExc_ValueError, "checkpoint is truncated!");
+    goto error;
+  }
+  if (k != kind) {
+    PyErr_SetString(PyExc_ValueError, k == CHECKPOINT_KIND_SHARD ? "file is a shard, not a checkpoint!" :
+        kind == CHECKPOINT_KIND_SHARD ? "file is a checkpoint, not a shard!" :
+        k == CHECKPOINT_KIND_EXACT ? "checkpoint was written by exact inference, not learning!" :
+        "checkpoint was written by learning, not exact inference!");
+    goto error;
+  }
+  program_shape(P, T);
+  if ((fread(S, sizeof(uint64_t), CHECKPOINT_SHAPE_N, f) != CHECKPOINT_SHAPE_N) ||
+      memcmp(S, T, sizeof(S))) {
+    PyErr_SetString(PyExc_ValueError, "checkpoint does not match program!");
+    goto error;
+  }
+  return f;
+error:
+  fclose(f);
+  return NULL;
+}
+
+bool checkpoint_write_run(FILE *f, program_t *P, psemantics_t psem, bool lstable_sat) {
+  uint8_t r[2] = {psem, lstable_sat};
+  cache_key_t key;
+  if (!cache_key(P, psem, lstable_sat, &key)) return false;
+  return checkpoint_write(f, r, sizeof(r)) && checkpoint_write(f, key.h, sizeof(key.h));
+}
+
+bool checkpoint_check_run(FILE *f, program_t *P, psemantics_t psem, bool lstable_sat) {
+  uint8_t r[2];
+  cache_key_t key, ck_key;
+  if (!checkpoint_read(f, r, sizeof(r)) || !checkpoint_read(f, ck_key.h, sizeof(ck_key.h)))
+    return false;
+  if (r[0] != psem) {
+    PyErr_Format(PyExc_ValueError, "checkpoint was written under %s semantics, not %s!",
+        r[0] == MAXENT_SEMANTICS ? "maxent" : "credal", psem == MAXENT_SEMANTICS ? "maxent" : "credal");
+    return false;
+  }
+  if (r[1] != lstable_sat) {
+    PyErr_SetString(PyExc_ValueError, r[1] ? "checkpoint was written with the L-stable translation!" :
+        "checkpoint was written without the L-stable translation!");
+    return false;
+  }
+  if (!cache_key(P, psem, lstable_sat, &key)) return false;
+  if (memcmp(key.h, ck_key.h, sizeof(key.h))) {
+    PyErr_SetString(PyExc_ValueError, "checkpoint was written for a program with different rules, "
+        "parameters or queries!");
+    return false;
+  }
+  return true;
+}
+
+bool checkpoint_write(FILE *f, const void *d, size_t n) {
+  return !n || (fwrite(d, 1, n, f) == n);
+}
+
+bool checkpoint_read(FILE *f, void *d, size_t n) {
+  if (!n || (fread(d, 1, n, f) == n)) return true;
+  PyErr_SetString(PyExc_ValueError, "checkpoint is truncated!");
+  return false;
+}
+
+bool checkpoint_write_total_choice(FILE *f, total_choice_t *theta) {
+  uint64_t n = theta->pf.n, m = theta->ad_n;
+  if (!checkpoint_write(f, &n, sizeof(uint64_t)) || !checkpoint_write(f, &m, sizeof(uint64_t)))
+    return false;
+  /* Bits are stored one per byte so that the file does not depend on the bitvector's layout. */
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t b = bitvec_GET(&theta->pf, i);
+    if (!checkpoint_write(f, &b, 1)) return false;
+  }
+  return checkpoint_write(f, theta->theta_ad, m*sizeof(uint8_t));
+}
+
+bool checkpoint_read_total_choice(FILE *f, total_choice_t *theta) {
+  uint64_t n, m;
+  if (!checkpoint_read(f, &n, sizeof(uint64_t)) || !checkpoint_read(f, &m, sizeof(uint64_t)))
+    return false;
+  if ((n != theta->pf.n) || (m != theta->ad_n)) {
+    PyErr_SetString(PyExc_ValueError, "checkpoint does not match program!");
+    return false;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    uint8_t b;
+    if (!checkpoint_read(f, &b, 1)) return false;
+    bitvec_SET(&theta->pf, i, b);
+  }
+  return checkpoint_read(f, theta->theta_ad, m*sizeof(uint8_t));
+}
+
+bool checkpoint_write_array(FILE *f, const void *d, size_t n, size_t s) {
+  uint64_t m = n;
+  return checkpoint_write(f, &m, sizeof(uint64_t)) && checkpoint_write(f, d, n*s);
+}
+
+bool checkpoint_read_array(FILE *f, void **d, size_t *n, size_t *c, size_t s) {
+  uint64_t m;
+  if (!checkpoint_read(f, &m, sizeof(uint64_t))) return false;
+  if (m > *c) {
+    void *e = mem_realloc(MEM_CREDAL, *d, m*s);
+    if (!e) {
+      mem_raise("checkpoint");
+      return false;
+    }
+    *d = e; *c = m;
+  }
+  *n = m;
+  return checkpoint_read(f, *d, m*s);
+}
+
+bool checkpoint_write_params(FILE *f, program_t *P) {
+  size_t i;
+  for (i = 0; i < P->PF_n; ++i) if (!checkpoint_write(f, &P->PF[i].p, sizeof(double))) return false;
+  for (i = 0; i < P->AD_n; ++i)
+    if (!checkpoint_write(f, P->AD[i].P, P->AD[i].n*sizeof(double))) return false;
+  for (i = 0; i < P->PR_n; ++i) if (!checkpoint_write(f, &P->PR[i].p, sizeof(double))) return false;
+  return true;
+}
+
+bool checkpoint_read_params(FILE *f, program_t *P) {
+  size_t i;
+  for (i = 0; i < P->PF_n; ++i) if (!checkpoint_read(f, &P->PF[i].p, sizeof(double))) return false;
+  for (i = 0; i < P->AD_n; ++i)
+    if (!checkpoint_read(f, P->AD[i].P, P->AD[i].n*sizeof(double))) return false;
+  for (i = 0; i < P->PR_n; ++i) if (!checkpoint_read(f, &P->PR[i].p, sizeof(double))) return false;
+  return true;
+}
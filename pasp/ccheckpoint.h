@@ -0,0 +1,72 @@
+#ifndef _PASP_CCHECKPOINT
+#define _PASP_CCHECKPOINT
+
+#include "cprogram.h"
+#include "cinf.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CHECKPOINT_MAGIC "PASPCKPT"
+#define CHECKPOINT_VERSION 3
+/* Default minimum number of seconds between two consecutive checkpoints. */
+#define CHECKPOINT_DEFAULT_INTERVAL 300
+
+#define CHECKPOINT_KIND_EXACT 0
+#define CHECKPOINT_KIND_LEARN 1
+#define CHECKPOINT_KIND_SHARD 2
+
+typedef struct {
+  /* Path to periodically write checkpoints to; NULL if checkpointing is disabled. */
+  const char *path;
+  /* Path to a previously written checkpoint to resume from; NULL if starting afresh. */
+  const char *resume;
+  /* Minimum number of seconds between two checkpoints. */
+  size_t interval;
+  /* Wall clock time of the last checkpoint (or of initialization). */
+  time_t last;
+} checkpoint_t;
+
+void init_checkpoint(checkpoint_t *ck, const char *path, const char *resume, size_t interval);
+/* Returns whether a checkpoint should be written now, resetting the timer if so. */
+bool checkpoint_due(checkpoint_t *ck);
+
+/* Checkpoint files also carry the partial aggregates of enumeration shards (see exact_merge). */
+
+/* Opens a temporary file for writing a checkpoint of the given kind for program P. The checkpoint
+ * only replaces ck->path once checkpoint_commit succeeds, so that an interrupted write never
+ * corrupts the last good checkpoint. */
+FILE* checkpoint_open_write(checkpoint_t *ck, program_t *P, uint8_t kind);
+bool checkpoint_commit(checkpoint_t *ck, FILE *f);
+/* Opens ck->resume for reading, checking that it was written by a run of the given kind over a
+ * program with the same shape as P. */
+FILE* checkpoint_open_read(checkpoint_t *ck, program_t *P, uint8_t kind);
+
+/* Writes (checks) the settings a run of exact inference depends on beyond the shape of P: its
+ * probabilistic semantics, whether it used the L-stable translation, and a hash of the logic and
+ * ground programs, the parameters, the queries and the logic semantics (see cache_key). Checking
+ * raises a ValueError on any mismatch, since resuming would silently mix incompatible
+ * accumulators. */
+bool checkpoint_write_run(FILE *f, program_t *P, psemantics_t psem, bool lstable_sat);
+bool checkpoint_check_run(FILE *f, program_t *P, psemantics_t psem, bool lstable_sat);
+
+bool checkpoint_write(FILE *f, const void *d, size_t n);
+bool checkpoint_read(FILE *f, void *d, size_t n);
+
+bool checkpoint_write_total_choice(FILE *f, total_choice_t *theta);
+bool checkpoint_read_total_choice(FILE *f, total_choice_t *theta);
+
+/* Writes the size of an array followed by its n elements of s bytes each. */
+bool checkpoint_write_array(FILE *f, const void *d, size_t n, size_t s);
+/* Reads an array written by checkpoint_write_array, (re)allocating *d and setting its size n and
+ * capacity c. */
+bool checkpoint_read_array(FILE *f, void **d, size_t *n, size_t *c, size_t s);
+
+/* Writes (reads) the parameters of all probabilistic facts, annotated disjunctions and
+ * probabilistic rules of P. */
+bool checkpoint_write_params(FILE *f, program_t *P);
+bool checkpoint_read_params(FILE *f, program_t *P);
+
+#endif
@@ -41,7 +41,7 @@ bool init_observations(observations_t *O, PyArrayObject *obs, PyArrayObject *ato
   clingo_symbol_t *A = NULL;
   uint8_t **S = NULL;
 
-  A = (clingo_symbol_t*) malloc(m*sizeof(clingo_symbol_t));
+  A = (clingo_symbol_t*) mem_malloc(MEM_DATA, m*sizeof(clingo_symbol_t));
   if (!A) goto cleanup;
   for (size_t i = 0; i < m; ++i) {
     char a[MAX_ATOM_SIZE] = {0};
@@ -53,12 +53,12 @@ bool init_observations(observations_t *O, PyArrayObject *obs, PyArrayObject *ato
     if (!clingo_parse_term(a, NULL, NULL, 20, &A[i])) goto clingo_err;
   }
 
-  S = (uint8_t**) malloc(n*sizeof(uint8_t*));
+  S = (uint8_t**) mem_malloc(MEM_DATA, n*sizeof(uint8_t*));
   if (!S) goto cleanup;
   for (size_t i = 0; i < n; ++i) {
-    S[i] = (uint8_t*) malloc(m*sizeof(uint8_t));
+    S[i] = (uint8_t*) mem_malloc(MEM_DATA, m*sizeof(uint8_t));
     if (!S[i]) {
-      for (size_t j = 0; j < i; ++j) free(S[j]);
+      for (size_t j = 0; j < i; ++j) mem_free(MEM_DATA, S[j]);
       goto cleanup;
     }
     for (size_t j = 0; j < m; ++j) {
@@ -76,18 +76,18 @@ clingo_err:
   PyErr_SetString(PyExc_ValueError, "atoms given as observations are not in clingo syntax!");
   if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
 cleanup:
-  free(A);
-  free(S);
+  mem_free(MEM_DATA, A);
+  mem_free(MEM_DATA, S);
   return false;
 }
 
 void free_observations_contents(observations_t *O) {
-  free(O->A);
-  for (size_t i = 0; i < O->n; ++i) free(O->S[i]);
-  free(O->S);
+  mem_free(MEM_DATA, O->A);
+  for (size_t i = 0; i < O->n; ++i) mem_free(MEM_DATA, O->S[i]);
+  mem_free(MEM_DATA, O->S);
 }
 
-void free_observations(observations_t *O) { free_observations_contents(O); free(O); }
+void free_observations(observations_t *O) { free_observations_contents(O); mem_free(MEM_DATA, O); }
 
 bool init_dense_observations(observations_t *O, PyArrayObject *obs, size_t batch) {
   /* Initialize numpy. */
@@ -100,20 +100,20 @@ bool init_dense_observations(observations_t *O, PyArrayObject *obs, size_t batch
   clingo_symbol_t **V = NULL;
   uint8_t **S = NULL;
 
-  V = (clingo_symbol_t**) malloc(batch*sizeof(clingo_symbol_t*));
+  V = (clingo_symbol_t**) mem_malloc(MEM_DATA, batch*sizeof(clingo_symbol_t*));
   if (!V) goto nomem;
-  S = (uint8_t**) malloc(batch*sizeof(uint8_t*));
+  S = (uint8_t**) mem_malloc(MEM_DATA, batch*sizeof(uint8_t*));
   if (!S) goto nomem;
   for (size_t i = 0; i < batch; ++i) {
-    V[i] = (clingo_symbol_t*) calloc(m, sizeof(clingo_symbol_t));
+    V[i] = (clingo_symbol_t*) mem_calloc(MEM_DATA, m, sizeof(clingo_symbol_t));
     if (!V[i]) {
-      for (size_t j = 0; j < i; ++j) { free(V[j]); free(S[j]); }
+      for (size_t j = 0; j < i; ++j) { mem_free(MEM_DATA, V[j]); mem_free(MEM_DATA, S[j]); }
       goto nomem;
     }
-    S[i] = (uint8_t*) malloc(m*sizeof(uint8_t));
+    S[i] = (uint8_t*) mem_malloc(MEM_DATA, m*sizeof(uint8_t));
     if (!S[i]) {
-      for (size_t j = 0; j < i; ++j) { free(V[j]); free(S[j]); }
-      free(V[i]);
+      for (size_t j = 0; j < i; ++j) { mem_free(MEM_DATA, V[j]); mem_free(MEM_DATA, S[j]); }
+      mem_free(MEM_DATA, V[i]);
       goto nomem;
     }
   }
@@ -139,7 +139,7 @@ bool init_dense_observations(observations_t *O, PyArrayObject *obs, size_t batch
 
   return true;
 nomem:
-  free(V); free(S);
+  mem_free(MEM_DATA, V); mem_free(MEM_DATA, S);
   O->V = NULL; O->S = NULL;
   O->batch = 0;
   goto error;
@@ -190,11 +190,16 @@ clingo_err:
 }
 
 void free_dense_observations_contents(observations_t *O) {
-  for (size_t i = 0; i < O->batch; ++i) { free(O->V[i]); free(O->S[i]); }
-  free(O->V); free(O->S);
+  for (size_t i = 0; i < O->batch; ++i) {
+    mem_free(MEM_DATA, O->V[i]); mem_free(MEM_DATA, O->S[i]);
+  }
+  mem_free(MEM_DATA, O->V); mem_free(MEM_DATA, O->S);
 }
 
-void free_dense_observations(observations_t *O) { free_dense_observations_contents(O); free(O); }
+void free_dense_observations(observations_t *O) {
+  free_dense_observations_contents(O);
+  mem_free(MEM_DATA, O);
+}
 
 bool ll2array(PyObject *ll, PyArrayObject **obs) {
   if (!PyList_Check(ll)) return false;
@@ -216,7 +221,7 @@ bool ll2array(PyObject *ll, PyArrayObject **obs) {
     m = (k > m)*k + (k <= m)*m;
   }
 
-  data = calloc(n*m*c, sizeof(char));
+  data = mem_calloc(MEM_DATA, n*m*c, sizeof(char));
   if (!data) return false;
 
   for (size_t i = 0; i < n; ++i) {
@@ -241,6 +246,6 @@ bool ll2array(PyObject *ll, PyArrayObject **obs) {
 
   return true;
 cleanup:
-  free(data);
+  mem_free(MEM_DATA, data);
   return false;
 }
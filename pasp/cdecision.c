@@ -0,0 +1,333 @@
+#include "cdecision.h"
+
+#include <math.h>
+
+#include "cutils.h"
+#include "cprofile.h"
+#include "ctrace.h"
+#include "cmem.h"
+#include "creduce.h"
+
+static bool symbol_from_python(PyObject *py_x, const char *what, clingo_symbol_t *x) {
+  PyObject *py_cl_f = NULL, *py_rep = NULL;
+  bool r = false;
+
+  py_cl_f = PyObject_GetAttrString(py_x, "cl_f");
+  if (!py_cl_f) {
+    PyErr_Format(PyExc_AttributeError, "could not access field cl_f of supposed %s object!", what);
+    goto cleanup;
+  }
+  py_rep = PyObject_GetAttrString(py_cl_f, "_rep");
+  if (!py_rep) {
+    PyErr_SetString(PyExc_AttributeError, "could not access field _rep of supposed Symbol object!");
+    goto cleanup;
+  }
+  *x = PyLong_AsUnsignedLongLong(py_rep);
+  if ((*x == (clingo_symbol_t) -1) && PyErr_Occurred()) {
+    PyErr_Format(PyExc_TypeError, "field cl_f of %s must be a Symbol!", what);
+    goto cleanup;
+  }
+  r = true;
+cleanup:
+  Py_XDECREF(py_cl_f);
+  Py_XDECREF(py_rep);
+  return r;
+}
+
+static bool from_python_utility(PyObject *py_u, utility_t *u) {
+  PyObject *py_v = NULL, *py_neg = NULL;
+  bool r = false;
+  int neg;
+
+  if (!symbol_from_python(py_u, "Utility", &u->f)) goto cleanup;
+  py_v = PyObject_GetAttrString(py_u, "v");
+  if (!py_v) {
+    PyErr_SetString(PyExc_AttributeError, "could not access field v of supposed Utility object!");
+    goto cleanup;
+  }
+  u->v = PyFloat_AsDouble(py_v);
+  if ((u->v == -1) && PyErr_Occurred()) {
+    PyErr_SetString(PyExc_TypeError, "field v of Utility must be a floating-point number!");
+    goto cleanup;
+  }
+  py_neg = PyObject_GetAttrString(py_u, "neg");
+  if (!py_neg) {
+    PyErr_SetString(PyExc_AttributeError, "could not access field neg of supposed Utility object!");
+    goto cleanup;
+  }
+  if ((neg = PyObject_IsTrue(py_neg)) < 0) goto cleanup;
+  u->neg = neg;
+  r = true;
+cleanup:
+  Py_XDECREF(py_v);
+  Py_XDECREF(py_neg);
+  return r;
+}
+
+bool from_python_decision_problem(PyObject *py_P, decision_problem_t *T) {
+  PyObject *py_U = NULL, *py_D = NULL, *py_U_L = NULL, *py_D_L = NULL;
+  bool r = false;
+
+  *T = (decision_problem_t) {0};
+  py_U = PyObject_GetAttrString(py_P, "U");
+  if (!py_U) {
+    PyErr_SetString(PyExc_AttributeError, "could not access field U of supposed Program object!");
+    goto cleanup;
+  }
+  py_D = PyObject_GetAttrString(py_P, "D");
+  if (!py_D) {
+    PyErr_SetString(PyExc_AttributeError, "could not access field D of supposed Program object!");
+    goto cleanup;
+  }
+  py_U_L = PySequence_Fast(py_U, "field Program.U must either be a list or tuple!");
+  if (!py_U_L) goto cleanup;
+  py_D_L = PySequence_Fast(py_D, "field Program.D must either be a list or tuple!");
+  if (!py_D_L) goto cleanup;
+
+  T->U_n = PySequence_Fast_GET_SIZE(py_U_L);
+  T->D_n = PySequence_Fast_GET_SIZE(py_D_L);
+  T->U = (utility_t*) mem_malloc(MEM_PROGRAM, T->U_n*sizeof(utility_t));
+  T->D = (clingo_symbol_t*) mem_malloc(MEM_PROGRAM, T->D_n*sizeof(clingo_symbol_t));
+  if ((T->U_n && !T->U) || (T->D_n && !T->D)) {
+    mem_raise("decision problem");
+    goto cleanup;
+  }
+  for (size_t i = 0; i < T->U_n; ++i)
+    if (!from_python_utility(PySequence_Fast_GET_ITEM(py_U_L, i), &T->U[i])) goto cleanup;
+  for (size_t i = 0; i < T->D_n; ++i)
+    if (!symbol_from_python(PySequence_Fast_GET_ITEM(py_D_L, i), "Decision", &T->D[i]))
+      goto cleanup;
+
+  r = true;
+cleanup:
+  if (!r) free_decision_problem_contents(T);
+  Py_XDECREF(py_U);
+  Py_XDECREF(py_D);
+  Py_XDECREF(py_U_L);
+  Py_XDECREF(py_D_L);
+  return r;
+}
+
+void free_decision_problem_contents(decision_problem_t *T) {
+  mem_free(MEM_PROGRAM, T->U);
+  mem_free(MEM_PROGRAM, T->D);
+  *T = (decision_problem_t) {0};
+}
+
+typedef struct {
+  /* Per decision assignment: probability of the total choices consistent with it, and the
+   * probability-weighted mean, minimum and maximum utility of its models. */
+  double *Z, *E, *L, *U;
+  /* Per decision assignment, for the total choice being solved: number of models, and sum, minimum
+   * and maximum utility of these models. */
+  size_t *n;
+  double *s, *lo, *hi;
+  /* Decision assignments with some model in the total choice being solved. */
+  uint32_t *seen;
+  size_t seen_n;
+  decision_problem_t *T;
+} decision_storage_t;
+
+static bool init_decision_storage(decision_storage_t *ds, decision_problem_t *T) {
+  size_t k = (size_t) 1 << T->D_n;
+  *ds = (decision_storage_t) { .T = T };
+  ds->Z = (double*) mem_calloc(MEM_STORAGE, 4*k, sizeof(double));
+  ds->n = (size_t*) mem_calloc(MEM_STORAGE, k, sizeof(size_t));
+  ds->s = (double*) mem_malloc(MEM_STORAGE, 3*k*sizeof(double));
+  ds->seen = (uint32_t*) mem_malloc(MEM_STORAGE, k*sizeof(uint32_t));
+  if (!(ds->Z && ds->n && ds->s && ds->seen)) {
+    mem_raise("decision storage");
+    return false;
+  }
+  ds->E = ds->Z + k; ds->L = ds->E + k; ds->U = ds->L + k;
+  ds->lo = ds->s + k; ds->hi = ds->lo + k;
+  return true;
+}
+
+static void free_decision_storage_contents(decision_storage_t *ds) {
+  mem_free(MEM_STORAGE, ds->Z);
+  mem_free(MEM_STORAGE, ds->n);
+  mem_free(MEM_STORAGE, ds->s);
+  mem_free(MEM_STORAGE, ds->seen);
+}
+
+static void compute_decision(void *args) {
+  struct { decision_storage_t *D; storage_t *S; } *pair = args;
+  decision_storage_t *ds = pair->D;
+  decision_problem_t *T = ds->T;
+  storage_t *st = pair->S;
+  total_choice_t *theta = &st->theta;
+  program_t *P = st->P;
+  clingo_control_t *C = NULL;
+  size_t m = 0;
+
+  TRACE_BEGIN(t_job);
+  st->fail = true;
+  uint64_t t_sched = prof_now();
+  size_t solvers = sched_solvers(st->sched);
+
+  if (!acquire_control(&st->ctl, &C, P, theta, solvers)) goto cleanup;
+
+  /* Solving. */ {
+    bool ok = false;
+    clingo_solve_handle_t *handle;
+    const clingo_model_t *M;
+
+    if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle))
+      goto solve_cleanup;
+    while (true) {
+      PROF_BEGIN(t_solve);
+      if (!clingo_solve_handle_resume(handle)) goto solve_cleanup;
+      if (!clingo_solve_handle_model(handle, &M)) goto solve_cleanup;
+      PROF_END(PROF_SOLVE, t_solve);
+      if (!M) break;
+      PROF_BEGIN(t_models);
+      uint32_t k = 0;
+      double u = 0;
+      bool c;
+      for (size_t j = 0; j < T->D_n; ++j) {
+        if (!clingo_model_contains(M, T->D[j], &c)) goto solve_cleanup;
+        if (c) k |= (uint32_t) 1 << j;
+      }
+      for (size_t j = 0; j < T->U_n; ++j) {
+        if (!clingo_model_contains(M, T->U[j].f, &c)) goto solve_cleanup;
+        if (c != T->U[j].neg) u += T->U[j].v;
+      }
+      if (!ds->n[k]++) {
+        ds->seen[ds->seen_n++] = k;
+        ds->s[k] = ds->lo[k] = ds->hi[k] = u;
+      } else {
+        ds->s[k] += u;
+        if (u < ds->lo[k]) ds->lo[k] = u;
+        if (u > ds->hi[k]) ds->hi[k] = u;
+      }
+      ++m;
+      PROF_END(PROF_MODELS, t_models);
+    }
+    ok = true;
+solve_cleanup:
+    if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
+  }
+
+  PROF_BEGIN(t_prob);
+  double p = prob_total_choice(P, theta);
+  for (size_t i = 0; i < ds->seen_n; ++i) {
+    uint32_t k = ds->seen[i];
+    ds->Z[k] += p;
+    ds->E[k] += p*ds->s[k]/ds->n[k];
+    ds->L[k] += p*ds->lo[k];
+    ds->U[k] += p*ds->hi[k];
+    ds->n[k] = 0;
+  }
+  ds->seen_n = 0;
+  PROF_END(PROF_PROB, t_prob);
+  progress_publish(st->prog, m, p);
+  st->fail = false;
+cleanup:
+  /* Leave the scratch clean for the next total choice even if this one failed. */
+  for (size_t i = 0; i < ds->seen_n; ++i) ds->n[ds->seen[i]] = 0;
+  ds->seen_n = 0;
+  release_control(&st->ctl, C);
+  sched_record(st->sched, prof_now() - t_sched, solvers);
+  TRACE_END(TRACE_JOB, t_job);
+  pthread_mutex_lock(st->wakeup);
+  st->busy_procs[st->pid] = false;
+  pthread_cond_signal(st->avail);
+  pthread_mutex_unlock(st->wakeup);
+}
+
+bool decision_enum(program_t *P, decision_problem_t *T, psemantics_t psem, double **R,
+    progress_t *pg) {
+  total_choice_t theta = {0};
+  size_t total_choice_n = get_num_facts(P);
+  size_t num_procs = estimate_nprocs(total_choice_n + P->AD_n);
+  size_t k = (size_t) 1 << T->D_n, w = psem == MAXENT_SEMANTICS ? 1 : 2;
+  bool busy_procs[NUM_PROCS] = {0};
+  decision_storage_t D[NUM_PROCS] = {{0}};
+  storage_t S[NUM_PROCS] = {{0}};
+  size_t i;
+  bool ok = false;
+  pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER, wakeup = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t avail = PTHREAD_COND_INITIALIZER;
+  threadpool pool = thpool_init(num_procs);
+  struct { decision_storage_t *D; storage_t *S; } pairs[NUM_PROCS] = {{0}};
+  sched_t sc;
+  double *X = NULL;
+
+  if (!init_total_choice(&theta, total_choice_n, P)) goto cleanup;
+  for (i = 0; i < num_procs; ++i) {
+    if (!init_decision_storage(&D[i], T)) goto cleanup;
+    S[i].pid = i; S[i].mu = &mu; S[i].wakeup = &wakeup; S[i].avail = &avail;
+    S[i].busy_procs = busy_procs;
+    S[i].P = P;
+    if (!init_total_choice(&S[i].theta, total_choice_n, P)) goto cleanup;
+    S[i].sched = &sc;
+    pairs[i].D = &D[i];
+    pairs[i].S = &S[i];
+  }
+  init_sched(&sc, num_procs, num_total_choices(P));
+  if (progress_enabled(pg)) {
+    if (!progress_begin(pg, num_procs, num_total_choices(P), 1)) goto cleanup;
+    for (i = 0; i < num_procs; ++i) S[i].prog = &pg->slots[i];
+  }
+
+  do {
+    do {
+      int id = retr_free_proc(busy_procs, num_procs, &wakeup, &avail);
+      if (!dispatch_job_with_payload(&theta, &wakeup, busy_procs, S, num_procs, pool, &avail, id,
+            compute_decision, &pairs[id])) goto cleanup;
+      sched_dispatched(&sc);
+      if (!progress_tick(pg)) goto cleanup;
+    } while (incr_total_choice_ad(&theta, P));
+  } while (incr_total_choice(&theta));
+  thpool_wait(pool);
+  if (!progress_finish(pg)) goto cleanup;
+  for (i = 0; i < num_procs; ++i) if (S[i].fail) goto cleanup;
+
+  /* Merge. */ {
+    reduce_seg_t G[NUM_PROCS];
+    for (i = 0; i < num_procs; ++i) G[i] = (reduce_seg_t) {D[i].Z, 4*k};
+    if (!reduce_sum(pool, num_procs, G, num_procs, 1, REDUCE_DOUBLE)) goto cleanup;
+  }
+
+  X = (double*) mem_malloc(MEM_RESULTS, k*w*sizeof(double));
+  if (!X) {
+    mem_raise("expected utilities");
+    goto cleanup;
+  }
+  for (i = 0; i < k; ++i) {
+    double z = D[0].Z[i];
+    if (z <= 0) {
+      for (size_t j = 0; j < w; ++j) X[i*w+j] = NAN;
+    } else if (psem == MAXENT_SEMANTICS) X[i] = D[0].E[i]/z;
+    else { X[2*i] = D[0].L[i]/z; X[2*i+1] = D[0].U[i]/z; }
+  }
+  *R = X;
+
+  ok = true;
+cleanup:
+  if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
+  free_total_choice_contents(&theta);
+  pthread_mutex_destroy(&mu);
+  pthread_mutex_destroy(&wakeup);
+  pthread_cond_destroy(&avail);
+  thpool_destroy(pool);
+  for (i = 0; i < num_procs; ++i) {
+    free_decision_storage_contents(&D[i]);
+    free_total_choice_contents(&S[i].theta);
+    free_control_pool_contents(&S[i].ctl);
+  }
+  return ok;
+}
+
+long decision_best(decision_problem_t *T, psemantics_t psem, double *R) {
+  size_t k = (size_t) 1 << T->D_n, w = psem == MAXENT_SEMANTICS ? 1 : 2;
+  long b = -1;
+  for (size_t i = 0; i < k; ++i) {
+    double *x = R + i*w;
+    if (isnan(x[0])) continue;
+    if ((b < 0) || (x[0] > R[b*w]) || ((w == 2) && (x[0] == R[b*w]) && (x[1] > R[b*w+1])))
+      b = i;
+  }
+  return b;
+}
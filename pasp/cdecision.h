@@ -0,0 +1,49 @@
+#ifndef _PASP_CDECISION
+#define _PASP_CDECISION
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <clingo.h>
+
+#include "cprogram.h"
+#include "cinf.h"
+#include "cprogress.h"
+
+/* Maximum number of decision facts; expected utilities are kept for each of the 2^n assignments. */
+#define DECISION_MAX 16
+
+typedef struct {
+  /* Atom whose truth value (or falsity, if neg) is rewarded with v. */
+  clingo_symbol_t f;
+  bool neg;
+  double v;
+} utility_t;
+
+/* Utility attributes utility(l, v). and decision facts ?::d. of a program. Decisions are choice
+ * rules {d}. of the logic program, so that every model of a total choice assigns some decision. */
+typedef struct {
+  utility_t *U;
+  size_t U_n;
+  clingo_symbol_t *D;
+  size_t D_n;
+} decision_problem_t;
+
+bool from_python_decision_problem(PyObject *py_P, decision_problem_t *T);
+void free_decision_problem_contents(decision_problem_t *T);
+
+/* Computes the expected utility of every assignment to the decisions of T from a single
+ * enumeration of the total choices of P. The utility of a model is the sum of the utilities of the
+ * literals it satisfies; the expected utility of an assignment is that of its models conditioned
+ * on the assignment being consistent. Row k of R (of 2^D_n rows) is the assignment where decision
+ * i is true iff bit i of k is set, and holds its expected utility under the maximum entropy
+ * semantics, or its lower and upper expected utilities under the credal semantics; rows of
+ * inconsistent assignments are NaN. */
+bool decision_enum(program_t *P, decision_problem_t *T, psemantics_t psem, double **R,
+    progress_t *pg);
+/* Returns the row of R with the highest expected utility (under the credal semantics, the highest
+ * lower expected utility, ties broken by the upper one), or -1 if every assignment is
+ * inconsistent. */
+long decision_best(decision_problem_t *T, psemantics_t psem, double *R);
+
+#endif
@@ -7,13 +7,28 @@
 #include "coptimize.h"
 #include "cutils.h"
 #include "cground.h"
+#include "cprofile.h"
+#include "ctrace.h"
+#include "cmem.h"
+#include "csharpsat.h"
+#include "creduce.h"
+#include "cjtree.h"
+#include "cbp.h"
+
+/* Enumeration kernels are written once as always-inlined functions over compile-time flags, and
+ * instantiated for every combination of flags. Flags are thus resolved when a kernel is selected
+ * (once per run) instead of inside the per-model loops. */
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+/* Columns (doubles) of each block of rank1_update. */
+#define RANK1_BLOCK 512
+typedef void (*kernel_t)(void*);
 
 bool setup_polynomial(array_bool_t (**Pn)[4], array_double_t (**K)[4], program_t *P) {
   size_t i;
 
-  *Pn = (array_bool_t(*)[4]) malloc(P->Q_n*sizeof(**Pn));
+  *Pn = (array_bool_t(*)[4]) mem_malloc(MEM_CREDAL, P->Q_n*sizeof(**Pn));
   if (!(*Pn)) return false;
-  *K = (array_double_t(*)[4]) malloc(P->Q_n*sizeof(**K));
+  *K = (array_double_t(*)[4]) mem_malloc(MEM_CREDAL, P->Q_n*sizeof(**K));
   if (!(*K)) return false;
 
   for (i = 0; i < P->Q_n; ++i)
@@ -24,16 +39,97 @@ bool setup_polynomial(array_bool_t (**Pn)[4], array_double_t (**K)[4], program_t
   return true;
 }
 
+void free_polynomial(array_bool_t (*Pn)[4], array_double_t (*K)[4], size_t Q_n) {
+  size_t i;
+  if (Pn) {
+    for (i = 0; i < Q_n; ++i) {
+      array_bool_free_contents(&Pn[i][0]); array_bool_free_contents(&Pn[i][1]);
+      array_bool_free_contents(&Pn[i][2]); array_bool_free_contents(&Pn[i][3]);
+    } mem_free(MEM_CREDAL, Pn);
+  } if (K) {
+    for (i = 0; i < Q_n; ++i) {
+      array_double_free_contents(&K[i][0]); array_double_free_contents(&K[i][1]);
+      array_double_free_contents(&K[i][2]); array_double_free_contents(&K[i][3]);
+    } mem_free(MEM_CREDAL, K);
+  }
+}
+
+static inline void swap_terms(bool *S, double *C, size_t m, size_t i, size_t j) {
+  double c = C[i];
+  C[i] = C[j]; C[j] = c;
+  for (size_t l = 0; l < m; ++l) { bool s = S[i*m+l]; S[i*m+l] = S[j*m+l]; S[j*m+l] = s; }
+}
+
+static void sift_terms(bool *S, double *C, size_t m, size_t i, size_t n) {
+  size_t c;
+  while ((c = 2*i+1) < n) {
+    if ((c+1 < n) && (memcmp(S+c*m, S+(c+1)*m, m) < 0)) ++c;
+    if (memcmp(S+i*m, S+c*m, m) >= 0) return;
+    swap_terms(S, C, m, i, c);
+    i = c;
+  }
+}
+
+/* Merges the like terms of polynomial S (of m variables) with coefficients C, so that each
+ * assignment of credal facts appears at most once, and gives the freed memory back. Terms are
+ * heapsorted in place, since compaction is called precisely when memory is scarce. */
+static void compact_polynomial(array_bool_t *S, array_double_t *C, size_t m) {
+  size_t n = C->n, i, k;
+  bool *s;
+  double *c;
+  if (n < 2) return;
+  for (i = n/2; i-- > 0;) sift_terms(S->d, C->d, m, i, n);
+  for (i = n-1; i > 0; --i) {
+    swap_terms(S->d, C->d, m, 0, i);
+    sift_terms(S->d, C->d, m, 0, i);
+  }
+  for (i = 1, k = 0; i < n; ++i) {
+    if (!memcmp(S->d+i*m, S->d+k*m, m)) C->d[k] += C->d[i];
+    else if (++k != i) { memcpy(S->d+k*m, S->d+i*m, m); C->d[k] = C->d[i]; }
+  }
+  S->n = (k+1)*m; C->n = k+1;
+  if ((s = (bool*) mem_realloc(MEM_CREDAL, S->d, S->n*sizeof(bool)))) S->d = s, S->c = S->n;
+  if ((c = (double*) mem_realloc(MEM_CREDAL, C->d, C->n*sizeof(double)))) C->d = c, C->c = C->n;
+}
+
+static void compact_polynomials(array_bool_t (*Pn)[4], array_double_t (*K)[4], size_t Q_n,
+    size_t m) {
+  for (size_t i = 0; i < Q_n; ++i)
+    for (size_t j = 0; j < 4; ++j) compact_polynomial(&Pn[i][j], &K[i][j], m);
+}
+
+/* Appends the term of total choice theta with coefficient p to S and C, leaving both untouched on
+ * failure. */
+static bool append_term(array_bool_t *S, array_double_t *C, total_choice_t *theta, double p,
+    size_t m) {
+  size_t n = S->n;
+  for (size_t j = 0; j < m; ++j)
+    if (!array_bool_append(S, CHOICE_IS_TRUE(theta, j))) { S->n = n; return false; }
+  if (!array_double_append(C, p)) { S->n = n; return false; }
+  return true;
+}
+
+/* Appends the term of st->theta with coefficient p to the j-th polynomial of query i. If the memory
+ * limit is reached, merges like terms of all polynomials to make room and tries once more. Must be
+ * called with st->mu held. */
+static bool add_credal_term(storage_t *st, size_t i, size_t j, double p) {
+  size_t m = st->P->CF_n;
+  if (append_term(&st->Pn[i][j], &st->K[i][j], &st->theta, p, m)) return true;
+  if (!mem_limit()) return false;
+  compact_polynomials(st->Pn, st->K, st->P->Q_n, m);
+  return append_term(&st->Pn[i][j], &st->K[i][j], &st->theta, p, m);
+}
+
 bool setup_credal(double **L_CF, double **U_CF, double **X, program_t *P) {
   size_t i;
 
-  *L_CF = (double*) malloc(P->CF_n*sizeof(double));
+  *L_CF = (double*) mem_malloc(MEM_CREDAL, P->CF_n*sizeof(double));
   if (!(*L_CF)) return false;
-  *U_CF = (double*) malloc(P->CF_n*sizeof(double));
+  *U_CF = (double*) mem_malloc(MEM_CREDAL, P->CF_n*sizeof(double));
   if (!(*U_CF)) return false;
   for (i = 0; i < P->CF_n; ++i) (*L_CF)[i] = P->CF[i].l, (*U_CF)[i] = P->CF[i].u;
 
-  *X = (double*) malloc(P->CF_n*sizeof(double));
+  *X = (double*) mem_malloc(MEM_CREDAL, P->CF_n*sizeof(double));
   if (!(*X)) return false;
 
   return true;
@@ -107,7 +203,8 @@ error:
 #define MODEL_CONTAINS_QUERY true
 #define MODEL_CONTAINS_EVI   false
 
-bool model_contains(const clingo_model_t *M, query_t *q, size_t i, bool *c, bool query_or_evi, bool is_partial) {
+KERNEL_INLINE bool model_contains(const clingo_model_t *M, query_t *q, size_t i, bool *c,
+    const bool query_or_evi, const bool is_partial) {
   clingo_symbol_t x, x_u;
   uint8_t s;
   bool c_x;
@@ -134,39 +231,44 @@ bool model_contains(const clingo_model_t *M, query_t *q, size_t i, bool *c, bool
   return true;
 }
 
-bool compute_smproblog(program_t *P, total_choice_t *theta, storage_t *st, bool *undef,
-    psemantics_t psem) {
-  if (!has_total_model(P, theta, undef)) return false;
-  *undef = !*undef;
-  /* There is an undefined atom in one of the models. */
-  if (*undef) {
-    double p = prob_total_choice(P, theta);
-    /* Under the SMProbLog semantics, if there is an undefined atom in a total choice, then all
-     * atoms must be set to undefined. */
-    for (size_t i = 0; i < P->Q_n; ++i) {
-      bool evi_all_undef = true;
-      for (size_t j = 0; j < P->Q[i].E_n; ++j)
-        evi_all_undef &= P->Q[i].E_s[j] == QUERY_TERM_UND;
-      bool que_all_undef = true, que_any_undef = false;
-      for (size_t j = 0; j < P->Q[i].Q_n; ++j) {
-        bool is_undef = P->Q[i].Q_s[j] == QUERY_TERM_UND;
-        que_all_undef &= is_undef;
-        que_any_undef |= is_undef;
-      }
-      if (psem == CREDAL_SEMANTICS) {
-        bool u = evi_all_undef && que_all_undef, v = evi_all_undef && !que_any_undef;
-        st->a[i] += u*p; st->b[i] += u*p;
-        st->c[i] += v*p; st->d[i] += v*p;
-      } else /* psem == MAXENT_SEMANTICS */ {
-        st->a[i] += (evi_all_undef && que_all_undef)*p;
-        st->b[i] += evi_all_undef*p;
-      }
+/* Accounts for a total choice with no total model under the SMProbLog semantics. */
+void compute_smproblog(program_t *P, total_choice_t *theta, storage_t *st, psemantics_t psem) {
+  double p = prob_total_choice(P, theta);
+  /* Under the SMProbLog semantics, if there is an undefined atom in a total choice, then all
+   * atoms must be set to undefined. */
+  for (size_t i = 0; i < P->Q_n; ++i) {
+    bool evi_all_undef = true;
+    for (size_t j = 0; j < P->Q[i].E_n; ++j)
+      evi_all_undef &= P->Q[i].E_s[j] == QUERY_TERM_UND;
+    bool que_all_undef = true, que_any_undef = false;
+    for (size_t j = 0; j < P->Q[i].Q_n; ++j) {
+      bool is_undef = P->Q[i].Q_s[j] == QUERY_TERM_UND;
+      que_all_undef &= is_undef;
+      que_any_undef |= is_undef;
+    }
+    if (psem == CREDAL_SEMANTICS) {
+      bool u = evi_all_undef && que_all_undef, v = evi_all_undef && !que_any_undef;
+      st->a[i] += u*p; st->b[i] += u*p;
+      st->c[i] += v*p; st->d[i] += v*p;
+    } else /* psem == MAXENT_SEMANTICS */ {
+      st->a[i] += (evi_all_undef && que_all_undef)*p;
+      st->b[i] += evi_all_undef*p;
     }
   }
-  return true;
 }
 
-void compute_total_choice(void *data) {
+/* Semantics a total choice kernel is specialized for. KSEM_PARTIAL only enumerates partial models;
+ * KSEM_LSTABLE and KSEM_SMPROBLOG first restrict the search to total models, then respectively
+ * fall back to partial models or to compute_smproblog if there are none. */
+typedef enum { KSEM_STABLE, KSEM_PARTIAL, KSEM_LSTABLE, KSEM_SMPROBLOG } kernel_sem_t;
+
+static inline kernel_sem_t kernel_semantics(program_t *P, bool lstable_sat) {
+  if (P->sem == STABLE_SEMANTICS) return KSEM_STABLE;
+  if (P->sem == SMPROBLOG_SEMANTICS) return KSEM_SMPROBLOG;
+  return (P->sem == LSTABLE_SEMANTICS && lstable_sat) ? KSEM_LSTABLE : KSEM_PARTIAL;
+}
+
+KERNEL_INLINE void _compute_total_choice(void *data, const kernel_sem_t ks, const bool has_credal) {
   storage_t *st = (storage_t*) data;
   size_t i, m;
   clingo_control_t *C = NULL;
@@ -175,31 +277,22 @@ void compute_total_choice(void *data) {
   bool *cond_1 = st->cond_1, *cond_2 = st->cond_2, *cond_3 = st->cond_3, *cond_4 = st->cond_4;
   size_t *count_q_e = st->count_q_e, *count_e = st->count_e, *count_partial_q_e = st->count_partial_q_e;
   double *a = st->a, *b = st->b, *c = st->c, *d = st->d, p;
-  array_bool_t (*Pn)[4] = st->Pn;
-  array_double_t (*K)[4] = st->K;
+  const bool is_partial = ks != KSEM_STABLE;
+  /* Whether to restrict the search to total models first. */
+  bool total = ks == KSEM_LSTABLE || ks == KSEM_SMPROBLOG;
+  clingo_literal_t total_lit;
 
+  TRACE_BEGIN(t_job);
   st->fail = true;
+  uint64_t t_sched = prof_now();
+  size_t solvers = sched_solvers(st->sched);
 
-  /* Check SAT if partial and lstable_sat. */
-  if (P->sem == LSTABLE_SEMANTICS && st->lstable_sat) {
-    bool has;
-    if (!has_total_model(P, theta, &has)) goto cleanup;
-    if (has) P = P->stable;
-  } else if (P->sem == SMPROBLOG_SEMANTICS) {
-    bool undef;
-    if (!compute_smproblog(P, theta, st, &undef, CREDAL_SEMANTICS)) goto cleanup;
-    if (undef) {
-      st->fail = false;
-      goto cleanup;
-    } else P = P->stable;
-  }
-
-  size_t CF_n = P->CF_n;
   size_t Q_n = P->Q_n, Q_n_bytes = Q_n*sizeof(size_t);
-  bool is_partial = P->sem, has_credal = P->CF_n;
 
-  if (!prepare_control(&C, P, theta, "0", false, NULL)) goto cleanup;
+  if (!acquire_control(&st->ctl, &C, P, theta, solvers)) goto cleanup;
+  if (total) if (!total_model_literal(C, &total_lit)) goto cleanup;
 
+enumerate:
   /* Zero-initialize counters and flags. */
   memset(cond_1, 0, Q_n); memset(cond_2, 0, Q_n);
   memset(cond_3, 0, Q_n); memset(cond_4, 0, Q_n);
@@ -211,15 +304,18 @@ void compute_total_choice(void *data) {
     clingo_solve_handle_t *handle;
     clingo_solve_result_bitset_t solve_ret;
     const clingo_model_t *M;
-    /* Get the solve handle. */
-    if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle))
+    /* Get the solve handle. Assuming __total_model leaves only the total models. */
+    if (!clingo_control_solve(C, clingo_solve_mode_yield, &total_lit, total, NULL, NULL, &handle))
       goto solve_error;
     /* Iterate over all stable models. */
     for (m = 0; true; ++m) {
       /* m is the number of stable models according to <P,θ>, i.e. m = |Γ(θ)|. */
+      PROF_BEGIN(t_solve);
       if (!clingo_solve_handle_resume(handle)) goto solve_error;
       if (!clingo_solve_handle_model(handle, &M)) goto solve_error;
+      PROF_END(PROF_SOLVE, t_solve);
       if (M) {
+        PROF_BEGIN(t_models);
         for (i = 0; i < Q_n; ++i) {
           size_t j;
           query_t *q = (P->Q)+i;
@@ -239,6 +335,7 @@ void compute_total_choice(void *data) {
           if (all_q) { cond_2[i] = true; ++count_q_e[i]; }
           else { cond_4[i] = true; ++count_partial_q_e[i]; }
         }
+        PROF_END(PROF_MODELS, t_models);
       } else break;
     }
     if (!clingo_solve_handle_get(handle, &solve_ret)) goto solve_error;
@@ -248,9 +345,21 @@ solve_error:
 solve_cleanup:
     if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
   }
+  if (total && m == 0) {
+    if (ks == KSEM_SMPROBLOG) {
+      compute_smproblog(P, theta, st, CREDAL_SEMANTICS);
+      progress_publish(st->prog, 0, prob_total_choice(P, theta));
+      st->fail = false;
+      goto cleanup;
+    }
+    /* No total model: fall back to the partial models of the same grounding. */
+    total = false;
+    goto enumerate;
+  }
   /* Probabilities are wrong when a total choice has no model. */
   if (m == 0) st->warn = true;
   /* Compute ℙ(θ). */
+  PROF_BEGIN(t_prob);
   p = prob_total_choice(P, theta);
   for (i = 0; i < Q_n; ++i) {
     /* Evaluate counts to judge whether cond_1 and/or cond_3 are true. */
@@ -264,21 +373,13 @@ solve_cleanup:
     if (has_credal) {
       size_t j;
       if (cond_1[i] || cond_2[i] || cond_3[i] || cond_4[i]) {
+        TRACE_BEGIN(t_lock);
         pthread_mutex_lock(st->mu);
-        if (cond_1[i]) {
-          for (j = 0; j < CF_n; ++j) if (!array_bool_append(&Pn[i][0], CHOICE_IS_TRUE(theta, j))) goto cleanup;
-          if (!array_double_append(&K[i][0], p)) goto cleanup;
-        } if (cond_2[i]) {
-          for (j = 0; j < CF_n; ++j) if (!array_bool_append(&Pn[i][1], CHOICE_IS_TRUE(theta, j))) goto cleanup;
-          if (!array_double_append(&K[i][1], p)) goto cleanup;
-        } if (cond_3[i]) {
-          for (j = 0; j < CF_n; ++j) if (!array_bool_append(&Pn[i][2], CHOICE_IS_TRUE(theta, j))) goto cleanup;
-          if (!array_double_append(&K[i][2], p)) goto cleanup;
-        } if (cond_4[i]) {
-          for (j = 0; j < CF_n; ++j) if (!array_bool_append(&Pn[i][3], CHOICE_IS_TRUE(theta, j))) goto cleanup;
-          if (!array_double_append(&K[i][3], p)) goto cleanup;
-        }
+        TRACE_END(TRACE_LOCK, t_lock);
+        bool conds[4] = {cond_1[i], cond_2[i], cond_3[i], cond_4[i]};
+        for (j = 0; j < 4; ++j) if (conds[j] && !add_credal_term(st, i, j, p)) break;
         pthread_mutex_unlock(st->mu);
+        if (j < 4) goto cleanup;
       }
     } else {
       a[i] += cond_1[i]*p;
@@ -288,16 +389,65 @@ solve_cleanup:
     }
   }
 
+  PROF_END(PROF_PROB, t_prob);
+  progress_publish(st->prog, m, p);
   st->fail = false;
 cleanup:
-  clingo_control_free(C);
+  release_control(&st->ctl, C);
+  sched_record(st->sched, prof_now() - t_sched, solvers);
+  TRACE_END(TRACE_JOB, t_job);
   pthread_mutex_lock(st->wakeup);
   st->busy_procs[st->pid] = false;
   pthread_cond_signal(st->avail);
   pthread_mutex_unlock(st->wakeup);
 }
 
-void compute_total_choice_maxent(void *data) {
+/* Counts the models of the program grounded by C (m), and of each query's evidence (count_e) and
+ * query and evidence (count_q_e), with the #SAT engine S. */
+static bool sharpsat_query_counts(sharpsat_t *S, clingo_control_t *C, program_t *P, size_t *m,
+    size_t *count_q_e, size_t *count_e) {
+  size_t n = 0;
+  clingo_literal_t *A = NULL, l;
+  double c;
+  bool ok = false, h;
+
+  for (size_t i = 0; i < P->Q_n; ++i)
+    if (P->Q[i].Q_n + P->Q[i].E_n > n) n = P->Q[i].Q_n + P->Q[i].E_n;
+  A = (clingo_literal_t*) mem_malloc(MEM_STORAGE, (n ? n : 1)*sizeof(clingo_literal_t));
+  if (!A) {
+    clingo_set_error(clingo_error_bad_alloc, "could not allocate memory for model counting!");
+    return false;
+  }
+  if ((c = sharpsat_count(S, NULL, 0)) < 0) goto cleanup;
+  *m = (size_t) c;
+  for (size_t i = 0; i < P->Q_n; ++i) {
+    query_t *q = P->Q+i;
+    size_t k = 0;
+    /* Whether some literal never holds. */
+    bool never = false;
+    for (size_t j = 0; j < q->E_n; ++j) {
+      if (!sharpsat_literal(C, q->E[j], q->E_s[j], &l, &h)) goto cleanup;
+      if (l) A[k++] = l; else never |= !h;
+    }
+    count_e[i] = count_q_e[i] = 0;
+    if (never) continue;
+    if ((c = sharpsat_count(S, A, k)) < 0) goto cleanup;
+    count_e[i] = (size_t) c;
+    for (size_t j = 0; j < q->Q_n; ++j) {
+      if (!sharpsat_literal(C, q->Q[j], q->Q_s[j], &l, &h)) goto cleanup;
+      if (l) A[k++] = l; else never |= !h;
+    }
+    if (never) continue;
+    if ((c = sharpsat_count(S, A, k)) < 0) goto cleanup;
+    count_q_e[i] = (size_t) c;
+  }
+  ok = true;
+cleanup:
+  mem_free(MEM_STORAGE, A);
+  return ok;
+}
+
+KERNEL_INLINE void _compute_total_choice_maxent(void *data, const kernel_sem_t ks) {
   storage_t *st = (storage_t*) data;
   size_t i, m;
   clingo_control_t *C = NULL;
@@ -305,27 +455,36 @@ void compute_total_choice_maxent(void *data) {
   total_choice_t *theta = &st->theta;
   size_t *count_q_e = st->count_q_e, *count_e = st->count_e;
   double *a = st->a, *b = st->b, p;
+  const bool is_partial = ks != KSEM_STABLE;
+  bool total = ks == KSEM_LSTABLE || ks == KSEM_SMPROBLOG;
+  clingo_literal_t total_lit;
 
+  TRACE_BEGIN(t_job);
   st->fail = true;
-
-  if (P->sem == LSTABLE_SEMANTICS && st->lstable_sat) {
-    bool has;
-    if (!has_total_model(P, theta, &has)) goto cleanup;
-    if (has) P = P->stable;
-  } else if (P->sem == SMPROBLOG_SEMANTICS) {
-    bool undef;
-    if (!compute_smproblog(P, theta, st, &undef, MAXENT_SEMANTICS)) goto cleanup;
-    if (undef) {
-      st->fail = false;
-      goto cleanup;
-    } else P = P->stable;
-  }
+  uint64_t t_sched = prof_now();
+  size_t solvers = sched_solvers(st->sched);
 
   size_t Q_n = P->Q_n, Q_n_bytes = Q_n*sizeof(size_t);
-  bool is_partial = P->sem;
+  /* The #SAT engine only covers the stable semantics. */
+  bool sharp = st->sharpsat && !is_partial;
+  sharpsat_t sh = {0};
 
-  if (!prepare_control(&C, P, theta, "0", false, NULL)) goto cleanup;
+  if (sharp) if (!init_sharpsat(&sh)) goto cleanup;
+  if (!prepare_control_observed(&C, P, theta, "0", solvers, sharp ? &SHARPSAT_OBSERVER : NULL,
+        &sh))
+    goto cleanup;
+  if (total) if (!total_model_literal(C, &total_lit)) goto cleanup;
+  if (sharp) {
+    if (!sharpsat_compile(&sh)) goto cleanup;
+    if (sh.ok) {
+      PROF_BEGIN(t_count);
+      if (!sharpsat_query_counts(&sh, C, P, &m, count_q_e, count_e)) goto cleanup;
+      PROF_END(PROF_SOLVE, t_count);
+      goto counted;
+    }
+  }
 
+enumerate:
   memset(count_q_e, 0, Q_n_bytes);
   memset(count_e, 0, Q_n_bytes);
   /* Solving. */ {
@@ -334,13 +493,16 @@ void compute_total_choice_maxent(void *data) {
     clingo_solve_result_bitset_t solve_ret;
     const clingo_model_t *M;
 
-    if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle))
+    if (!clingo_control_solve(C, clingo_solve_mode_yield, &total_lit, total, NULL, NULL, &handle))
       goto solve_error;
 
     for (m = 0; true; ++m) {
+      PROF_BEGIN(t_solve);
       if (!clingo_solve_handle_resume(handle)) goto solve_error;
       if (!clingo_solve_handle_model(handle, &M)) goto solve_error;
+      PROF_END(PROF_SOLVE, t_solve);
       if (M) {
+        PROF_BEGIN(t_models);
         for (i = 0; i < Q_n; ++i) {
           size_t j;
           query_t *q = (P->Q)+i;
@@ -357,6 +519,7 @@ void compute_total_choice_maxent(void *data) {
           ++count_e[i];
           if (all_q) ++count_q_e[i];
         }
+        PROF_END(PROF_MODELS, t_models);
       } else break;
     }
     if (!clingo_solve_handle_get(handle, &solve_ret)) goto solve_error;
@@ -366,24 +529,524 @@ solve_error:
 solve_cleanup:
     if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
   }
+counted:
+  if (total && m == 0) {
+    if (ks == KSEM_SMPROBLOG) {
+      compute_smproblog(P, theta, st, MAXENT_SEMANTICS);
+      progress_publish(st->prog, 0, prob_total_choice(P, theta));
+      st->fail = false;
+      goto cleanup;
+    }
+    total = false;
+    goto enumerate;
+  }
   /* Probabilities are wrong when a total choice has no model. */
   if (m == 0) st->warn = true;
+  PROF_BEGIN(t_prob);
   p = prob_total_choice(P, theta);
   for (i = 0; i < Q_n; ++i) {
     a[i] += (count_q_e[i]*p)/m;
     b[i] += (count_e[i]*p)/m;
   }
 
+  PROF_END(PROF_PROB, t_prob);
+  progress_publish(st->prog, m, p);
   st->fail = false;
 cleanup:
+  PROF_CLINGO(C);
   clingo_control_free(C);
+  free_sharpsat_contents(&sh);
+  sched_record(st->sched, prof_now() - t_sched, solvers);
+  TRACE_END(TRACE_JOB, t_job);
   pthread_mutex_lock(st->wakeup);
   st->busy_procs[st->pid] = false;
   pthread_cond_signal(st->avail);
   pthread_mutex_unlock(st->wakeup);
 }
 
-bool exact_enum(program_t *P, double **R, bool lstable_sat, psemantics_t psem, bool quiet) {
+#define TOTAL_CHOICE_KERNEL(name, ks, has_credal) \
+  static void name(void *data) { _compute_total_choice(data, ks, has_credal); }
+#define TOTAL_CHOICE_MAXENT_KERNEL(name, ks) \
+  static void name(void *data) { _compute_total_choice_maxent(data, ks); }
+
+TOTAL_CHOICE_KERNEL(compute_total_choice_stable, KSEM_STABLE, false)
+TOTAL_CHOICE_KERNEL(compute_total_choice_stable_credal, KSEM_STABLE, true)
+TOTAL_CHOICE_KERNEL(compute_total_choice_partial, KSEM_PARTIAL, false)
+TOTAL_CHOICE_KERNEL(compute_total_choice_partial_credal, KSEM_PARTIAL, true)
+TOTAL_CHOICE_KERNEL(compute_total_choice_lstable, KSEM_LSTABLE, false)
+TOTAL_CHOICE_KERNEL(compute_total_choice_lstable_credal, KSEM_LSTABLE, true)
+TOTAL_CHOICE_KERNEL(compute_total_choice_smproblog, KSEM_SMPROBLOG, false)
+TOTAL_CHOICE_KERNEL(compute_total_choice_smproblog_credal, KSEM_SMPROBLOG, true)
+TOTAL_CHOICE_MAXENT_KERNEL(compute_total_choice_maxent_stable, KSEM_STABLE)
+TOTAL_CHOICE_MAXENT_KERNEL(compute_total_choice_maxent_partial, KSEM_PARTIAL)
+TOTAL_CHOICE_MAXENT_KERNEL(compute_total_choice_maxent_lstable, KSEM_LSTABLE)
+TOTAL_CHOICE_MAXENT_KERNEL(compute_total_choice_maxent_smproblog, KSEM_SMPROBLOG)
+
+/* Unspecialized kernels, which read the semantics and credal facts of each total choice at run
+ * time, as all kernels did before specialization. Only used under GENERIC_KERNELS_ENV. */
+static void compute_total_choice_generic(void *data) {
+  storage_t *st = (storage_t*) data;
+  _compute_total_choice(data, kernel_semantics(st->P, st->lstable_sat), st->P->CF_n > 0);
+}
+static void compute_total_choice_maxent_generic(void *data) {
+  storage_t *st = (storage_t*) data;
+  _compute_total_choice_maxent(data, kernel_semantics(st->P, st->lstable_sat));
+}
+
+bool generic_kernels_enabled(void) {
+  const char *e = getenv(GENERIC_KERNELS_ENV);
+  return e && !strcmp(e, "1");
+}
+
+/* Picks the specialized total choice kernel for P under psem and lstable_sat, indexed by
+ * [kernel_semantics][has_credal]. */
+static kernel_t select_total_choice_kernel(program_t *P, psemantics_t psem, bool lstable_sat) {
+  static const kernel_t credal[4][2] = {
+    {compute_total_choice_stable, compute_total_choice_stable_credal},
+    {compute_total_choice_partial, compute_total_choice_partial_credal},
+    {compute_total_choice_lstable, compute_total_choice_lstable_credal},
+    {compute_total_choice_smproblog, compute_total_choice_smproblog_credal},
+  };
+  static const kernel_t maxent[4] = {
+    compute_total_choice_maxent_stable, compute_total_choice_maxent_partial,
+    compute_total_choice_maxent_lstable, compute_total_choice_maxent_smproblog,
+  };
+  kernel_sem_t ks = kernel_semantics(P, lstable_sat);
+  if (psem == MAXENT_SEMANTICS)
+    return generic_kernels_enabled() ? compute_total_choice_maxent_generic : maxent[ks];
+  return generic_kernels_enabled() ? compute_total_choice_generic : credal[ks][P->CF_n > 0];
+}
+
+void print_answers(program_t *P, double *I, psemantics_t psem, bool quiet) {
+  size_t sem_stride = psem == MAXENT_SEMANTICS ? 1 : 2;
+  for (size_t i = 0; i < P->Q_n; ++i) {
+    size_t i_l = i*sem_stride, i_u = i_l+1;
+    if (psem != MAXENT_SEMANTICS && I[i_l] == -INFINITY) fputws(L"Fail: ℙ(E) = 0!\n", stdout);
+    if (!quiet) {
+      print_query(P->Q+i);
+      if (psem == MAXENT_SEMANTICS) wprintf(L" = %f\n", I[i_l]);
+      else wprintf(L" = [%f, %f]\n", I[i_l], I[i_u]);
+    }
+  }
+  if (!quiet) fputws(L"---\n", stdout);
+}
+
+/* Answers every query of P from the accumulated a, b, c and d (sharp) or polynomials Pn and
+ * coefficients K (credal), writing the results to I. */
+static void answer_queries(program_t *P, double *I, double *a, double *b, double *c, double *d,
+    array_bool_t (*Pn)[4], array_double_t (*K)[4], double *X, double *L_CF, double *U_CF,
+    psemantics_t psem, bool quiet) {
+  bool has_credal = P->CF_n > 0;
+  size_t Q_n = P->Q_n, i;
+  /* If credal, then 2: lower and upper; else, then 1: sharp probability. */
+  size_t sem_stride = psem == MAXENT_SEMANTICS ? 1 : 2;
+  for (i = 0; i < Q_n; ++i) {
+    size_t i_l = i*sem_stride;
+    size_t i_u = i_l+1;
+    if (has_credal) {
+      if (P->Q[i].E_n == 0) {
+        double _a, _b;
+        bf(X, Pn[i][0].d, Pn[i][1].d, K[i][0].d, K[i][1].d, L_CF, U_CF, K[i][0].n, K[i][1].n,
+            P->CF_n, &_a, &_b, true);
+        I[i_l] = _a, I[i_u] = _b;
+      } else {
+        size_t _a = K[i][0].n, _b = K[i][1].n, _c = K[i][2].n, _d = K[i][3].n;
+        if (_b + _d == 0) {
+          I[i_l] = -INFINITY, I[i_u] = INFINITY;
+        } else {
+          if ((_b + _c == 0) && (_d > 0)) I[i_l] = 0, I[i_u] = 0;
+          else if ((_a + _d == 0) && (_b > 0)) I[i_l] = 1, I[i_u] = 1;
+          else {
+            double min, max;
+            bf_minmax(X, Pn[i][0].d, Pn[i][1].d, Pn[i][2].d, Pn[i][3].d, K[i][0].d, K[i][1].d,
+                K[i][2].d, K[i][3].d, L_CF, U_CF, _a, _b, _c, _d, P->CF_n, &min, &max);
+            I[i_l] = min, I[i_u] = max;
+          }
+        }
+      }
+    } else {
+      if (psem == MAXENT_SEMANTICS) I[i_l] = a[i]/b[i];
+      else {
+        double _a = a[i], _b = b[i], _c = c[i], _d = d[i];
+        if (P->Q[i].E_n == 0) I[i_l] = _a, I[i_u] = _b;
+        else {
+          if (_b + _d == 0) {
+            I[i_l] = -INFINITY, I[i_u] = INFINITY;
+          } else {
+            if ((_b + _c == 0) && (_d > 0)) I[i_l] = 0, I[i_u] = 0;
+            else if ((_a + _d == 0) && (_b > 0)) I[i_l] = 1, I[i_u] = 1;
+            else I[i_l] = _a/(_a + _d), I[i_u] = _b/(_b + _c);
+          }
+        }
+      }
+    }
+  }
+  print_answers(P, I, psem, quiet);
+}
+
+/* Writes the state of an exact enumeration to a checkpoint: the current data stride ds, the last
+ * dispatched total choice theta, results for the previous ds strides in R and either the per-thread
+ * accumulators in S or the shared polynomials Pn and coefficients K. Must only be called when all
+ * jobs have finished. */
+static bool save_exact_checkpoint(checkpoint_t *ck, program_t *P, psemantics_t psem,
+    bool lstable_sat, size_t ds, total_choice_t *theta, double *R, size_t r_n, storage_t *S,
+    size_t num_procs, array_bool_t (*Pn)[4], array_double_t (*K)[4]) {
+  uint64_t u_ds = ds, u_procs = num_procs;
+  uint8_t warn = 0;
+  size_t i, j, Q_n = P->Q_n;
+  FILE *f = checkpoint_open_write(ck, P, CHECKPOINT_KIND_EXACT);
+  if (!f) return false;
+  if (!checkpoint_write_run(f, P, psem, lstable_sat)) {
+    fclose(f);
+    return false;
+  }
+  for (i = 0; i < num_procs; ++i) warn |= S[i].warn;
+  checkpoint_write(f, &u_ds, sizeof(uint64_t));
+  checkpoint_write_total_choice(f, theta);
+  checkpoint_write(f, &warn, sizeof(uint8_t));
+  checkpoint_write(f, R, r_n*sizeof(double));
+  if (!P->CF_n) {
+    checkpoint_write(f, &u_procs, sizeof(uint64_t));
+    for (i = 0; i < num_procs; ++i) {
+      checkpoint_write(f, S[i].a, Q_n*sizeof(double)); checkpoint_write(f, S[i].b, Q_n*sizeof(double));
+      checkpoint_write(f, S[i].c, Q_n*sizeof(double)); checkpoint_write(f, S[i].d, Q_n*sizeof(double));
+    }
+  } else {
+    for (i = 0; i < Q_n; ++i)
+      for (j = 0; j < 4; ++j) {
+        checkpoint_write_array(f, Pn[i][j].d, Pn[i][j].n, sizeof(bool));
+        checkpoint_write_array(f, K[i][j].d, K[i][j].n, sizeof(double));
+      }
+  }
+  return checkpoint_commit(ck, f);
+}
+
+/* Restores the state written by save_exact_checkpoint. If the checkpoint was written with a
+ * different number of threads, accumulators are folded round-robin into the available ones. */
+static bool load_exact_checkpoint(checkpoint_t *ck, program_t *P, psemantics_t psem,
+    bool lstable_sat, size_t *ds, total_choice_t *theta, double *R, size_t sem_stride, storage_t *S,
+    size_t num_procs, array_bool_t (*Pn)[4], array_double_t (*K)[4]) {
+  uint64_t u_ds, u_procs;
+  uint8_t warn;
+  size_t i, j, l, Q_n = P->Q_n;
+  bool ok = false;
+  double *T = NULL;
+  FILE *f = checkpoint_open_read(ck, P, CHECKPOINT_KIND_EXACT);
+  if (!f) return false;
+  if (!checkpoint_check_run(f, P, psem, lstable_sat)) goto cleanup;
+  if (!checkpoint_read(f, &u_ds, sizeof(uint64_t))) goto cleanup;
+  if (!checkpoint_read_total_choice(f, theta)) goto cleanup;
+  if (!checkpoint_read(f, &warn, sizeof(uint8_t))) goto cleanup;
+  if (!checkpoint_read(f, R, u_ds*Q_n*sem_stride*sizeof(double))) goto cleanup;
+  S[0].warn = warn;
+  if (!P->CF_n) {
+    if (!checkpoint_read(f, &u_procs, sizeof(uint64_t))) goto cleanup;
+    T = (double*) mem_malloc(MEM_STORAGE, 4*Q_n*sizeof(double));
+    if (!T) {
+      mem_raise("checkpoint");
+      goto cleanup;
+    }
+    for (i = 0; i < u_procs; ++i) {
+      storage_t *s = &S[i % num_procs];
+      if (!checkpoint_read(f, T, 4*Q_n*sizeof(double))) goto cleanup;
+      for (l = 0; l < Q_n; ++l) {
+        s->a[l] += T[l]; s->b[l] += T[Q_n+l];
+        s->c[l] += T[2*Q_n+l]; s->d[l] += T[3*Q_n+l];
+      }
+    }
+  } else {
+    for (i = 0; i < Q_n; ++i)
+      for (j = 0; j < 4; ++j) {
+        if (!checkpoint_read_array(f, (void**) &Pn[i][j].d, &Pn[i][j].n, &Pn[i][j].c, sizeof(bool)))
+          goto cleanup;
+        if (!checkpoint_read_array(f, (void**) &K[i][j].d, &K[i][j].n, &K[i][j].c, sizeof(double)))
+          goto cleanup;
+      }
+  }
+  *ds = u_ds;
+  ok = true;
+cleanup:
+  mem_free(MEM_STORAGE, T);
+  fclose(f);
+  return ok;
+}
+
+/* Writes the aggregates of block p to shard file f, resetting them for the next block. Sharp
+ * aggregates are summed over threads into T (of size 4*Q_n); credal polynomials are written as is. */
+static bool write_shard_block(FILE *f, program_t *P, uint64_t p, storage_t *S, size_t num_procs,
+    array_bool_t (*Pn)[4], array_double_t (*K)[4], double *T) {
+  size_t i, j, Q_n = P->Q_n;
+  if (!checkpoint_write(f, &p, sizeof(uint64_t))) return false;
+  if (!P->CF_n) {
+    size_t s = Q_n*sizeof(double);
+    memset(T, 0, 4*s);
+    for (i = 0; i < num_procs; ++i) {
+      for (j = 0; j < Q_n; ++j) {
+        T[j] += S[i].a[j]; T[Q_n+j] += S[i].b[j];
+        T[2*Q_n+j] += S[i].c[j]; T[3*Q_n+j] += S[i].d[j];
+      }
+      memset(S[i].a, 0, s); memset(S[i].b, 0, s);
+      memset(S[i].c, 0, s); memset(S[i].d, 0, s);
+    }
+    return checkpoint_write(f, T, 4*s);
+  }
+  for (i = 0; i < Q_n; ++i)
+    for (j = 0; j < 4; ++j) {
+      if (!checkpoint_write_array(f, Pn[i][j].d, Pn[i][j].n, sizeof(bool))) return false;
+      if (!checkpoint_write_array(f, K[i][j].d, K[i][j].n, sizeof(double))) return false;
+      array_bool_clear(&Pn[i][j]); array_double_clear(&K[i][j]);
+    }
+  return true;
+}
+
+/* Enumerates the blocks of shard sh, writing their aggregates to sh->path. */
+static bool enum_shard(shard_t *sh, program_t *P, psemantics_t psem, bool lstable_sat,
+    total_choice_t *theta, size_t total_choice_n, storage_t *S, size_t num_procs, threadpool pool,
+    bool *busy_procs, pthread_mutex_t *wakeup, pthread_cond_t *avail, kernel_t compute_func,
+    array_bool_t (*Pn)[4], array_double_t (*K)[4]) {
+  size_t b = total_choice_n < SHARD_BLOCK_BITS ? total_choice_n : SHARD_BLOCK_BITS;
+  size_t lo = total_choice_n - b, l;
+  uint64_t B = (uint64_t) 1 << b, p, j;
+  uint64_t H[4] = {B, sh->k, sh->i, sh->i < B ? (B - sh->i + sh->k - 1)/sh->k : 0};
+  uint8_t warn = 0;
+  double *T = NULL;
+  checkpoint_t ck;
+  FILE *f;
+
+  if (lo >= 64) {
+    PyErr_SetString(PyExc_ValueError, "too many probabilistic facts to enumerate in shards!");
+    return false;
+  }
+  T = (double*) mem_malloc(MEM_STORAGE, 4*P->Q_n*sizeof(double));
+  if (!T) {
+    mem_raise("shard");
+    return false;
+  }
+  init_checkpoint(&ck, sh->path, NULL, 0);
+  if (!(f = checkpoint_open_write(&ck, P, CHECKPOINT_KIND_SHARD))) goto error;
+  /* Record the run settings, so that exact_merge refuses shards of a different program. */
+  if (!checkpoint_write_run(f, P, psem, lstable_sat)) goto error_close;
+  checkpoint_write(f, H, sizeof(H));
+
+  for (p = sh->i; p < B; p += sh->k) {
+    /* Fix the last b facts to the block index and enumerate the remaining lo facts. */
+    for (l = 0; l < b; ++l) bitvec_SET(&theta->pf, lo + l, (p >> l) & 1);
+    for (j = 0; j < ((uint64_t) 1 << lo); ++j) {
+      for (l = 0; l < lo; ++l) bitvec_SET(&theta->pf, l, (j >> l) & 1);
+      do {
+        if (!dispatch_job(theta, wakeup, busy_procs, S, num_procs, pool, avail, compute_func))
+          goto error_close;
+      } while (incr_total_choice_ad(theta, P));
+    }
+    thpool_wait(pool);
+    if (!write_shard_block(f, P, p, S, num_procs, Pn, K, T)) goto error_close;
+    if (PyErr_CheckSignals()) goto error_close;
+  }
+  for (l = 0; l < num_procs; ++l) warn |= S[l].warn;
+  checkpoint_write(f, &warn, sizeof(uint8_t));
+
+  mem_free(MEM_STORAGE, T);
+  return checkpoint_commit(&ck, f);
+error_close:
+  thpool_wait(pool);
+  fclose(f);
+error:
+  mem_free(MEM_STORAGE, T);
+  return false;
+}
+
+bool exact_merge(program_t *P, const char **paths, size_t n, double **R, psemantics_t psem,
+    bool lstable_sat, bool quiet) {
+  bool ok = false, warn = false, has_credal = P->CF_n > 0;
+  size_t Q_n = P->Q_n, l, q, j, m;
+  uint64_t B = 0, k = 0, p;
+  bool *seen = NULL, *present = NULL;
+  /* Sharp aggregates of each block, or credal polynomials and coefficients of each block. */
+  double *T = NULL;
+  array_bool_t (*T_Pn)[4] = NULL;
+  array_double_t (*T_K)[4] = NULL;
+  /* Merged aggregates. */
+  double *A = NULL, *X, *L_CF, *U_CF = L_CF = X = NULL;
+  array_bool_t (*Pn)[4] = NULL;
+  array_double_t (*K)[4] = NULL;
+  FILE *f = NULL;
+
+  if (!n) {
+    PyErr_SetString(PyExc_ValueError, "no shards to merge!");
+    return false;
+  }
+
+  for (l = 0; l < n; ++l) {
+    checkpoint_t ck;
+    uint64_t H[4];
+    uint8_t s_warn;
+    init_checkpoint(&ck, NULL, paths[l], 0);
+    if (!(f = checkpoint_open_read(&ck, P, CHECKPOINT_KIND_SHARD))) goto cleanup;
+    if (!checkpoint_check_run(f, P, psem, lstable_sat) || !checkpoint_read(f, H, sizeof(H)))
+      goto cleanup;
+    if (!l) {
+      B = H[0]; k = H[1];
+      if (k != n) {
+        PyErr_Format(PyExc_ValueError, "expected %zu shards, got %zu!", (size_t) k, n);
+        goto cleanup;
+      }
+      seen = (bool*) mem_calloc(MEM_STORAGE, k, sizeof(bool));
+      present = (bool*) mem_calloc(MEM_STORAGE, B, sizeof(bool));
+      if (!(seen && present)) goto nomem;
+      if (has_credal) {
+        T_Pn = (array_bool_t(*)[4]) mem_calloc(MEM_CREDAL, B*Q_n, sizeof(*T_Pn));
+        T_K = (array_double_t(*)[4]) mem_calloc(MEM_CREDAL, B*Q_n, sizeof(*T_K));
+        if (!(T_Pn && T_K)) goto nomem;
+      } else {
+        T = (double*) mem_calloc(MEM_STORAGE, B*4*Q_n, sizeof(double));
+        if (!T) goto nomem;
+      }
+    } else if ((H[0] != B) || (H[1] != k)) {
+      PyErr_SetString(PyExc_ValueError, "shards were not written by the same sharded run!");
+      goto cleanup;
+    }
+    if ((H[2] >= k) || seen[H[2]]) {
+      PyErr_SetString(PyExc_ValueError, "duplicate or out of range shard!");
+      goto cleanup;
+    }
+    seen[H[2]] = true;
+    for (m = 0; m < H[3]; ++m) {
+      if (!checkpoint_read(f, &p, sizeof(uint64_t))) goto cleanup;
+      if ((p >= B) || present[p]) {
+        PyErr_SetString(PyExc_ValueError, "shard is corrupted!");
+        goto cleanup;
+      }
+      present[p] = true;
+      if (has_credal) {
+        for (q = 0; q < Q_n; ++q)
+          for (j = 0; j < 4; ++j) {
+            array_bool_t *a = &T_Pn[p*Q_n+q][j];
+            array_double_t *b = &T_K[p*Q_n+q][j];
+            if (!checkpoint_read_array(f, (void**) &a->d, &a->n, &a->c, sizeof(bool))) goto cleanup;
+            if (!checkpoint_read_array(f, (void**) &b->d, &b->n, &b->c, sizeof(double))) goto cleanup;
+          }
+      } else if (!checkpoint_read(f, T + p*4*Q_n, 4*Q_n*sizeof(double))) goto cleanup;
+    }
+    if (!checkpoint_read(f, &s_warn, sizeof(uint8_t))) goto cleanup;
+    warn |= s_warn;
+    fclose(f); f = NULL;
+  }
+  for (p = 0; p < B; ++p)
+    if (!present[p]) {
+      PyErr_SetString(PyExc_ValueError, "shards do not cover the whole total choice space!");
+      goto cleanup;
+    }
+
+  /* Merge blocks in block order, so that the result is independent of the number of shards. */
+  A = (double*) mem_calloc(MEM_STORAGE, 4*Q_n, sizeof(double));
+  if (!A) goto nomem;
+  if (has_credal) {
+    if (!setup_credal(&L_CF, &U_CF, &X, P)) goto nomem;
+    if (!setup_polynomial(&Pn, &K, P)) goto nomem;
+    for (p = 0; p < B; ++p)
+      for (q = 0; q < Q_n; ++q)
+        for (j = 0; j < 4; ++j) {
+          array_bool_t *a = &T_Pn[p*Q_n+q][j];
+          array_double_t *b = &T_K[p*Q_n+q][j];
+          for (m = 0; m < a->n; ++m) if (!array_bool_append(&Pn[q][j], a->d[m])) goto nomem;
+          for (m = 0; m < b->n; ++m) if (!array_double_append(&K[q][j], b->d[m])) goto nomem;
+        }
+  } else {
+    for (p = 0; p < B; ++p)
+      for (j = 0; j < 4*Q_n; ++j) A[j] += T[p*4*Q_n+j];
+  }
+
+  *R = (double*) mem_malloc(MEM_RESULTS, Q_n*(psem == MAXENT_SEMANTICS ? 1 : 2)*sizeof(double));
+  if (!*R) goto nomem;
+  answer_queries(P, *R, A, A+Q_n, A+2*Q_n, A+3*Q_n, Pn, K, X, L_CF, U_CF, psem, quiet);
+  if (warn)
+    fputws(L"Warning: found total choice with no model. Probabilities may be incorrect.\n", stdout);
+
+  ok = true;
+  goto cleanup;
+nomem:
+  mem_raise("merging shards");
+cleanup:
+  if (f) fclose(f);
+  mem_free(MEM_STORAGE, seen); mem_free(MEM_STORAGE, present); mem_free(MEM_STORAGE, T);
+  mem_free(MEM_STORAGE, A);
+  free_polynomial(T_Pn, T_K, B*Q_n);
+  free_polynomial(Pn, K, Q_n);
+  mem_free(MEM_CREDAL, X); mem_free(MEM_CREDAL, L_CF); mem_free(MEM_CREDAL, U_CF);
+  return ok;
+}
+
+/* Answers the queries of P into *R from ℙ(Q_i | E_i) in q[i] and whether ℙ(E_i) > 0 in e[i], for
+ * programs whose total choices each have a single model. */
+static bool answer_single_model(program_t *P, double *q, bool *e, double **R, psemantics_t psem,
+    bool quiet) {
+  size_t Q_n = P->Q_n, sem_stride = psem == MAXENT_SEMANTICS ? 1 : 2;
+  double *A = (double*) mem_malloc(MEM_STORAGE, (Q_n ? Q_n : 1)*4*sizeof(double)), *I = NULL;
+
+  if (!A) {
+    mem_raise("single model queries");
+    return false;
+  }
+  /* Each total choice has a single model, so lower and upper probabilities coincide. */
+  double *a = A, *b = a + Q_n, *c = b + Q_n, *d = c + Q_n;
+  for (size_t i = 0; i < Q_n; ++i) {
+    double p_e = e[i] ? 1 : 0;
+    if (psem == MAXENT_SEMANTICS) a[i] = q[i]*p_e, b[i] = p_e;
+    else a[i] = b[i] = q[i]*p_e, c[i] = d[i] = (1-q[i])*p_e;
+  }
+  I = (double*) mem_malloc(MEM_RESULTS, (Q_n ? Q_n : 1)*sem_stride*sizeof(double));
+  if (!I) {
+    mem_free(MEM_STORAGE, A);
+    mem_raise("exact result");
+    return false;
+  }
+  answer_queries(P, I, a, b, c, d, NULL, NULL, NULL, NULL, NULL, psem, quiet);
+  *R = I;
+  mem_free(MEM_STORAGE, A);
+  return true;
+}
+
+bool exact_jtree(program_t *P, double **R, psemantics_t psem, bool quiet, bool *done) {
+  size_t Q_n = P->Q_n;
+  double *q = (double*) mem_malloc(MEM_STORAGE, (Q_n ? Q_n : 1)*sizeof(double));
+  bool *e = (bool*) mem_malloc(MEM_STORAGE, Q_n ? Q_n : 1), ok = false;
+
+  *done = false;
+  if (!q || !e) {
+    mem_raise("junction tree queries");
+    goto cleanup;
+  }
+  if (!jtree_query(P, q, e, done)) goto cleanup;
+  if (*done && !answer_single_model(P, q, e, R, psem, quiet)) goto cleanup;
+
+  ok = true;
+cleanup:
+  mem_free(MEM_STORAGE, q); mem_free(MEM_STORAGE, e);
+  return ok;
+}
+
+bool approx_bp(program_t *P, double **R, psemantics_t psem, double damping, size_t max_iters,
+    double tol, bool quiet, bool *done, size_t *iters, bool *converged) {
+  size_t Q_n = P->Q_n;
+  double *q = (double*) mem_malloc(MEM_STORAGE, (Q_n ? Q_n : 1)*sizeof(double));
+  bool *e = (bool*) mem_malloc(MEM_STORAGE, Q_n ? Q_n : 1), ok = false;
+
+  *done = false;
+  if (!q || !e) {
+    mem_raise("belief propagation queries");
+    goto cleanup;
+  }
+  if (!bp_query(P, damping, max_iters, tol, q, e, done, iters, converged)) goto cleanup;
+  if (*done && !answer_single_model(P, q, e, R, psem, quiet)) goto cleanup;
+
+  ok = true;
+cleanup:
+  mem_free(MEM_STORAGE, q); mem_free(MEM_STORAGE, e);
+  return ok;
+}
+
+bool exact_enum(program_t *P, double **R, bool lstable_sat, psemantics_t psem, bool quiet,
+    checkpoint_t *ck, shard_t *sh, progress_t *pg) {
   bool has_credal = P->CF_n > 0, has_neural = P->NR_n + P->NA_n > 0;
   double *a, *b, *c, *d = c = b = a = NULL;
   size_t Q_n = P->Q_n, i;
@@ -393,12 +1056,13 @@ bool exact_enum(program_t *P, double **R, bool lstable_sat, psemantics_t psem, b
   array_double_t (*K)[4] = NULL;
   double *X, *L_CF, *U_CF = L_CF = X = NULL;
   size_t num_procs = estimate_nprocs(total_choice_n + P->AD_n);
-  threadpool pool = thpool_init(num_procs);
-  bool busy_procs[NUM_PROCS] = {0}, exact_num_ok, warn = false;
+  threadpool pool = NULL;
+  bool busy_procs[NUM_PROCS] = {0}, exact_num_ok = false, warn = false;
   storage_t S[NUM_PROCS] = {{0}};
   pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER, wakeup = PTHREAD_MUTEX_INITIALIZER;
   pthread_cond_t avail = PTHREAD_COND_INITIALIZER;
-  void (*compute_func)(void*) = psem ? compute_total_choice_maxent : compute_total_choice;
+  kernel_t compute_func = select_total_choice_kernel(P, psem, lstable_sat);
+  sched_t sc;
 
   if (!init_total_choice(&theta, total_choice_n, P)) goto cleanup;
 
@@ -409,97 +1073,96 @@ bool exact_enum(program_t *P, double **R, bool lstable_sat, psemantics_t psem, b
 
   for (i = 0; i < num_procs; ++i)
     if (!init_storage(&S[i], P, Pn, K, i, busy_procs, &mu, &wakeup, &avail, lstable_sat,
-          total_choice_n, P->AD, P->AD_n))
-      goto cleanup;
+          total_choice_n, P->AD, P->AD_n)) {
+      /* Under a memory limit, run with fewer workers rather than not at all. */
+      if (!i || !mem_limit_hit()) goto cleanup;
+      PyErr_Clear();
+      free_storage_contents(&S[i]);
+      num_procs = i;
+    }
+  /* Only spawn as many threads as there are storages. */
+  pool = thpool_init(num_procs);
+  init_sched(&sc, num_procs, num_total_choices(P)*(has_neural ? P->m_test : 1));
+  for (i = 0; i < num_procs; ++i) { S[i].sched = &sc; S[i].sharpsat = sharpsat_enabled(); }
+
+  if (P->NR_n + P->NA_n > 0) {
+    PROF_BEGIN(t_neural);
+    TRACE_BEGIN(t_trace);
+    for (i = 0; i < P->NR_n; ++i)
+      if (!update_pr_neural_rule(&P->NR[i])) goto cleanup;
+    for (i = 0; i < P->NA_n; ++i)
+      if (!update_pr_neural_annot_disj(&P->NA[i])) goto cleanup;
+    TRACE_END(TRACE_NEURAL, t_trace);
+    PROF_END(PROF_NEURAL, t_neural);
+  }
 
-  for (i = 0; i < P->NR_n; ++i)
-    if (!update_pr_neural_rule(&P->NR[i])) goto cleanup;
-  for (i = 0; i < P->NA_n; ++i)
-    if (!update_pr_neural_annot_disj(&P->NA[i])) goto cleanup;
+  if (sh) {
+    exact_num_ok = enum_shard(sh, P, psem, lstable_sat, &theta, total_choice_n, S, num_procs, pool,
+        busy_procs, &wakeup, &avail, compute_func, Pn, K);
+    goto cleanup;
+  }
 
   size_t data_stride = has_neural ? P->m_test : 1;
+  if (progress_enabled(pg)) {
+    /* Credal facts are enumerated as if they were fair coins, so mass adds up to 2^CF_n. */
+    if (!progress_begin(pg, num_procs, num_total_choices(P)*data_stride,
+          ldexp(data_stride, P->CF_n)))
+      goto cleanup;
+    for (i = 0; i < num_procs; ++i) S[i].prog = &pg->slots[i];
+  }
   /* If credal, then 2: lower and upper; else, then 1: sharp probability. */
   size_t sem_stride = psem == MAXENT_SEMANTICS ? 1 : 2;
-  double *R_data = (double*) malloc(Q_n*sem_stride*data_stride*sizeof(double));
+  double *R_data = (double*) mem_malloc(MEM_RESULTS, Q_n*sem_stride*data_stride*sizeof(double));
   if (!R_data) {
-    PyErr_SetString(PyExc_MemoryError, "could not allocate enough memory for exact result!");
+    mem_raise("exact result");
     goto cleanup;
   }
   *R = R_data;
   double *I = R_data;
-  for (size_t ds = 0; ds < data_stride; ++ds) {
+  size_t ds = 0;
+  if (ck && ck->resume) {
+    if (!load_exact_checkpoint(ck, P, psem, lstable_sat, &ds, &theta, R_data, sem_stride, S,
+          num_procs, Pn, K))
+      goto cleanup;
+    I += ds*Q_n*sem_stride;
+    for (i = 0; i < P->NR_n; ++i) P->NR[i].P += ds*P->NR[i].o;
+    for (i = 0; i < P->NA_n; ++i) P->NA[i].P += ds*P->NA[i].v*P->NA[i].o;
+    /* The checkpointed total choice has already been accounted for: continue from the next one. */
+    goto resume;
+  }
+  for (; ds < data_stride; ++ds) {
     do {
       do {
         if (!dispatch_job(&theta, &wakeup, busy_procs, S, num_procs, pool, &avail, compute_func))
           goto cleanup;
+        sched_dispatched(&sc);
+        if (!progress_tick(pg)) goto cleanup;
+        if (checkpoint_due(ck)) {
+          thpool_wait(pool);
+          if (!save_exact_checkpoint(ck, P, psem, lstable_sat, ds, &theta, R_data,
+                ds*Q_n*sem_stride, S, num_procs, Pn, K))
+            goto cleanup;
+        }
+resume:;
       } while (incr_total_choice_ad(&theta, P));
     } while (incr_total_choice(&theta));
     thpool_wait(pool);
 
+    PROF_BEGIN(t_merge);
     for (i = 0; i < num_procs; ++i) warn |= S[i].warn;
 
     if (!has_credal) {
-      a = S[0].a; b = S[0].b; c = S[0].c; d = S[0].d;
-      for (i = 1; i < num_procs; ++i) {
-        size_t j;
-        for (j = 0; j < Q_n; ++j) {
-          a[j] += S[i].a[j];
-          b[j] += S[i].b[j];
-          c[j] += S[i].c[j];
-          d[j] += S[i].d[j];
-        }
+      reduce_seg_t G[4*NUM_PROCS];
+      for (i = 0; i < num_procs; ++i) {
+        G[4*i] = (reduce_seg_t) {S[i].a, Q_n}; G[4*i+1] = (reduce_seg_t) {S[i].b, Q_n};
+        G[4*i+2] = (reduce_seg_t) {S[i].c, Q_n}; G[4*i+3] = (reduce_seg_t) {S[i].d, Q_n};
       }
+      if (!reduce_sum(pool, num_procs, G, num_procs, 4, REDUCE_DOUBLE)) goto cleanup;
+      a = S[0].a; b = S[0].b; c = S[0].c; d = S[0].d;
     }
 
-    for (i = 0; i < Q_n; ++i) {
-      size_t i_l = i*sem_stride;
-      size_t i_u = i_l+1;
-      if (has_credal) {
-        if (P->Q[i].E_n == 0) {
-          double _a, _b;
-          bf(X, Pn[i][0].d, Pn[i][1].d, K[i][0].d, K[i][1].d, L_CF, U_CF, K[i][0].n, K[i][1].n,
-              P->CF_n, &_a, &_b, true);
-          I[i_l] = _a, I[i_u] = _b;
-        } else {
-          size_t _a = K[i][0].n, _b = K[i][1].n, _c = K[i][2].n, _d = K[i][3].n;
-          if (_b + _d == 0) {
-            fputws(L"Fail: ℙ(E) = 0!\n", stdout);
-            I[i_l] = -INFINITY, I[i_u] = INFINITY;
-          } else {
-            if ((_b + _c == 0) && (_d > 0)) I[i_l] = 0, I[i_u] = 0;
-            else if ((_a + _d == 0) && (_b > 0)) I[i_l] = 1, I[i_u] = 1;
-            else {
-              double min, max;
-              bf_minmax(X, Pn[i][0].d, Pn[i][1].d, Pn[i][2].d, Pn[i][3].d, K[i][0].d, K[i][1].d,
-                  K[i][2].d, K[i][3].d, L_CF, U_CF, _a, _b, _c, _d, P->CF_n, &min, &max);
-              I[i_l] = min, I[i_u] = max;
-            }
-          }
-        }
-      } else {
-        if (psem == MAXENT_SEMANTICS) I[i_l] = a[i]/b[i];
-        else {
-          double _a = a[i], _b = b[i], _c = c[i], _d = d[i];
-          if (P->Q[i].E_n == 0) I[i_l] = _a, I[i_u] = _b;
-          else {
-            if (_b + _d == 0) {
-              fputws(L"Fail: ℙ(E) = 0!\n", stdout);
-              I[i_l] = -INFINITY, I[i_u] = INFINITY;
-            } else {
-              if ((_b + _c == 0) && (_d > 0)) I[i_l] = 0, I[i_u] = 0;
-              else if ((_a + _d == 0) && (_b > 0)) I[i_l] = 1, I[i_u] = 1;
-              else I[i_l] = _a/(_a + _d), I[i_u] = _b/(_b + _c);
-            }
-          }
-        }
-      }
-      if (!quiet) {
-        print_query(P->Q+i);
-        if (psem == MAXENT_SEMANTICS) wprintf(L" = %f\n", I[i_l]);
-        else wprintf(L" = [%f, %f]\n", I[i_l], I[i_u]);
-      }
-    }
-    if (!quiet) fputws(L"---\n", stdout);
+    answer_queries(P, I, a, b, c, d, Pn, K, X, L_CF, U_CF, psem, quiet);
+    PROF_END(PROF_MERGE, t_merge);
 
     /* Move memory for next batch. */
     I += Q_n*sem_stride;
@@ -515,29 +1178,25 @@ bool exact_enum(program_t *P, double **R, bool lstable_sat, psemantics_t psem, b
     }
   }
 
+  if (!progress_finish(pg)) goto cleanup;
   if (warn)
     fputws(L"Warning: found total choice with no model. Probabilities may be incorrect.\n", stdout);
+  if (mem_limit_hit())
+    wprintf(L"Warning: reached the memory limit, so ran with %zu worker(s)%ls.\n", num_procs,
+        has_credal ? L" and compacted credal polynomials" : L"");
 
   exact_num_ok = true;
 cleanup:
   if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
+  /* Workers cannot raise, so report a memory limit they ran into here. */
+  if (!exact_num_ok && !PyErr_Occurred() && mem_limit_hit()) mem_raise("credal polynomials");
   free_total_choice_contents(&theta);
   pthread_mutex_destroy(&mu); pthread_mutex_destroy(&wakeup); pthread_cond_destroy(&avail);
   thpool_destroy(pool);
   for (i = 0; i < num_procs; ++i) free_storage_contents(&S[i]);
   if (has_credal) {
-    free(L_CF); free(U_CF); free(X);
-    if (Pn) {
-      for (i = 0; i < Q_n; ++i) {
-        array_bool_free_contents(&Pn[i][0]); array_bool_free_contents(&Pn[i][1]);
-        array_bool_free_contents(&Pn[i][2]); array_bool_free_contents(&Pn[i][3]);
-      } free(Pn);
-    } if (K) {
-      for (i = 0; i < Q_n; ++i) {
-        array_double_free_contents(&K[i][0]); array_double_free_contents(&K[i][1]);
-        array_double_free_contents(&K[i][2]); array_double_free_contents(&K[i][3]);
-      } free(K);
-    }
+    mem_free(MEM_CREDAL, L_CF); mem_free(MEM_CREDAL, U_CF); mem_free(MEM_CREDAL, X);
+    free_polynomial(Pn, K, Q_n);
   }
   return exact_num_ok;
 }
@@ -568,20 +1227,20 @@ bool init_learnable_indices(program_t *P, prob_storage_t *U, count_storage_t *V,
     I_F = I_A = I_PR = NULL;
     for (i = n_lpf = 0; i < n; ++i) if (PF[i].learnable) ++n_lpf;
     if (n_lpf) {
-      I_F = (uint16_t*) malloc(n_lpf*sizeof(uint16_t));
+      I_F = (uint16_t*) mem_malloc(MEM_STORAGE, n_lpf*sizeof(uint16_t));
       if (!I_F) goto fail;
       for (size_t j = i = 0; i < n; ++i) if (PF[i].learnable) I_F[j++] = i;
     }
     for (i = n_lad = 0; i < m; ++i) if (AD[i].learnable) ++n_lad;
     if (n_lad) {
-      I_A = (uint16_t*) malloc(n_lad*sizeof(uint16_t));
+      I_A = (uint16_t*) mem_malloc(MEM_STORAGE, n_lad*sizeof(uint16_t));
       if (!I_A) goto fail;
       for (size_t j = i = 0; i < m; ++i) if (AD[i].learnable) I_A[j++] = i;
     }
     if (S) {
       for (i = n_pr = 0; i < P->PR_n; ++i) if (P->PR[i].learnable) ++n_pr;
       if (n_pr) {
-        I_PR = (uint16_t*) malloc(n_pr*sizeof(uint16_t));
+        I_PR = (uint16_t*) mem_malloc(MEM_STORAGE, n_pr*sizeof(uint16_t));
         if (!I_PR) goto fail;
         for (size_t j = i = 0; i < P->PR_n; ++i) if (P->PR[i].learnable) I_PR[j++] = i;
       }
@@ -589,7 +1248,7 @@ bool init_learnable_indices(program_t *P, prob_storage_t *U, count_storage_t *V,
   }
   if (S) {
     if (n_pr && !I_GR) {
-      I_GR = (array_uint8_t*) malloc(n_pr*sizeof(array_uint8_t));
+      I_GR = (array_uint8_t*) mem_malloc(MEM_STORAGE, n_pr*sizeof(array_uint8_t));
       if (!I_GR) goto fail;
       for (size_t i = 0; i < n_pr; ++i)
         if (!array_uint8_t_init(&I_GR[i])) {
@@ -607,7 +1266,8 @@ bool init_learnable_indices(program_t *P, prob_storage_t *U, count_storage_t *V,
   return true;
 fail:
   PyErr_SetString(PyExc_MemoryError, "could not allocate memory!");
-  free(I_F); free(I_A); free(I_GR); free(I_PR);
+  mem_free(MEM_STORAGE, I_F); mem_free(MEM_STORAGE, I_A); mem_free(MEM_STORAGE, I_GR);
+  mem_free(MEM_STORAGE, I_PR);
   return false;
 }
 
@@ -621,9 +1281,9 @@ bool init_learnable_neural_indices(program_t *P, prob_storage_t *U, prob_storage
     for (i = n_lnr = 0; i < n; ++i) if (NR[i].learnable) ++n_lnr;
     if (n_lnr) {
       I_NR = O_NR = NULL;
-      I_NR = (uint16_t*) malloc(n_lnr*sizeof(uint16_t));
+      I_NR = (uint16_t*) mem_malloc(MEM_STORAGE, n_lnr*sizeof(uint16_t));
       if (!I_NR) goto fail;
-      O_NR = (uint16_t*) malloc(n_lnr*sizeof(uint16_t));
+      O_NR = (uint16_t*) mem_malloc(MEM_STORAGE, n_lnr*sizeof(uint16_t));
       if (!O_NR) goto fail;
       size_t s = P->PF_n + P->CF_n;
       for (size_t j = i = 0; i < n; ++i) {
@@ -638,9 +1298,9 @@ bool init_learnable_neural_indices(program_t *P, prob_storage_t *U, prob_storage
     for (i = n_lna = 0; i < m; ++i) if (NA[i].learnable) ++n_lna;
     if (n_lna) {
       I_NA = O_NA = NULL;
-      I_NA = (uint16_t*) malloc(n_lna*sizeof(uint16_t));
+      I_NA = (uint16_t*) mem_malloc(MEM_STORAGE, n_lna*sizeof(uint16_t));
       if (!I_NA) goto fail;
-      O_NA = (uint16_t*) malloc(n_lna*sizeof(uint16_t));
+      O_NA = (uint16_t*) mem_malloc(MEM_STORAGE, n_lna*sizeof(uint16_t));
       if (!O_NA) goto fail;
       size_t s = P->AD_n;
       for (size_t j = i = 0; i < m; ++i) {
@@ -654,41 +1314,36 @@ bool init_learnable_neural_indices(program_t *P, prob_storage_t *U, prob_storage
   return true;
 fail:
   PyErr_SetString(PyExc_MemoryError, "could not allocate memory!");
-  free(I_NR); free(I_NA); free(O_NR); free(O_NA);
+  mem_free(MEM_STORAGE, I_NR); mem_free(MEM_STORAGE, I_NA); mem_free(MEM_STORAGE, O_NR);
+  mem_free(MEM_STORAGE, O_NA);
   return false;
 }
 
 /* Initializes learnable statements F and A in storage S according to PF and AD of size n and m
- * respectively. Initialized data is of type type_t. If fail, goto fail. */
-bool init_learnable_storage(annot_disj_t *AD, prob_storage_t *U, prob_obs_storage_t *S) {
+ * respectively, as views into rows F (of 2n entries) and A (of one entry per value of each learnable
+ * AD) of the dense matrices of U. If fail, goto fail. */
+bool init_learnable_storage(annot_disj_t *AD, prob_storage_t *U, prob_obs_storage_t *S, double *F,
+    double *A) {
   uint16_t *I_A = U->I_A;
-  size_t n_lpf = U->n, n_lad = U->m;
-  double (*F)[2] = NULL;
-  double **A = NULL;
+  size_t n_lad = U->m;
+  double **V = NULL;
   double (*R)[2] = NULL;
-  if (n_lpf) {
-    F = (double(*)[2]) calloc(n_lpf, sizeof(double[2]));
-    if (!F) goto fail;
-  }
   if (n_lad) {
-    A = (double**) malloc(n_lad*sizeof(double*));
-    if (!A) goto fail;
+    V = (double**) mem_malloc(MEM_STORAGE, n_lad*sizeof(double*));
+    if (!V) goto fail;
     for (size_t i = 0; i < n_lad; ++i) {
-      A[i] = (double*) calloc(AD[I_A[i]].n, sizeof(double));
-      if (!A[i]) {
-        for (size_t j = 0; j < i; ++j) free(A[j]);
-        goto fail;
-      }
+      V[i] = A;
+      A += AD[I_A[i]].n;
     }
   }
   if (U->pr) {
-    R = (double(*)[2]) calloc(U->pr, sizeof(double[2]));
-    if (!F) goto fail;
+    R = (double(*)[2]) mem_calloc(MEM_STORAGE, U->pr, sizeof(double[2]));
+    if (!R) goto fail;
   }
-  S->F = F; S->A = A; S->R = R;
+  S->F = (double(*)[2]) F; S->A = V; S->R = R;
   return true;
 fail:
-  free(F); free(A); free(R);
+  mem_free(MEM_STORAGE, V); mem_free(MEM_STORAGE, R);
   return false;
 }
 
@@ -699,25 +1354,26 @@ bool init_learnable_neural_storage(neural_rule_t *NR, neural_annot_disj_t *NA, p
   double **R = NULL;
   double **A = NULL;
   if (n_lnr) {
-    R = (double**) malloc(n_lnr*sizeof(double*));
+    R = (double**) mem_malloc(MEM_STORAGE, n_lnr*sizeof(double*));
     if (!R) goto fail;
     for (size_t i = 0; i < n_lnr; ++i) {
       /* R[i] = [P(not f(x; 0)), P(f(x; 0)), P(not f(x; 1)), P(f(x; 1)), P(not f(y; 0)), ...] */
-      R[i] = (double*) calloc(2*NR[U->I_NR[i]].n*NR[U->I_NR[i]].o, sizeof(double));
+      R[i] = (double*) mem_calloc(MEM_STORAGE, 2*NR[U->I_NR[i]].n*NR[U->I_NR[i]].o, sizeof(double));
       if (!R[i]) {
-        for (size_t j = 0; j < i; ++j) free(R[j]);
+        for (size_t j = 0; j < i; ++j) mem_free(MEM_STORAGE, R[j]);
         goto fail;
       }
     }
   }
   if (n_lna) {
-    A = (double**) malloc(n_lna*sizeof(double*));
+    A = (double**) mem_malloc(MEM_STORAGE, n_lna*sizeof(double*));
     if (!A) goto fail;
     for (size_t i = 0; i < n_lna; ++i) {
       /* A[i] = [P(f(x, 0; 0)), P(f(x, 1; 0)), P(f(x, 0; 1)), P(f(x, 1; 1)), P(f(y, 0; 0)), ...] */
-      A[i] = (double*) calloc(NA[I_NA[i]].v*NA[I_NA[i]].n*NA[I_NA[i]].o, sizeof(double));
+      A[i] = (double*) mem_calloc(MEM_STORAGE, NA[I_NA[i]].v*NA[I_NA[i]].n*NA[I_NA[i]].o,
+          sizeof(double));
       if (!A[i]) {
-        for (size_t j = 0; j < i; ++j) free(A[j]);
+        for (size_t j = 0; j < i; ++j) mem_free(MEM_STORAGE, A[j]);
         goto fail;
       }
     }
@@ -725,23 +1381,23 @@ bool init_learnable_neural_storage(neural_rule_t *NR, neural_annot_disj_t *NA, p
   S->NR = R; S->NA = A;
   return true;
 fail:
-  free(R); free(A);
+  mem_free(MEM_STORAGE, R); mem_free(MEM_STORAGE, A);
   return false;
 }
 
 bool init_count_storage(count_storage_t *C, program_t *P, count_storage_t *U) {
   if (!init_learnable_indices(P, NULL, U, NULL, C)) goto cleanup;
   if (C->n) {
-    C->F = (uint16_t(*)[2]) calloc(C->n, sizeof(uint16_t[2]));
+    C->F = (uint64_t(*)[2]) mem_calloc(MEM_STORAGE, C->n, sizeof(uint64_t[2]));
     if (!C->F) goto cleanup;
   } else C->F = NULL;
   if (C->m) {
-    C->A = (uint16_t**) malloc(C->m*sizeof(uint16_t*));
+    C->A = (uint64_t**) mem_malloc(MEM_STORAGE, C->m*sizeof(uint64_t*));
     if (!C->A) goto cleanup;
     for (size_t i = 0; i < C->m; ++i) {
-      C->A[i] = (uint16_t*) calloc(P->AD[C->I_A[i]].n, sizeof(uint16_t));
+      C->A[i] = (uint64_t*) mem_calloc(MEM_STORAGE, P->AD[C->I_A[i]].n, sizeof(uint64_t));
       if (!C->A[i]) {
-        for (size_t j = 0; j < i; ++j) free(C->A[j]);
+        for (size_t j = 0; j < i; ++j) mem_free(MEM_STORAGE, C->A[j]);
         goto cleanup;
       }
     }
@@ -749,20 +1405,23 @@ bool init_count_storage(count_storage_t *C, program_t *P, count_storage_t *U) {
   return true;
 cleanup:
   PyErr_SetString(PyExc_MemoryError, "no free memory available!");
-  free(C->F);
-  free(C->A);
+  mem_free(MEM_STORAGE, C->F);
+  mem_free(MEM_STORAGE, C->A);
   return false;
 }
 
 void free_count_storage_contents(count_storage_t *C, bool free_shared) {
-  free(C->F);
-  free(C->A);
+  mem_free(MEM_STORAGE, C->F);
+  mem_free(MEM_STORAGE, C->A);
   if (free_shared) {
-    free(C->I_F);
-    free(C->I_A);
+    mem_free(MEM_STORAGE, C->I_F);
+    mem_free(MEM_STORAGE, C->I_A);
   }
 }
-void free_count_storage(count_storage_t *C) { free_count_storage_contents(C, true); free(C); }
+void free_count_storage(count_storage_t *C) {
+  free_count_storage_contents(C, true);
+  mem_free(MEM_STORAGE, C);
+}
 
 void compute_model_count(void *args) {
   struct { count_storage_t *C; storage_t *S; } *pair = args;
@@ -770,25 +1429,44 @@ void compute_model_count(void *args) {
   storage_t *st = pair->S;
   total_choice_t *theta = &st->theta;
   program_t *P = st->P;
-  size_t i, m;
+  size_t i;
+  uint64_t m;
   clingo_control_t *C = NULL;
+  bool total = P->sem == LSTABLE_SEMANTICS && st->lstable_sat;
+  clingo_literal_t total_lit;
 
+  TRACE_BEGIN(t_job);
   st->fail = true;
+  uint64_t t_sched = prof_now();
+  size_t solvers = sched_solvers(st->sched);
 
-  if (P->sem == LSTABLE_SEMANTICS && st->lstable_sat) {
-    bool has;
-    if (!has_total_model(P, theta, &has)) goto cleanup;
-    if (has) P = P->stable;
-  }
+  bool sharp = st->sharpsat && (P->sem == STABLE_SEMANTICS);
+  sharpsat_t sh = {0};
 
-  if (!prepare_control(&C, P, theta, "0", false, NULL)) goto cleanup;
+  if (sharp) if (!init_sharpsat(&sh)) goto cleanup;
+  if (!prepare_control_observed(&C, P, theta, "0", solvers, sharp ? &SHARPSAT_OBSERVER : NULL,
+        &sh))
+    goto cleanup;
+  if (total) if (!total_model_literal(C, &total_lit)) goto cleanup;
+  if (sharp) {
+    if (!sharpsat_compile(&sh)) goto cleanup;
+    if (sh.ok) {
+      double c = sharpsat_count(&sh, NULL, 0);
+      if (c < 0) goto cleanup;
+      /* 2^64 is the first double a count cannot be converted from. */
+      if (!(c < 0x1p64)) { cnt->overflow = true; goto cleanup; }
+      m = (uint64_t) c;
+      goto counted;
+    }
+  }
 
+enumerate:
   {
     bool ok = false;
     clingo_solve_handle_t *handle;
     clingo_solve_result_bitset_t solve_ret;
 
-    if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle))
+    if (!clingo_control_solve(C, clingo_solve_mode_yield, &total_lit, total, NULL, NULL, &handle))
       goto solve_cleanup;
 
     for (m = 0; true; ++m) {
@@ -801,22 +1479,38 @@ void compute_model_count(void *args) {
 solve_cleanup:
     if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
   }
+  if (total && m == 0) { total = false; goto enumerate; }
 
+counted:
+  PROF_BEGIN(t_prob);
   /* Add counts to probabilistic facts that agree with total choice theta. */
-  for (i = 0; i < cnt->n; ++i) cnt->F[i][bitvec_GET(&theta->pf, i)] += m;
+  for (i = 0; i < cnt->n; ++i) {
+    uint64_t *x = &cnt->F[i][bitvec_GET(&theta->pf, i)];
+    if (__builtin_add_overflow(*x, m, x)) { cnt->overflow = true; goto cleanup; }
+  }
   /* Add counts to annotated disjunctions that agree with total choice theta. */
-  for (i = 0; i < cnt->m; ++i) cnt->A[i][theta->theta_ad[cnt->I_A[i]]] += m;
+  for (i = 0; i < cnt->m; ++i) {
+    uint64_t *x = &cnt->A[i][theta->theta_ad[cnt->I_A[i]]];
+    if (__builtin_add_overflow(*x, m, x)) { cnt->overflow = true; goto cleanup; }
+  }
 
+  PROF_END(PROF_PROB, t_prob);
+  /* Learnable facts have no probabilities yet, so no mass is reported. */
+  progress_publish(st->prog, m, 0);
   st->fail = false;
 cleanup:
+  PROF_CLINGO(C);
   clingo_control_free(C);
+  free_sharpsat_contents(&sh);
+  sched_record(st->sched, prof_now() - t_sched, solvers);
+  TRACE_END(TRACE_JOB, t_job);
   pthread_mutex_lock(st->wakeup);
   st->busy_procs[st->pid] = false;
   pthread_cond_signal(st->avail);
   pthread_mutex_unlock(st->wakeup);
 }
 
-bool count_models(program_t *P, bool lstable_sat, count_storage_t *ret) {
+bool count_models(program_t *P, bool lstable_sat, count_storage_t *ret, progress_t *pg) {
   total_choice_t theta;
   size_t total_choice_n = get_num_facts(P);
   size_t num_procs = estimate_nprocs(total_choice_n + P->AD_n);
@@ -829,6 +1523,7 @@ bool count_models(program_t *P, bool lstable_sat, count_storage_t *ret) {
   pthread_cond_t avail = PTHREAD_COND_INITIALIZER;
   threadpool pool = thpool_init(num_procs);
   struct { count_storage_t *C; storage_t *S; } pairs[NUM_PROCS] = {{0}};
+  sched_t sc;
 
   if (!ret) {
     PyErr_SetString(PyExc_ValueError, "received NULL count_storage_t as argument!");
@@ -846,25 +1541,43 @@ bool count_models(program_t *P, bool lstable_sat, count_storage_t *ret) {
     if (!init_total_choice(&S[i].theta, total_choice_n, P)) goto cleanup;
     pairs[i].C = &C[i];
     pairs[i].S = &S[i];
+    S[i].sched = &sc;
+    S[i].sharpsat = sharpsat_enabled();
+  }
+  init_sched(&sc, num_procs, num_total_choices(P));
+  if (progress_enabled(pg)) {
+    if (!progress_begin(pg, num_procs, num_total_choices(P), 0)) goto cleanup;
+    for (i = 0; i < num_procs; ++i) S[i].prog = &pg->slots[i];
   }
 
   do {
     do {
       int id = retr_free_proc(busy_procs, num_procs, &wakeup, &avail);
       if (!dispatch_job_with_payload(&theta, &wakeup, busy_procs, S, num_procs, pool, &avail, id,
-            compute_model_count, &pairs[id])) goto cleanup;
+            compute_model_count, &pairs[id])) goto failed;
+      sched_dispatched(&sc);
+      if (!progress_tick(pg)) goto cleanup;
     } while (incr_total_choice_ad(&theta, P));
   } while (incr_total_choice(&theta));
   thpool_wait(pool);
-
-  for (i = 1; i < num_procs; ++i) {
-    for (size_t j = 0; j < C[0].n; ++j) {
-      C[0].F[j][0] += C[i].F[j][0];
-      C[0].F[j][1] += C[i].F[j][1];
+  for (i = 0; i < num_procs; ++i) if (C[i].overflow) goto overflow;
+  if (!progress_finish(pg)) goto cleanup;
+
+  /* Merge. */ {
+    size_t m = 1 + C[0].m;
+    reduce_seg_t *G = (reduce_seg_t*) mem_malloc(MEM_STORAGE, num_procs*m*sizeof(reduce_seg_t));
+    if (!G) {
+      mem_raise("model count reduction");
+      goto cleanup;
     }
-    for (size_t j = 0; j < C[0].m; ++j)
-      for (size_t c = 0; c < P->AD[C[0].I_A[j]].n; ++c)
-        C[0].A[j][c] += C[i].A[j][c];
+    for (i = 0; i < num_procs; ++i) {
+      G[i*m] = (reduce_seg_t) {C[i].F, 2*C[0].n};
+      for (size_t j = 0; j < C[0].m; ++j)
+        G[i*m+1+j] = (reduce_seg_t) {C[i].A[j], P->AD[C[0].I_A[j]].n};
+    }
+    bool r = reduce_sum(pool, num_procs, G, num_procs, m, REDUCE_UINT64);
+    mem_free(MEM_STORAGE, G);
+    if (!r) goto cleanup;
   }
 
   ret->n = C[0].n; ret->m = C[0].m;
@@ -872,6 +1585,14 @@ bool count_models(program_t *P, bool lstable_sat, count_storage_t *ret) {
   ret->I_F = C[0].I_F; ret->I_A = C[0].I_A;
 
   ok = true;
+  goto cleanup;
+failed:
+  /* A worker failed: report an overflow as such, once all jobs are done. */
+  thpool_wait(pool);
+  for (i = 0; i < num_procs; ++i) if (C[i].overflow) goto overflow;
+  goto cleanup;
+overflow:
+  PyErr_SetString(PyExc_OverflowError, "model counts do not fit in 64 bits!");
 cleanup:
   if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
   free_total_choice_contents(&theta);
@@ -887,13 +1608,23 @@ cleanup:
 
 bool init_prob_storage(prob_storage_t *Q, program_t *P, prob_storage_t *U, observations_t *O) {
   prob_obs_storage_t *po = NULL;
-  po = (prob_obs_storage_t*) malloc(O->n*sizeof(prob_obs_storage_t));
+  size_t i;
+  po = (prob_obs_storage_t*) mem_malloc(MEM_STORAGE, O->n*sizeof(prob_obs_storage_t));
   if (!po) goto cleanup;
   if (!init_learnable_indices(P, U, NULL, Q, NULL)) goto cleanup;
   if (!init_learnable_neural_indices(P, U, Q)) goto cleanup;
-  for (size_t i = 0; i < O->n; ++i) {
+  Q->A_w = 0;
+  for (i = 0; i < U->m; ++i) Q->A_w += STORAGE_AD_DIM(P, U, i);
+  Q->DF = (double*) mem_calloc(MEM_STORAGE, O->n*2*U->n + 1, sizeof(double));
+  Q->DA = (double*) mem_calloc(MEM_STORAGE, O->n*Q->A_w + 1, sizeof(double));
+  Q->p_o = (double*) mem_malloc(MEM_STORAGE, (O->n + 1)*sizeof(double));
+  Q->GF = (double*) mem_malloc(MEM_STORAGE, (2*U->n + 1)*sizeof(double));
+  Q->GA = (double*) mem_malloc(MEM_STORAGE, (Q->A_w + 1)*sizeof(double));
+  Q->pos = (size_t*) mem_malloc(MEM_STORAGE, (U->pr + 1)*sizeof(size_t));
+  if (!(Q->DF && Q->DA && Q->p_o && Q->GF && Q->GA && Q->pos)) goto cleanup;
+  for (i = 0; i < O->n; ++i) {
     prob_obs_storage_t *o = po + i;
-    if (!init_learnable_storage(P->AD, U, o)) goto cleanup;
+    if (!init_learnable_storage(P->AD, U, o, Q->DF + i*2*U->n, Q->DA + i*Q->A_w)) goto cleanup;
     if (!init_learnable_neural_storage(P->NR, P->NA, U, o)) goto cleanup;
     o->o = 0.0; o->N = 0;
   }
@@ -902,7 +1633,12 @@ bool init_prob_storage(prob_storage_t *Q, program_t *P, prob_storage_t *U, obser
   return true;
 cleanup:
   PyErr_SetString(PyExc_MemoryError, "no free memory available!");
-  free(po);
+  mem_free(MEM_STORAGE, po);
+  mem_free(MEM_STORAGE, Q->DF); mem_free(MEM_STORAGE, Q->DA);
+  mem_free(MEM_STORAGE, Q->p_o); mem_free(MEM_STORAGE, Q->GF); mem_free(MEM_STORAGE, Q->GA);
+  mem_free(MEM_STORAGE, Q->pos);
+  Q->DF = Q->DA = Q->p_o = Q->GF = Q->GA = NULL;
+  Q->pos = NULL;
   return false;
 }
 
@@ -930,25 +1666,46 @@ cleanup:
 
 void free_prob_storage_contents(prob_storage_t *Q, bool free_shared) {
   for (size_t i = 0; i < Q->o; ++i) {
-    free(Q->P[i].F);
-    for (size_t j = 0; j < Q->m; ++j) free(Q->P[i].A[j]);
-    free(Q->P[i].A);
-    free(Q->P[i].R);
-    for (size_t j = 0; j < Q->nr; ++j) free(Q->P[i].NR[j]);
-    free(Q->P[i].NR);
-    for (size_t j = 0; j < Q->na; ++j) free(Q->P[i].NA[j]);
-    free(Q->P[i].NA);
+    mem_free(MEM_STORAGE, Q->P[i].A);
+    mem_free(MEM_STORAGE, Q->P[i].R);
+    for (size_t j = 0; j < Q->nr; ++j) mem_free(MEM_STORAGE, Q->P[i].NR[j]);
+    mem_free(MEM_STORAGE, Q->P[i].NR);
+    for (size_t j = 0; j < Q->na; ++j) mem_free(MEM_STORAGE, Q->P[i].NA[j]);
+    mem_free(MEM_STORAGE, Q->P[i].NA);
   }
+  mem_free(MEM_STORAGE, Q->DF); mem_free(MEM_STORAGE, Q->DA);
+  mem_free(MEM_STORAGE, Q->p_o); mem_free(MEM_STORAGE, Q->GF); mem_free(MEM_STORAGE, Q->GA);
+  mem_free(MEM_STORAGE, Q->pos);
   for (size_t i = 0; i < Q->pr; ++i) array_uint8_t_free_contents(&Q->I_GR[i]);
   if (free_shared) {
-    free(Q->I_F); free(Q->I_A); free(Q->I_PR); free(Q->I_GR);
-    free(Q->I_NR); free(Q->I_NA);
-    free(Q->O_NR); free(Q->O_NA);
+    mem_free(MEM_STORAGE, Q->I_F); mem_free(MEM_STORAGE, Q->I_A); mem_free(MEM_STORAGE, Q->I_PR);
+    mem_free(MEM_STORAGE, Q->I_GR);
+    mem_free(MEM_STORAGE, Q->I_NR); mem_free(MEM_STORAGE, Q->I_NA);
+    mem_free(MEM_STORAGE, Q->O_NR); mem_free(MEM_STORAGE, Q->O_NA);
+  }
+}
+void free_prob_storage(prob_storage_t *Q) {
+  free_prob_storage_contents(Q, true);
+  mem_free(MEM_STORAGE, Q);
+}
+
+/* Adds x y^T to the m × n row-major matrix D, skipping the zero entries of x. Columns are taken in
+ * blocks of RANK1_BLOCK, so that each block of y stays in cache across the rows, and the inner loop
+ * is a plain axpy the compiler vectorizes. */
+KERNEL_INLINE void rank1_update(double *restrict D, const double *restrict x, size_t m,
+    const double *restrict y, size_t n) {
+  for (size_t c = 0; c < n; c += RANK1_BLOCK) {
+    size_t w = n - c < RANK1_BLOCK ? n - c : RANK1_BLOCK;
+    for (size_t i = 0; i < m; ++i) {
+      if (x[i] == 0) continue;
+      double a = x[i], *restrict d = D + i*n + c;
+      const double *restrict z = y + c;
+      for (size_t j = 0; j < w; ++j) d[j] += a*z[j];
+    }
   }
 }
-void free_prob_storage(prob_storage_t *Q) { free_prob_storage_contents(Q, true); free(Q); }
 
-void compute_prob_obs(void *args) {
+KERNEL_INLINE void _compute_prob_obs(void *args, const bool dense, const bool derive) {
   struct { prob_storage_t *C; storage_t *S; observations_t *O; bool derive; } *tuple = args;
   prob_storage_t *prob = tuple->C;
   storage_t *st = tuple->S;
@@ -957,17 +1714,16 @@ void compute_prob_obs(void *args) {
   program_t *P = st->P;
   size_t i, N;
   clingo_control_t *C = NULL;
+  bool total = P->sem == LSTABLE_SEMANTICS && st->lstable_sat;
+  clingo_literal_t total_lit;
 
+  TRACE_BEGIN(t_job);
   st->fail = true;
 
-  if (P->sem == LSTABLE_SEMANTICS && st->lstable_sat) {
-    bool has;
-    if (!has_total_model(P, theta, &has)) goto cleanup;
-    if (has) P = P->stable;
-  }
-
-  if (!prepare_control(&C, P, theta, "0", false, NULL)) goto cleanup;
+  if (!acquire_control(&st->ctl, &C, P, theta, 1)) goto cleanup;
+  if (total) if (!total_model_literal(C, &total_lit)) goto cleanup;
 
+enumerate:
   /* Reset observation counting. */
   for (size_t i = 0; i < obs->n; ++i) prob->P[i].N = 0;
 
@@ -976,17 +1732,20 @@ void compute_prob_obs(void *args) {
     clingo_solve_handle_t *handle;
     const clingo_model_t *M;
 
-    if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle))
+    if (!clingo_control_solve(C, clingo_solve_mode_yield, &total_lit, total, NULL, NULL, &handle))
       goto solve_error;
 
     for (N = 0; true; ++N) {
+      PROF_BEGIN(t_solve);
       if (!clingo_solve_handle_resume(handle)) goto solve_error;
       if (!clingo_solve_handle_model(handle, &M)) goto solve_error;
+      PROF_END(PROF_SOLVE, t_solve);
       if (M) {
+        PROF_BEGIN(t_models);
         for (i = 0; i < obs->n; ++i) {
           for (size_t j = 0; j < obs->m; ++j) {
             bool contains_atom;
-            if (obs->dense) {
+            if (dense) {
               if (!obs->V[i][j]) break;
               if (!clingo_model_contains(M, obs->V[i][j], &contains_atom)) goto solve_error;
             } else {
@@ -999,6 +1758,7 @@ void compute_prob_obs(void *args) {
           ++prob->P[i].N;
 next_obs: ;
         }
+        PROF_END(PROF_MODELS, t_models);
       } else break;
     }
     goto solve_cleanup;
@@ -1007,31 +1767,59 @@ solve_error:
 solve_cleanup:
     if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
   }
+  if (total && N == 0) { total = false; goto enumerate; }
 
   /* Only multiply after model counting to avoid numeric errors. */
-  double p = prob_total_choice_prob(P, theta)/N;
+  PROF_BEGIN(t_prob);
+  double p = prob_total_choice_prob(P, theta)/N, *p_o = prob->p_o, *GF = prob->GF, *GA = prob->GA;
+  bool any = false;
+  for (i = 0; i < obs->n; ++i) {
+    prob_obs_storage_t *pr = &prob->P[i];
+    p_o[i] = pr->N ? pr->N * p * prob_total_choice_neural(P, theta, i, true) : 0;
+    pr->o += p_o[i];
+    any |= pr->N > 0;
+  }
+  if (!any) goto done;
+
+  /* The factor of each learnable fact and AD depends only on theta, so that their contribution to
+   * every observation is the rank-1 update D += p_o G^T of the dense matrices. */
+  for (size_t j = 0, k = 0; j < prob->m; ++j) {
+    annot_disj_t *A = &P->AD[prob->I_A[j]];
+    uint8_t u = theta->theta_ad[prob->I_A[j]];
+    for (size_t v = 0; v < A->n; ++v) GA[k+v] = 0;
+    GA[k+u] = derive ? 1/A->P[u] : 1;
+    k += A->n;
+  }
+  for (size_t j = 0; j < prob->n; ++j) {
+    if (derive) {
+      bool u = bitvec_GET(&theta->pf, prob->I_F[j]);
+      double q = P->PF[prob->I_F[j]].p;
+      GF[2*j+u] = 1/(u*q + (!u)*(1-q));
+      GF[2*j+!u] = 0;
+    } else {
+      bool u = bitvec_GET(&theta->pf, j);
+      GF[2*j+u] = 1;
+      GF[2*j+!u] = 0;
+    }
+  }
+  rank1_update(prob->DF, p_o, obs->n, GF, 2*prob->n);
+  rank1_update(prob->DA, p_o, obs->n, GA, prob->A_w);
+
+  for (size_t j = 0; j < prob->pr; ++j) {
+    array_uint8_t *gr_pf = &prob->I_GR[j];
+    prob->pos[j] = 0;
+    for (size_t l = 0; l < gr_pf->n; ++l) prob->pos[j] += bitvec_GET(&theta->pf, gr_pf->d[l]);
+  }
   for (i = 0; i < obs->n; ++i) {
     prob_obs_storage_t *pr = &prob->P[i];
     if (!pr->N) continue;
-    double p_o = pr->N * p * prob_total_choice_neural(P, theta, i, true);
-    pr->o += p_o;
-    if (tuple->derive) {
-      for (size_t j = 0; j < prob->n; ++j) {
-        bool u = bitvec_GET(&theta->pf, prob->I_F[j]);
-        double q = P->PF[prob->I_F[j]].p;
-        pr->F[j][u] += p_o/(u*q + (!u)*(1-q));
-      }
-      for (size_t j = 0; j < prob->m; ++j) {
-        uint8_t u = theta->theta_ad[prob->I_A[j]];
-        pr->A[j][u] += p_o/(P->AD[prob->I_A[j]].P[u]);
-      }
+    if (derive) {
       for (size_t j = 0; j < prob->pr; ++j) {
-        uint8_t pos = 0;
+        uint8_t pos = prob->pos[j];
         array_uint8_t *gr_pf = &prob->I_GR[j];
-        for (size_t l = 0; l < gr_pf->n; ++l) pos += bitvec_GET(&theta->pf, gr_pf->d[l]);
         double p_pr = P->PR[prob->I_PR[j]].p;
-        pr->R[j][0] = (gr_pf->n-pos)*p_o/(1-p_pr);
-        pr->R[j][1] = pos*p_o/p_pr;
+        pr->R[j][0] = (gr_pf->n-pos)*p_o[i]/(1-p_pr);
+        pr->R[j][1] = pos*p_o[i]/p_pr;
       }
       for (size_t j = 0; j < prob->nr; ++j) {
         neural_rule_t *R = &P->NR[prob->I_NR[j]];
@@ -1047,7 +1835,7 @@ solve_cleanup:
              * | 0.3  0.4 | -> outcome 1, grounding 2
              * | 0.5  0.7 | -> outcome 2, grounding 2
              */
-            pr->NR[j][g*2*R->o + o*2 + u] += p_o/(u*q_p + (!u)*(1-q_p));
+            pr->NR[j][g*2*R->o + o*2 + u] += p_o[i]/(u*q_p + (!u)*(1-q_p));
           }
       }
       for (size_t j = 0; j < prob->na; ++j) {
@@ -1063,32 +1851,43 @@ solve_cleanup:
              * | 0.1  0.5  0.3 | -> outcome 1, grounding 2
              * | 0.5  0.7  0.3 | -> outcome 2, grounding 2
              */
-            pr->NA[j][g*A->v*A->o + o*A->v + u] += p_o/q[g*P->batch*A->v*A->o+ o*A->v + u];
+            pr->NA[j][g*A->v*A->o + o*A->v + u] += p_o[i]/q[g*P->batch*A->v*A->o+ o*A->v + u];
           }
       }
     } else {
-      for (size_t j = 0; j < prob->n; ++j)
-        pr->F[j][bitvec_GET(&theta->pf, j)] += p_o;
-      for (size_t j = 0; j < prob->m; ++j)
-        pr->A[j][theta->theta_ad[prob->I_A[j]]] += p_o;
-      for (size_t j = 0; j < prob->pr; ++j) {
-        uint8_t pos = 0;
-        array_uint8_t *gr_pf = &prob->I_GR[j];
-        for (size_t l = 0; l < gr_pf->n; ++l) pos += bitvec_GET(&theta->pf, gr_pf->d[l]);
-        pr->R[j][1] += pos*p_o;
-      }
+      for (size_t j = 0; j < prob->pr; ++j) pr->R[j][1] += prob->pos[j]*p_o[i];
     }
   }
 
+done:
+  PROF_END(PROF_PROB, t_prob);
   st->fail = false;
 cleanup:
-  clingo_control_free(C);
+  release_control(&st->ctl, C);
+  TRACE_END(TRACE_JOB, t_job);
   pthread_mutex_lock(st->wakeup);
   st->busy_procs[st->pid] = false;
   pthread_cond_signal(st->avail);
   pthread_mutex_unlock(st->wakeup);
 }
 
+#define PROB_OBS_KERNEL(name, dense, derive) \
+  static void name(void *args) { _compute_prob_obs(args, dense, derive); }
+
+PROB_OBS_KERNEL(compute_prob_obs_sparse, false, false)
+PROB_OBS_KERNEL(compute_prob_obs_sparse_derive, false, true)
+PROB_OBS_KERNEL(compute_prob_obs_dense, true, false)
+PROB_OBS_KERNEL(compute_prob_obs_dense_derive, true, true)
+
+/* Picks the specialized observation kernel, indexed by [dense][derive]. */
+kernel_t select_prob_obs_kernel(observations_t *obs, bool derive) {
+  static const kernel_t kernels[2][2] = {
+    {compute_prob_obs_sparse, compute_prob_obs_sparse_derive},
+    {compute_prob_obs_dense, compute_prob_obs_dense_derive},
+  };
+  return kernels[obs->dense][derive];
+}
+
 bool prob_obs(program_t *P, observations_t *obs, bool lstables_sat, prob_storage_t *ret, bool derive) {
   prob_storage_t Q[NUM_PROCS] = {0};
   size_t num_procs = init_prob_storage_seq(Q, P, obs);
@@ -1123,6 +1922,7 @@ bool prob_obs_reuse(program_t *P, observations_t *obs, bool lstable_sat, prob_st
   pthread_cond_t avail = PTHREAD_COND_INITIALIZER;
   threadpool pool = thpool_init(num_procs);
   struct { prob_storage_t *Q; storage_t *S; observations_t *O; bool derive; } tuple[NUM_PROCS] = {{0}};
+  kernel_t compute_func = select_prob_obs_kernel(obs, derive);
 
   if (!init_total_choice(&theta, total_choice_n, P)) goto cleanup;
 
@@ -1134,10 +1934,10 @@ bool prob_obs_reuse(program_t *P, observations_t *obs, bool lstable_sat, prob_st
     tuple[i].Q = &Q[i]; tuple[i].S = &S[i];
     tuple[i].O = obs; tuple[i].derive = derive;
     /* Fill probs with zero. */
+    memset(Q[i].DF, 0, obs->n*2*Q[0].n*sizeof(double));
+    memset(Q[i].DA, 0, obs->n*Q[i].A_w*sizeof(double));
     for (size_t j = 0; j < obs->n; ++j) {
       prob_obs_storage_t *pr = &Q[i].P[j];
-      memset(pr->F, 0, Q[0].n*sizeof(double[2]));
-      for (size_t l = 0; l < Q[0].m; ++l) memset(pr->A[l], 0, STORAGE_AD_DIM(P, &Q[0], l)*sizeof(double));
       memset(pr->R, 0, Q[0].pr*sizeof(double[2]));
       for (size_t l = 0; l < Q[0].nr; ++l) {
         neural_rule_t *nr = &P->NR[Q[0].I_NR[l]];
@@ -1155,7 +1955,7 @@ bool prob_obs_reuse(program_t *P, observations_t *obs, bool lstable_sat, prob_st
     do {
       int id = retr_free_proc(busy_procs, num_procs, &wakeup, &avail);
       if (!dispatch_job_with_payload(&theta, &wakeup, busy_procs, S, num_procs, pool, &avail, id,
-            compute_prob_obs, &tuple[id])) {
+            compute_func, &tuple[id])) {
         PyErr_SetString(PyExc_ChildProcessError, "compute_prob_obs returned an error code!");
         goto cleanup;
       }
@@ -1163,44 +1963,39 @@ bool prob_obs_reuse(program_t *P, observations_t *obs, bool lstable_sat, prob_st
   } while (incr_total_choice(&theta));
   thpool_wait(pool);
 
-  for (i = 1; i < num_procs; ++i) {
-    for (size_t o = 0; o < obs->n; ++o) {
-      prob_obs_storage_t *qr = &Q[0].P[o];
-      prob_obs_storage_t *pr = &Q[i].P[o];
-      for (size_t j = 0; j < Q[0].n; ++j) {
-        qr->F[j][0] += pr->F[j][0];
-        qr->F[j][1] += pr->F[j][1];
-      }
-      for (size_t j = 0; j < Q[0].m; ++j) {
-        size_t k = P->AD[Q[0].I_A[j]].n;
-        for (size_t c = 0; c < k; ++c)
-          qr->A[j][c] += pr->A[j][c];
-      }
-      for (size_t j = 0; j < Q[0].pr; ++j) {
-        qr->R[j][0] += pr->R[j][0];
-        qr->R[j][1] += pr->R[j][1];
-      }
-      for (size_t j = 0; j < Q[0].nr; ++j) {
-        neural_rule_t *R = &P->NR[Q[0].I_NR[j]];
-        for (size_t g = 0; g < R->n; ++g)
-          for (size_t o = 0; o < R->o; ++o) {
-            size_t u = g*2*R->o + o*2;
-            qr->NR[j][u] += pr->NR[j][u];
-            qr->NR[j][u+1] += pr->NR[j][u+1];
-          }
-      }
-      for (size_t j = 0; j < Q[0].na; ++j) {
-        neural_annot_disj_t *A = &P->NA[Q[0].I_NA[j]];
-        for (size_t g = 0; g < A->n; ++g)
-          for (size_t o = 0; o < A->o; ++o)
-            for (size_t v = 0; v < A->v; ++v) {
-              size_t u = g*A->v*A->o + o*A->v + v;
-              qr->NA[j][u] += pr->NA[j][u];
-            }
+  PROF_BEGIN(t_merge);
+  /* Merge. */ {
+    /* Segments of each observation: F, A, R, NR, NA and o. */
+    size_t m_o = 3 + Q[0].m + Q[0].nr + Q[0].na, m = obs->n*m_o;
+    reduce_seg_t *G = (reduce_seg_t*) mem_malloc(MEM_STORAGE, num_procs*m*sizeof(reduce_seg_t));
+    if (!G) {
+      mem_raise("observation reduction");
+      goto cleanup;
+    }
+    for (i = 0; i < num_procs; ++i) {
+      reduce_seg_t *g = G + i*m;
+      for (size_t o = 0; o < obs->n; ++o) {
+        prob_obs_storage_t *pr = &Q[i].P[o];
+        *g++ = (reduce_seg_t) {pr->F, 2*Q[0].n};
+        for (size_t j = 0; j < Q[0].m; ++j)
+          *g++ = (reduce_seg_t) {pr->A[j], P->AD[Q[0].I_A[j]].n};
+        *g++ = (reduce_seg_t) {pr->R, 2*Q[0].pr};
+        for (size_t j = 0; j < Q[0].nr; ++j) {
+          neural_rule_t *R = &P->NR[Q[0].I_NR[j]];
+          *g++ = (reduce_seg_t) {pr->NR[j], 2*R->n*R->o};
+        }
+        for (size_t j = 0; j < Q[0].na; ++j) {
+          neural_annot_disj_t *A = &P->NA[Q[0].I_NA[j]];
+          *g++ = (reduce_seg_t) {pr->NA[j], A->n*A->v*A->o};
+        }
+        *g++ = (reduce_seg_t) {&pr->o, 1};
       }
-      qr->o += pr->o;
     }
+    bool r = reduce_sum(pool, num_procs, G, num_procs, m, REDUCE_DOUBLE);
+    mem_free(MEM_STORAGE, G);
+    if (!r) goto cleanup;
   }
+  PROF_END(PROF_MERGE, t_merge);
 
   if (ret) {
     ret->n = Q[0].n; ret->m = Q[0].m; ret->o = Q[0].o;
@@ -1208,6 +2003,7 @@ bool prob_obs_reuse(program_t *P, observations_t *obs, bool lstable_sat, prob_st
     ret->I_F = Q[0].I_F; ret->I_A = Q[0].I_A;
     ret->I_NR = Q[0].I_NR; ret->I_NA = Q[0].I_NA;
     ret->I_PR = Q[0].I_PR;
+    ret->DF = Q[0].DF; ret->DA = Q[0].DA; ret->A_w = Q[0].A_w;
     for (size_t o = 0; o < obs->n; ++o) {
       prob_obs_storage_t *qr = &ret->P[o];
       prob_obs_storage_t *pr = &Q[0].P[o];
@@ -4,6 +4,7 @@
 #include "cdata.h"
 #include "cprogram.h"
 #include "cinf.h"
+#include "ccheckpoint.h"
 
 typedef struct {
   /* Number of learnable probabilistic facts. */
@@ -11,22 +12,65 @@ typedef struct {
   /* Number of learnable annotated disjunctions. */
   size_t m;
   /* Number of models for each learnable probabilistic fact. */
-  uint16_t (*F)[2];
+  uint64_t (*F)[2];
   /* Indices of learnable PFs within the global PF array. */
   uint16_t *I_F;
   /* Number of models for each value of each learnable annotated disjunction. */
-  uint16_t **A;
+  uint64_t **A;
   /* Indices of learnable ADs within the global AD array. */
   uint16_t *I_A;
+  /* Whether a count did not fit in 64 bits. */
+  bool overflow;
 } count_storage_t;
 
 void free_count_storage_contents(count_storage_t *C, bool free_shared);
 void free_count_storage(count_storage_t *C);
 
-/* Compute (exactly) query probabilities by exhaustively enumerating all models. */
-bool exact_enum(program_t *P, double **R, bool lstable_sat, psemantics_t psem, bool quiet);
+/* Environment variable which, when set to "1", makes exact_enum run the unspecialized total choice
+ * kernels, for measuring what specialization saves (see benchmarks/run.py). */
+#define GENERIC_KERNELS_ENV "PASP_GENERIC_KERNELS"
+/* Whether exact_enum runs the unspecialized kernels (see GENERIC_KERNELS_ENV). */
+bool generic_kernels_enabled(void);
+
+/* The total choice space is cut into 2^SHARD_BLOCK_BITS blocks by the values of its last
+ * SHARD_BLOCK_BITS facts. Shard i of k enumerates blocks i, i+k, i+2k, ...; since aggregates are kept
+ * per block and merged in block order, the merged result does not depend on k. */
+#define SHARD_BLOCK_BITS 8
+
+typedef struct {
+  /* Index of this shard. */
+  size_t i;
+  /* Total number of shards. */
+  size_t k;
+  /* Path to write the partial aggregates of this shard to. */
+  const char *path;
+} shard_t;
+
+/* Compute (exactly) query probabilities by exhaustively enumerating all models. If ck is not NULL,
+ * the enumeration is periodically checkpointed to ck->path and/or resumed from ck->resume. If sh is
+ * not NULL, only the blocks of shard sh are enumerated, their aggregates written to sh->path and R
+ * left untouched. Progress is reported through pg, unless pg is NULL or disabled. */
+bool exact_enum(program_t *P, double **R, bool lstable_sat, psemantics_t psem, bool quiet,
+    checkpoint_t *ck, shard_t *sh, progress_t *pg);
+/* Answers the queries of P by junction tree propagation (see jtree_query) instead of enumeration.
+ * If P is not an acyclic normal program of small enough treewidth, sets *done to false and leaves R
+ * untouched. */
+bool exact_jtree(program_t *P, double **R, psemantics_t psem, bool quiet, bool *done);
+/* Approximates the queries of P by loopy belief propagation (see cbp.h) with the given damping,
+ * iteration limit and tolerance, writing the largest number of iterations to *iters and whether
+ * every propagation converged to *converged. If P is not an acyclic normal program as required,
+ * sets *done to false and leaves R untouched. */
+bool approx_bp(program_t *P, double **R, psemantics_t psem, double damping, size_t max_iters,
+    double tol, bool quiet, bool *done, size_t *iters, bool *converged);
+/* Merges the n shard files in paths written by exact_enum and answers the queries of P. Raises
+ * ValueError if a shard was written for another program or under other psem or lstable_sat. */
+bool exact_merge(program_t *P, const char **paths, size_t n, double **R, psemantics_t psem,
+    bool lstable_sat, bool quiet);
+/* Prints the answers I to the queries of P as exact inference does, reporting queries whose
+ * evidence has zero probability even if quiet. */
+void print_answers(program_t *P, double *I, psemantics_t psem, bool quiet);
 /* Count number of models for each learnable probabilistic fact or annotated disjunction. */
-bool count_models(program_t *P, bool lstable_sat, count_storage_t *C);
+bool count_models(program_t *P, bool lstable_sat, count_storage_t *C, progress_t *pg);
 
 typedef struct {
   /* Probabilities for each learnable PF. */
@@ -76,6 +120,15 @@ typedef struct {
   uint16_t *O_NA;
   /* Arrays for identifying the indices of ground rules. */
   array_uint8_t *I_GR;
+  /* Dense observations × parameters matrices holding the rows F (2n columns) and A (A_w columns,
+   * the values of each learnable AD in turn) of every observation, so that the contribution of a
+   * total choice is a single rank-1 update of each. */
+  double *DF, *DA;
+  size_t A_w;
+  /* Scratch of the observation kernel: the probability of each observation under a total choice,
+   * the factor of each column of DF and DA, and the number of true groundings of each PR. */
+  double *p_o, *GF, *GA;
+  size_t *pos;
 } prob_storage_t;
 
 bool init_prob_storage(prob_storage_t *Q, program_t *P, prob_storage_t *U, observations_t *O);
@@ -0,0 +1,325 @@
+#include "cfactor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cinf.h"
+#include "cutils.h"
+#include "cmem.h"
+
+#define VAR(l) ((uint32_t) ((l) > 0 ? (l) : -(l)))
+/* Variable of program atoms outside of the factor graph. */
+#define FG_NONE UINT32_MAX
+
+void free_factor_graph_contents(factor_graph_t *G) {
+  array_uint32_t_free_contents(&G->FV); array_uint32_t_free_contents(&G->FO);
+  mem_free(MEM_STORAGE, G->FT);
+  mem_free(MEM_STORAGE, G->L); mem_free(MEM_STORAGE, G->LO); mem_free(MEM_STORAGE, G->never);
+  G->FT = NULL; G->L = NULL; G->LO = NULL; G->never = NULL;
+}
+
+bool query_same_evidence(query_t *a, query_t *b) {
+  if (a->E_n != b->E_n) return false;
+  for (size_t i = 0; i < a->E_n; ++i)
+    if (!clingo_symbol_is_equal_to(a->E[i], b->E[i]) || a->E_s[i] != b->E_s[i]) return false;
+  return true;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+  return (x > y) - (x < y);
+}
+
+/* Grounds P on C, observed by S, where every probabilistic fact and every atom of an annotated
+ * disjunction is a choice. Their program atoms are written to A, facts first. */
+static bool fg_ground(program_t *P, clingo_control_t *C, sharpsat_t *S, clingo_atom_t *A) {
+  clingo_backend_t *back;
+  size_t k = 0;
+
+  if (!clingo_control_register_observer(C, &SHARPSAT_OBSERVER, false, S)) return false;
+  if (!clingo_control_add(C, "base", NULL, 0, P->P)) return false;
+  if (P->gr_P[0]) if (!clingo_control_add(C, "base", NULL, 0, P->gr_P)) return false;
+  if (!clingo_control_backend(C, &back)) return false;
+  if (!clingo_backend_begin(back)) return false;
+  for (size_t i = 0; i < P->PF_n; ++i)
+    if (!clingo_backend_add_atom(back, &P->PF[i].cl_f, &A[k++])) goto error;
+  for (size_t i = 0; i < P->AD_n; ++i)
+    for (size_t j = 0; j < P->AD[i].n; ++j)
+      if (!clingo_backend_add_atom(back, &P->AD[i].cl_F[j], &A[k++])) goto error;
+  if (!clingo_backend_rule(back, true, A, k, NULL, 0)) goto error;
+  if (!clingo_backend_end(back)) return false;
+  return atomic_ground(C, NULL, NULL);
+error:
+  clingo_backend_end(back);
+  return false;
+}
+
+/* Appends to G a factor over the k variables in V (sorted in place), setting *T to its table and
+ * *k to the size of its scope. Sets *ok to false if the scope is wider than G->w. */
+static bool fg_factor(factor_graph_t *G, uint32_t *V, size_t *k, double **T, bool *ok) {
+  size_t m = 0;
+  qsort(V, *k, sizeof(uint32_t), cmp_u32);
+  for (size_t i = 0; i < *k; ++i) if (!m || V[m-1] != V[i]) V[m++] = V[i];
+  if (m > G->w) { *ok = false; return true; }
+  for (size_t i = 0; i < m; ++i) if (!array_uint32_t_append(&G->FV, V[i])) return false;
+  if (!array_uint32_t_append(&G->FO, G->FV.n)) return false;
+  if (G->FT_n + ((size_t) 1 << m) > G->FT_c) {
+    size_t c = 2*(G->FT_c + ((size_t) 1 << m));
+    double *F = (double*) mem_realloc(MEM_STORAGE, G->FT, c*sizeof(double));
+    if (!F) return false;
+    G->FT = F; G->FT_c = c;
+  }
+  *T = G->FT + G->FT_n;
+  G->FT_n += (size_t) 1 << m;
+  *k = m;
+  return true;
+}
+
+/* Builds the factors of G from the ground program observed by S, over the atoms the R_n program
+ * atoms in R depend on; A holds the program atoms of probabilistic facts and annotated
+ * disjunctions, as written by fg_ground. The variable of each program atom is written to loc. Sets
+ * *ok to false if the program is not normal and acyclic, has integrity constraints or choices
+ * other than those of A, or has a factor that is too wide. */
+static bool fg_build(program_t *P, sharpsat_t *S, clingo_atom_t *A, uint32_t *R, size_t R_n,
+    factor_graph_t *G, uint32_t **loc, bool *ok) {
+  size_t N = S->atoms + 1, K = P->PF_n, r_n = S->H.n, i, j;
+  uint32_t *pr = NULL, *ga = NULL, *HO = NULL, *HR = NULL, *OO = NULL, *OE = NULL, *deg = NULL;
+  uint32_t *stk = NULL, *V = NULL, *L = NULL;
+  int32_t *Lp = NULL;
+  bool *rel = NULL, *gdone = NULL, r = false;
+  size_t *ado = NULL;
+
+  *ok = false;
+  for (i = 0; i < P->AD_n; ++i) K += P->AD[i].n;
+  pr = (uint32_t*) mem_malloc(MEM_STORAGE, N*sizeof(uint32_t));
+  ga = (uint32_t*) mem_malloc(MEM_STORAGE, (K+1)*sizeof(uint32_t));
+  ado = (size_t*) mem_malloc(MEM_STORAGE, (P->AD_n+1)*sizeof(size_t));
+  HO = (uint32_t*) mem_calloc(MEM_STORAGE, N+1, sizeof(uint32_t));
+  HR = (uint32_t*) mem_malloc(MEM_STORAGE, (r_n+1)*sizeof(uint32_t));
+  OO = (uint32_t*) mem_calloc(MEM_STORAGE, N+1, sizeof(uint32_t));
+  OE = (uint32_t*) mem_malloc(MEM_STORAGE, (S->B.n+1)*sizeof(uint32_t));
+  deg = (uint32_t*) mem_calloc(MEM_STORAGE, N, sizeof(uint32_t));
+  stk = (uint32_t*) mem_malloc(MEM_STORAGE, N*sizeof(uint32_t));
+  V = (uint32_t*) mem_malloc(MEM_STORAGE, (S->B.n+K+1)*sizeof(uint32_t));
+  Lp = (int32_t*) mem_malloc(MEM_STORAGE, (S->B.n+1)*sizeof(int32_t));
+  rel = (bool*) mem_calloc(MEM_STORAGE, N, sizeof(bool));
+  gdone = (bool*) mem_calloc(MEM_STORAGE, P->AD_n+1, sizeof(bool));
+  *loc = L = (uint32_t*) mem_malloc(MEM_STORAGE, N*sizeof(uint32_t));
+  if (!(pr && ga && ado && HO && HR && OO && OE && deg && stk && V && Lp && rel && gdone && L))
+    goto nomem;
+
+  /* Probabilistic atoms, each a choice of exactly one fact or annotated disjunction. */
+  for (i = 0; i < N; ++i) pr[i] = FG_NONE;
+  for (i = 0; i < P->PF_n; ++i) ga[i] = FG_NONE;
+  for (i = 0, ado[0] = P->PF_n; i < P->AD_n; ++i) {
+    ado[i+1] = ado[i] + P->AD[i].n;
+    for (j = ado[i]; j < ado[i+1]; ++j) ga[j] = i;
+  }
+  for (i = 0; i < K; ++i) {
+    if (A[i] >= N || pr[A[i]] != FG_NONE) goto cleanup;
+    pr[A[i]] = i;
+  }
+
+  /* Rules of each head, and heads depending on each atom. */
+  for (i = 0; i < r_n; ++i) {
+    uint32_t h = S->H.d[i];
+    size_t e = i+1 < r_n ? S->R.d[i+1] : S->B.n;
+    if (!h) goto cleanup;
+    if (S->Ch.d[i]) {
+      if (e > S->R.d[i] || pr[h] == FG_NONE) goto cleanup;
+      continue;
+    }
+    if (pr[h] != FG_NONE) goto cleanup;
+    ++HO[h+1];
+    deg[h] += e - S->R.d[i];
+    for (j = S->R.d[i]; j < e; ++j) ++OO[VAR(S->B.d[j])+1];
+  }
+  for (i = 0; i < N; ++i) { HO[i+1] += HO[i]; OO[i+1] += OO[i]; }
+  for (i = 0; i < r_n; ++i) {
+    uint32_t h = S->H.d[i];
+    size_t e = i+1 < r_n ? S->R.d[i+1] : S->B.n;
+    if (S->Ch.d[i]) continue;
+    HR[HO[h]++] = i;
+    for (j = S->R.d[i]; j < e; ++j) OE[OO[VAR(S->B.d[j])]++] = h;
+  }
+  for (i = N; i > 0; --i) { HO[i] = HO[i-1]; OO[i] = OO[i-1]; }
+  HO[0] = OO[0] = 0;
+
+  /* The program is acyclic iff every atom is eventually popped in Kahn's algorithm. */
+  size_t top = 0, popped = 0;
+  for (i = 1; i < N; ++i) if (!deg[i]) stk[top++] = i;
+  while (top) {
+    uint32_t u = stk[--top];
+    ++popped;
+    for (j = OO[u]; j < OO[u+1]; ++j) if (!--deg[OE[j]]) stk[top++] = OE[j];
+  }
+  if (popped < N-1) goto cleanup;
+
+  /* Only ancestors of the atoms in R are relevant. */
+  for (i = 0; i < R_n; ++i) {
+    if (R[i] >= N) goto cleanup;
+    if (!rel[R[i]]) { rel[R[i]] = true; stk[top++] = R[i]; }
+  }
+  while (top) {
+    uint32_t u = stk[--top];
+    if (pr[u] != FG_NONE && ga[pr[u]] != FG_NONE) {
+      size_t g = ga[pr[u]];
+      for (j = ado[g]; j < ado[g+1]; ++j)
+        if (!rel[A[j]]) { rel[A[j]] = true; stk[top++] = A[j]; }
+    }
+    for (size_t k = HO[u]; k < HO[u+1]; ++k) {
+      size_t t = HR[k], e = t+1 < r_n ? S->R.d[t+1] : S->B.n;
+      for (j = S->R.d[t]; j < e; ++j) {
+        uint32_t v = VAR(S->B.d[j]);
+        if (!rel[v]) { rel[v] = true; stk[top++] = v; }
+      }
+    }
+  }
+  G->n = 0;
+  for (i = 0; i < N; ++i) L[i] = rel[i] ? G->n++ : FG_NONE;
+
+  /* Factors of probabilistic facts, annotated disjunctions and rule heads. */
+  if (!array_uint32_t_init(&G->FV) || !array_uint32_t_init(&G->FO)) goto nomem;
+  if (!array_uint32_t_append(&G->FO, 0)) goto nomem;
+  *ok = true;
+  for (uint32_t u = 1; u < N; ++u) {
+    if (!rel[u]) continue;
+    size_t k = 0;
+    double *T;
+    if (pr[u] != FG_NONE && ga[pr[u]] == FG_NONE) {
+      double p = P->PF[pr[u]].p;
+      V[k++] = L[u];
+      if (!fg_factor(G, V, &k, &T, ok)) goto nomem;
+      T[0] = 1-p; T[1] = p;
+    } else if (pr[u] != FG_NONE) {
+      /* Exactly one atom of an annotated disjunction is true. */
+      size_t g = ga[pr[u]];
+      if (gdone[g]) continue;
+      gdone[g] = true;
+      for (j = ado[g]; j < ado[g+1]; ++j) V[k++] = L[A[j]];
+      if (!fg_factor(G, V, &k, &T, ok)) goto nomem;
+      if (!*ok) goto cleanup;
+      for (size_t x = 0; x < ((size_t) 1 << k); ++x) {
+        T[x] = 0;
+        if (__builtin_popcountll(x) != 1) continue;
+        uint32_t v = V[__builtin_ctzll(x)];
+        for (j = ado[g]; j < ado[g+1]; ++j) if (L[A[j]] == v) T[x] = P->AD[g].P[j-ado[g]];
+      }
+    } else if (HO[u] == HO[u+1]) {
+      /* Atoms without rules are false. */
+      V[k++] = L[u];
+      if (!fg_factor(G, V, &k, &T, ok)) goto nomem;
+      T[0] = 1; T[1] = 0;
+    } else {
+      /* The head is true iff the body of one of its rules holds. */
+      V[k++] = L[u];
+      for (size_t t = HO[u]; t < HO[u+1]; ++t) {
+        size_t h = HR[t], e = h+1 < r_n ? S->R.d[h+1] : S->B.n;
+        for (j = S->R.d[h]; j < e; ++j) V[k++] = L[VAR(S->B.d[j])];
+      }
+      if (!fg_factor(G, V, &k, &T, ok)) goto nomem;
+      if (!*ok) goto cleanup;
+      size_t l = 0, ph = (uint32_t*) bsearch(&L[u], V, k, sizeof(uint32_t), cmp_u32) - V;
+      for (size_t t = HO[u]; t < HO[u+1]; ++t) {
+        size_t h = HR[t], e = h+1 < r_n ? S->R.d[h+1] : S->B.n;
+        for (j = S->R.d[h]; j < e; ++j) {
+          int32_t p = (uint32_t*) bsearch(&L[VAR(S->B.d[j])], V, k, sizeof(uint32_t), cmp_u32) - V;
+          Lp[l++] = S->B.d[j] > 0 ? p+1 : -(p+1);
+        }
+      }
+      for (size_t x = 0; x < ((size_t) 1 << k); ++x) {
+        bool any = false;
+        for (size_t t = HO[u], o = 0; t < HO[u+1] && !any; ++t) {
+          size_t h = HR[t], e = (h+1 < r_n ? S->R.d[h+1] : S->B.n) - S->R.d[h];
+          bool all = true;
+          for (j = 0; j < e && all; ++j) {
+            int32_t p = Lp[o+j];
+            all = ((x >> (abs(p)-1)) & 1) == (p > 0);
+          }
+          any = all;
+          o += e;
+        }
+        T[x] = ((x >> ph) & 1) == any;
+      }
+    }
+    if (!*ok) goto cleanup;
+  }
+
+  r = true;
+  goto cleanup;
+nomem:
+  mem_raise("factor graph");
+cleanup:
+  if (!r) *ok = false;
+  mem_free(MEM_STORAGE, pr); mem_free(MEM_STORAGE, ga); mem_free(MEM_STORAGE, ado);
+  mem_free(MEM_STORAGE, HO); mem_free(MEM_STORAGE, HR);
+  mem_free(MEM_STORAGE, OO); mem_free(MEM_STORAGE, OE);
+  mem_free(MEM_STORAGE, deg); mem_free(MEM_STORAGE, stk);
+  mem_free(MEM_STORAGE, V); mem_free(MEM_STORAGE, Lp);
+  mem_free(MEM_STORAGE, rel); mem_free(MEM_STORAGE, gdone);
+  return r || !PyErr_Occurred();
+}
+
+bool factor_graph_compile(program_t *P, size_t w, factor_graph_t *G, bool *ok) {
+  clingo_control_t *C = NULL;
+  sharpsat_t S = {0};
+  clingo_atom_t *A = NULL;
+  uint32_t *loc = NULL, *R = NULL;
+  size_t K = P->PF_n, Q_n = P->Q_n, L_n = 0, i, j;
+  bool r = false;
+
+  *G = (factor_graph_t) {0};
+  G->w = w;
+  *ok = false;
+  /* Credal facts and neural components are only handled by enumeration, as are the partial
+   * semantics, whose programs are not plain normal programs. */
+  if (P->sem != STABLE_SEMANTICS || P->CF_n || P->NR_n || P->NA_n || !Q_n) return true;
+  for (i = 0; i < P->AD_n; ++i) K += P->AD[i].n;
+  for (i = 0; i < Q_n; ++i) L_n += P->Q[i].Q_n + P->Q[i].E_n;
+
+  A = (clingo_atom_t*) mem_malloc(MEM_STORAGE, (K ? K : 1)*sizeof(clingo_atom_t));
+  R = (uint32_t*) mem_malloc(MEM_STORAGE, (L_n ? L_n : 1)*sizeof(uint32_t));
+  G->L = (int32_t*) mem_malloc(MEM_STORAGE, (L_n ? L_n : 1)*sizeof(int32_t));
+  G->LO = (size_t*) mem_malloc(MEM_STORAGE, (2*Q_n+1)*sizeof(size_t));
+  G->never = (bool*) mem_calloc(MEM_STORAGE, 2*Q_n, sizeof(bool));
+  if (!(A && R && G->L && G->LO && G->never)) {
+    mem_raise("factor graph");
+    goto cleanup;
+  }
+
+  if (!clingo_control_new(NULL, 0, undef_atom_ignore, NULL, 20, &C)) goto cleanup;
+  if (!init_sharpsat(&S)) goto cleanup;
+  if (!fg_ground(P, C, &S, A)) goto cleanup;
+  if (!S.ok) { r = true; goto cleanup; }
+
+  size_t l = 0;
+  G->LO[0] = 0;
+  for (i = 0; i < Q_n; ++i) {
+    query_t *Q = P->Q+i;
+    for (j = 0; j < Q->E_n + Q->Q_n; ++j) {
+      bool E = j < Q->E_n, c;
+      clingo_literal_t x;
+      if (!sharpsat_literal(C, E ? Q->E[j] : Q->Q[j-Q->E_n], E ? Q->E_s[j] : Q->Q_s[j-Q->E_n], &x,
+            &c)) goto cleanup;
+      if (x) { R[l] = VAR(x); G->L[l++] = x; }
+      else G->never[2*i+!E] |= !c;
+      if (j+1 == Q->E_n) G->LO[2*i+1] = l;
+    }
+    if (!Q->E_n) G->LO[2*i+1] = G->LO[2*i];
+    G->LO[2*i+2] = l;
+  }
+
+  if (!fg_build(P, &S, A, R, l, G, &loc, ok)) goto cleanup;
+  if (*ok)
+    for (i = 0; i < l; ++i)
+      G->L[i] = G->L[i] > 0 ? (int32_t) loc[VAR(G->L[i])]+1 : -(int32_t) loc[VAR(G->L[i])]-1;
+
+  r = true;
+cleanup:
+  if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
+  if (!r || !*ok) { free_factor_graph_contents(G); *ok = false; }
+  clingo_control_free(C);
+  free_sharpsat_contents(&S);
+  mem_free(MEM_STORAGE, A); mem_free(MEM_STORAGE, R); mem_free(MEM_STORAGE, loc);
+  return r;
+}
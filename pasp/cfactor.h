@@ -0,0 +1,45 @@
+#ifndef _PASP_CFACTOR
+#define _PASP_CFACTOR
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cprogram.h"
+#include "csharpsat.h"
+
+/* Factor graph of a ground program that is normal, acyclic and has no integrity constraints, so
+ * that each total choice has exactly one stable model and the program is a Bayesian network over
+ * its atoms. Variables are the atoms relevant to the queries (their ancestors), numbered in
+ * increasing order of their program atoms. The rules of each head become a single factor over the
+ * head and its body atoms, and each probabilistic fact or annotated disjunction a factor over its
+ * atoms. */
+typedef struct {
+  /* Number of variables. */
+  size_t n;
+  /* Largest number of variables in the scope of a factor. */
+  size_t w;
+  /* Factors: factor i has scope FV[FO[i]..FO[i+1]), in increasing order, and a table of 2^k
+   * entries in FT right after the table of factor i-1, where bit j of an index is the truth value
+   * of the j-th variable of the scope. FT holds FT_n entries and has room for FT_c. */
+  array_uint32_t_t FV, FO;
+  double *FT;
+  size_t FT_n, FT_c;
+  /* Literals of the evidence of query i are L[LO[2i]..LO[2i+1]), and those of its query
+   * L[LO[2i+1]..LO[2i+2]), where +(u+1) (resp. -(u+1)) means variable u is true (resp. false);
+   * never[2i] (resp. never[2i+1]) is whether some evidence (resp. query) literal is false in every
+   * model. */
+  int32_t *L;
+  size_t *LO;
+  bool *never;
+} factor_graph_t;
+
+/* Grounds P and compiles it into the factor graph G, whose factors have at most w variables. Sets
+ * *ok to false (and returns true) if P has no queries, is not as described for factor_graph_t,
+ * uses the partial semantics, credal facts or neural components, or has a wider factor. */
+bool factor_graph_compile(program_t *P, size_t w, factor_graph_t *G, bool *ok);
+void free_factor_graph_contents(factor_graph_t *G);
+
+/* Whether queries a and b have the same evidence. */
+bool query_same_evidence(query_t *a, query_t *b);
+
+#endif
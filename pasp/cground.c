@@ -161,9 +161,9 @@ bool partial_update_program(program_t *P, array_char_t *gr_P, array_prob_fact_t_
   py_P_PF = PyObject_GetAttrString(P->py_P, "PF");
   if (!py_P_PF) goto cleanup;
 
-  PF = (prob_fact_t*) realloc(P->PF, n*sizeof(prob_fact_t));
+  PF = (prob_fact_t*) mem_realloc(MEM_GROUND, P->PF, n*sizeof(prob_fact_t));
   if (!PF) {
-    PyErr_SetString(PyExc_MemoryError, "could not allocate enough memory for grounding!");
+    mem_raise("grounding");
     goto cleanup;
   }
   for (size_t i = 0; i < gr_PF->n; ++i) {
@@ -238,7 +238,7 @@ bool ground_per_total_choice(program_t *P, total_choice_t *theta, array_prob_fac
   clingo_control_t *C = NULL;
   array_prob_fact_t gr_PF = {0};
   array_char_t gr_P = {0};
-  void *pack[5] = {(void*) &gr_PF, (void*) &gr_P, (void*) P, (void*) true, NULL};
+  void *pack[4] = {(void*) &gr_PF, (void*) &gr_P, (void*) P, NULL};
   bool ok = false;
 
   if (!array_prob_fact_t_init(&gr_PF)) goto error;
@@ -253,7 +253,7 @@ bool ground_per_total_choice(program_t *P, total_choice_t *theta, array_prob_fac
   }
 
   if (Q) {
-    pack[4] = (void*) Q->I_GR;
+    pack[3] = (void*) Q->I_GR;
     for (i = 0; i < Q->pr; ++i) array_uint8_t_clear(&Q->I_GR[i]);
   }
 
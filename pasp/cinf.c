@@ -1,5 +1,7 @@
 #include "cinf.h"
 #include "cutils.h"
+#include "cprofile.h"
+#include "ctrace.h"
 #include <string.h>
 
 double prob_total_choice_prob(program_t *P, total_choice_t *theta) {
@@ -58,6 +60,8 @@ bool init_storage(storage_t *s, program_t *P, array_bool_t (*Pn)[4],
   s->count_q_e = s->count_e = s->count_partial_q_e = NULL;
   s->a = s->b = s->c = s->d = NULL;
   s->Pn = Pn; s->K = K; s->P = P;
+  s->prog = NULL; s->sched = NULL; s->sharpsat = false;
+  s->ctl = (control_pool_t) {0};
   s->mu = mu; s->wakeup = wakeup; s->avail = avail;
   if (!setup_conds(&s->cond_1, &s->cond_2, &s->cond_3, &s->cond_4, P->Q_n*sizeof(bool))) goto error;
   if (!setup_counts(&s->count_q_e, &s->count_e, &s->count_partial_q_e, P->Q_n*sizeof(size_t))) goto error;
@@ -68,66 +72,73 @@ bool init_storage(storage_t *s, program_t *P, array_bool_t (*Pn)[4],
   if (!init_total_choice(&s->theta, total_choice_n, P)) goto error;
   return true;
 error:
-  PyErr_SetString(PyExc_MemoryError, "could not allocate enough memory for init_storage!");
+  mem_raise("worker storage");
   return false;
 }
 
 void free_storage_contents(storage_t *s) {
-  free(s->cond_1); free(s->cond_2); free(s->cond_3); free(s->cond_4);
-  free(s->count_q_e); free(s->count_e); free(s->count_partial_q_e);
-  if (!s->P->CF_n) { free(s->a); free(s->b); free(s->c); free(s->d); }
+  mem_free(MEM_STORAGE, s->cond_1); mem_free(MEM_STORAGE, s->cond_2);
+  mem_free(MEM_STORAGE, s->cond_3); mem_free(MEM_STORAGE, s->cond_4);
+  mem_free(MEM_STORAGE, s->count_q_e); mem_free(MEM_STORAGE, s->count_e);
+  mem_free(MEM_STORAGE, s->count_partial_q_e);
+  if (!s->P->CF_n) {
+    mem_free(MEM_STORAGE, s->a); mem_free(MEM_STORAGE, s->b);
+    mem_free(MEM_STORAGE, s->c); mem_free(MEM_STORAGE, s->d);
+  }
   free_total_choice_contents(&s->theta);
+  free_control_pool_contents(&s->ctl);
 }
 
 bool setup_conds(bool **cond_1, bool **cond_2, bool **cond_3, bool **cond_4, size_t n) {
-  *cond_1 = (bool*) malloc(n);
+  *cond_1 = (bool*) mem_malloc(MEM_STORAGE, n);
   if (!(*cond_1)) goto nomem;
-  *cond_2 = (bool*) malloc(n);
+  *cond_2 = (bool*) mem_malloc(MEM_STORAGE, n);
   if (!(*cond_2)) goto nomem;
-  *cond_3 = (bool*) malloc(n);
+  *cond_3 = (bool*) mem_malloc(MEM_STORAGE, n);
   if (!(*cond_3)) goto nomem;
-  *cond_4 = (bool*) malloc(n);
+  *cond_4 = (bool*) mem_malloc(MEM_STORAGE, n);
   if (!(*cond_4)) goto nomem;
   return true;
 nomem:
-  free(*cond_1); free(*cond_2);
-  free(*cond_3); free(*cond_4);
+  mem_free(MEM_STORAGE, *cond_1); mem_free(MEM_STORAGE, *cond_2);
+  mem_free(MEM_STORAGE, *cond_3); mem_free(MEM_STORAGE, *cond_4);
   *cond_1 = *cond_2 = *cond_3 = *cond_4 = NULL;
-  goto nomem;
+  return false;
 }
 
 bool setup_counts(size_t **count_q_e, size_t **count_e, size_t **count_partial_q_e, size_t n) {
-  *count_q_e = (size_t*) malloc(n);
+  *count_q_e = (size_t*) mem_malloc(MEM_STORAGE, n);
   if (!(*count_q_e)) goto nomem;
-  *count_e = (size_t*) malloc(n);
+  *count_e = (size_t*) mem_malloc(MEM_STORAGE, n);
   if (!(*count_e)) goto nomem;
   if (count_partial_q_e) {
-    *count_partial_q_e = (size_t*) malloc(n);
+    *count_partial_q_e = (size_t*) mem_malloc(MEM_STORAGE, n);
     if (!(*count_partial_q_e)) goto nomem;
   }
   return true;
 nomem:
-  free(*count_q_e); free(*count_e); free(*count_partial_q_e);
+  mem_free(MEM_STORAGE, *count_q_e); mem_free(MEM_STORAGE, *count_e);
+  mem_free(MEM_STORAGE, *count_partial_q_e);
   *count_q_e = *count_e = *count_partial_q_e = NULL;
   return false;
 }
 
 bool setup_abcd(double **a, double **b, double **c, double **d, size_t n, size_t s) {
-  *a = (double*) calloc(n, s);
+  *a = (double*) mem_calloc(MEM_STORAGE, n, s);
   if (!(*a)) goto nomem;
-  *b = (double*) calloc(n, s);
+  *b = (double*) mem_calloc(MEM_STORAGE, n, s);
   if (!(*b)) goto nomem;
   if (c) {
-    *c = (double*) calloc(n, s);
+    *c = (double*) mem_calloc(MEM_STORAGE, n, s);
     if (!(*c)) goto nomem;
   } if (d) {
-    *d = (double*) calloc(n, s);
+    *d = (double*) mem_calloc(MEM_STORAGE, n, s);
     if (!(*d)) goto nomem;
   }
   return true;
 nomem:
-  free(*a); free(*b);
-  free(*c); free(*d);
+  mem_free(MEM_STORAGE, *a); mem_free(MEM_STORAGE, *b);
+  mem_free(MEM_STORAGE, *c); mem_free(MEM_STORAGE, *d);
   *a = *b = *c = *d = NULL;
   return false;
 }
@@ -136,7 +147,7 @@ bool _init_total_choice(total_choice_t *theta, size_t n, size_t m) {
   if (!bitvec_init(&theta->pf, n)) return false;
   bitvec_zeron(&theta->pf, n);
   theta->ad_n = m;
-  theta->theta_ad = (uint8_t*) calloc(m, sizeof(uint8_t));
+  theta->theta_ad = (uint8_t*) mem_calloc(MEM_STORAGE, m, sizeof(uint8_t));
   return true;
 }
 bool init_total_choice(total_choice_t *theta, size_t n, program_t *P) {
@@ -146,7 +157,7 @@ bool init_total_choice(total_choice_t *theta, size_t n, program_t *P) {
 }
 void free_total_choice_contents(total_choice_t *theta) {
   bitvec_free_contents(&theta->pf);
-  free(theta->theta_ad);
+  mem_free(MEM_STORAGE, theta->theta_ad);
 }
 
 size_t get_num_facts(program_t *P) {
@@ -155,9 +166,16 @@ size_t get_num_facts(program_t *P) {
   return n;
 }
 
+double num_total_choices(program_t *P) {
+  double n = ldexp(1.0, get_num_facts(P));
+  for (size_t i = 0; i < P->AD_n; ++i) n *= P->AD[i].n;
+  for (size_t i = 0; i < P->NA_n; ++i) n *= pow(P->NA[i].v, P->NA[i].n*P->NA[i].o);
+  return n;
+}
+
 total_choice_t* copy_total_choice(total_choice_t *src, total_choice_t *dst) {
   if (!dst) {
-    dst = (total_choice_t*) malloc(sizeof(total_choice_t));
+    dst = (total_choice_t*) mem_malloc(MEM_STORAGE, sizeof(total_choice_t));
     if (!_init_total_choice(dst, src->pf.n, src->ad_n)) return NULL;
   } else dst->ad_n = src->ad_n;
   bitvec_copy(&src->pf, &dst->pf);
@@ -201,14 +219,47 @@ void print_total_choice(total_choice_t *theta) {
     wprintf(L"AD[%lu] = %u\n", i, theta->theta_ad[i]);
 }
 
+size_t max_nprocs(void) {
+  const char *e = getenv(NUM_PROCS_ENV);
+  long n;
+  if (!e || ((n = strtol(e, NULL, 10)) <= 0) || (n > NUM_PROCS)) return NUM_PROCS;
+  return n;
+}
+
 size_t estimate_nprocs(size_t total_choice_n) {
-  return (total_choice_n > log2(NUM_PROCS)) ? NUM_PROCS : (1 << total_choice_n);
+  size_t m = max_nprocs();
+  return (total_choice_n > log2(m)) ? m : ((size_t) 1 << total_choice_n);
+}
+
+void init_sched(sched_t *s, size_t workers, double total) {
+  const char *e = getenv(SCHED_ENV);
+  *s = (sched_t) {0};
+  s->max = (e && !strcmp(e, "0")) ? 1 : max_nprocs();
+  s->workers = workers ? workers : 1;
+  s->left = total;
+  sched_plan(s);
+}
+
+void sched_plan(sched_t *s) {
+  size_t busy, solvers;
+  if (__atomic_load_n(&s->n, __ATOMIC_RELAXED) >= s->workers) {
+    uint64_t n = __atomic_exchange_n(&s->n, 0, __ATOMIC_RELAXED);
+    uint64_t m = __atomic_exchange_n(&s->ns, 0, __ATOMIC_RELAXED)/n;
+    s->mean = s->mean ? (3*s->mean + m)/4 : m;
+  }
+  /* Threads left idle by too few remaining total choices go to clingo, unless solves are too quick
+   * to make up for starting solver threads. */
+  busy = s->left < s->workers ? (size_t) ceil(s->left) : s->workers;
+  solvers = s->max/(busy ? busy : 1);
+  if ((s->mean && (s->mean < SCHED_MIN_SOLVE_NS)) || !solvers) solvers = 1;
+  __atomic_store_n(&s->solvers, solvers, __ATOMIC_RELAXED);
 }
 
 int retr_free_proc(bool *busy_procs, size_t num_procs, pthread_mutex_t *wakeup,
     pthread_cond_t *avail) {
   size_t i;
   int id = -1;
+  PROF_BEGIN(t_wait);
   /* The line below does not produce a problematic race condition since it will, at worst, skip
    * the i-th busy_procs and have to iterate NUM_PROCS all over again. */
   pthread_mutex_lock(wakeup);
@@ -217,10 +268,13 @@ int retr_free_proc(bool *busy_procs, size_t num_procs, pthread_mutex_t *wakeup,
       if (!busy_procs[i]) { id = i; break; }
     }
     if (id != -1) break;
+    TRACE_BEGIN(t_idle);
     pthread_cond_wait(avail, wakeup);
+    TRACE_END(TRACE_IDLE, t_idle);
   }
   busy_procs[id] = true;
   pthread_mutex_unlock(wakeup);
+  PROF_END(PROF_WAIT, t_wait);
   return id;
 }
 
@@ -237,10 +291,6 @@ bool dispatch_job(total_choice_t *theta, pthread_mutex_t *wakeup, bool *busy_pro
       compute_func, (void*) &S[id]);
 }
 
-#define PROCS_STR(x) #x ",compete"
-#define PROCS_XSTR(x) PROCS_STR(x)
-#define NUM_PROCS_CONFIG_STR PROCS_XSTR(NUM_PROCS)
-
 bool add_facts_from_total_choice(clingo_control_t *C, array_prob_fact_t *PF, total_choice_t *theta) {
   clingo_backend_t *back;
   if (!clingo_control_backend(C, &back)) return false;
@@ -287,7 +337,7 @@ bool add_all_atoms_as_choice(clingo_control_t *C, program_t *P) {
   if (!clingo_backend_begin(back)) goto cleanup;
 
   /* Collect all probabilistic facts. */
-  heads = (clingo_atom_t*) malloc(nheads*sizeof(clingo_atom_t));
+  heads = (clingo_atom_t*) mem_malloc(MEM_STORAGE, nheads*sizeof(clingo_atom_t));
   if (!heads) goto cleanup;
   size_t i_head = 0;
   for (size_t i = 0; i < P->PF_n; ++i)
@@ -319,7 +369,7 @@ bool add_all_atoms_as_choice(clingo_control_t *C, program_t *P) {
     }
   ok = true;
 cleanup:
-  free(heads);
+  mem_free(MEM_STORAGE, heads);
   /* Cleanup backend. */
   if (back) if (!clingo_backend_end(back)) return false;
   return ok;
@@ -410,24 +460,31 @@ cleanup:
 }
 
 bool _prepare_control(clingo_control_t **C, program_t *P, total_choice_t *theta,
-    const char *nmodels, bool parallelize_clingo, const char *append) {
+    const char *nmodels, size_t solvers, const char *append,
+    const clingo_ground_program_observer_t *obs, void *obs_data) {
+  PROF_BEGIN(t_control);
   /* Create new clingo controller. */
   if (!clingo_control_new(NULL, 0, undef_atom_ignore, NULL, 20, C)) return false;
+  /* The observer must be registered before the total choice is added through the backend. */
+  if (obs) if (!clingo_control_register_observer(*C, obs, false, obs_data)) return false;
   /* Config to enumerate all models. */
-  if (!setup_config(*C, nmodels, false)) return false;
+  if (!setup_config(*C, nmodels, solvers)) return false;
+  PROF_END(PROF_CONTROL, t_control);
+  PROF_BEGIN(t_parse);
   /* Add the purely logical part. */
   if (!clingo_control_add(*C, "base", NULL, 0, P->P)) return false;
   if (append) if (!clingo_control_add(*C, "base", NULL, 0, append)) return false;
   /* Add grounded probabilistic rules. */
   if (P->gr_P[0]) if (!clingo_control_add(*C, "base", NULL, 0, P->gr_P)) return false;
   if (!add_atoms_from_total_choice(*C, P, theta)) return false;
+  PROF_END(PROF_PARSE, t_parse);
   return true;
 }
 
 bool prepare_control_preground(clingo_control_t **C, program_t *P, total_choice_t *theta,
-    const char *nmodels, bool parallelize_clingo, const char *append, array_prob_fact_t *gr_PF,
+    const char *nmodels, size_t solvers, const char *append, array_prob_fact_t *gr_PF,
     total_choice_t *gr_theta) {
-  if (!_prepare_control(C, P, theta, nmodels, parallelize_clingo, append)) return false;
+  if (!_prepare_control(C, P, theta, nmodels, solvers, append, NULL, NULL)) return false;
   if (!add_facts_from_total_choice(*C, gr_PF, gr_theta)) return false;
   /* Ground atoms. */
   if (!atomic_ground(*C, NULL, NULL)) return false;
@@ -437,20 +494,157 @@ bool prepare_control_preground(clingo_control_t **C, program_t *P, total_choice_
 bool atomic_ground(clingo_control_t *C, clingo_ground_callback_t gcb, void *gdata) {
   static pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
   bool ok;
+  PROF_BEGIN(t_ground);
   pthread_mutex_lock(&mu);
   ok = clingo_control_ground(C, GROUND_DEFAULT_PARTS, 1, gcb, gdata);
   pthread_mutex_unlock(&mu);
+  PROF_END(PROF_GROUND, t_ground);
   return ok;
 }
 
 bool prepare_control(clingo_control_t **C, program_t *P, total_choice_t *theta,
-    const char *nmodels, bool parallelize_clingo, const char *append) {
-  if (!_prepare_control(C, P, theta, nmodels, parallelize_clingo, append)) return false;
+    const char *nmodels, size_t solvers, const char *append) {
+  return prepare_control_observed(C, P, theta, nmodels, solvers, NULL, NULL);
+}
+
+bool prepare_control_observed(clingo_control_t **C, program_t *P, total_choice_t *theta,
+    const char *nmodels, size_t solvers, const clingo_ground_program_observer_t *obs,
+    void *obs_data) {
+  if (!_prepare_control(C, P, theta, nmodels, solvers, NULL, obs, obs_data)) return false;
+  PROF_BEGIN(t_ground);
   if (!clingo_control_ground(*C, GROUND_DEFAULT_PARTS, 1, NULL, NULL)) return false;
+  PROF_END(PROF_GROUND, t_ground);
   return true;
 }
 
-bool setup_config(clingo_control_t *C, const char *nmodels, bool parallelize_clingo) {
+bool control_pool_enabled(void) {
+  const char *e = getenv(CONTROL_POOL_ENV);
+  return e && !strcmp(e, "1");
+}
+
+void free_control_pool_contents(control_pool_t *pool) {
+  if (pool->C) {
+    /* Statistics of a pooled control cover all its solves, so they are collected only once. */
+    PROF_CLINGO(pool->C);
+    clingo_control_free(pool->C);
+  }
+  mem_free(MEM_STORAGE, pool->X);
+  *pool = (control_pool_t) {0};
+}
+
+/* Adds a fresh external x, false unless assigned, and the rule f :- x. */
+static bool add_pool_choice(clingo_backend_t *back, clingo_symbol_t *f, clingo_atom_t *x) {
+  clingo_atom_t a;
+  clingo_literal_t l;
+  if (!clingo_backend_add_atom(back, NULL, x)) return false;
+  if (!clingo_backend_external(back, *x, clingo_external_type_false)) return false;
+  if (!clingo_backend_add_atom(back, f, &a)) return false;
+  l = (clingo_literal_t) *x;
+  return clingo_backend_rule(back, false, &a, 1, &l, 1);
+}
+
+/* Prepares the control of pool, deriving each choice atom from an external so that the program is
+ * grounded once for all total choices. */
+static bool init_control_pool(control_pool_t *pool, program_t *P, size_t solvers) {
+  clingo_backend_t *back;
+  size_t n = P->CF_n + P->PF_n, k = 0;
+  bool ok = false;
+
+  for (size_t i = 0; i < P->AD_n; ++i) n += P->AD[i].n;
+  pool->X = (clingo_atom_t*) mem_malloc(MEM_STORAGE, (n ? n : 1)*sizeof(clingo_atom_t));
+  if (!pool->X) { mem_raise("control pool"); return false; }
+  pool->X_n = n;
+  pool->solvers = solvers;
+
+  PROF_BEGIN(t_control);
+  if (!clingo_control_new(NULL, 0, undef_atom_ignore, NULL, 20, &pool->C)) return false;
+  if (!setup_config(pool->C, "0", solvers)) return false;
+  PROF_END(PROF_CONTROL, t_control);
+  PROF_BEGIN(t_parse);
+  if (!clingo_control_add(pool->C, "base", NULL, 0, P->P)) return false;
+  if (P->gr_P[0]) if (!clingo_control_add(pool->C, "base", NULL, 0, P->gr_P)) return false;
+  if (!clingo_control_backend(pool->C, &back)) return false;
+  if (!clingo_backend_begin(back)) return false;
+  /* Externals follow the order of total choices: credal facts, probabilistic facts and then the
+   * atoms of each annotated disjunction. */
+  for (size_t i = 0; i < P->CF_n; ++i)
+    if (!add_pool_choice(back, &P->CF[i].cl_f, &pool->X[k++])) goto cleanup;
+  for (size_t i = 0; i < P->PF_n; ++i)
+    if (!add_pool_choice(back, &P->PF[i].cl_f, &pool->X[k++])) goto cleanup;
+  for (size_t i = 0; i < P->AD_n; ++i)
+    for (size_t j = 0; j < P->AD[i].n; ++j)
+      if (!add_pool_choice(back, &P->AD[i].cl_F[j], &pool->X[k++])) goto cleanup;
+  ok = true;
+cleanup:
+  if (!clingo_backend_end(back)) return false;
+  PROF_END(PROF_PARSE, t_parse);
+  return ok && atomic_ground(pool->C, NULL, NULL);
+}
+
+/* Number of symbolic atoms in the grounding of C. */
+static bool ground_size(clingo_control_t *C, size_t *n) {
+  clingo_symbolic_atoms_t const *atoms;
+  return clingo_control_symbolic_atoms(C, &atoms) && clingo_symbolic_atoms_size(atoms, n);
+}
+
+/* Prepares the control of pool, unless its grounding is more than CONTROL_POOL_MAX_GROWTH times
+ * that of the total choice theta, in which case the pool is dropped and *C is prepared for theta
+ * alone. */
+static bool init_control_pool_checked(control_pool_t *pool, clingo_control_t **C, program_t *P,
+    total_choice_t *theta, size_t solvers) {
+  size_t n_pool, n_theta;
+  *C = NULL;
+  if (!init_control_pool(pool, P, solvers) || !ground_size(pool->C, &n_pool)) goto error;
+  if (!prepare_control(C, P, theta, "0", solvers, NULL) || !ground_size(*C, &n_theta)) goto error;
+  if (n_pool > CONTROL_POOL_MAX_GROWTH*(n_theta ? n_theta : 1)) {
+    free_control_pool_contents(pool);
+    pool->dropped = true;
+    return true;
+  }
+  PROF_CLINGO(*C);
+  clingo_control_free(*C);
+  *C = NULL;
+  return true;
+error:
+  if (*C) clingo_control_free(*C);
+  *C = NULL;
+  free_control_pool_contents(pool);
+  return false;
+}
+
+bool acquire_control(control_pool_t *pool, clingo_control_t **C, program_t *P,
+    total_choice_t *theta, size_t solvers) {
+  if (P->NR_n || P->NA_n || pool->dropped || !control_pool_enabled())
+    return prepare_control(C, P, theta, "0", solvers, NULL);
+  /* A control is configured with its number of solvers once and for all. */
+  if (pool->C && pool->solvers != solvers) free_control_pool_contents(pool);
+  if (!pool->C) {
+    if (!init_control_pool_checked(pool, C, P, theta, solvers)) return false;
+    /* Dropped, so *C was prepared for theta. */
+    if (*C) return true;
+  }
+  *C = pool->C;
+
+  PROF_BEGIN(t_control);
+  size_t k = 0;
+  for (size_t i = 0; i < P->CF_n + P->PF_n; ++i, ++k)
+    if (!clingo_control_assign_external(*C, pool->X[k], CHOICE_IS_TRUE(theta, i) ?
+          clingo_truth_value_true : clingo_truth_value_false)) return false;
+  for (size_t i = 0; i < P->AD_n; ++i)
+    for (size_t j = 0; j < P->AD[i].n; ++j, ++k)
+      if (!clingo_control_assign_external(*C, pool->X[k], j == theta->theta_ad[i] ?
+            clingo_truth_value_true : clingo_truth_value_false)) return false;
+  PROF_END(PROF_CONTROL, t_control);
+  return true;
+}
+
+void release_control(control_pool_t *pool, clingo_control_t *C) {
+  if (!C || C == pool->C) return;
+  PROF_CLINGO(C);
+  clingo_control_free(C);
+}
+
+bool setup_config(clingo_control_t *C, const char *nmodels, size_t solvers) {
   clingo_configuration_t *cfg = NULL;
   clingo_id_t cfg_root, cfg_sub;
 
@@ -460,31 +654,33 @@ bool setup_config(clingo_control_t *C, const char *nmodels, bool parallelize_cli
   if (!clingo_configuration_root(cfg, &cfg_root)) return false;
   if (!clingo_configuration_map_at(cfg, cfg_root, "solve.models", &cfg_sub)) return false;
   if (!clingo_configuration_value_set(cfg, cfg_sub, nmodels)) return false;
-  if (parallelize_clingo) {
-    /* Set parallel_mode to "NUM_PROCS,compete", where NUM_PROCS is the #procs in this machine. */
+  if (solvers > 1) {
+    /* When enumerating all models, split the search space between solvers so that each model is
+     * found once; otherwise let them compete for the first model. */
+    char mode[32];
+    snprintf(mode, sizeof(mode), "%zu,%s", solvers, strcmp(nmodels, "0") ? "compete" : "split");
     if (!clingo_configuration_map_at(cfg, cfg_root, "solve.parallel_mode", &cfg_sub)) return false;
-    if (!clingo_configuration_value_set(cfg, cfg_sub, NUM_PROCS_CONFIG_STR)) return false;
+    if (!clingo_configuration_value_set(cfg, cfg_sub, mode)) return false;
   }
 
   return true;
 }
 
-bool has_total_model(program_t *P, total_choice_t *theta, bool *has) {
-  clingo_control_t *C = NULL;
-  clingo_solve_handle_t *handle;
-  clingo_solve_result_bitset_t res;
-  /* Prepare control according to the stable semantics. */
-  if (!prepare_control(&C, P->stable, theta, "1", false, NULL)) goto cleanup;
-  /* Solve and determine if there exists a (total) model. */
-  if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle)) goto cleanup;
-  if (!clingo_solve_handle_get(handle, &res)) goto cleanup;
-  *has = (res & clingo_solve_result_satisfiable);
-  /* Cleanup. */
-  clingo_control_free(C);
-  return true;
-cleanup:
-  clingo_control_free(C);
-  return false;
+bool total_model_literal(clingo_control_t *C, clingo_literal_t *l) {
+  const clingo_symbolic_atoms_t *atoms;
+  clingo_symbolic_atom_iterator_t it;
+  clingo_symbol_t s;
+  bool valid;
+
+  if (!clingo_symbol_create_id(TOTAL_MODEL_ATOM, true, &s)) return false;
+  if (!clingo_control_symbolic_atoms(C, &atoms)) return false;
+  if (!clingo_symbolic_atoms_find(atoms, s, &it)) return false;
+  if (!clingo_symbolic_atoms_is_valid(atoms, it, &valid)) return false;
+  if (!valid) {
+    clingo_set_error(clingo_error_runtime, "partial program has no " TOTAL_MODEL_ATOM " external!");
+    return false;
+  }
+  return clingo_symbolic_atoms_literal(atoms, it, l);
 }
 
 
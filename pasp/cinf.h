@@ -3,6 +3,7 @@
 
 #include "cprogram.h"
 #include "carray.h"
+#include "cprogress.h"
 #include "../bitvector/bitvector.h"
 
 #include <pthread.h>
@@ -25,6 +26,8 @@ typedef struct {
 bool init_total_choice(total_choice_t *theta, size_t n, program_t *P);
 void free_total_choice_contents(total_choice_t *theta);
 size_t get_num_facts(program_t *P);
+/* Number of total choices of P, as a double since it easily overflows an integer. */
+double num_total_choices(program_t *P);
 total_choice_t* copy_total_choice(total_choice_t *src, total_choice_t *dst);
 bool incr_total_choice(total_choice_t *theta);
 bool incr_total_choice_ad(total_choice_t *theta, program_t *P);
@@ -35,6 +38,81 @@ double prob_total_choice_prob(program_t *P, total_choice_t *theta);
 double prob_total_choice_neural(program_t *P, total_choice_t *theta, size_t offset, bool train);
 double prob_total_choice_ground(array_prob_fact_t *PF, total_choice_t *theta);
 
+/* Minimum mean (sequential) solve time of a total choice, in nanoseconds, for clingo's internal
+ * parallel solving to make up for starting its solver threads. */
+#define SCHED_MIN_SOLVE_NS 20000000ull
+/* Environment variable that, if set to 0, disables clingo's internal parallel solving. */
+#define SCHED_ENV "PASP_CLINGO_PARALLEL"
+
+/* Splits threads between solving total choices concurrently (workers) and clingo's internal
+ * parallel solving of each total choice (solvers). Workers are fixed by the size of the pool, and
+ * threads they leave idle, e.g. because there are fewer total choices than threads, are given to
+ * clingo. The split is re-planned after every dispatch from the number of total choices left and
+ * the measured solve time. */
+typedef struct {
+  /* Threads available, and workers solving total choices concurrently. */
+  size_t max, workers;
+  /* Clingo solver threads per total choice, read by workers when creating a control. */
+  size_t solvers;
+  /* Total choices not yet dispatched. */
+  double left;
+  /* Solve time (times solvers used) and number of solves since the last measurement, added to by
+   * workers; and their smoothed mean, or 0 if not yet measured. */
+  uint64_t ns, n, mean;
+} sched_t;
+
+void init_sched(sched_t *s, size_t workers, double total);
+void sched_plan(sched_t *s);
+
+/* Called by the dispatcher after each dispatched total choice. */
+static inline void sched_dispatched(sched_t *s) {
+  if (!s) return;
+  s->left -= 1;
+  sched_plan(s);
+}
+/* Called by a worker after solving a total choice in ns nanoseconds with solvers threads. */
+static inline void sched_record(sched_t *s, uint64_t ns, size_t solvers) {
+  if (!s) return;
+  __atomic_add_fetch(&s->ns, ns*solvers, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&s->n, 1, __ATOMIC_RELAXED);
+}
+/* Number of clingo solver threads to create a control with. */
+static inline size_t sched_solvers(sched_t *s) {
+  return s ? __atomic_load_n(&s->solvers, __ATOMIC_RELAXED) : 1;
+}
+
+/* Environment variable that, if set to 1, enables control pools. By default a new control is
+ * prepared and grounded for every total choice. */
+#define CONTROL_POOL_ENV "PASP_CONTROL_POOL"
+/* A worker drops its pool if the pooled grounding has more than this many times the atoms of the
+ * grounding of a single total choice. */
+#define CONTROL_POOL_MAX_GROWTH 4
+
+/* Control of a worker, reused across the total choices it is given. The program is added,
+ * configured and grounded once, with every credal fact, probabilistic fact and annotated disjunction
+ * atom derived from a fresh external atom; a total choice is then set by assigning the externals,
+ * which is equivalent to adding the chosen atoms as facts.
+ *
+ * Since the chosen atoms are not facts when grounding, the grounder cannot simplify them away, and
+ * the pooled grounding is the union of the groundings of all total choices. Pools are therefore
+ * opt-in (see CONTROL_POOL_ENV), and a pool whose grounding outgrows that of a single total choice
+ * by more than CONTROL_POOL_MAX_GROWTH is dropped for the rest of the run. */
+typedef struct {
+  /* Pooled control, or NULL if not yet prepared. */
+  clingo_control_t *C;
+  /* External atoms of credal facts, probabilistic facts and then the atoms of each annotated
+   * disjunction, in the order of total choices. */
+  clingo_atom_t *X;
+  size_t X_n;
+  /* Number of solver threads C is configured with. */
+  size_t solvers;
+  /* Whether the pool was dropped for its size, so that controls are prepared per total choice. */
+  bool dropped;
+} control_pool_t;
+
+/* Whether workers reuse their controls across total choices (see CONTROL_POOL_ENV). */
+bool control_pool_enabled(void);
+
 typedef struct {
   bool *cond_1, *cond_2, *cond_3, *cond_4;
   size_t *count_q_e, *count_e, *count_partial_q_e;
@@ -47,6 +125,15 @@ typedef struct {
   size_t pid;
   pthread_mutex_t *mu, *wakeup;
   pthread_cond_t *avail;
+  /* Progress counters of this worker, or NULL if progress is not reported. */
+  progress_slot_t *prog;
+  /* Thread split between workers and clingo, or NULL to always solve sequentially. */
+  sched_t *sched;
+  /* Whether to count models with the #SAT engine when the ground program allows it, instead of
+   * enumerating them. */
+  bool sharpsat;
+  /* Control reused across total choices. */
+  control_pool_t ctl;
 } storage_t;
 
 bool init_storage(storage_t *s, program_t *P, array_bool_t (*Pn)[4],
@@ -63,6 +150,11 @@ bool setup_abcd(double **a, double **b, double **c, double **d, size_t n, size_t
 #define NUM_PROCS 1
 #endif
 
+/* Environment variable that, if set to some 0 < n <= NUM_PROCS, caps the number of worker threads
+ * at n (e.g. for measuring how inference scales with the number of threads). */
+#define NUM_PROCS_ENV "PASP_NUM_PROCS"
+
+size_t max_nprocs(void);
 size_t estimate_nprocs(size_t total_choice_n);
 
 int retr_free_proc(bool *busy_procs, size_t num_procs, pthread_mutex_t *wakeup,
@@ -80,13 +172,32 @@ bool add_facts_from_total_choice(clingo_control_t *C, array_prob_fact_t *PF, tot
 bool add_all_atoms_as_choice(clingo_control_t *C, program_t *P);
 bool add_atoms_from_total_choice(clingo_control_t *C, program_t *P, total_choice_t *theta);
 bool prepare_control(clingo_control_t **C, program_t *P, total_choice_t *theta,
-    const char *nmodels, bool parallelize_clingo, const char *append);
+    const char *nmodels, size_t solvers, const char *append);
+/* Same as prepare_control, but obs observes the ground program (see csharpsat.h). */
+bool prepare_control_observed(clingo_control_t **C, program_t *P, total_choice_t *theta,
+    const char *nmodels, size_t solvers, const clingo_ground_program_observer_t *obs,
+    void *obs_data);
 bool prepare_control_preground(clingo_control_t **C, program_t *P, total_choice_t *theta,
-    const char *nmodels, bool parallelize_clingo, const char *append, array_prob_fact_t *gr_PF,
+    const char *nmodels, size_t solvers, const char *append, array_prob_fact_t *gr_PF,
     total_choice_t *gr_theta);
 
-bool setup_config(clingo_control_t *C, const char *nmodels, bool parallelize_clingo);
-bool has_total_model(program_t *P, total_choice_t *theta, bool *has);
+/* Same as prepare_control with nmodels "0" and no append, but takes the control from pool if P has
+ * no neural components and pooling is enabled, preparing it on first use. The control must be
+ * given back with release_control. */
+bool acquire_control(control_pool_t *pool, clingo_control_t **C, program_t *P,
+    total_choice_t *theta, size_t solvers);
+/* Collects the profiling statistics of C and frees it, unless it is the control of pool, whose
+ * statistics are collected once when the pool is freed. */
+void release_control(control_pool_t *pool, clingo_control_t *C);
+void free_control_pool_contents(control_pool_t *pool);
+
+/* Configures C to find nmodels models ("0" for all) with solvers clingo threads (0 or 1 for
+ * sequential solving). */
+bool setup_config(clingo_control_t *C, const char *nmodels, size_t solvers);
+
+/* External atom guarding the totality constraints :- __total_model, _a, not a. of partial programs. */
+#define TOTAL_MODEL_ATOM "__total_model"
+bool total_model_literal(clingo_control_t *C, clingo_literal_t *l);
 bool atomic_ground(clingo_control_t *C, clingo_ground_callback_t gcb, void *gdata);
 
 #endif
@@ -0,0 +1,345 @@
+#include "cjtree.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmem.h"
+#include "cfactor.h"
+
+/* Parent of root cliques. */
+#define JT_NONE UINT32_MAX
+
+typedef struct {
+  /* Number of variables of the factor graph. */
+  size_t n;
+  /* Cliques, one per variable in elimination order: clique i has scope CV[CO[i]..CO[i+1]), in
+   * increasing order, eliminates the b[i]-th atom of its scope and has parent par[i] (JT_NONE if
+   * it is a root). M[CO[i]+j] is the position of the j-th atom of clique i in its parent's scope,
+   * and pos[u] is the clique that eliminates local atom u. */
+  uint32_t *CV, *CO, *par, *pos;
+  uint8_t *b, *M;
+  /* Base (the product of the factors assigned to each clique) and working tables of clique i,
+   * both at offset TO[i], and the separator (message to its parent) of clique i at SO[i]. */
+  size_t *TO, *SO;
+  double *B, *T, *S, *tmp;
+} jtree_t;
+
+static void free_jtree_contents(jtree_t *J) {
+  mem_free(MEM_STORAGE, J->CV); mem_free(MEM_STORAGE, J->CO);
+  mem_free(MEM_STORAGE, J->par); mem_free(MEM_STORAGE, J->pos);
+  mem_free(MEM_STORAGE, J->b); mem_free(MEM_STORAGE, J->M);
+  mem_free(MEM_STORAGE, J->TO); mem_free(MEM_STORAGE, J->SO);
+  mem_free(MEM_STORAGE, J->B); mem_free(MEM_STORAGE, J->T);
+  mem_free(MEM_STORAGE, J->S); mem_free(MEM_STORAGE, J->tmp);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+  return (x > y) - (x < y);
+}
+
+static inline bool jt_adj(const uint64_t *G, size_t W, uint32_t u, uint32_t v) {
+  return (G[u*W + v/64] >> (v%64)) & 1;
+}
+
+static inline bool jt_connect(uint64_t *G, size_t W, array_uint32_t_t *N, uint32_t u, uint32_t v) {
+  G[u*W + v/64] |= (uint64_t) 1 << (v%64);
+  G[v*W + u/64] |= (uint64_t) 1 << (u%64);
+  return array_uint32_t_append(&N[u], v) && array_uint32_t_append(&N[v], u);
+}
+
+/* Position of local atom u in the scope of clique i, or -1 if it is not in it. */
+static inline int jt_find(jtree_t *J, size_t i, uint32_t u) {
+  uint32_t *p = (uint32_t*) bsearch(&u, J->CV + J->CO[i], J->CO[i+1] - J->CO[i], sizeof(uint32_t),
+      cmp_u32);
+  return p ? (int) (p - J->CV - J->CO[i]) : -1;
+}
+
+/* Index of the separator of clique i that entry y of its parent's table projects to. */
+static inline size_t jt_gather(jtree_t *J, size_t i, size_t y) {
+  size_t s = 0, t = 0, o = J->CO[i], c = J->CO[i+1] - o;
+  for (size_t j = 0; j < c; ++j)
+    if (j != J->b[i]) s |= ((y >> J->M[o+j]) & 1) << t++;
+  return s;
+}
+
+/* Compiles the factors of J into a junction tree, eliminating at each step the atom whose
+ * neighbours in the moral graph lack the fewest edges between them (ties broken by degree). Sets
+ * *ok to false if some clique is too wide or the tables too large. */
+static bool jt_tree(jtree_t *J, factor_graph_t *F, bool *ok) {
+  size_t n = J->n = F->n, W = (n + 63)/64, F_n = F->FO.n - 1, i, j;
+  uint64_t *G = (uint64_t*) mem_calloc(MEM_STORAGE, n ? n*W : 1, sizeof(uint64_t));
+  array_uint32_t_t *N = (array_uint32_t_t*) mem_calloc(MEM_STORAGE, n ? n : 1,
+      sizeof(array_uint32_t_t));
+  size_t *fill = (size_t*) mem_malloc(MEM_STORAGE, (n ? n : 1)*sizeof(size_t));
+  bool *dirty = (bool*) mem_malloc(MEM_STORAGE, n ? n : 1), *dead = (bool*) mem_calloc(MEM_STORAGE,
+      n ? n : 1, sizeof(bool));
+  size_t *P = (size_t*) mem_malloc(MEM_STORAGE, JTREE_MAX_WIDTH*sizeof(size_t));
+  array_uint32_t_t C = {0};
+  bool r = false;
+
+  *ok = false;
+  J->CO = (uint32_t*) mem_malloc(MEM_STORAGE, (n+1)*sizeof(uint32_t));
+  J->par = (uint32_t*) mem_malloc(MEM_STORAGE, (n ? n : 1)*sizeof(uint32_t));
+  J->pos = (uint32_t*) mem_malloc(MEM_STORAGE, (n ? n : 1)*sizeof(uint32_t));
+  J->b = (uint8_t*) mem_malloc(MEM_STORAGE, n ? n : 1);
+  J->TO = (size_t*) mem_malloc(MEM_STORAGE, (n+1)*sizeof(size_t));
+  J->SO = (size_t*) mem_malloc(MEM_STORAGE, (n+1)*sizeof(size_t));
+  if (!(G && N && fill && dirty && dead && P && J->CO && J->par && J->pos && J->b && J->TO &&
+        J->SO)) goto nomem;
+  if (!array_uint32_t_init(&C)) goto nomem;
+  for (i = 0; i < n; ++i) {
+    if (!array_uint32_t_init(&N[i])) goto nomem;
+    dirty[i] = true;
+  }
+
+  /* Moral graph: atoms sharing a factor are adjacent. */
+  for (size_t f = 0; f < F_n; ++f) {
+    uint32_t *V = F->FV.d + F->FO.d[f];
+    size_t k = F->FO.d[f+1] - F->FO.d[f];
+    for (i = 0; i < k; ++i)
+      for (j = i+1; j < k; ++j)
+        if (!jt_adj(G, W, V[i], V[j])) if (!jt_connect(G, W, N, V[i], V[j])) goto nomem;
+  }
+
+  J->CO[0] = 0;
+  for (size_t s = 0; s < n; ++s) {
+    uint32_t v = JT_NONE;
+    for (uint32_t u = 0; u < n; ++u) {
+      if (dead[u]) continue;
+      if (dirty[u]) {
+        uint32_t *A = N[u].d;
+        fill[u] = 0;
+        for (i = 0; i < N[u].n; ++i)
+          for (j = i+1; j < N[u].n; ++j) fill[u] += !jt_adj(G, W, A[i], A[j]);
+        dirty[u] = false;
+      }
+      if (v == JT_NONE || fill[u] < fill[v] || (fill[u] == fill[v] && N[u].n < N[v].n)) v = u;
+    }
+    if (N[v].n + 1 > JTREE_MAX_WIDTH) goto cleanup;
+
+    /* The clique of v is v and its neighbours, which become pairwise adjacent. */
+    size_t o = C.n;
+    if (!array_uint32_t_append(&C, v)) goto nomem;
+    for (i = 0; i < N[v].n; ++i) if (!array_uint32_t_append(&C, N[v].d[i])) goto nomem;
+    qsort(C.d + o, C.n - o, sizeof(uint32_t), cmp_u32);
+    J->CO[s+1] = C.n;
+    J->b[s] = (uint32_t*) bsearch(&v, C.d + o, C.n - o, sizeof(uint32_t), cmp_u32) - (C.d + o);
+    J->pos[v] = s;
+    dead[v] = true;
+    for (i = 0; i < N[v].n; ++i) {
+      array_uint32_t_t *A = &N[N[v].d[i]];
+      for (j = 0; A->d[j] != v; ++j);
+      A->d[j] = A->d[--A->n];
+    }
+    for (i = 0; i < N[v].n; ++i)
+      for (j = i+1; j < N[v].n; ++j)
+        if (!jt_adj(G, W, N[v].d[i], N[v].d[j]))
+          if (!jt_connect(G, W, N, N[v].d[i], N[v].d[j])) goto nomem;
+    for (i = 0; i < N[v].n; ++i) {
+      uint32_t u = N[v].d[i];
+      dirty[u] = true;
+      for (j = 0; j < N[u].n; ++j) dirty[N[u].d[j]] = true;
+    }
+  }
+  J->CV = C.d;
+  C.d = NULL;
+
+  /* The parent of a clique is the clique of the first eliminated atom of its separator. */
+  J->M = (uint8_t*) mem_malloc(MEM_STORAGE, J->CO[n] ? J->CO[n] : 1);
+  if (!J->M) goto nomem;
+  size_t w = 1;
+  J->TO[0] = J->SO[0] = 0;
+  for (i = 0; i < n; ++i) {
+    size_t c = J->CO[i+1] - J->CO[i];
+    if (c > w) w = c;
+    J->par[i] = JT_NONE;
+    for (j = 0; j < c; ++j)
+      if (j != J->b[i] && J->pos[J->CV[J->CO[i]+j]] < J->par[i]) J->par[i] = J->pos[J->CV[J->CO[i]+j]];
+    if (J->par[i] != JT_NONE)
+      for (j = 0; j < c; ++j)
+        if (j != J->b[i]) J->M[J->CO[i]+j] = jt_find(J, J->par[i], J->CV[J->CO[i]+j]);
+    J->TO[i+1] = J->TO[i] + ((size_t) 1 << c);
+    J->SO[i+1] = J->SO[i] + ((size_t) 1 << (c-1));
+  }
+  if (J->TO[n] > JTREE_MAX_ENTRIES) goto cleanup;
+
+  J->B = (double*) mem_malloc(MEM_STORAGE, (J->TO[n] ? J->TO[n] : 1)*sizeof(double));
+  J->T = (double*) mem_malloc(MEM_STORAGE, (J->TO[n] ? J->TO[n] : 1)*sizeof(double));
+  J->S = (double*) mem_malloc(MEM_STORAGE, (J->SO[n] ? J->SO[n] : 1)*sizeof(double));
+  J->tmp = (double*) mem_malloc(MEM_STORAGE, ((size_t) 1 << (w-1))*sizeof(double));
+  if (!(J->B && J->T && J->S && J->tmp)) goto nomem;
+  for (i = 0; i < J->TO[n]; ++i) J->B[i] = 1;
+
+  /* Each factor goes to the clique of the first eliminated atom of its scope, which contains the
+   * whole scope. */
+  double *T = F->FT;
+  for (size_t f = 0; f < F_n; ++f) {
+    uint32_t *V = F->FV.d + F->FO.d[f];
+    size_t k = F->FO.d[f+1] - F->FO.d[f], q = J->pos[V[0]];
+    for (i = 1; i < k; ++i) if (J->pos[V[i]] < q) q = J->pos[V[i]];
+    for (i = 0; i < k; ++i) P[i] = jt_find(J, q, V[i]);
+    double *B = J->B + J->TO[q];
+    for (size_t x = 0; x < J->TO[q+1] - J->TO[q]; ++x) {
+      size_t y = 0;
+      for (i = 0; i < k; ++i) y |= ((x >> P[i]) & 1) << i;
+      B[x] *= T[y];
+    }
+    T += (size_t) 1 << k;
+  }
+
+  *ok = true;
+  r = true;
+  goto cleanup;
+nomem:
+  mem_raise("junction tree");
+cleanup:
+  if (N) for (i = 0; i < n; ++i) array_uint32_t_free_contents(&N[i]);
+  array_uint32_t_free_contents(&C);
+  mem_free(MEM_STORAGE, G); mem_free(MEM_STORAGE, N);
+  mem_free(MEM_STORAGE, fill); mem_free(MEM_STORAGE, dirty); mem_free(MEM_STORAGE, dead);
+  mem_free(MEM_STORAGE, P);
+  return r || !PyErr_Occurred();
+}
+
+/* Resets the working tables to the base ones, zeroing the entries inconsistent with the n
+ * literals in L, where +(u+1) (resp. -(u+1)) means local atom u is true (resp. false). */
+static void jt_reset(jtree_t *J, const int32_t *L, size_t n) {
+  memcpy(J->T, J->B, J->TO[J->n]*sizeof(double));
+  for (size_t k = 0; k < n; ++k) {
+    uint32_t u = abs(L[k])-1, i = J->pos[u];
+    size_t p = jt_find(J, i, u);
+    double *T = J->T + J->TO[i];
+    for (size_t x = 0; x < J->TO[i+1] - J->TO[i]; ++x)
+      if (((x >> p) & 1) != (L[k] > 0)) T[x] = 0;
+  }
+}
+
+/* Sends the message of every clique to its parent, from the leaves up. Messages are normalized,
+ * and the log of the product of their normalizing constants and of the masses of the roots, i.e.
+ * the log-probability of the literals set by jt_reset, is returned (-INFINITY if it is zero). */
+static double jt_collect(jtree_t *J) {
+  double lz = 0;
+  for (size_t i = 0; i < J->n; ++i) {
+    double *T = J->T + J->TO[i], z = 0;
+    size_t c = J->CO[i+1] - J->CO[i], b = J->b[i], h = (size_t) 1 << b;
+    if (J->par[i] == JT_NONE) {
+      for (size_t x = 0; x < ((size_t) 1 << c); ++x) z += T[x];
+      if (z == 0) return -INFINITY;
+      lz += log(z);
+      continue;
+    }
+    double *S = J->S + J->SO[i];
+    for (size_t s = 0; s < ((size_t) 1 << (c-1)); ++s) {
+      size_t x = ((s >> b) << (b+1)) | (s & (h-1));
+      z += S[s] = T[x] + T[x|h];
+    }
+    if (z == 0) return -INFINITY;
+    for (size_t s = 0; s < ((size_t) 1 << (c-1)); ++s) S[s] /= z;
+    lz += log(z);
+    size_t p = J->par[i];
+    double *Tp = J->T + J->TO[p];
+    for (size_t y = 0; y < J->TO[p+1] - J->TO[p]; ++y) Tp[y] *= S[jt_gather(J, i, y)];
+  }
+  return lz;
+}
+
+/* Sends the message of every parent back to its children, from the roots down, after which the
+ * table of each clique is proportional to the joint of its atoms and the literals of jt_reset. */
+static void jt_distribute(jtree_t *J) {
+  for (size_t i = J->n; i-- > 0;) {
+    if (J->par[i] == JT_NONE) continue;
+    double *T = J->T + J->TO[i], *S = J->S + J->SO[i], *Tp = J->T + J->TO[J->par[i]];
+    size_t c = J->CO[i+1] - J->CO[i], b = J->b[i], h = (size_t) 1 << b, p = J->par[i];
+    memset(J->tmp, 0, ((size_t) 1 << (c-1))*sizeof(double));
+    for (size_t y = 0; y < J->TO[p+1] - J->TO[p]; ++y) J->tmp[jt_gather(J, i, y)] += Tp[y];
+    for (size_t x = 0; x < ((size_t) 1 << c); ++x) {
+      size_t s = ((x >> (b+1)) << b) | (x & (h-1));
+      T[x] = S[s] > 0 ? T[x]*J->tmp[s]/S[s] : 0;
+    }
+  }
+}
+
+/* Probability of the n literals in L given those of jt_reset, read off a calibrated clique that
+ * contains all of their atoms. Returns a negative number if there is no such clique. */
+static double jt_marginal(jtree_t *J, const int32_t *L, size_t n) {
+  int P[JTREE_MAX_WIDTH];
+  if (!n) return 1;
+  if (n > JTREE_MAX_WIDTH) return -1;
+  for (size_t i = 0; i < J->n; ++i) {
+    size_t k;
+    for (k = 0; k < n; ++k) if ((P[k] = jt_find(J, i, abs(L[k])-1)) < 0) break;
+    if (k < n) continue;
+    double *T = J->T + J->TO[i], z = 0, a = 0;
+    for (size_t x = 0; x < J->TO[i+1] - J->TO[i]; ++x) {
+      bool h = true;
+      for (k = 0; k < n && h; ++k) h = ((x >> P[k]) & 1) == (L[k] > 0);
+      z += T[x];
+      if (h) a += T[x];
+    }
+    return z > 0 ? a/z : 0;
+  }
+  return -1;
+}
+
+bool jtree_query(program_t *P, double *q, bool *e, bool *done) {
+  factor_graph_t G = {0};
+  jtree_t J = {0};
+  int32_t *L, *X = NULL;
+  size_t *LO, Q_n = P->Q_n, i;
+  bool *never, *pending = NULL, *handled = NULL, ok = false, applies;
+
+  *done = false;
+  if (!factor_graph_compile(P, JTREE_MAX_WIDTH, &G, &applies)) return false;
+  if (!applies) return true;
+  if (G.n > JTREE_MAX_ATOMS) { ok = true; goto cleanup; }
+  if (!jt_tree(&J, &G, &applies)) goto cleanup;
+  if (!applies) { ok = true; goto cleanup; }
+  L = G.L; LO = G.LO; never = G.never;
+
+  X = (int32_t*) mem_malloc(MEM_STORAGE, (LO[2*Q_n] ? LO[2*Q_n] : 1)*sizeof(int32_t));
+  pending = (bool*) mem_calloc(MEM_STORAGE, Q_n, sizeof(bool));
+  handled = (bool*) mem_calloc(MEM_STORAGE, Q_n, sizeof(bool));
+  if (!(X && pending && handled)) {
+    mem_raise("junction tree");
+    goto cleanup;
+  }
+
+  /* Calibrate once per distinct evidence. Queries whose atoms share no clique are answered by
+   * collecting again with the query as evidence. */
+  for (i = 0; i < Q_n; ++i) {
+    if (handled[i]) continue;
+    double lz = -INFINITY;
+    if (!never[2*i]) {
+      jt_reset(&J, L + LO[2*i], LO[2*i+1] - LO[2*i]);
+      if ((lz = jt_collect(&J)) > -INFINITY) jt_distribute(&J);
+    }
+    for (size_t k = i; k < Q_n; ++k) {
+      if (handled[k] || !query_same_evidence(P->Q+i, P->Q+k)) continue;
+      handled[k] = true;
+      e[k] = lz > -INFINITY;
+      q[k] = 0;
+      if (!e[k] || never[2*k+1]) continue;
+      q[k] = jt_marginal(&J, L + LO[2*k+1], LO[2*k+2] - LO[2*k+1]);
+      pending[k] = q[k] < 0;
+    }
+    for (size_t k = i; k < Q_n; ++k) {
+      if (!pending[k]) continue;
+      size_t m = LO[2*k+2] - LO[2*k];
+      memcpy(X, L + LO[2*k], m*sizeof(int32_t));
+      jt_reset(&J, X, m);
+      double lq = jt_collect(&J);
+      q[k] = lq > -INFINITY ? fmin(exp(lq - lz), 1) : 0;
+      pending[k] = false;
+    }
+  }
+
+  *done = true;
+  ok = true;
+cleanup:
+  free_factor_graph_contents(&G);
+  free_jtree_contents(&J);
+  mem_free(MEM_STORAGE, X); mem_free(MEM_STORAGE, pending); mem_free(MEM_STORAGE, handled);
+  return ok;
+}
@@ -0,0 +1,27 @@
+#ifndef _PASP_CJTREE
+#define _PASP_CJTREE
+
+#include <stdbool.h>
+
+#include "cprogram.h"
+
+/* Largest number of atoms in a clique of the junction tree, or in the scope of a factor. Programs
+ * of higher treewidth are enumerated instead. */
+#define JTREE_MAX_WIDTH 20
+/* Largest number of (relevant) atoms a junction tree is built over. */
+#define JTREE_MAX_ATOMS 8192
+/* Largest number of entries over all clique tables. */
+#define JTREE_MAX_ENTRIES (1 << 24)
+
+/* Answers the queries of P by junction tree propagation if its ground program is normal, acyclic
+ * and has no integrity constraints, so that each total choice has exactly one stable model and P
+ * is a Bayesian network over its atoms. The rules of each head become a single factor over the
+ * head and its body atoms, and each probabilistic fact or annotated disjunction a factor over its
+ * atoms; only ancestors of query and evidence atoms are kept. The factor graph is compiled into a
+ * junction tree by min-fill elimination, which is calibrated once per distinct evidence, so that
+ * inference is exponential in the treewidth instead of in the number of facts. Writes ℙ(Q_i | E_i)
+ * to q[i] and whether ℙ(E_i) > 0 to e[i]. If P is not as above, or its treewidth exceeds
+ * JTREE_MAX_WIDTH, sets *done to false and returns true. */
+bool jtree_query(program_t *P, double *q, bool *e, bool *done);
+
+#endif
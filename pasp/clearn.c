@@ -1,8 +1,13 @@
 #include "clearn.h"
 
+#include <math.h>
+
 #include "carray.h"
 #include "cdata.h"
 #include "cground.h"
+#include "cmem.h"
+#include "cprofile.h"
+#include "ctrace.h"
 
 #include "../progressbar/progressbar.h"
 
@@ -13,18 +18,26 @@ static inline void update_ground_pr(program_t *P, prob_storage_t *Q) {
 }
 
 static inline bool forward_neural(program_t *P, observations_t *O) {
+  PROF_BEGIN(t);
+  TRACE_BEGIN(t_trace);
   for (size_t j = 0; j < P->NR_n; ++j)
     if (!update_forward_neural_rule(&P->NR[j], O->i, O->i+O->n)) return false;
   for (size_t j = 0; j < P->NA_n; ++j)
     if (!update_forward_neural_annot_disj(&P->NA[j], O->i, O->i+O->n)) return false;
+  TRACE_END(TRACE_NEURAL, t_trace);
+  PROF_END(PROF_NEURAL, t);
   return true;
 }
 
 static inline bool backward_neural(program_t *P, prob_storage_t *Q) {
+  PROF_BEGIN(t);
+  TRACE_BEGIN(t_trace);
   for (size_t i_nr = 0; i_nr < Q->nr; ++i_nr)
     if (!backward_neural_rule(&P->NR[Q->I_NR[i_nr]])) return false;
   for (size_t i_na = 0; i_na < Q->na; ++i_na)
     if (!backward_neural_annot_disj(&P->NA[Q->I_NA[i_na]])) return false;
+  TRACE_END(TRACE_NEURAL, t_trace);
+  PROF_END(PROF_NEURAL, t);
   return true;
 }
 
@@ -145,8 +158,149 @@ void compute_neurasp(program_t *P, prob_storage_t *Q, size_t N, double eta,
   }
 }
 
+void compute_fixpoint_batch(program_t *P, prob_storage_t *Q, observations_t *O, double eta,
+    double smooth);
+
+/* Number of parameters updated by fixpoint: the probabilities of the learnable probabilistic facts,
+ * annotated disjunctions and probabilistic rules of Q, in this order. */
+static size_t fixpoint_dim(program_t *P, prob_storage_t *Q) {
+  size_t d = Q->n + Q->pr;
+  for (size_t i_ad = 0; i_ad < Q->m; ++i_ad) d += P->AD[Q->I_A[i_ad]].n;
+  return d;
+}
+
+static void get_fixpoint_params(program_t *P, prob_storage_t *Q, double *x) {
+  for (size_t i_pf = 0; i_pf < Q->n; ++i_pf) *x++ = P->PF[Q->I_F[i_pf]].p;
+  for (size_t i_ad = 0; i_ad < Q->m; ++i_ad) {
+    annot_disj_t *AD = &P->AD[Q->I_A[i_ad]];
+    for (size_t j = 0; j < AD->n; ++j) *x++ = AD->P[j];
+  }
+  for (size_t i_pr = 0; i_pr < Q->pr; ++i_pr) *x++ = P->PR[Q->I_PR[i_pr]].p;
+}
+
+static void set_fixpoint_params(program_t *P, prob_storage_t *Q, const double *x) {
+  for (size_t i_pf = 0; i_pf < Q->n; ++i_pf) P->PF[Q->I_F[i_pf]].p = *x++;
+  for (size_t i_ad = 0; i_ad < Q->m; ++i_ad) {
+    annot_disj_t *AD = &P->AD[Q->I_A[i_ad]];
+    for (size_t j = 0; j < AD->n; ++j) AD->P[j] = *x++;
+  }
+  for (size_t i_pr = 0; i_pr < Q->pr; ++i_pr) P->PR[Q->I_PR[i_pr]].p = *x++;
+  update_ground_pr(P, Q);
+}
+
+/* Projects x onto valid parameters. Probabilities of facts and rules are clipped to [0, 1]; those of
+ * an annotated disjunction are clipped to nonnegative values and rescaled to the total of the same
+ * entries of y, a fixpoint iterate (fixpoint preserves the total of each disjunction). Returns
+ * false if some disjunction has no positive entry left. */
+static bool project_fixpoint_params(program_t *P, prob_storage_t *Q, double *x, const double *y) {
+  for (size_t i_pf = 0; i_pf < Q->n; ++i_pf, ++x, ++y) *x = *x < 0 ? 0 : (*x > 1 ? 1 : *x);
+  for (size_t i_ad = 0; i_ad < Q->m; ++i_ad) {
+    size_t n = P->AD[Q->I_A[i_ad]].n;
+    double s = 0, t = 0;
+    for (size_t j = 0; j < n; ++j) {
+      if (x[j] < 0) x[j] = 0;
+      s += x[j]; t += y[j];
+    }
+    if (s <= 0) return false;
+    for (size_t j = 0; j < n; ++j) x[j] *= t/s;
+    x += n; y += n;
+  }
+  for (size_t i_pr = 0; i_pr < Q->pr; ++i_pr, ++x) *x = *x < 0 ? 0 : (*x > 1 ? 1 : *x);
+  return true;
+}
+
+/* Computes the probabilities of observations under the current parameters of P, writing their
+ * log-likelihood to *ll, and then applies one fixpoint update. If obs_counts is NULL, each
+ * observation counts once. */
+static bool fixpoint_step(program_t *P, prob_storage_t *Q, observations_t *O,
+    PyArrayObject *obs_counts, size_t N, bool lstable_sat, double *ll) {
+  if (!prob_obs_reuse(P, O, lstable_sat, NULL, Q, false)) return false;
+  if (obs_counts) {
+    *ll = 0;
+    for (size_t i_o = 0; i_o < O->n; ++i_o)
+      *ll += (int) *((int*) PyArray_GETPTR1(obs_counts, i_o))*log(Q[0].P[i_o].o);
+    compute_fixpoint(P, &Q[0], N, 0., obs_counts, O);
+  } else {
+    *ll = ll_prob_storage(&Q[0], O->n);
+    compute_fixpoint_batch(P, &Q[0], O, 0., 0.);
+  }
+  update_ground_pr(P, &Q[0]);
+  return true;
+}
+
+/* Advances the progress bar, if any, and checks for signals. */
+static inline bool fixpoint_tick(progressbar *bar, double ll) {
+  if (bar) progressbar_inc(bar, ll);
+  return !PyErr_CheckSignals();
+}
+
+/* Learns by fixpoint accelerated with SQUAREM [Varadhan and Roland, 2008]. From parameters x0, two
+ * fixpoint updates give x1 and x2, and the extrapolation
+ *
+ *   x' = x0 - 2a r + a² v,   where r = x1 - x0, v = x2 - 2 x1 + x0 and a = min(-|r|/|v|, -1),
+ *
+ * is projected onto valid parameters and updated once more. If x' is less likely than x0, that
+ * last update is discarded and the cycle ends at x2, as plain fixpoint would. Every update counts as
+ * one of the niters iterations. The log-likelihood of the last accepted parameters is written to
+ * *ll, and displayed multiplied by scale. */
+static bool learn_fixpoint_accel(program_t *P, prob_storage_t *Q, observations_t *O,
+    PyArrayObject *obs_counts, size_t N, size_t niters, bool lstable_sat, progressbar *bar,
+    bool display, double scale, double *ll) {
+  size_t d = fixpoint_dim(P, Q);
+  double *X = (double*) mem_malloc(MEM_STORAGE, 4*d*sizeof(double));
+  double *x0 = X, *x1 = X + d, *x2 = X + 2*d, *x = X + 3*d;
+  double ll_0, ll_1, ll_x;
+  bool ok = false;
+
+  if (!X) { mem_raise("SQUAREM iterates"); return false; }
+
+  for (size_t i = 0; i < niters;) {
+    get_fixpoint_params(P, Q, x0);
+    if (!fixpoint_step(P, Q, O, obs_counts, N, lstable_sat, &ll_0)) goto cleanup;
+    *ll = ll_0;
+    if (!fixpoint_tick(bar, display ? ll_0*scale : 0.)) goto cleanup;
+    ++i;
+    /* Not enough iterations left for a full cycle. */
+    if (niters - i < 2) continue;
+
+    get_fixpoint_params(P, Q, x1);
+    if (!fixpoint_step(P, Q, O, obs_counts, N, lstable_sat, &ll_1)) goto cleanup;
+    *ll = ll_1;
+    if (!fixpoint_tick(bar, display ? ll_1*scale : 0.)) goto cleanup;
+    ++i;
+    get_fixpoint_params(P, Q, x2);
+
+    double r2 = 0, v2 = 0;
+    for (size_t k = 0; k < d; ++k) {
+      double r = x1[k] - x0[k], v = x2[k] - 2*x1[k] + x0[k];
+      r2 += r*r; v2 += v*v;
+    }
+    /* Either a fixed point or a straight path, which plain fixpoint already follows. */
+    if (v2 == 0) continue;
+    double a = -sqrt(r2/v2);
+    if (a > -1) a = -1;
+    for (size_t k = 0; k < d; ++k) {
+      double r = x1[k] - x0[k], v = x2[k] - 2*x1[k] + x0[k];
+      x[k] = x0[k] - 2*a*r + a*a*v;
+    }
+    if (!project_fixpoint_params(P, Q, x, x2)) continue;
+
+    set_fixpoint_params(P, Q, x);
+    if (!fixpoint_step(P, Q, O, obs_counts, N, lstable_sat, &ll_x)) goto cleanup;
+    if (!fixpoint_tick(bar, display && isfinite(ll_x) ? ll_x*scale : 0.)) goto cleanup;
+    ++i;
+    if (!isfinite(ll_x) || ll_x < ll_0) set_fixpoint_params(P, Q, x2);
+    else *ll = ll_x;
+  }
+
+  ok = true;
+cleanup:
+  mem_free(MEM_STORAGE, X);
+  return ok;
+}
+
 bool learn(program_t *P, PyArrayObject *obs, PyArrayObject *obs_counts,
-    PyArrayObject *atoms, size_t niters, double eta, bool lstable_sat, size_t which,
+    PyArrayObject *atoms, size_t niters, double eta, bool lstable_sat, size_t which, bool accel,
     uint8_t display) {
   observations_t O = {0}; /* Observations as a C type. */
   prob_storage_t Q[NUM_PROCS] = {{0}}; /* Storage for observation probabilities. */
@@ -175,7 +329,15 @@ bool learn(program_t *P, PyArrayObject *obs, PyArrayObject *obs_counts,
       N += (int) *((int*) PyArray_GETPTR1(obs_counts, i));
   }
 
-  for (size_t i = 0; i < niters; ++i) {
+  if (accel) {
+    if (P->NR_n + P->NA_n > 0) {
+      PyErr_SetString(PyExc_NotImplementedError, "accel is not supported for neural programs!");
+      goto cleanup;
+    }
+    P->batch = O.n;
+    if (!learn_fixpoint_accel(P, Q, &O, obs_counts, N, niters, lstable_sat, bar, display, 1., &ll))
+      goto cleanup;
+  } else for (size_t i = 0; i < niters; ++i) {
     P->batch = O.n;
     if (!forward_neural(P, &O)) goto cleanup;
 
@@ -209,18 +371,18 @@ cleanup:
 }
 
 bool learn_fixpoint(program_t *P, PyArrayObject *obs, PyArrayObject *obs_counts,
-    PyArrayObject *atoms, size_t niters, bool lstable_sat, uint8_t display) {
-  return learn(P, obs, obs_counts, atoms, niters, 0., lstable_sat, ALG_FIXPOINT, display);
+    PyArrayObject *atoms, size_t niters, bool lstable_sat, bool accel, uint8_t display) {
+  return learn(P, obs, obs_counts, atoms, niters, 0., lstable_sat, ALG_FIXPOINT, accel, display);
 }
 
 bool learn_lagrange(program_t *P, PyArrayObject *obs, PyArrayObject *obs_counts,
     PyArrayObject *atoms, size_t niters, double eta, bool lstable_sat, uint8_t display) {
-  return learn(P, obs, obs_counts, atoms, niters, eta, lstable_sat, ALG_LAGRANGE, display);
+  return learn(P, obs, obs_counts, atoms, niters, eta, lstable_sat, ALG_LAGRANGE, false, display);
 }
 
 bool learn_neurasp(program_t *P, PyArrayObject *obs, PyArrayObject *obs_counts,
     PyArrayObject *atoms, size_t niters, double eta, bool lstable_sat, uint8_t display) {
-  return learn(P, obs, obs_counts, atoms, niters, eta, lstable_sat, ALG_NEURASP, display);
+  return learn(P, obs, obs_counts, atoms, niters, eta, lstable_sat, ALG_NEURASP, false, display);
 }
 
 void compute_fixpoint_batch(program_t *P, prob_storage_t *Q, observations_t *O, double eta,
@@ -357,8 +519,38 @@ void compute_neurasp_batch(program_t *P, prob_storage_t *Q, observations_t *O, d
   }
 }
 
+/* Writes the state of batch learning to a checkpoint: the epoch i and observation cursor c of the
+ * next batch to be processed, the number of batches seen so far (for the progress bar), the last
+ * log-likelihood and all program parameters. */
+static bool save_learn_checkpoint(checkpoint_t *ck, program_t *P, size_t i, size_t c, size_t steps,
+    double ll) {
+  uint64_t H[3] = {i, c, steps};
+  FILE *f = checkpoint_open_write(ck, P, CHECKPOINT_KIND_LEARN);
+  if (!f) return false;
+  checkpoint_write(f, H, sizeof(H));
+  checkpoint_write(f, &ll, sizeof(double));
+  checkpoint_write_params(f, P);
+  return checkpoint_commit(ck, f);
+}
+
+static bool load_learn_checkpoint(checkpoint_t *ck, program_t *P, size_t *i, size_t *c,
+    size_t *steps, double *ll) {
+  uint64_t H[3];
+  bool ok = false;
+  FILE *f = checkpoint_open_read(ck, P, CHECKPOINT_KIND_LEARN);
+  if (!f) return false;
+  if (!checkpoint_read(f, H, sizeof(H))) goto cleanup;
+  if (!checkpoint_read(f, ll, sizeof(double))) goto cleanup;
+  if (!checkpoint_read_params(f, P)) goto cleanup;
+  *i = H[0]; *c = H[1]; *steps = H[2];
+  ok = true;
+cleanup:
+  fclose(f);
+  return ok;
+}
+
 bool learn_batch(program_t *P, PyArrayObject *obs, size_t niters, double eta, size_t batch,
-    double smooth, bool lstable_sat, size_t which, uint8_t display) {
+    double smooth, bool lstable_sat, size_t which, bool accel, uint8_t display, checkpoint_t *ck) {
   observations_t O = {0}; /* Dense representation of observations. */
   prob_storage_t Q[NUM_PROCS] = {{0}}; /* Storage for observation probabilities. */
   size_t num_procs = 0;
@@ -381,7 +573,36 @@ bool learn_batch(program_t *P, PyArrayObject *obs, size_t niters, double eta, si
 
   if (needs_ground(P)) if (!ground_all(P, Q)) goto cleanup;
 
-  for (size_t i = 0; i < niters; ++i) {
+  size_t i = 0, steps = 0;
+  if (ck && (P->NR_n + P->NA_n > 0)) {
+    PyErr_SetString(PyExc_NotImplementedError, "checkpointing is not supported for neural programs!");
+    goto cleanup;
+  }
+  if (accel) {
+    /* Extrapolation needs the same objective at every update, i.e. a single batch. */
+    if (O.n < num_obs || ck) {
+      PyErr_SetString(PyExc_ValueError, "accel requires a single batch and no checkpointing!");
+      goto cleanup;
+    }
+    if (P->NR_n + P->NA_n > 0) {
+      PyErr_SetString(PyExc_NotImplementedError, "accel is not supported for neural programs!");
+      goto cleanup;
+    }
+    P->batch = O.n;
+    if (!learn_fixpoint_accel(P, Q, &O, NULL, O.n, niters, lstable_sat, bar, display, 1./O.n, &ll))
+      goto cleanup;
+    i = niters;
+  }
+  if (ck && ck->resume) {
+    size_t c;
+    if (!load_learn_checkpoint(ck, P, &i, &c, &steps, &ll)) goto cleanup;
+    /* Load the batch starting at observation c. */
+    O.i = c; O.n = 0;
+    if (!next_dense_observations(&O, obs)) goto cleanup;
+    if (bar) progressbar_update(bar, steps, display ? ll : 0.);
+  }
+
+  for (; i < niters; ++i) {
     do {
       P->batch = O.n;
       if (!forward_neural(P, &O)) goto cleanup;
@@ -401,6 +622,10 @@ bool learn_batch(program_t *P, PyArrayObject *obs, size_t niters, double eta, si
       if (bar) progressbar_inc(bar, display ? (ll = ll_prob_storage(&Q[0], O.n)/O.n) : 0.);
 
       if (!next_dense_observations(&O, obs)) goto cleanup;
+      ++steps;
+
+      if (checkpoint_due(ck))
+        if (!save_learn_checkpoint(ck, P, O.i ? i : i+1, O.i, steps, ll)) goto cleanup;
 
       /* Check for signals. */
       if (PyErr_CheckSignals()) goto cleanup;
@@ -422,18 +647,21 @@ cleanup:
 }
 
 bool learn_fixpoint_batch(program_t *P, PyArrayObject *obs, size_t niters, size_t batch,
-    double smooth, bool lstable_sat, uint8_t display) {
-  return learn_batch(P, obs, niters, 0., batch, smooth, lstable_sat, ALG_FIXPOINT, display);
+    double smooth, bool lstable_sat, bool accel, uint8_t display, checkpoint_t *ck) {
+  return learn_batch(P, obs, niters, 0., batch, smooth, lstable_sat, ALG_FIXPOINT, accel, display,
+      ck);
 }
 
 bool learn_lagrange_batch(program_t *P, PyArrayObject *obs, size_t niters, double eta, size_t batch,
-    double smooth, bool lstable_sat, uint8_t display) {
-  return learn_batch(P, obs, niters, eta, batch, smooth, lstable_sat, ALG_LAGRANGE, display);
+    double smooth, bool lstable_sat, uint8_t display, checkpoint_t *ck) {
+  return learn_batch(P, obs, niters, eta, batch, smooth, lstable_sat, ALG_LAGRANGE, false, display,
+      ck);
 }
 
 bool learn_neurasp_batch(program_t *P, PyArrayObject *obs, size_t niters, double eta, size_t batch,
-    double smooth, bool lstable_sat, uint8_t display) {
-  return learn_batch(P, obs, niters, eta, batch, smooth, lstable_sat, ALG_NEURASP, display);
+    double smooth, bool lstable_sat, uint8_t display, checkpoint_t *ck) {
+  return learn_batch(P, obs, niters, eta, batch, smooth, lstable_sat, ALG_NEURASP, false, display,
+      ck);
 }
 
 bool update_program_parameters(program_t *P, prob_storage_t *Q) {
@@ -19,19 +19,23 @@
 #define DISPLAY_PROGRESS      1
 #define DISPLAY_LOGLIKELIHOOD 2
 
+/* If accel is set, fixpoint updates are accelerated by SQUAREM extrapolation, falling back to plain
+ * updates whenever an extrapolated step is less likely. */
 bool learn_fixpoint(program_t *P, PyArrayObject *obs, PyArrayObject *obs_counts,
-    PyArrayObject *atoms, size_t niters, bool lstable_sat, uint8_t display);
+    PyArrayObject *atoms, size_t niters, bool lstable_sat, bool accel, uint8_t display);
 bool learn_lagrange(program_t *P, PyArrayObject *obs, PyArrayObject *obs_counts,
     PyArrayObject *atoms, size_t niters, double eta, bool lstable_sat, uint8_t display);
 bool learn_neurasp(program_t *P, PyArrayObject *obs, PyArrayObject *obs_counts,
     PyArrayObject *atoms, size_t niters, double eta, bool lstable_sat, uint8_t display);
 
+/* Batch learning. If ck is not NULL, learning is periodically checkpointed to ck->path and/or
+ * resumed from ck->resume. Accelerated fixpoint (accel) requires a single batch and no ck. */
 bool learn_fixpoint_batch(program_t *P, PyArrayObject *obs, size_t niters, size_t batch,
-    double smooth, bool lstable_sat, uint8_t display);
+    double smooth, bool lstable_sat, bool accel, uint8_t display, checkpoint_t *ck);
 bool learn_lagrange_batch(program_t *P, PyArrayObject *obs, size_t niters, double eta, size_t batch,
-    double smooth, bool lstable_sat, uint8_t display);
+    double smooth, bool lstable_sat, uint8_t display, checkpoint_t *ck);
 bool learn_neurasp_batch(program_t *P, PyArrayObject *obs, size_t niters, double eta, size_t batch,
-    double smooth, bool lstable_sat, uint8_t display);
+    double smooth, bool lstable_sat, uint8_t display, checkpoint_t *ck);
 
 bool update_program_parameters(program_t *P, prob_storage_t *Q);
 
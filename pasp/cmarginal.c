@@ -0,0 +1,343 @@
+#include "cmarginal.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "cutils.h"
+#include "cprofile.h"
+#include "ctrace.h"
+#include "cmem.h"
+#include "creduce.h"
+#include "csharpsat.h"
+
+static int cmp_symbol(const void *a, const void *b) {
+  clingo_symbol_t x = *(const clingo_symbol_t*) a, y = *(const clingo_symbol_t*) b;
+  return clingo_symbol_is_less_than(x, y) ? -1 : clingo_symbol_is_less_than(y, x);
+}
+
+bool marginal_atoms(program_t *P, clingo_symbol_t **A, size_t *n) {
+  clingo_control_t *C = NULL;
+  const clingo_symbolic_atoms_t *atoms;
+  clingo_symbolic_atom_iterator_t it, end;
+  clingo_symbol_t *S = NULL;
+  size_t m = 0, k = 0;
+  bool ok = false;
+
+  /* Every total choice grounds a subset of the program where all probabilistic facts are choices. */
+  if (!clingo_control_new(NULL, 0, undef_atom_ignore, NULL, 20, &C)) goto cleanup;
+  if (!add_all_atoms_as_choice(C, P)) goto cleanup;
+  if (!clingo_control_add(C, "base", NULL, 0, P->P)) goto cleanup;
+  if (P->gr_P[0]) if (!clingo_control_add(C, "base", NULL, 0, P->gr_P)) goto cleanup;
+  if (!atomic_ground(C, NULL, NULL)) goto cleanup;
+
+  if (!clingo_control_symbolic_atoms(C, &atoms)) goto cleanup;
+  if (!clingo_symbolic_atoms_size(atoms, &m)) goto cleanup;
+  S = (clingo_symbol_t*) mem_malloc(MEM_PROGRAM, (m ? m : 1)*sizeof(clingo_symbol_t));
+  if (!S) {
+    mem_raise("Herbrand base");
+    goto cleanup;
+  }
+  if (!clingo_symbolic_atoms_begin(atoms, NULL, &it)) goto cleanup;
+  if (!clingo_symbolic_atoms_end(atoms, &end)) goto cleanup;
+  while (true) {
+    bool is_end;
+    clingo_symbol_t s;
+    const char *name;
+    if (!clingo_symbolic_atoms_iterator_is_equal_to(atoms, it, end, &is_end)) goto cleanup;
+    if (is_end) break;
+    if (!clingo_symbolic_atoms_symbol(atoms, it, &s)) goto cleanup;
+    if (!clingo_symbol_name(s, &name)) goto cleanup;
+    if (name[0] != '_') S[k++] = s;
+    if (!clingo_symbolic_atoms_next(atoms, it, &it)) goto cleanup;
+  }
+  qsort(S, k, sizeof(clingo_symbol_t), cmp_symbol);
+
+  *A = S; *n = k;
+  ok = true;
+cleanup:
+  if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
+  if (!ok) mem_free(MEM_PROGRAM, S);
+  clingo_control_free(C);
+  return ok;
+}
+
+typedef struct {
+  marginal_query_t *M;
+  /* Whether to accumulate maximum entropy (instead of credal) probabilities. */
+  bool maxent;
+  /* Accumulators a, b, c and d of every atom, as in exact_enum, followed by the mass of the
+   * evidence under the maximum entropy semantics. */
+  double *X;
+  /* Literal of each atom in the total choice being solved, or 0 if the atom has the same truth
+   * value T in every model. */
+  clingo_literal_t *L;
+  bool *T;
+  /* Atoms with a literal, and their number. */
+  uint32_t *V;
+  size_t v;
+  /* Bitset of the atoms of V in the current model, and MARGINAL_PLANES bit planes of W words each,
+   * where bit i of plane k is bit k of the number of models (with the evidence) containing V[i]. */
+  uint64_t *B, *K;
+  size_t W;
+  /* Number of models (with the evidence) containing each atom. */
+  size_t *cnt;
+  /* Literals of the evidence, and whether each must be true; E_ok is false if some evidence does
+   * not hold in any model. */
+  clingo_literal_t *EL;
+  bool *ES;
+  size_t el;
+  bool E_ok;
+} marginal_storage_t;
+
+static bool init_marginal_storage(marginal_storage_t *ms, marginal_query_t *M, bool maxent) {
+  size_t n = M->n, W = (n + 63)/64;
+  *ms = (marginal_storage_t) { .M = M, .maxent = maxent, .W = W };
+  ms->X = (double*) mem_calloc(MEM_STORAGE, 4*n+1, sizeof(double));
+  ms->L = (clingo_literal_t*) mem_malloc(MEM_STORAGE, (n+1)*sizeof(clingo_literal_t));
+  ms->T = (bool*) mem_malloc(MEM_STORAGE, n+1);
+  ms->V = (uint32_t*) mem_malloc(MEM_STORAGE, (n+1)*sizeof(uint32_t));
+  ms->B = (uint64_t*) mem_calloc(MEM_STORAGE, W+1, sizeof(uint64_t));
+  ms->K = (uint64_t*) mem_calloc(MEM_STORAGE, MARGINAL_PLANES*W+1, sizeof(uint64_t));
+  ms->cnt = (size_t*) mem_malloc(MEM_STORAGE, (n+1)*sizeof(size_t));
+  ms->EL = (clingo_literal_t*) mem_malloc(MEM_STORAGE, (M->E_n+1)*sizeof(clingo_literal_t));
+  ms->ES = (bool*) mem_malloc(MEM_STORAGE, M->E_n+1);
+  if (!(ms->X && ms->L && ms->T && ms->V && ms->B && ms->K && ms->cnt && ms->EL && ms->ES)) {
+    mem_raise("marginal storage");
+    return false;
+  }
+  return true;
+}
+
+static void free_marginal_storage_contents(marginal_storage_t *ms) {
+  mem_free(MEM_STORAGE, ms->X);
+  mem_free(MEM_STORAGE, ms->L);
+  mem_free(MEM_STORAGE, ms->T);
+  mem_free(MEM_STORAGE, ms->V);
+  mem_free(MEM_STORAGE, ms->B);
+  mem_free(MEM_STORAGE, ms->K);
+  mem_free(MEM_STORAGE, ms->cnt);
+  mem_free(MEM_STORAGE, ms->EL);
+  mem_free(MEM_STORAGE, ms->ES);
+}
+
+/* Resolves the literals of atoms and evidence in the program grounded by C. */
+static bool resolve_literals(marginal_storage_t *ms, clingo_control_t *C) {
+  marginal_query_t *M = ms->M;
+  ms->v = 0;
+  for (size_t i = 0; i < M->n; ++i) {
+    if (!sharpsat_literal(C, M->A[i], true, &ms->L[i], &ms->T[i])) return false;
+    if (ms->L[i]) ms->V[ms->v++] = i;
+  }
+  ms->el = 0;
+  ms->E_ok = true;
+  for (size_t i = 0; i < M->E_n; ++i) {
+    clingo_literal_t l;
+    bool c;
+    if (!sharpsat_literal(C, M->E[i], true, &l, &c)) return false;
+    if (l) { ms->EL[ms->el] = l; ms->ES[ms->el++] = M->E_s[i]; }
+    else if (c != M->E_s[i]) ms->E_ok = false;
+  }
+  return true;
+}
+
+/* Adds bitset B to the bit-sliced counters K, returning the number of planes touched. */
+static inline size_t add_bitset(uint64_t *K, const uint64_t *B, size_t W) {
+  size_t h = 0;
+  for (size_t w = 0; w < W; ++w) {
+    uint64_t carry = B[w];
+    size_t k;
+    for (k = 0; carry && (k < MARGINAL_PLANES); ++k) {
+      uint64_t *x = &K[k*W+w], t = *x & carry;
+      *x ^= carry;
+      carry = t;
+    }
+    if (k > h) h = k;
+  }
+  return h;
+}
+
+static void compute_marginal(void *args) {
+  struct { marginal_storage_t *M; storage_t *S; } *pair = args;
+  marginal_storage_t *ms = pair->M;
+  marginal_query_t *Q = ms->M;
+  storage_t *st = pair->S;
+  total_choice_t *theta = &st->theta;
+  program_t *P = st->P;
+  clingo_control_t *C = NULL;
+  size_t m = 0, m_e = 0, planes = 0, n = Q->n, W = ms->W;
+
+  TRACE_BEGIN(t_job);
+  st->fail = true;
+  uint64_t t_sched = prof_now();
+  size_t solvers = sched_solvers(st->sched);
+
+  if (!acquire_control(&st->ctl, &C, P, theta, solvers)) goto cleanup;
+  if (!resolve_literals(ms, C)) goto cleanup;
+
+  /* Solving. */ {
+    bool ok = false;
+    clingo_solve_handle_t *handle;
+    const clingo_model_t *M;
+
+    if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle))
+      goto solve_cleanup;
+    while (true) {
+      PROF_BEGIN(t_solve);
+      if (!clingo_solve_handle_resume(handle)) goto solve_cleanup;
+      if (!clingo_solve_handle_model(handle, &M)) goto solve_cleanup;
+      PROF_END(PROF_SOLVE, t_solve);
+      if (!M) break;
+      ++m;
+      if (!ms->E_ok) continue;
+      PROF_BEGIN(t_models);
+      bool all_e = true, c;
+      for (size_t i = 0; i < ms->el; ++i) {
+        if (!clingo_model_is_true(M, ms->EL[i], &c)) goto solve_cleanup;
+        if (c != ms->ES[i]) { all_e = false; break; }
+      }
+      if (all_e) {
+        ++m_e;
+        memset(ms->B, 0, W*sizeof(uint64_t));
+        for (size_t i = 0; i < ms->v; ++i) {
+          if (!clingo_model_is_true(M, ms->L[ms->V[i]], &c)) goto solve_cleanup;
+          ms->B[i/64] |= (uint64_t) c << (i%64);
+        }
+        size_t h = add_bitset(ms->K, ms->B, W);
+        if (h > planes) planes = h;
+      }
+      PROF_END(PROF_MODELS, t_models);
+    }
+    ok = true;
+solve_cleanup:
+    if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
+  }
+
+  PROF_BEGIN(t_prob);
+  double p = prob_total_choice(P, theta);
+  /* Decode the bit-sliced counters of varying atoms; fixed atoms are in all or none of the models. */
+  for (size_t i = 0; i < n; ++i) ms->cnt[i] = ms->T[i] ? m_e : 0;
+  for (size_t i = 0; i < ms->v; ++i) {
+    size_t c = 0, w = i/64, b = i%64;
+    for (size_t k = 0; k < planes; ++k) c |= (size_t) ((ms->K[k*W+w] >> b) & 1) << k;
+    ms->cnt[ms->V[i]] = c;
+  }
+  memset(ms->K, 0, planes*W*sizeof(uint64_t));
+  if (m == 0) st->warn = true;
+  else {
+    double *a = ms->X, *b = a + n, *c = b + n, *d = c + n;
+    bool all_e = (m_e == m) || !Q->E_n;
+    for (size_t i = 0; i < n; ++i) {
+      size_t q = ms->cnt[i];
+      if (ms->maxent) { a[i] += (q*p)/m; continue; }
+      a[i] += (all_e && (q == m))*p;
+      b[i] += (q > 0)*p;
+      c[i] += (all_e && (q == 0))*p;
+      d[i] += (m_e > q)*p;
+    }
+    ms->X[4*n] += (m_e*p)/m;
+  }
+  PROF_END(PROF_PROB, t_prob);
+  progress_publish(st->prog, m, p);
+  st->fail = false;
+cleanup:
+  if (st->fail) memset(ms->K, 0, MARGINAL_PLANES*W*sizeof(uint64_t));
+  release_control(&st->ctl, C);
+  sched_record(st->sched, prof_now() - t_sched, solvers);
+  TRACE_END(TRACE_JOB, t_job);
+  pthread_mutex_lock(st->wakeup);
+  st->busy_procs[st->pid] = false;
+  pthread_cond_signal(st->avail);
+  pthread_mutex_unlock(st->wakeup);
+}
+
+bool marginal_enum(program_t *P, marginal_query_t *M, psemantics_t psem, double **R,
+    progress_t *pg) {
+  total_choice_t theta = {0};
+  size_t total_choice_n = get_num_facts(P);
+  size_t num_procs = estimate_nprocs(total_choice_n + P->AD_n);
+  size_t n = M->n, w = psem == MAXENT_SEMANTICS ? 1 : 2;
+  bool busy_procs[NUM_PROCS] = {0}, warn = false;
+  marginal_storage_t D[NUM_PROCS] = {{0}};
+  storage_t S[NUM_PROCS] = {{0}};
+  size_t i;
+  bool ok = false;
+  pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER, wakeup = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t avail = PTHREAD_COND_INITIALIZER;
+  threadpool pool = thpool_init(num_procs);
+  struct { marginal_storage_t *M; storage_t *S; } pairs[NUM_PROCS] = {{0}};
+  sched_t sc;
+  double *X = NULL;
+
+  if (!init_total_choice(&theta, total_choice_n, P)) goto cleanup;
+  for (i = 0; i < num_procs; ++i) {
+    if (!init_marginal_storage(&D[i], M, psem == MAXENT_SEMANTICS)) goto cleanup;
+    S[i].pid = i; S[i].mu = &mu; S[i].wakeup = &wakeup; S[i].avail = &avail;
+    S[i].busy_procs = busy_procs;
+    S[i].P = P;
+    if (!init_total_choice(&S[i].theta, total_choice_n, P)) goto cleanup;
+    S[i].sched = &sc;
+    pairs[i].M = &D[i];
+    pairs[i].S = &S[i];
+  }
+  init_sched(&sc, num_procs, num_total_choices(P));
+  if (progress_enabled(pg)) {
+    if (!progress_begin(pg, num_procs, num_total_choices(P), 1)) goto cleanup;
+    for (i = 0; i < num_procs; ++i) S[i].prog = &pg->slots[i];
+  }
+
+  do {
+    do {
+      int id = retr_free_proc(busy_procs, num_procs, &wakeup, &avail);
+      if (!dispatch_job_with_payload(&theta, &wakeup, busy_procs, S, num_procs, pool, &avail, id,
+            compute_marginal, &pairs[id])) goto cleanup;
+      sched_dispatched(&sc);
+      if (!progress_tick(pg)) goto cleanup;
+    } while (incr_total_choice_ad(&theta, P));
+  } while (incr_total_choice(&theta));
+  thpool_wait(pool);
+  if (!progress_finish(pg)) goto cleanup;
+  for (i = 0; i < num_procs; ++i) {
+    if (S[i].fail) goto cleanup;
+    warn |= S[i].warn;
+  }
+
+  /* Merge. */ {
+    reduce_seg_t G[NUM_PROCS];
+    for (i = 0; i < num_procs; ++i) G[i] = (reduce_seg_t) {D[i].X, 4*n+1};
+    if (!reduce_sum(pool, num_procs, G, num_procs, 1, REDUCE_DOUBLE)) goto cleanup;
+  }
+
+  X = (double*) mem_malloc(MEM_RESULTS, (n ? n : 1)*w*sizeof(double));
+  if (!X) {
+    mem_raise("marginals");
+    goto cleanup;
+  }
+  double *a = D[0].X, *b = a + n, *c = b + n, *d = c + n, e = a[4*n];
+  for (i = 0; i < n; ++i) {
+    if (psem == MAXENT_SEMANTICS) { X[i] = a[i]/e; continue; }
+    double *x = X + 2*i;
+    if (!M->E_n) { x[0] = a[i]; x[1] = b[i]; }
+    else if (b[i] + d[i] == 0) { x[0] = -INFINITY; x[1] = INFINITY; }
+    else if ((b[i] + c[i] == 0) && (d[i] > 0)) { x[0] = 0; x[1] = 0; }
+    else if ((a[i] + d[i] == 0) && (b[i] > 0)) { x[0] = 1; x[1] = 1; }
+    else { x[0] = a[i]/(a[i] + d[i]); x[1] = b[i]/(b[i] + c[i]); }
+  }
+  if (warn)
+    fputws(L"Warning: found total choice with no model. Probabilities may be incorrect.\n", stdout);
+  *R = X;
+
+  ok = true;
+cleanup:
+  if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
+  free_total_choice_contents(&theta);
+  pthread_mutex_destroy(&mu);
+  pthread_mutex_destroy(&wakeup);
+  pthread_cond_destroy(&avail);
+  thpool_destroy(pool);
+  for (i = 0; i < num_procs; ++i) {
+    free_marginal_storage_contents(&D[i]);
+    free_total_choice_contents(&S[i].theta);
+    free_control_pool_contents(&S[i].ctl);
+  }
+  return ok;
+}
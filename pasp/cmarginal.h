@@ -0,0 +1,36 @@
+#ifndef _PASP_CMARGINAL
+#define _PASP_CMARGINAL
+
+#include <clingo.h>
+
+#include "cprogram.h"
+#include "cinf.h"
+#include "cprogress.h"
+
+/* Number of bit planes of the per-model counters, i.e. models of a single total choice are counted
+ * modulo 2^MARGINAL_PLANES. */
+#define MARGINAL_PLANES 32
+
+typedef struct {
+  /* Atoms whose marginals are computed. */
+  clingo_symbol_t *A;
+  size_t n;
+  /* Evidence atoms, and whether each must be true (E_s[i]) or false. */
+  clingo_symbol_t *E;
+  bool *E_s;
+  size_t E_n;
+} marginal_query_t;
+
+/* Collects in *A (of *n elements, allocated with MEM_PROGRAM) every atom of the Herbrand base of P,
+ * except for the auxiliary atoms whose names start with an underscore, in clingo's symbol order. */
+bool marginal_atoms(program_t *P, clingo_symbol_t **A, size_t *n);
+
+/* Computes the marginal of every atom of M given its evidence in a single enumeration of the total
+ * choices of P, writing to row i of R the lower and upper (or, under the maximum entropy semantics,
+ * the sole) probability of the i-th atom. Each model is read once into a bitset of the atoms that
+ * vary between the models of its total choice, which is added to bit-sliced counters a word (64
+ * atoms) at a time. */
+bool marginal_enum(program_t *P, marginal_query_t *M, psemantics_t psem, double **R,
+    progress_t *pg);
+
+#endif
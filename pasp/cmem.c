@@ -0,0 +1,142 @@
+#include "cmem.h"
+
+#include <string.h>
+
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#define mem_usable_size(p) malloc_size(p)
+#else
+#include <malloc.h>
+#define mem_usable_size(p) malloc_usable_size(p)
+#endif
+
+static const char *MEM_SUBSYSTEM_NAMES[MEM_N] = {
+  "program", "ground", "credal", "storage", "samples", "data", "results", "instrument", "other",
+};
+
+/* Counters are signed, since memory allocated before mem_start may be freed after it. */
+static int64_t mem_cur[MEM_N], mem_peak[MEM_N], mem_total, mem_total_peak;
+static size_t mem_max = 0;
+static bool mem_hit = false;
+
+void mem_start(size_t limit) {
+  memset(mem_cur, 0, sizeof(mem_cur));
+  memset(mem_peak, 0, sizeof(mem_peak));
+  mem_total = mem_total_peak = 0;
+  mem_max = limit;
+  mem_hit = false;
+}
+
+void mem_stop(void) { mem_max = 0; }
+
+bool mem_limit_hit(void) { return __atomic_load_n(&mem_hit, __ATOMIC_RELAXED); }
+size_t mem_limit(void) { return mem_max; }
+
+static inline void mem_update_peak(int64_t *peak, int64_t v) {
+  int64_t p = __atomic_load_n(peak, __ATOMIC_RELAXED);
+  while ((v > p) && !__atomic_compare_exchange_n(peak, &p, v, true, __ATOMIC_RELAXED,
+        __ATOMIC_RELAXED));
+}
+
+static inline void mem_add(mem_subsystem_t s, int64_t n) {
+  mem_update_peak(&mem_peak[s], __atomic_add_fetch(&mem_cur[s], n, __ATOMIC_RELAXED));
+  mem_update_peak(&mem_total_peak, __atomic_add_fetch(&mem_total, n, __ATOMIC_RELAXED));
+}
+
+/* Reserves n bytes against the limit before they are actually allocated. */
+static inline bool mem_reserve(size_t n) {
+  if (!mem_max) return true;
+  if (__atomic_add_fetch(&mem_total, (int64_t) n, __ATOMIC_RELAXED) > (int64_t) mem_max) {
+    __atomic_sub_fetch(&mem_total, (int64_t) n, __ATOMIC_RELAXED);
+    __atomic_store_n(&mem_hit, true, __ATOMIC_RELAXED);
+    return false;
+  }
+  return true;
+}
+
+/* Replaces a reservation of n bytes with the usable size u of the actual allocation. */
+static inline void mem_commit(mem_subsystem_t s, size_t n, size_t u) {
+  if (mem_max) __atomic_sub_fetch(&mem_total, (int64_t) n, __ATOMIC_RELAXED);
+  mem_add(s, (int64_t) u);
+}
+
+void* mem_malloc(mem_subsystem_t s, size_t n) {
+  void *p;
+  if (!mem_reserve(n)) return NULL;
+  p = malloc(n);
+  mem_commit(s, n, p ? mem_usable_size(p) : 0);
+  return p;
+}
+
+void* mem_calloc(mem_subsystem_t s, size_t n, size_t k) {
+  void *p;
+  if (k && (n > SIZE_MAX/k)) return NULL;
+  if (!mem_reserve(n*k)) return NULL;
+  p = calloc(n, k);
+  mem_commit(s, n*k, p ? mem_usable_size(p) : 0);
+  return p;
+}
+
+void* mem_aligned_alloc(mem_subsystem_t s, size_t a, size_t n) {
+  void *p;
+  if (!mem_reserve(n)) return NULL;
+  p = aligned_alloc(a, n);
+  mem_commit(s, n, p ? mem_usable_size(p) : 0);
+  return p;
+}
+
+void* mem_realloc(mem_subsystem_t s, void *p, size_t n) {
+  size_t u = p ? mem_usable_size(p) : 0, g = n > u ? n - u : 0;
+  void *q;
+  if (!mem_reserve(g)) return NULL;
+  q = realloc(p, n);
+  if (!q) {
+    if (mem_max) __atomic_sub_fetch(&mem_total, (int64_t) g, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  mem_commit(s, g, mem_usable_size(q));
+  mem_add(s, -(int64_t) u);
+  return q;
+}
+
+void mem_free(mem_subsystem_t s, void *p) {
+  if (!p) return;
+  mem_add(s, -(int64_t) mem_usable_size(p));
+  free(p);
+}
+
+void mem_raise(const char *what) {
+  if (mem_limit_hit())
+    PyErr_Format(PyExc_MemoryError, "memory limit of %zu bytes exceeded while allocating %s!",
+        mem_max, what);
+  else PyErr_Format(PyExc_MemoryError, "could not allocate memory for %s!", what);
+}
+
+static inline long long mem_clamp(int64_t v) { return v > 0 ? v : 0; }
+
+PyObject* mem_stats(void) {
+  PyObject *D = NULL, *S = PyDict_New(), *limit;
+  if (!S) return NULL;
+  for (size_t i = 0; i < MEM_N; ++i) {
+    PyObject *T = Py_BuildValue("{s:L,s:L}", "current", mem_clamp(mem_cur[i]), "peak",
+        mem_clamp(mem_peak[i]));
+    if (!T || PyDict_SetItemString(S, MEM_SUBSYSTEM_NAMES[i], T)) { Py_XDECREF(T); goto cleanup; }
+    Py_DECREF(T);
+  }
+  if (mem_max) limit = PyLong_FromSize_t(mem_max);
+  else { limit = Py_None; Py_INCREF(limit); }
+  D = Py_BuildValue("{s:L,s:L,s:N,s:O,s:O}", "current", mem_clamp(mem_total), "peak",
+      mem_clamp(mem_total_peak), "limit", limit, "hit", mem_limit_hit() ? Py_True : Py_False,
+      "subsystems", S);
+cleanup:
+  Py_DECREF(S);
+  return D;
+}
+
+bool mem_stats_into(PyObject *D) {
+  PyObject *M = mem_stats();
+  if (!M) return false;
+  int r = PyDict_SetItemString(D, "memory", M);
+  Py_DECREF(M);
+  return !r;
+}
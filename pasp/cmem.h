@@ -0,0 +1,60 @@
+#ifndef _PASP_CMEM
+#define _PASP_CMEM
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Subsystems whose memory is accounted separately. Keep MEM_SUBSYSTEM_NAMES (cmem.c) in the same
+ * order. */
+typedef enum {
+  /* Program structures: facts, rules, queries and their symbols. */
+  MEM_PROGRAM,
+  /* Ground program strings and probabilistic facts found during grounding. */
+  MEM_GROUND,
+  /* Credal polynomials Pn and coefficients K, and credal fact bounds. */
+  MEM_CREDAL,
+  /* Per-thread storage: counters, accumulators and (for learning) per-observation storage. */
+  MEM_STORAGE,
+  /* Sample matrices. */
+  MEM_SAMPLES,
+  /* Observations and datasets. */
+  MEM_DATA,
+  /* Results returned to Python. */
+  MEM_RESULTS,
+  /* Trace rings and progress counters. */
+  MEM_INSTRUMENT,
+  MEM_OTHER,
+  MEM_N
+} mem_subsystem_t;
+
+/* Resets all counters and caps the total number of tracked bytes at limit (0 for no limit). */
+void mem_start(size_t limit);
+/* Lifts the limit, keeping the counters for mem_stats. */
+void mem_stop(void);
+/* Returns the counters as a Python dict with keys "current", "peak", "limit" and "subsystems"
+ * (current and peak bytes of each subsystem), or NULL on error. */
+PyObject* mem_stats(void);
+/* Adds mem_stats() to dict D under key "memory". */
+bool mem_stats_into(PyObject *D);
+/* Whether an allocation was refused for exceeding the limit since the last mem_start. */
+bool mem_limit_hit(void);
+size_t mem_limit(void);
+
+/* Drop-in replacements for malloc, calloc, realloc and free that account bytes to subsystem s. They
+ * return NULL (leaving p untouched for mem_realloc) if the limit would be exceeded. Memory may be
+ * freed with either mem_free or free; the latter only leaves the counters of s too high. */
+void* mem_malloc(mem_subsystem_t s, size_t n);
+void* mem_calloc(mem_subsystem_t s, size_t n, size_t k);
+void* mem_realloc(mem_subsystem_t s, void *p, size_t n);
+/* As aligned_alloc, with n a multiple of a. */
+void* mem_aligned_alloc(mem_subsystem_t s, size_t a, size_t n);
+void mem_free(mem_subsystem_t s, void *p);
+
+/* Raises a MemoryError for failing to allocate what, telling whether the limit was the cause. */
+void mem_raise(const char *what);
+
+#endif
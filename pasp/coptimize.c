@@ -1,5 +1,10 @@
 #include "coptimize.h"
 
+#include <stdint.h>
+#include <string.h>
+
+#include "cmem.h"
+
 /* The polynomial to evaluate, where X are the variables, S are the signs of each factor, C are the
  * coefficients, n are the number of terms and m are the number of variables. For example, the
  * following polynomial
@@ -102,6 +107,107 @@ double bfca(double *X, bool *S_a, bool *S_b, double *C_a, double *C_b, double *L
   return maxmin*best;
 }
 
+bool monotone_enabled(void) {
+  const char *e = getenv(MONOTONE_ENV);
+  return !(e && !strcmp(e, "0"));
+}
+
+typedef struct {
+  /* Truth values of the factors of a term, bit j for variable j. */
+  uint64_t s;
+  double c;
+} term_t;
+
+static int cmp_term(const void *a, const void *b) {
+  uint64_t x = ((const term_t*) a)->s, y = ((const term_t*) b)->s;
+  return (x > y) - (x < y);
+}
+
+/* Signs the partial derivatives of the polynomial S, C, n, m (see f) may take over [0, 1]^m: bit 0
+ * (resp. 1) of D[j] is set if ∂f/∂x_j may be positive (resp. negative). As f is multilinear and
+ * each term fixes every variable, ∂f/∂x_j is the sum, over the values of the other variables, of
+ * the difference between the coefficients of the terms with x_j and with 1-x_j times a product of
+ * factors that is nonnegative over the box, so its sign is fixed if those of the differences
+ * agree. Returns false if out of memory. */
+static bool slope_signs(bool *S, double *C, size_t n, size_t m, uint8_t *D) {
+  term_t *T = (term_t*) mem_malloc(MEM_STORAGE, (n ? n : 1)*sizeof(term_t));
+  size_t i, j, k = 0;
+
+  if (!T) return false;
+  for (i = 0; i < n; ++i) {
+    uint64_t s = 0;
+    for (j = 0; j < m; ++j) s |= (uint64_t) S[m*i+j] << j;
+    T[i] = (term_t) { s, C[i] };
+  }
+  /* Merge terms with the same factors. */
+  qsort(T, n, sizeof(term_t), cmp_term);
+  for (i = 0; i < n; ++i) {
+    if (k && (T[k-1].s == T[i].s)) T[k-1].c += T[i].c;
+    else T[k++] = T[i];
+  }
+  memset(D, 0, m);
+  for (j = 0; j < m; ++j) {
+    uint64_t b = (uint64_t) 1 << j;
+    for (i = 0; i < k; ++i) {
+      term_t t = { T[i].s ^ b, 0 }, *p = (term_t*) bsearch(&t, T, k, sizeof(term_t), cmp_term);
+      double d;
+      if (T[i].s & b) d = T[i].c - (p ? p->c : 0);
+      else if (p) continue; /* Already paired with its partner. */
+      else d = -T[i].c;
+      if (d > 0) D[j] |= 1;
+      else if (d < 0) D[j] |= 2;
+    }
+  }
+  mem_free(MEM_STORAGE, T);
+  return true;
+}
+
+/* Writes to D[j] the direction in which g(X) = p(X)/(p(X)+q(X)) (or g(X) = p(X) if S_q is NULL)
+ * moves as x_j grows anywhere in the box: MONOTONE_UP if it never decreases, MONOTONE_DOWN if it
+ * never increases, or MONOTONE_FREE if neither is provable. Since p, q ≥ 0, g is monotone in x_j
+ * if p and q are, in opposite directions. */
+static void monotone(bool *S_p, bool *S_q, double *C_p, double *C_q, size_t n_p, size_t n_q,
+    size_t m, int8_t *D) {
+  uint8_t D_p[64], D_q[64] = {0};
+  size_t j;
+
+  if (!monotone_enabled() || !slope_signs(S_p, C_p, n_p, m, D_p) ||
+      (S_q && !slope_signs(S_q, C_q, n_q, m, D_q))) {
+    memset(D, MONOTONE_FREE, m);
+    return;
+  }
+  for (j = 0; j < m; ++j) {
+    bool up = (D_p[j] & 1) || (D_q[j] & 2), down = (D_p[j] & 2) || (D_q[j] & 1);
+    D[j] = (up && down) ? MONOTONE_FREE : down ? MONOTONE_DOWN : MONOTONE_UP;
+  }
+}
+
+/* Minimizes (maxmin = BFCA_MINIMIZE) or maximizes (maxmin = BFCA_MAXIMIZE) g(X) = p(X)/(p(X)+q(X))
+ * (or g(X) = p(X) if S_q is NULL) over the vertices of the box [L, U], fixing the variables that g
+ * is monotone in (by D) at their best bound and enumerating the others. */
+static double bf_search(double *X, bool *S_p, bool *S_q, double *C_p, double *C_q, double *L,
+    double *U, size_t n_p, size_t n_q, size_t m, const int8_t *D, int maxmin) {
+  size_t F[64], r = 0, j;
+  unsigned long long int k, i;
+  double best = maxmin == BFCA_MINIMIZE ? 1.0 : 0.0, y, z;
+
+  for (j = 0; j < m; ++j) {
+    if (D[j] == MONOTONE_FREE) F[r++] = j;
+    else X[j] = (D[j]*maxmin > 0) ? L[j] : U[j];
+  }
+  k = 1ULL << r;
+  for (i = 0; i < k; ++i) {
+    for (j = 0; j < r; ++j) X[F[j]] = ((i >> j) % 2) ? L[F[j]] : U[F[j]];
+    y = f(X, S_p, C_p, n_p, m);
+    if (S_q) {
+      z = y+f(X, S_q, C_q, n_q, m);
+      if (z != 0) y = y/z;
+    }
+    if (maxmin*y < maxmin*best) best = y;
+  }
+  return best;
+}
+
 /* Brute-force.
  *
  * Array X are the coordinates to optimize, S_i, C_i, n_i, m - where i ∈ {a, b} are the polynomials
@@ -110,12 +216,36 @@ double bfca(double *X, bool *S_a, bool *S_b, double *C_a, double *C_b, double *L
  * where the function should store the minimized and maximized values. This function is constrained
  * over 1 ≤ m ≤ 30 (any call above 30 would end up taking too long anyway). Parameter smp
  * determines (if true) that the function should override the objective function with g(X)=a(X)
+ * for the minimum and g(X)=b(X) for the maximum.
+ *
+ * Variables the objective is provably monotone in (see slope_signs) are fixed at the bound that
+ * minimizes or maximizes it, so that only 2^k vertices are searched, where k ≤ m is the number of
+ * the other variables. bf_minmax does the same for the minimum of a(X)/(a(X)+d(X)) and the maximum
+ * of b(X)/(b(X)+c(X)).
  */
 void bf(double *X, bool *S_a, bool *S_b, double *C_a, double *C_b, double *L, double *U,
     size_t n_a, size_t n_b, size_t m, double *low, double *up, bool smp) {
   size_t j;
   unsigned long long int k, i;
   double a, b, y;
+  int8_t D[64];
+
+  if (smp) {
+    monotone(S_a, NULL, C_a, NULL, n_a, 0, m, D);
+    *low = bf_search(X, S_a, NULL, C_a, NULL, L, U, n_a, 0, m, D, BFCA_MINIMIZE);
+    monotone(S_b, NULL, C_b, NULL, n_b, 0, m, D);
+    *up = bf_search(X, S_b, NULL, C_b, NULL, L, U, n_b, 0, m, D, BFCA_MAXIMIZE);
+    return;
+  }
+  /* Monotone variables are fixed at opposite bounds for the minimum and the maximum, which are
+   * then searched for separately. */
+  monotone(S_a, S_b, C_a, C_b, n_a, n_b, m, D);
+  for (j = 0; (j < m) && (D[j] == MONOTONE_FREE); ++j);
+  if (j < m) {
+    *low = bf_search(X, S_a, S_b, C_a, C_b, L, U, n_a, n_b, m, D, BFCA_MINIMIZE);
+    *up = bf_search(X, S_a, S_b, C_a, C_b, L, U, n_a, n_b, m, D, BFCA_MAXIMIZE);
+    return;
+  }
 
   *low = 1.0; *up = 0.0;
   k = 1 << m;
@@ -123,37 +253,20 @@ void bf(double *X, bool *S_a, bool *S_b, double *C_a, double *C_b, double *L, do
     for (j = 0; j < m; ++j) X[j] = ((i >> j) % 2) ? L[j] : U[j];
     a = f(X, S_a, C_a, n_a, m);
     b = f(X, S_b, C_b, n_b, m);
-    if (smp) {
-      if (*low > a) *low = a;
-      if (*up < b) *up = b;
-    } else {
-      y = a+b;
-      if (y != 0) y = a/y;
-      if (*low > y) *low = y;
-      if (*up < y) *up = y;
-    }
+    y = a+b;
+    if (y != 0) y = a/y;
+    if (*low > y) *low = y;
+    if (*up < y) *up = y;
   }
 }
 void bf_minmax(double *X, bool *S_a, bool *S_b, bool* S_c, bool* S_d, double *C_a,
     double *C_b, double *C_c, double *C_d, double *L, double *U, size_t n_a, size_t n_b,
     size_t n_c, size_t n_d, size_t m, double *low, double *up) {
-  size_t j;
-  unsigned long long int k, i;
-  double a, b, c, d, y, z;
+  int8_t D[64];
 
-  *low = 1.0; *up = 0.0;
-  k = 1 << m;
-  for (i = 0; i < k; ++i) {
-    for (j = 0; j < m; ++j) X[j] = ((i >> j) % 2) ? L[j] : U[j];
-    a = f(X, S_a, C_a, n_a, m);
-    b = f(X, S_b, C_b, n_b, m);
-    c = f(X, S_c, C_c, n_c, m);
-    d = f(X, S_d, C_d, n_d, m);
-    y = a+d;
-    if (y != 0) y = a/y;
-    z = b+c;
-    if (z != 0) z = b/z;
-    if (*low > y) *low = y;
-    if (*up < z) *up = z;
-  }
+  /* The lower bound is the minimum of a/(a+d) and the upper the maximum of b/(b+c). */
+  monotone(S_a, S_d, C_a, C_d, n_a, n_d, m, D);
+  *low = bf_search(X, S_a, S_d, C_a, C_d, L, U, n_a, n_d, m, D, BFCA_MINIMIZE);
+  monotone(S_b, S_c, C_b, C_c, n_b, n_c, m, D);
+  *up = bf_search(X, S_b, S_c, C_b, C_c, L, U, n_b, n_c, m, D, BFCA_MAXIMIZE);
 }
@@ -4,6 +4,18 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+/* Environment variable that, if set to 0, disables the monotonicity analysis of bf and bf_minmax,
+ * so that every vertex of the box of credal facts is searched. */
+#define MONOTONE_ENV "PASP_MONOTONE"
+
+/* Directions of an objective in a variable. */
+#define MONOTONE_FREE 0
+#define MONOTONE_UP   1
+#define MONOTONE_DOWN -1
+
+/* Whether bf and bf_minmax prune monotone variables (see MONOTONE_ENV). */
+bool monotone_enabled(void);
+
 double bfca(double *X, bool *S_a, bool *S_b, double *C_a, double *C_b, double *L, double *U,
     size_t n_a, size_t n_b, size_t m, int maxmin, size_t tries, bool smp);
 
@@ -0,0 +1,104 @@
+#include "cprofile.h"
+
+#include <string.h>
+
+bool prof_enabled = false;
+
+static const char *PROF_PHASE_NAMES[PROF_N] = {
+  "control", "parse", "ground", "solve", "models", "probability", "wait", "merge", "neural",
+};
+static const char *PROF_CLINGO_KEYS[PROF_CLINGO_N] = {
+  "summary.times.total", "summary.times.solve", "summary.models.enumerated",
+  "solving.solvers.choices", "solving.solvers.conflicts", "problem.lp.atoms",
+};
+
+static prof_counters_t prof_threads[PROF_MAX_THREADS];
+static size_t prof_threads_n = 0;
+/* Bumped on every prof_start, so that threads claim a fresh slot in each profiling run. */
+static unsigned prof_gen = 0;
+static __thread unsigned prof_tls_gen = 0;
+static __thread prof_counters_t *prof_tls = NULL;
+
+prof_counters_t* prof_local(void) {
+  if (prof_tls_gen != __atomic_load_n(&prof_gen, __ATOMIC_RELAXED)) {
+    size_t i = __atomic_fetch_add(&prof_threads_n, 1, __ATOMIC_RELAXED);
+    prof_tls = &prof_threads[i < PROF_MAX_THREADS ? i : PROF_MAX_THREADS-1];
+    prof_tls_gen = prof_gen;
+  }
+  return prof_tls;
+}
+
+void prof_start(void) {
+  memset(prof_threads, 0, sizeof(prof_threads));
+  prof_threads_n = 0;
+  __atomic_add_fetch(&prof_gen, 1, __ATOMIC_RELAXED);
+  prof_enabled = true;
+}
+
+void prof_clingo(clingo_control_t *C) {
+  const clingo_statistics_t *S;
+  uint64_t root, k;
+  prof_counters_t *c = prof_local();
+  if (!clingo_control_statistics(C, &S) || !clingo_statistics_root(S, &root)) return;
+  for (size_t i = 0; i < PROF_CLINGO_N; ++i) {
+    char path[64], *tok, *save;
+    bool has = true;
+    double v;
+    strcpy(path, PROF_CLINGO_KEYS[i]);
+    /* Walk the statistics tree along the dot-separated path, skipping keys this clingo lacks. */
+    for (k = root, tok = strtok_r(path, ".", &save); tok; tok = strtok_r(NULL, ".", &save)) {
+      clingo_statistics_type_t t;
+      if (!clingo_statistics_type(S, k, &t) || (t != clingo_statistics_type_map)) { has = false; break; }
+      if (!clingo_statistics_map_has_subkey(S, k, tok, &has) || !has) { has = false; break; }
+      if (!clingo_statistics_map_at(S, k, tok, &k)) { has = false; break; }
+    }
+    if (has && clingo_statistics_value_get(S, k, &v)) c->clingo[i] += v;
+  }
+  ++c->controls;
+}
+
+static PyObject* phases_to_python(prof_counters_t *c) {
+  PyObject *D = PyDict_New();
+  if (!D) return NULL;
+  for (size_t i = 0; i < PROF_N; ++i) {
+    PyObject *p = Py_BuildValue("{s:d,s:K}", "seconds", c->ns[i]*1e-9, "count",
+        (unsigned long long) c->n[i]);
+    if (!p || PyDict_SetItemString(D, PROF_PHASE_NAMES[i], p)) { Py_XDECREF(p); Py_DECREF(D); return NULL; }
+    Py_DECREF(p);
+  }
+  return D;
+}
+
+PyObject* prof_stop(void) {
+  prof_counters_t total = {0};
+  PyObject *R = NULL, *T = NULL, *D = NULL;
+  size_t n = prof_threads_n < PROF_MAX_THREADS ? prof_threads_n : PROF_MAX_THREADS;
+
+  prof_enabled = false;
+  if (!(T = PyList_New(0))) goto error;
+  for (size_t i = 0; i < n; ++i) {
+    prof_counters_t *c = &prof_threads[i];
+    for (size_t j = 0; j < PROF_N; ++j) { total.ns[j] += c->ns[j]; total.n[j] += c->n[j]; }
+    for (size_t j = 0; j < PROF_CLINGO_N; ++j) total.clingo[j] += c->clingo[j];
+    total.controls += c->controls;
+    if (!(D = phases_to_python(c)) || PyList_Append(T, D)) goto error;
+    Py_CLEAR(D);
+  }
+  if (!(D = PyDict_New())) goto error;
+  for (size_t j = 0; j < PROF_CLINGO_N; ++j) {
+    PyObject *v = PyFloat_FromDouble(total.clingo[j]);
+    if (!v || PyDict_SetItemString(D, PROF_CLINGO_KEYS[j], v)) { Py_XDECREF(v); goto error; }
+    Py_DECREF(v);
+  }
+  PyObject *controls = PyLong_FromUnsignedLongLong(total.controls);
+  if (!controls || PyDict_SetItemString(D, "controls", controls)) { Py_XDECREF(controls); goto error; }
+  Py_DECREF(controls);
+
+  PyObject *P = phases_to_python(&total);
+  if (!P) goto error;
+  R = Py_BuildValue("{s:N,s:N,s:N}", "phases", P, "threads", T, "clingo", D);
+  return R;
+error:
+  Py_XDECREF(T); Py_XDECREF(D);
+  return NULL;
+}
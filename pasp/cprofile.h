@@ -0,0 +1,90 @@
+#ifndef _PASP_CPROFILE
+#define _PASP_CPROFILE
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <clingo.h>
+
+/* Phases timed by the profiler. Keep PROF_PHASE_NAMES (cprofile.c) in the same order. */
+typedef enum {
+  /* Creating and configuring a clingo control. */
+  PROF_CONTROL,
+  /* Adding (and thus parsing) program text to a control. */
+  PROF_PARSE,
+  /* Grounding. */
+  PROF_GROUND,
+  /* Solving, i.e. waiting on clingo for the next model. */
+  PROF_SOLVE,
+  /* Scanning models for queries and observations. */
+  PROF_MODELS,
+  /* Computing and accumulating probabilities. */
+  PROF_PROB,
+  /* Waiting in retr_free_proc for a free worker. */
+  PROF_WAIT,
+  /* Merging per-thread results. */
+  PROF_MERGE,
+  /* Neural forward and backward passes. */
+  PROF_NEURAL,
+  PROF_N
+} prof_phase_t;
+
+/* Statistics summed over every clingo control created while profiling. */
+#define PROF_CLINGO_N 6
+
+typedef struct {
+  /* Nanoseconds spent in each phase. */
+  uint64_t ns[PROF_N];
+  /* Number of times each phase was entered. */
+  uint64_t n[PROF_N];
+  /* Sums of clingo statistics (see PROF_CLINGO_KEYS in cprofile.c). */
+  double clingo[PROF_CLINGO_N];
+  /* Number of clingo controls whose statistics were collected. */
+  uint64_t controls;
+} __attribute__((aligned(64))) prof_counters_t;
+
+/* Maximum number of threads counted separately; any further threads share one last slot. */
+#define PROF_MAX_THREADS 256
+
+extern bool prof_enabled;
+
+/* Resets all counters and enables profiling. */
+void prof_start(void);
+/* Disables profiling and returns the counters as a Python dict with keys "phases" (totals over
+ * threads), "threads" (per thread) and "clingo" (clingo statistics), or NULL on error. */
+PyObject* prof_stop(void);
+
+/* Counters of the calling thread. */
+prof_counters_t* prof_local(void);
+
+static inline uint64_t prof_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec*1000000000ull + (uint64_t) t.tv_nsec;
+}
+
+static inline void prof_add(prof_phase_t phase, uint64_t t0) {
+  prof_counters_t *c = prof_local();
+  c->ns[phase] += prof_now() - t0;
+  ++c->n[phase];
+}
+
+void prof_clingo(clingo_control_t *C);
+
+/* Profiling costs a single predictable branch per phase when disabled at runtime, and nothing at
+ * all when compiled with PASP_NO_PROFILE. */
+#ifdef PASP_NO_PROFILE
+#define PROF_BEGIN(t)
+#define PROF_END(phase, t)
+#define PROF_CLINGO(C)
+#else
+#define PROF_BEGIN(t) uint64_t t = prof_enabled ? prof_now() : 0
+#define PROF_END(phase, t) do { if (prof_enabled) prof_add(phase, t); } while (0)
+#define PROF_CLINGO(C) do { if (prof_enabled && (C)) prof_clingo(C); } while (0)
+#endif
+
+#endif
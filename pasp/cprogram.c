@@ -9,24 +9,27 @@
 #include "cutils.h"
 
 /* Implement dynamic array of prob_fact_t's. */
-ARRAY_IMPL(prob_fact_t)
+ARRAY_IMPL(prob_fact_t, MEM_GROUND)
 
 void print_prob_fact(prob_fact_t *pf) {
   if (pf->learnable) wprintf(L"%f?::%s", pf->p, pf->f);
   else wprintf(L"%f::%s", pf->p, pf->f);
 }
 void free_prob_fact_contents(prob_fact_t *pf) { if (pf) Py_XDECREF(pf->f_obj); }
-void free_prob_fact(prob_fact_t *pf) { free_prob_fact_contents(pf); free(pf); }
+void free_prob_fact(prob_fact_t *pf) { free_prob_fact_contents(pf); mem_free(MEM_PROGRAM, pf); }
 
 void print_prob_rule(prob_rule_t *pr) { wprintf(L"%f::%s", pr->p, pr->f); }
 void free_prob_rule_contents(prob_rule_t *pr) {
   if (pr) { Py_DECREF(pr->f_obj); Py_XDECREF(pr->unify_obj); array_uint8_t_free_contents(&pr->PF); }
 }
-void free_prob_rule(prob_rule_t *pr) { free_prob_rule_contents(pr); free(pr); }
+void free_prob_rule(prob_rule_t *pr) { free_prob_rule_contents(pr); mem_free(MEM_PROGRAM, pr); }
 
 void print_credal_fact(credal_fact_t *cf) { wprintf(L"[%f, %f]::%s", cf->l, cf->u, cf->f); }
 void free_credal_fact_contents(credal_fact_t *cf) { if (cf) Py_DECREF(cf->f_obj); }
-void free_credal_fact(credal_fact_t *cf) { free_credal_fact_contents(cf); free(cf); }
+void free_credal_fact(credal_fact_t *cf) {
+  free_credal_fact_contents(cf);
+  mem_free(MEM_PROGRAM, cf);
+}
 
 void print_annot_disj(annot_disj_t *ad) {
   size_t i;
@@ -38,12 +41,12 @@ void print_annot_disj(annot_disj_t *ad) {
 }
 void free_annot_disj_contents(annot_disj_t *ad) {
   if (!ad) return;
-  free(ad->P);
-  free(ad->F);
-  free(ad->F_obj);
-  free(ad->cl_F);
+  mem_free(MEM_PROGRAM, ad->P);
+  mem_free(MEM_PROGRAM, ad->F);
+  mem_free(MEM_PROGRAM, ad->F_obj);
+  mem_free(MEM_PROGRAM, ad->cl_F);
 }
-void free_annot_disj(annot_disj_t *ad) { free_annot_disj_contents(ad); free(ad); }
+void free_annot_disj(annot_disj_t *ad) { free_annot_disj_contents(ad); mem_free(MEM_PROGRAM, ad); }
 
 bool update_pr_neural_rule(neural_rule_t *nr) {
   PyArrayObject *py_P = (PyArrayObject*) PyObject_CallMethod(nr->self, "pr", NULL);
@@ -63,7 +66,10 @@ bool backward_neural_rule(neural_rule_t *nr) {
 }
 
 void free_neural_rule_contents(neural_rule_t *nr) {}
-void free_neural_rule(neural_rule_t *nr) { free_neural_rule_contents(nr); free(nr); }
+void free_neural_rule(neural_rule_t *nr) {
+  free_neural_rule_contents(nr);
+  mem_free(MEM_PROGRAM, nr);
+}
 
 bool update_pr_neural_annot_disj(neural_annot_disj_t *na) {
   PyArrayObject *py_P = (PyArrayObject*) PyObject_CallMethod(na->self, "pr", NULL);
@@ -83,7 +89,10 @@ bool backward_neural_annot_disj(neural_annot_disj_t *na) {
 }
 
 void free_neural_annot_disj_contents(neural_annot_disj_t *na) {}
-void free_neural_annot_disj(neural_annot_disj_t *na) { free_neural_annot_disj_contents(na); free(na); }
+void free_neural_annot_disj(neural_annot_disj_t *na) {
+  free_neural_annot_disj_contents(na);
+  mem_free(MEM_PROGRAM, na);
+}
 
 bool print_query_with_buffer(query_t *q, string_t *s) {
   size_t i;
@@ -115,20 +124,20 @@ bool print_query_with_buffer(query_t *q, string_t *s) {
 bool print_query(query_t *Q) {
   string_t s = {NULL, 0};
   bool r = print_query_with_buffer(Q, &s);
-  free(s.s);
+  mem_free(MEM_OTHER, s.s);
   return r;
 }
 
 void free_query_contents(query_t *Q) {
   if (!Q) return;
-  free(Q->Q);
-  free(Q->Q_s);
-  free(Q->Q_u);
-  free(Q->E);
-  free(Q->E_s);
-  free(Q->E_u);
+  mem_free(MEM_PROGRAM, Q->Q);
+  mem_free(MEM_PROGRAM, Q->Q_s);
+  mem_free(MEM_PROGRAM, Q->Q_u);
+  mem_free(MEM_PROGRAM, Q->E);
+  mem_free(MEM_PROGRAM, Q->E_s);
+  mem_free(MEM_PROGRAM, Q->E_u);
 }
-void free_query(query_t *Q) { free_query_contents(Q); free(Q); }
+void free_query(query_t *Q) { free_query_contents(Q); mem_free(MEM_PROGRAM, Q); }
 
 void print_program(program_t *P) {
   size_t i;
@@ -144,30 +153,29 @@ void print_program(program_t *P) {
   fputws(L"\nQueries:\n", stdout);
   for (i = 0; i < P->Q_n; ++i) { print_query_with_buffer(P->Q + i, &s); fputws(L", ", stdout); }
   fputws(L">\n", stdout);
-  free(s.s);
+  mem_free(MEM_OTHER, s.s);
 }
 void free_program_contents(program_t *P) {
   size_t i;
   if (!P) return;
   Py_XDECREF(P->P_obj);
   for (i = 0; i < P->PF_n; ++i) free_prob_fact_contents(&P->PF[i]);
-  free(P->PF);
+  mem_free(MEM_PROGRAM, P->PF);
   for (i = 0; i < P->PR_n; ++i) free_prob_rule_contents(&P->PR[i]);
-  free(P->PR);
+  mem_free(MEM_PROGRAM, P->PR);
   for (i = 0; i < P->Q_n; ++i) free_query_contents(&P->Q[i]);
-  free(P->Q);
+  mem_free(MEM_PROGRAM, P->Q);
   for (i = 0; i < P->CF_n; ++i) free_credal_fact_contents(&P->CF[i]);
-  free(P->CF);
+  mem_free(MEM_PROGRAM, P->CF);
   for (i = 0; i < P->AD_n; ++i) free_annot_disj_contents(&P->AD[i]);
-  free(P->AD);
+  mem_free(MEM_PROGRAM, P->AD);
   for (i = 0; i < P->NR_n; ++i) free_neural_rule_contents(&P->NR[i]);
-  free(P->NR);
+  mem_free(MEM_PROGRAM, P->NR);
   for (i = 0; i < P->NA_n; ++i) free_neural_annot_disj_contents(&P->NA[i]);
-  free(P->NA);
+  mem_free(MEM_PROGRAM, P->NA);
   Py_XDECREF(P->py_gr_P);
-  if (P->stable) free_program(P->stable);
 }
-void free_program(program_t *P) { free_program_contents(P); free(P); }
+void free_program(program_t *P) { free_program_contents(P); mem_free(MEM_PROGRAM, P); }
 
 bool from_python_prob_rule(PyObject *py_pr, prob_rule_t *pr) {
   PyObject *py_p, *py_f, *py_is_prop, *py_unify = py_is_prop = py_f = py_p = NULL;
@@ -463,18 +471,18 @@ bool from_python_query(PyObject *py_q, query_t *q, semantics_t sem) {
   q->Q_n = PySequence_Fast_GET_SIZE(py_Q_L);
   q->E_n = PySequence_Fast_GET_SIZE(py_E_L);
 
-  Q = (clingo_symbol_t*) malloc(q->Q_n*sizeof(clingo_symbol_t));
+  Q = (clingo_symbol_t*) mem_malloc(MEM_PROGRAM, q->Q_n*sizeof(clingo_symbol_t));
   if (!Q) goto nomem;
-  E = (clingo_symbol_t*) malloc(q->E_n*sizeof(clingo_symbol_t));
+  E = (clingo_symbol_t*) mem_malloc(MEM_PROGRAM, q->E_n*sizeof(clingo_symbol_t));
   if (!E) goto nomem;
-  Q_s = (uint8_t*) malloc(q->Q_n*sizeof(uint8_t));
+  Q_s = (uint8_t*) mem_malloc(MEM_PROGRAM, q->Q_n*sizeof(uint8_t));
   if (!Q_s) goto nomem;
-  E_s = (uint8_t*) malloc(q->E_n*sizeof(uint8_t));
+  E_s = (uint8_t*) mem_malloc(MEM_PROGRAM, q->E_n*sizeof(uint8_t));
   if (!E_s) goto nomem;
   if (sem) {
-    Q_u = (clingo_symbol_t*) malloc(q->Q_n*sizeof(clingo_symbol_t));
+    Q_u = (clingo_symbol_t*) mem_malloc(MEM_PROGRAM, q->Q_n*sizeof(clingo_symbol_t));
     if (!Q_u) goto nomem;
-    E_u = (clingo_symbol_t*) malloc(q->E_n*sizeof(clingo_symbol_t));
+    E_u = (clingo_symbol_t*) mem_malloc(MEM_PROGRAM, q->E_n*sizeof(clingo_symbol_t));
     if (!E_u) goto nomem;
   }
 
@@ -542,9 +550,9 @@ cleanup:
   Py_XDECREF(py_E);
   Py_XDECREF(py_Q_L);
   Py_XDECREF(py_E_L);
-  free(Q); free(E);
-  free(Q_s); free(E_s);
-  free(Q_u); free(E_u);
+  mem_free(MEM_PROGRAM, Q); mem_free(MEM_PROGRAM, E);
+  mem_free(MEM_PROGRAM, Q_s); mem_free(MEM_PROGRAM, E_s);
+  mem_free(MEM_PROGRAM, Q_u); mem_free(MEM_PROGRAM, E_u);
   return false;
 }
 
@@ -592,13 +600,13 @@ bool from_python_ad(PyObject *py_ad, annot_disj_t *ad) {
   if (!py_cl_F_L) goto cleanup;
 
   n = PySequence_Fast_GET_SIZE(py_P_L);
-  P = (double*) malloc(n*sizeof(double));
+  P = (double*) mem_malloc(MEM_PROGRAM, n*sizeof(double));
   if (!P) goto nomem;
-  F = (const char**) malloc(n*sizeof(const char*));
+  F = (const char**) mem_malloc(MEM_PROGRAM, n*sizeof(const char*));
   if (!F) goto nomem;
-  cl_F = (clingo_symbol_t*) malloc(n*sizeof(clingo_symbol_t));
+  cl_F = (clingo_symbol_t*) mem_malloc(MEM_PROGRAM, n*sizeof(clingo_symbol_t));
   if (!cl_F) goto nomem;
-  F_obj = (PyObject**) malloc(n*sizeof(PyObject*));
+  F_obj = (PyObject**) mem_malloc(MEM_PROGRAM, n*sizeof(PyObject*));
   if (!F_obj) goto nomem;
 
   for (i = 0; i < n; ++i) {
@@ -653,8 +661,8 @@ cleanup:
   Py_XDECREF(py_P_L);
   Py_XDECREF(py_F_L);
   Py_XDECREF(py_cl_F_L);
-  free(P); free(F);
-  free(cl_F); free(F_obj);
+  mem_free(MEM_PROGRAM, P); mem_free(MEM_PROGRAM, F);
+  mem_free(MEM_PROGRAM, cl_F); mem_free(MEM_PROGRAM, F_obj);
 
   return false;
 }
@@ -742,7 +750,7 @@ bool from_python_neural_rule(PyObject *py_nr, neural_rule_t *nr) {
 
   ok = true;
 cleanup:
-  if (!ok) { free(H); free(B); free(S); }
+  if (!ok) { mem_free(MEM_PROGRAM, H); mem_free(MEM_PROGRAM, B); mem_free(MEM_PROGRAM, S); }
   Py_XDECREF(py_H); Py_XDECREF(py_B); Py_XDECREF(py_S); Py_XDECREF(py_learnable);
   Py_XDECREF(py_tensor_dw); Py_XDECREF(py_dw); Py_XDECREF(py_o);
   return ok;
@@ -841,7 +849,7 @@ bool from_python_neural_ad(PyObject *py_nad, neural_annot_disj_t *nad) {
 
   ok = true;
 cleanup:
-  if (!ok) { free(H); free(B); free(S); }
+  if (!ok) { mem_free(MEM_PROGRAM, H); mem_free(MEM_PROGRAM, B); mem_free(MEM_PROGRAM, S); }
   Py_XDECREF(py_H); Py_XDECREF(py_B); Py_XDECREF(py_S); Py_XDECREF(py_learnable);
   Py_XDECREF(py_tensor_dw); Py_XDECREF(py_dw); Py_XDECREF(py_o);
   return ok;
@@ -852,7 +860,7 @@ bool from_python_program(PyObject *py_P, program_t *P) {
   PyObject *py_P_P, *py_P_PF, *py_P_PF_L, *py_P_PR, *py_P_PR_L, *py_P_Q, *py_P_Q_L, *py_P_CF, *py_P_AD, *py_P_CF_L, *py_P_sem = NULL;
   PyObject *py_P_AD_L = py_P_AD = py_P_CF_L = py_P_CF = py_P_Q_L = py_P_Q = py_P_PR_L = py_P_PR = py_P_PF_L = py_P_PF = py_P_P = NULL;
   PyObject *py_P_NR, *py_P_NR_L, *py_P_NA, *py_P_NA_L = py_P_NA = py_P_NR_L = py_P_NR = NULL;
-  PyObject *py_m = NULL, *py_P_stable = NULL, *py_gr_P = NULL;
+  PyObject *py_m = NULL, *py_gr_P = NULL;
   const char *P_P, *gr_P;
   prob_fact_t *PF = NULL;
   prob_rule_t *PR = NULL;
@@ -861,7 +869,6 @@ bool from_python_program(PyObject *py_P, program_t *P) {
   annot_disj_t *AD = NULL;
   neural_rule_t *NR = NULL;
   neural_annot_disj_t *NA = NULL;
-  program_t *stable = NULL;
   semantics_t sem;
   size_t i, m_train, m_test;
 
@@ -945,15 +952,6 @@ bool from_python_program(PyObject *py_P, program_t *P) {
     goto cleanup;
   }
 
-  py_P_stable = PyObject_GetAttrString(py_P, "stable");
-  if (py_P_stable != Py_None) {
-    stable = (program_t*) malloc(sizeof(program_t));
-    if (!from_python_program(py_P_stable, stable)) goto cleanup;
-  } else if (!py_P_stable && sem) {
-    PyErr_SetString(PyExc_TypeError, "field stable of Program must be a Program!");
-    goto cleanup;
-  }
-
   py_gr_P = PyObject_GetAttrString(py_P, "gr_P");
   if (!py_gr_P) {
     PyErr_SetString(PyExc_AttributeError, "could not access field gr_P of supposed Program object!");
@@ -988,19 +986,19 @@ bool from_python_program(PyObject *py_P, program_t *P) {
   P->NR_n = PySequence_Fast_GET_SIZE(py_P_NR_L);
   P->NA_n = PySequence_Fast_GET_SIZE(py_P_NA_L);
 
-  PF = (prob_fact_t*) malloc(P->PF_n*sizeof(prob_fact_t));
+  PF = (prob_fact_t*) mem_malloc(MEM_PROGRAM, P->PF_n*sizeof(prob_fact_t));
   if (!PF) goto nomem;
-  PR = (prob_rule_t*) malloc(P->PR_n*sizeof(prob_rule_t));
+  PR = (prob_rule_t*) mem_malloc(MEM_PROGRAM, P->PR_n*sizeof(prob_rule_t));
   if (!PR) goto nomem;
-  Q = (query_t*) malloc(P->Q_n*sizeof(query_t));
+  Q = (query_t*) mem_malloc(MEM_PROGRAM, P->Q_n*sizeof(query_t));
   if (!Q) goto nomem;
-  CF = (credal_fact_t*) malloc(P->CF_n*sizeof(credal_fact_t));
+  CF = (credal_fact_t*) mem_malloc(MEM_PROGRAM, P->CF_n*sizeof(credal_fact_t));
   if (!CF) goto nomem;
-  AD = (annot_disj_t*) malloc(P->AD_n*sizeof(annot_disj_t));
+  AD = (annot_disj_t*) mem_malloc(MEM_PROGRAM, P->AD_n*sizeof(annot_disj_t));
   if (!AD) goto nomem;
-  NR = (neural_rule_t*) malloc(P->NR_n*sizeof(neural_rule_t));
+  NR = (neural_rule_t*) mem_malloc(MEM_PROGRAM, P->NR_n*sizeof(neural_rule_t));
   if (!NR) goto nomem;
-  NA = (neural_annot_disj_t*) malloc(P->NA_n*sizeof(neural_annot_disj_t));
+  NA = (neural_annot_disj_t*) mem_malloc(MEM_PROGRAM, P->NA_n*sizeof(neural_annot_disj_t));
   if (!NA) goto nomem;
 
   for (i = 0; i < P->PF_n; ++i)
@@ -1034,7 +1032,6 @@ bool from_python_program(PyObject *py_P, program_t *P) {
   P->py_gr_P = py_gr_P;
 
   P->sem = sem;
-  P->stable = stable;
   P->py_P = py_P;
 
   Py_DECREF(py_P_PF);
@@ -1052,7 +1049,6 @@ bool from_python_program(PyObject *py_P, program_t *P) {
   Py_DECREF(py_P_NR_L);
   Py_DECREF(py_P_NA_L);
   Py_DECREF(py_P_sem);
-  Py_XDECREF(py_P_stable);
 
   return true;
 nomem:
@@ -1074,15 +1070,13 @@ cleanup:
   Py_XDECREF(py_P_NR_L);
   Py_XDECREF(py_P_NA_L);
   Py_XDECREF(py_P_sem);
-  Py_XDECREF(py_P_stable);
   Py_XDECREF(py_gr_P);
-  free(PF);
-  free(PR);
-  free(Q);
-  free(CF);
-  free(AD);
-  free(NR);
-  free(NA);
-  free(stable);
+  mem_free(MEM_PROGRAM, PF);
+  mem_free(MEM_PROGRAM, PR);
+  mem_free(MEM_PROGRAM, Q);
+  mem_free(MEM_PROGRAM, CF);
+  mem_free(MEM_PROGRAM, AD);
+  mem_free(MEM_PROGRAM, NR);
+  mem_free(MEM_PROGRAM, NA);
   return false;
 }
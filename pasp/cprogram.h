@@ -147,7 +147,6 @@ typedef struct program {
   size_t batch;
 
   semantics_t sem;
-  struct program *stable;
   PyObject *py_P;
 } program_t;
 
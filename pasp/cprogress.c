@@ -0,0 +1,119 @@
+#include "cprogress.h"
+#include "cmem.h"
+
+#include <math.h>
+#include <time.h>
+
+static uint64_t now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t) t.tv_sec*1000000000ull + (uint64_t) t.tv_nsec;
+}
+
+bool init_progress(progress_t *pg, PyObject *arg, double interval, const char *name) {
+  *pg = (progress_t) {0};
+  pg->name = name;
+  if (!arg || (arg == Py_None)) return true;
+  if (interval < 0) {
+    PyErr_SetString(PyExc_ValueError, "progress_every must be non-negative!");
+    return false;
+  }
+  pg->interval = interval*1e9;
+  if (PyCallable_Check(arg)) {
+    Py_INCREF(arg);
+    pg->callback = arg;
+    return true;
+  }
+  int t = PyObject_IsTrue(arg);
+  if (t < 0) return false;
+  pg->show_bar = t;
+  return true;
+}
+
+bool progress_begin(progress_t *pg, size_t n, double total, double norm) {
+  if (!progress_enabled(pg)) return true;
+  pg->slots = (progress_slot_t*) mem_aligned_alloc(MEM_INSTRUMENT, sizeof(progress_slot_t),
+      n*sizeof(progress_slot_t));
+  if (!pg->slots) {
+    PyErr_SetString(PyExc_MemoryError, "could not allocate memory for progress counters!");
+    return false;
+  }
+  memset(pg->slots, 0, n*sizeof(progress_slot_t));
+  pg->n = n; pg->total = total; pg->norm = norm;
+  pg->start = pg->last = now_ns();
+  if (pg->show_bar) {
+    snprintf(pg->label, sizeof(pg->label), "%s", pg->name);
+    pg->bar = progressbar_new(pg->label, PROGRESS_BAR_MAX, false);
+    if (!pg->bar) {
+      PyErr_SetString(PyExc_MemoryError, "could not allocate memory for progressbar!");
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool progress_report(progress_t *pg, uint64_t now) {
+  uint64_t done = 0, models = 0;
+  double mass = 0;
+  for (size_t i = 0; i < pg->n; ++i) {
+    double m;
+    done += __atomic_load_n(&pg->slots[i].done, __ATOMIC_RELAXED);
+    models += __atomic_load_n(&pg->slots[i].models, __ATOMIC_RELAXED);
+    __atomic_load(&pg->slots[i].mass, &m, __ATOMIC_RELAXED);
+    mass += m;
+  }
+  double elapsed = (now - pg->start)*1e-9, rate = elapsed > 0 ? models/elapsed : 0;
+  double frac = pg->total > 0 ? done/pg->total : 1;
+  if (pg->norm > 0) mass /= pg->norm;
+
+  if (pg->bar) {
+    if (pg->norm > 0)
+      snprintf(pg->label, sizeof(pg->label), "%s %.0f/%.0f | mass %.4f | %.3g models/s", pg->name,
+          (double) done, pg->total, mass, rate);
+    else
+      snprintf(pg->label, sizeof(pg->label), "%s %.0f/%.0f | %.3g models/s", pg->name,
+          (double) done, pg->total, rate);
+    progressbar_update(pg->bar, fmin(frac, 1)*PROGRESS_BAR_MAX, 0.);
+    return true;
+  }
+
+  PyObject *py_mass, *py_eta;
+  if (pg->norm > 0) py_mass = PyFloat_FromDouble(mass);
+  else { py_mass = Py_None; Py_INCREF(py_mass); }
+  if (done > 0) py_eta = PyFloat_FromDouble(elapsed*(pg->total - done)/done);
+  else { py_eta = Py_None; Py_INCREF(py_eta); }
+  PyObject *D = Py_BuildValue("{s:K,s:d,s:N,s:K,s:d,s:d,s:N}", "done", (unsigned long long) done,
+      "total", pg->total, "mass", py_mass, "models", (unsigned long long) models, "models_per_s",
+      rate, "elapsed", elapsed, "eta", py_eta);
+  if (!D) return false;
+  PyObject *r = PyObject_CallFunctionObjArgs(pg->callback, D, NULL);
+  Py_DECREF(D);
+  if (!r) return false;
+  Py_DECREF(r);
+  return true;
+}
+
+bool progress_tick(progress_t *pg) {
+  if (!pg || !pg->slots) return true;
+  uint64_t now = now_ns();
+  if (now - pg->last < pg->interval) return true;
+  pg->last = now;
+  return progress_report(pg, now);
+}
+
+bool progress_finish(progress_t *pg) {
+  if (!pg || !pg->slots) return true;
+  bool ok = progress_report(pg, now_ns());
+  if (pg->bar) {
+    progressbar_finish(pg->bar, 0.);
+    pg->bar = NULL;
+  }
+  return ok;
+}
+
+void free_progress_contents(progress_t *pg) {
+  if (pg->bar) progressbar_finish(pg->bar, 0.);
+  mem_free(MEM_INSTRUMENT, pg->slots);
+  Py_XDECREF(pg->callback);
+  pg->bar = NULL; pg->slots = NULL; pg->callback = NULL;
+}
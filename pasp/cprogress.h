@@ -0,0 +1,64 @@
+#ifndef _PASP_CPROGRESS
+#define _PASP_CPROGRESS
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../progressbar/progressbar.h"
+
+/* Default number of seconds between two progress reports. */
+#define PROGRESS_DEFAULT_INTERVAL 0.5
+/* Resolution of the progressbar, since the number of total choices may not fit an unsigned long. */
+#define PROGRESS_BAR_MAX 1000
+
+/* Counters published by a single worker. Only the owning worker writes to them (with relaxed
+ * atomic stores), so that workers never contend with each other or with the reporter. */
+typedef struct {
+  uint64_t done, models;
+  double mass;
+} __attribute__((aligned(64))) progress_slot_t;
+
+typedef struct {
+  progress_slot_t *slots;
+  size_t n;
+  /* Number of total choices to be enumerated. */
+  double total;
+  /* Total probability mass, or 0 if mass is not tracked. */
+  double norm;
+  /* Either a progressbar or a Python callable (or neither, if progress is disabled). */
+  bool show_bar;
+  progressbar *bar;
+  PyObject *callback;
+  const char *name;
+  char label[128];
+  uint64_t start, last, interval;
+} progress_t;
+
+/* Initializes progress reporting from the Python argument arg, which is either None or False
+ * (disabled), True (a progressbar on stderr) or a callable receiving a dict every interval
+ * seconds. */
+bool init_progress(progress_t *pg, PyObject *arg, double interval, const char *name);
+/* Sets up one slot for each of the n workers. Call once the total is known. */
+bool progress_begin(progress_t *pg, size_t n, double total, double norm);
+/* Reports progress if at least interval seconds have passed since the last report. Returns false
+ * (with a Python error set) if the callback raised. */
+bool progress_tick(progress_t *pg);
+/* Reports the final state. */
+bool progress_finish(progress_t *pg);
+void free_progress_contents(progress_t *pg);
+
+static inline bool progress_enabled(progress_t *pg) { return pg && (pg->show_bar || pg->callback); }
+
+/* Called by a worker after each total choice with m models and probability p. */
+static inline void progress_publish(progress_slot_t *s, size_t m, double p) {
+  if (!s) return;
+  __atomic_store_n(&s->done, s->done + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&s->models, s->models + m, __ATOMIC_RELAXED);
+  double q = s->mass + p;
+  __atomic_store(&s->mass, &q, __ATOMIC_RELAXED);
+}
+
+#endif
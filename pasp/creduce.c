@@ -0,0 +1,128 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "creduce.h"
+#include "cmem.h"
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+  reduce_seg_t *S;
+  size_t m;
+  reduce_type_t type;
+  /* Prefix sums of segment sizes, of size m+1. */
+  size_t *O;
+  /* Compensation terms of each worker, O[m] doubles each; NULL if summing plainly. */
+  double *E;
+  /* Whether an integer sum overflowed. */
+  bool overflow;
+} reduce_t;
+
+typedef struct {
+  reduce_t *R;
+  /* Workers to sum src into dst. */
+  size_t dst, src;
+  /* Range of elements (over all segments) this job sums. */
+  size_t lo, hi;
+} reduce_job_t;
+
+/* Adds (y, ey) to (*x, *ex), keeping the rounding error of x + y in the compensation term. */
+static inline void twosum_add(double *x, double *ex, double y, double ey) {
+  double s = *x + y, z = s - *x;
+  *ex += ((*x - (s - z)) + (y - z)) + ey;
+  *x = s;
+}
+
+static void reduce_pair(void *args) {
+  reduce_job_t *J = (reduce_job_t*) args;
+  reduce_t *R = J->R;
+  reduce_seg_t *D = R->S + J->dst*R->m, *S = R->S + J->src*R->m;
+  size_t t = 0, N = R->O[R->m];
+  /* Segment containing element lo. */
+  while (R->O[t+1] <= J->lo) ++t;
+  for (size_t x = J->lo; x < J->hi; ++t) {
+    size_t u = x - R->O[t], e = (R->O[t+1] < J->hi ? R->O[t+1] : J->hi) - R->O[t];
+    if (R->type == REDUCE_UINT64) {
+      uint64_t *d = (uint64_t*) D[t].d, *s = (uint64_t*) S[t].d;
+      for (; u < e; ++u) if (__builtin_add_overflow(d[u], s[u], &d[u])) R->overflow = true;
+    } else if (R->E) {
+      double *d = (double*) D[t].d, *s = (double*) S[t].d;
+      double *ed = R->E + J->dst*N + R->O[t], *es = R->E + J->src*N + R->O[t];
+      for (; u < e; ++u) twosum_add(&d[u], &ed[u], s[u], es[u]);
+    } else {
+      double *d = (double*) D[t].d, *s = (double*) S[t].d;
+      for (; u < e; ++u) d[u] += s[u];
+    }
+    x = R->O[t] + e;
+  }
+}
+
+bool reduce_sum(threadpool pool, size_t threads, reduce_seg_t *S, size_t k, size_t m,
+    reduce_type_t type) {
+  reduce_t R = { .S = S, .m = m, .type = type };
+  reduce_job_t *J = NULL;
+  bool ok = false;
+  size_t N;
+
+  if (k < 2 || !m) return true;
+  R.O = (size_t*) mem_malloc(MEM_STORAGE, (m+1)*sizeof(size_t));
+  if (!R.O) {
+    PyErr_SetString(PyExc_MemoryError, "could not allocate memory for reduction!");
+    return false;
+  }
+  R.O[0] = 0;
+  for (size_t t = 0; t < m; ++t) R.O[t+1] = R.O[t] + S[t].n;
+  N = R.O[m];
+  if (!N) { ok = true; goto cleanup; }
+  if (type == REDUCE_DOUBLE) R.E = (double*) mem_calloc(MEM_STORAGE, k*N, sizeof(double));
+
+  bool parallel = (threads > 1) && (k*N >= REDUCE_MIN_PARALLEL);
+  size_t max_jobs = (k/2 + 1)*(threads ? threads : 1);
+  if (parallel) {
+    J = (reduce_job_t*) mem_malloc(MEM_STORAGE, max_jobs*sizeof(reduce_job_t));
+    /* Not worth failing over: sum on this thread instead. */
+    if (!J) parallel = false;
+  }
+
+  for (size_t s = 1; s < k; s *= 2) {
+    size_t pairs = 0, n = 0;
+    for (size_t i = 0; i + s < k; i += 2*s) ++pairs;
+    /* Split every pair into chunks, so that each level keeps all threads busy. */
+    size_t chunks = parallel ? (threads + pairs - 1)/pairs : 1;
+    size_t max_chunks = (N + REDUCE_MIN_CHUNK - 1)/REDUCE_MIN_CHUNK;
+    if (chunks > max_chunks) chunks = max_chunks;
+    if (!chunks) chunks = 1;
+    for (size_t i = 0; i + s < k; i += 2*s) {
+      for (size_t c = 0; c < chunks; ++c) {
+        reduce_job_t j = { .R = &R, .dst = i, .src = i + s, .lo = N*c/chunks,
+          .hi = N*(c+1)/chunks };
+        if (!parallel) { reduce_pair(&j); continue; }
+        J[n] = j;
+        if (thpool_add_work(pool, reduce_pair, &J[n++])) {
+          thpool_wait(pool);
+          PyErr_SetString(PyExc_RuntimeError, "could not add reduction to the thread pool!");
+          goto cleanup;
+        }
+      }
+    }
+    if (parallel) thpool_wait(pool);
+  }
+
+  if (R.overflow) {
+    PyErr_SetString(PyExc_OverflowError, "integer sum overflows in reduction!");
+    goto cleanup;
+  }
+  if (R.E) {
+    for (size_t t = 0; t < m; ++t) {
+      double *d = (double*) S[t].d, *e = R.E + R.O[t];
+      for (size_t u = 0; u < S[t].n; ++u) d[u] += e[u];
+    }
+  }
+  ok = true;
+cleanup:
+  mem_free(MEM_STORAGE, R.O);
+  mem_free(MEM_STORAGE, R.E);
+  mem_free(MEM_STORAGE, J);
+  return ok;
+}
@@ -0,0 +1,35 @@
+#ifndef _PASP_CREDUCE
+#define _PASP_CREDUCE
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../thpool/thpool.h"
+
+/* Reductions of fewer elements than this (over all workers) run on the calling thread. */
+#define REDUCE_MIN_PARALLEL 65536
+/* Minimum number of elements summed by a single job. */
+#define REDUCE_MIN_CHUNK 4096
+
+typedef enum {
+  REDUCE_DOUBLE,
+  REDUCE_UINT64,
+} reduce_type_t;
+
+/* A contiguous run of n elements of a worker's accumulators. */
+typedef struct {
+  void *d;
+  size_t n;
+} reduce_seg_t;
+
+/* Sums the accumulators of k workers elementwise into those of worker 0, where S[i*m+t] is the
+ * t-th of m segments of worker i and every worker has segments of the same sizes. Workers are
+ * summed pairwise in a tree of ceil(log2(k)) levels, each level split into jobs run on pool (of
+ * threads threads), which must be idle. Doubles are summed with compensation (Kahan-Babuska), so
+ * that the result barely depends on how total choices were split between workers; if there is not
+ * enough memory for the compensation terms, they are summed plainly. Returns false (with a Python
+ * error set) only if jobs could not be added to the pool, or if an integer sum overflows. */
+bool reduce_sum(threadpool pool, size_t threads, reduce_seg_t *S, size_t k, size_t m,
+    reduce_type_t type);
+
+#endif
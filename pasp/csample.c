@@ -2,6 +2,11 @@
 
 #include "cinf.h"
 #include "cutils.h"
+#include "cprofile.h"
+#include "ctrace.h"
+
+#include <math.h>
+#include <string.h>
 
 typedef struct {
   /* Total choice. */
@@ -29,6 +34,16 @@ typedef struct {
   bool *busy_procs;
   /* Whether to use the L-stable translation. */
   bool lstable_sat;
+  /* Control reused across samples. */
+  control_pool_t ctl;
+  /* Parameter settings sampled with common random numbers (see crn_sample): K rows of W_n
+   * parameters, the total choice of each setting, the uniforms of the current sample, and the
+   * distance between the sample matrices of consecutive settings. */
+  const double *W;
+  size_t K, W_n;
+  total_choice_t *T;
+  double *U;
+  size_t stride;
 } sample_storage_t;
 
 bool atoms2symbols(PyArrayObject *atoms, sample_storage_t S[NUM_PROCS], size_t num_procs) {
@@ -47,9 +62,9 @@ bool atoms2symbols(PyArrayObject *atoms, sample_storage_t S[NUM_PROCS], size_t n
     goto cleanup;
   }
 
-  A = (clingo_symbol_t*) malloc(n*sizeof(clingo_symbol_t));
+  A = (clingo_symbol_t*) mem_malloc(MEM_SAMPLES, n*sizeof(clingo_symbol_t));
   if (!A) {
-    PyErr_SetString(PyExc_MemoryError, "could not allocate memory in atoms2symbols!");
+    mem_raise("atoms2symbols");
     goto cleanup;
   }
 
@@ -70,7 +85,7 @@ bool atoms2symbols(PyArrayObject *atoms, sample_storage_t S[NUM_PROCS], size_t n
 
   return true;
 cleanup:
-  free(A);
+  mem_free(MEM_SAMPLES, A);
   return false;
 }
 
@@ -91,75 +106,137 @@ bool sample_total_choice(program_t *P, total_choice_t *theta, unsigned short see
   return true;
 }
 
-void compute_sample(void *args) {
-  sample_storage_t *S = (sample_storage_t*) args;
+/* Solves the program under theta and writes to row whether each atom of S is in its model of index
+ * ⌊u·m⌋, where m is the number of (total, if possible) models. */
+static bool sample_model(sample_storage_t *S, total_choice_t *theta, double u, bool *row) {
   program_t *P = S->P;
-  total_choice_t *theta = &S->theta;
-
-  for (size_t i = 0; i < S->n; ++i) {
-    sample_total_choice(P, theta, S->rng);
-    clingo_control_t *C = NULL;
-    bool gok = false;
-
-    if (P->sem == LSTABLE_SEMANTICS && S->lstable_sat) {
-      bool has;
-      if (!has_total_model(P, theta, &has)) goto cleanup;
-      if (has) P = P->stable;
-    }
+  clingo_control_t *C = NULL;
+  bool gok = false;
+  bool total = P->sem == LSTABLE_SEMANTICS && S->lstable_sat;
+  clingo_literal_t total_lit;
 
-    if (!prepare_control(&C, P, theta, "0", false, NULL)) goto cleanup;
+  if (!acquire_control(&S->ctl, &C, P, theta, 1)) goto cleanup;
+  if (total) if (!total_model_literal(C, &total_lit)) goto cleanup;
 
-    size_t m = 0;
-    {
-      bool ok = false;
-      clingo_solve_handle_t *handle;
-      clingo_solve_result_bitset_t solve_ret;
+  size_t m = 0;
+count:
+  {
+    bool ok = false;
+    clingo_solve_handle_t *handle;
+    clingo_solve_result_bitset_t solve_ret;
 
-      if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle))
-        goto count_cleanup;
+    if (!clingo_control_solve(C, clingo_solve_mode_yield, &total_lit, total, NULL, NULL, &handle))
+      goto count_cleanup;
 
-      for (m = 0; true; ++m) {
-        if (!clingo_solve_handle_resume(handle)) goto count_cleanup;
-        if (!clingo_solve_handle_get(handle, &solve_ret)) goto count_cleanup;
-        if (solve_ret & clingo_solve_result_exhausted) break;
-      }
+    PROF_BEGIN(t_solve);
+    for (m = 0; true; ++m) {
+      if (!clingo_solve_handle_resume(handle)) goto count_cleanup;
+      if (!clingo_solve_handle_get(handle, &solve_ret)) goto count_cleanup;
+      if (solve_ret & clingo_solve_result_exhausted) break;
+    }
+    PROF_END(PROF_SOLVE, t_solve);
 
-      ok = true;
+    ok = true;
 count_cleanup:
-      if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
-    }
-    /* Samples an integer uniformly between 0 and m-1. */
-    size_t choice = erand48(S->rng)*m;
-    {
-      bool ok = false;
-      clingo_solve_handle_t *handle;
-      clingo_solve_result_bitset_t solve_ret;
-      const clingo_model_t *M;
-
-      if (!clingo_control_solve(C, clingo_solve_mode_yield, NULL, 0, NULL, NULL, &handle))
-        goto sample_cleanup;
-
-      for (m = 0; true; ++m) {
-        if (!clingo_solve_handle_resume(handle)) goto sample_cleanup;
-        if (m == choice) {
-          if (!clingo_solve_handle_model(handle, &M)) goto sample_cleanup;
-          for (size_t j = 0; j < S->A_n; ++j)
-            if (!clingo_model_contains(M, S->A[j], S->samples + (i*S->A_n+j))) goto sample_cleanup;
-          break;
-        }
-        if (!clingo_solve_handle_get(handle, &solve_ret)) goto sample_cleanup;
-        if (solve_ret & clingo_solve_result_exhausted) break;
+    if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
+  }
+  /* No total model: sample from the partial models instead. */
+  if (total && m == 0) { total = false; goto count; }
+  /* Picks an integer uniformly between 0 and m-1. */
+  size_t choice = u*m;
+  {
+    bool ok = false;
+    clingo_solve_handle_t *handle;
+    clingo_solve_result_bitset_t solve_ret;
+    const clingo_model_t *M;
+
+    if (!clingo_control_solve(C, clingo_solve_mode_yield, &total_lit, total, NULL, NULL, &handle))
+      goto sample_cleanup;
+
+    PROF_BEGIN(t_solve);
+    for (m = 0; true; ++m) {
+      if (!clingo_solve_handle_resume(handle)) goto sample_cleanup;
+      if (m == choice) {
+        if (!clingo_solve_handle_model(handle, &M)) goto sample_cleanup;
+        for (size_t j = 0; j < S->A_n; ++j)
+          if (!clingo_model_contains(M, S->A[j], row + j)) goto sample_cleanup;
+        break;
       }
+      if (!clingo_solve_handle_get(handle, &solve_ret)) goto sample_cleanup;
+      if (solve_ret & clingo_solve_result_exhausted) break;
+    }
+    PROF_END(PROF_SOLVE, t_solve);
 
-      ok = true;
+    ok = true;
 sample_cleanup:
-      if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
-    }
+    if (!(clingo_solve_handle_close(handle) && ok)) goto cleanup;
+  }
 
-    gok = true;
+  gok = true;
 cleanup:
-    if (C) clingo_control_free(C);
-    if (!gok) { S->fail = true; break; }
+  release_control(&S->ctl, C);
+  return gok;
+}
+
+void compute_sample(void *args) {
+  sample_storage_t *S = (sample_storage_t*) args;
+  total_choice_t *theta = &S->theta;
+
+  for (size_t i = 0; i < S->n; ++i) {
+    TRACE_BEGIN(t_job);
+    PROF_BEGIN(t_prob);
+    sample_total_choice(S->P, theta, S->rng);
+    PROF_END(PROF_PROB, t_prob);
+    bool ok = sample_model(S, theta, erand48(S->rng), S->samples + i*S->A_n);
+    TRACE_END(TRACE_JOB, t_job);
+    if (!ok) { S->fail = true; break; }
+  }
+}
+
+/* Derives the total choice of P under the parameters w (see crn_sample) from the uniforms U, one per
+ * probabilistic fact and then one per annotated disjunction. */
+static void crn_total_choice(program_t *P, const double *w, const double *U, total_choice_t *theta) {
+  size_t n = P->PF_n;
+  for (size_t i = 0; i < n; ++i) bitvec_SET(&theta->pf, i, U[i] <= w[i]);
+  w += n; U += n;
+  for (size_t i = 0; i < P->AD_n; ++i) {
+    size_t k = P->AD[i].n, c = k-1;
+    double p = 0;
+    /* Inverts the cdf of the i-th annotated disjunction; rounding leaves the last atom. */
+    for (size_t j = 0; j < k; ++j) if (U[i] < (p += w[j])) { c = j; break; }
+    theta->theta_ad[i] = c;
+    w += k;
+  }
+}
+
+static bool same_total_choice(program_t *P, total_choice_t *a, total_choice_t *b) {
+  for (size_t i = 0; i < P->PF_n; ++i) if (CHOICE_IS_TRUE(a, i) != CHOICE_IS_TRUE(b, i)) return false;
+  return !P->AD_n || !memcmp(a->theta_ad, b->theta_ad, P->AD_n*sizeof(uint8_t));
+}
+
+void compute_crn_sample(void *args) {
+  sample_storage_t *S = (sample_storage_t*) args;
+  program_t *P = S->P;
+  size_t n_pf = P->PF_n, n_u = n_pf + P->AD_n;
+
+  for (size_t i = 0; i < S->n; ++i) {
+    TRACE_BEGIN(t_job);
+    /* The uniforms common to all settings: one per choice, and the last picks a model. */
+    for (size_t j = 0; j <= n_u; ++j) S->U[j] = erand48(S->rng);
+    for (size_t k = 0; k < S->K; ++k) {
+      total_choice_t *theta = &S->T[k];
+      bool *row = S->samples + k*S->stride + i*S->A_n;
+      size_t l;
+      PROF_BEGIN(t_prob);
+      crn_total_choice(P, S->W + k*S->W_n, S->U, theta);
+      PROF_END(PROF_PROB, t_prob);
+      /* Settings that agree on the total choice share the model, since they share its uniform. */
+      for (l = 0; l < k; ++l) if (same_total_choice(P, theta, &S->T[l])) break;
+      if (l < k) memcpy(row, S->samples + l*S->stride + i*S->A_n, S->A_n*sizeof(bool));
+      else if (!sample_model(S, theta, S->U[n_u], row)) { S->fail = true; break; }
+    }
+    TRACE_END(TRACE_JOB, t_job);
+    if (S->fail) break;
   }
 }
 
@@ -170,7 +247,7 @@ bool naive_sample(program_t *P, size_t n, PyArrayObject *atoms, bool lstable_sat
   import_array();
   size_t total_choice_n = get_num_facts(P);
   /* Heuristic for choosing the number of processes to use. Roughly 100 samples per process. */
-  size_t num_procs = max(min(n / 100, NUM_PROCS), 1);
+  size_t num_procs = max(min(n / 100, max_nprocs()), 1);
   bool ok = false;
   threadpool pool = thpool_init(num_procs);
   sample_storage_t S[NUM_PROCS] = {0};
@@ -178,8 +255,11 @@ bool naive_sample(program_t *P, size_t n, PyArrayObject *atoms, bool lstable_sat
   size_t m = (size_t) PyArray_SIZE(atoms);
 
   /* Variable samples is a matrix of dimension n by m in contiguous array format. */
-  samples = (bool*) malloc(n*m*sizeof(bool));
-  if (!samples) goto cleanup;
+  samples = (bool*) mem_malloc(MEM_SAMPLES, n*m*sizeof(bool));
+  if (!samples) {
+    mem_raise("samples");
+    goto cleanup;
+  }
 
   /* Initialize storages. */ {
     size_t d = n / num_procs;
@@ -214,8 +294,109 @@ bool naive_sample(program_t *P, size_t n, PyArrayObject *atoms, bool lstable_sat
 cleanup:
   if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
   thpool_destroy(pool);
-  for (size_t i = 0; i < num_procs; ++i) free_total_choice_contents(&S[i].theta);
-  free(S[0].A);
-  if (!ok) free(samples);
+  for (size_t i = 0; i < num_procs; ++i) {
+    free_total_choice_contents(&S[i].theta);
+    free_control_pool_contents(&S[i].ctl);
+  }
+  mem_free(MEM_SAMPLES, S[0].A);
+  if (!ok) mem_free(MEM_SAMPLES, samples);
+  return ok;
+}
+
+bool crn_sample(program_t *P, size_t n, PyArrayObject *atoms, PyArrayObject *params,
+    bool lstable_sat, PyObject **ret) {
+  import_array();
+  size_t total_choice_n = get_num_facts(P);
+  size_t num_procs = max(min(n / 100, max_nprocs()), 1);
+  size_t m = (size_t) PyArray_SIZE(atoms), K, W_n = P->PF_n;
+  bool ok = false;
+  threadpool pool = NULL;
+  sample_storage_t S[NUM_PROCS] = {0};
+  bool *samples = NULL;
+  const double *W;
+
+  for (size_t i = 0; i < P->AD_n; ++i) W_n += P->AD[i].n;
+  if (PyArray_NDIM(params) != 2 || (size_t) PyArray_DIM(params, 1) != W_n) {
+    PyErr_Format(PyExc_ValueError, "params must be a matrix with a row of %zu parameters per "
+        "setting!", W_n);
+    return false;
+  }
+  K = (size_t) PyArray_DIM(params, 0);
+  W = (const double*) PyArray_DATA(params);
+  for (size_t k = 0; k < K; ++k) {
+    const double *w = W + k*W_n;
+    for (size_t j = 0; j < W_n; ++j) if (!(w[j] >= 0 && w[j] <= 1)) {
+      PyErr_Format(PyExc_ValueError, "parameter %zu of setting %zu is not a probability!", j, k);
+      return false;
+    }
+    w += P->PF_n;
+    for (size_t i = 0; i < P->AD_n; w += P->AD[i++].n) {
+      double z = 0;
+      for (size_t j = 0; j < P->AD[i].n; ++j) z += w[j];
+      if (fabs(z - 1) > 1e-6) {
+        PyErr_Format(PyExc_ValueError, "annotated disjunction %zu of setting %zu does not sum to "
+            "one!", i, k);
+        return false;
+      }
+    }
+  }
+
+  /* Variable samples is a tensor of dimension K by n by m in contiguous array format. */
+  samples = (bool*) mem_malloc(MEM_SAMPLES, (K*n*m > 0 ? K*n*m : 1)*sizeof(bool));
+  if (!samples) {
+    mem_raise("samples");
+    goto cleanup;
+  }
+  pool = thpool_init(num_procs);
+
+  /* Initialize storages. */ {
+    size_t d = n / num_procs;
+    size_t r = n % num_procs;
+    size_t t = 0;
+    for (size_t i = 0; i < num_procs; ++i) {
+      S[i].pid = i;
+      S[i].lstable_sat = lstable_sat;
+      S[i].P = P;
+      S[i].fail = false;
+      S[i].W = W; S[i].K = K; S[i].W_n = W_n;
+      S[i].stride = n*m;
+      S[i].T = (total_choice_t*) mem_calloc(MEM_SAMPLES, K ? K : 1, sizeof(total_choice_t));
+      S[i].U = (double*) mem_malloc(MEM_SAMPLES, (P->PF_n + P->AD_n + 1)*sizeof(double));
+      if (!S[i].T || !S[i].U) {
+        mem_raise("common random numbers");
+        goto cleanup;
+      }
+      for (size_t k = 0; k < K; ++k)
+        if (!init_total_choice(&S[i].T[k], total_choice_n, P)) goto cleanup;
+      S[i].n = d + (i < r);
+      S[i].samples = samples + t;
+      S[i].rng[0] = rand(); S[i].rng[1] = rand(); S[i].rng[2] = rand();
+      t += m*S[i].n;
+    }
+  }
+  if (!atoms2symbols(atoms, S, num_procs)) goto cleanup;
+
+  for (size_t i = 0; i < num_procs; ++i)
+    if (thpool_add_work(pool, compute_crn_sample, &S[i])) goto cleanup;
+  thpool_wait(pool);
+  for (size_t i = 0; i < num_procs; ++i) if (S[i].fail) goto cleanup;
+
+  npy_intp dims[3] = {K, n, m};
+  *ret = PyArray_SimpleNewFromData(3, dims, NPY_BOOL, samples);
+  if (!*ret) goto cleanup;
+  PyArray_ENABLEFLAGS((PyArrayObject*) *ret, NPY_ARRAY_OWNDATA);
+
+  ok = true;
+cleanup:
+  if (clingo_error_code() != clingo_error_success) raise_clingo_error(NULL);
+  if (pool) thpool_destroy(pool);
+  for (size_t i = 0; i < num_procs; ++i) {
+    if (S[i].T) for (size_t k = 0; k < K; ++k) free_total_choice_contents(&S[i].T[k]);
+    mem_free(MEM_SAMPLES, S[i].T);
+    mem_free(MEM_SAMPLES, S[i].U);
+    free_control_pool_contents(&S[i].ctl);
+  }
+  mem_free(MEM_SAMPLES, S[0].A);
+  if (!ok) mem_free(MEM_SAMPLES, samples);
   return ok;
 }
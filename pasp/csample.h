@@ -12,5 +12,14 @@
 #include "cprogram.h"
 
 bool naive_sample(program_t *P, size_t n, PyArrayObject *atoms, bool lstable_sat, PyObject **ret);
+/* Samples atoms from P under each of several parameter settings with common random numbers: every
+ * sample draws one uniform per probabilistic fact, one per annotated disjunction and one to pick a
+ * model, and each setting derives its total choice and model from the same draws. Row k of params
+ * holds the probabilities of every probabilistic fact followed by those of every annotated
+ * disjunction. Settings that agree on the total choice of a sample share its solve. Writes a K by n
+ * by m boolean tensor to *ret, whose differences across settings have far less variance than those
+ * of independent runs. */
+bool crn_sample(program_t *P, size_t n, PyArrayObject *atoms, PyArrayObject *params,
+    bool lstable_sat, PyObject **ret);
 
 #endif
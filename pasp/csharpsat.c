@@ -0,0 +1,502 @@
+#include "csharpsat.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+ARRAY_IMPL(int32_t, MEM_STORAGE)
+ARRAY_IMPL(uint32_t, MEM_STORAGE)
+
+/* Number of buckets of the component cache. */
+#define SHARPSAT_CACHE_BUCKETS (1 << 14)
+
+struct sharpsat_entry {
+  sharpsat_entry_t *next;
+  uint64_t h;
+  /* Number of variables and clauses of the component, stored sorted in key. */
+  uint32_t nv, nc;
+  double count;
+  uint32_t key[];
+};
+
+#define VAR(l) ((uint32_t) ((l) > 0 ? (l) : -(l)))
+
+static bool sharpsat_nomem(void) {
+  clingo_set_error(clingo_error_bad_alloc, "could not allocate memory for model counting!");
+  return false;
+}
+
+static bool obs_rule(bool choice, const clingo_atom_t *head, size_t head_n,
+    const clingo_literal_t *body, size_t body_n, void *data) {
+  sharpsat_t *S = (sharpsat_t*) data;
+  if (!S->ok) return true;
+  if (!choice && head_n > 1) { S->ok = false; return true; }
+  /* An empty choice is always satisfied. */
+  if (choice && !head_n) return true;
+  for (size_t i = 0; i < body_n; ++i)
+    if (VAR(body[i]) > S->atoms) S->atoms = VAR(body[i]);
+  /* Each atom of a choice gets a rule of its own. */
+  for (size_t h = 0; h < (head_n ? head_n : 1); ++h) {
+    clingo_atom_t a = head_n ? head[h] : 0;
+    if (a > S->atoms) S->atoms = a;
+    if (!array_uint32_t_append(&S->H, a)) return sharpsat_nomem();
+    if (!array_uint32_t_append(&S->R, S->B.n)) return sharpsat_nomem();
+    if (!array_uint8_t_append(&S->Ch, choice)) return sharpsat_nomem();
+    for (size_t i = 0; i < body_n; ++i)
+      if (!array_int32_t_append(&S->B, body[i])) return sharpsat_nomem();
+  }
+  return true;
+}
+
+static bool obs_weight_rule(bool choice, const clingo_atom_t *head, size_t head_n,
+    clingo_weight_t lower, const clingo_weighted_literal_t *body, size_t body_n, void *data) {
+  ((sharpsat_t*) data)->ok = false;
+  return true;
+}
+static bool obs_minimize(clingo_weight_t priority, const clingo_weighted_literal_t *L, size_t n,
+    void *data) {
+  ((sharpsat_t*) data)->ok = false;
+  return true;
+}
+static bool obs_project(const clingo_atom_t *A, size_t n, void *data) {
+  ((sharpsat_t*) data)->ok = false;
+  return true;
+}
+static bool obs_external(clingo_atom_t a, clingo_external_type_t t, void *data) {
+  ((sharpsat_t*) data)->ok = false;
+  return true;
+}
+static bool obs_assume(const clingo_literal_t *L, size_t n, void *data) {
+  ((sharpsat_t*) data)->ok = false;
+  return true;
+}
+static bool obs_acyc_edge(int u, int v, const clingo_literal_t *L, size_t n, void *data) {
+  ((sharpsat_t*) data)->ok = false;
+  return true;
+}
+static bool obs_theory_atom(clingo_id_t id, clingo_id_t term, const clingo_id_t *E, size_t n,
+    void *data) {
+  ((sharpsat_t*) data)->ok = false;
+  return true;
+}
+static bool obs_theory_atom_with_guard(clingo_id_t id, clingo_id_t term, const clingo_id_t *E,
+    size_t n, clingo_id_t op, clingo_id_t rhs, void *data) {
+  ((sharpsat_t*) data)->ok = false;
+  return true;
+}
+
+const clingo_ground_program_observer_t SHARPSAT_OBSERVER = {
+  .rule = obs_rule,
+  .weight_rule = obs_weight_rule,
+  .minimize = obs_minimize,
+  .project = obs_project,
+  .external = obs_external,
+  .assume = obs_assume,
+  .acyc_edge = obs_acyc_edge,
+  .theory_atom = obs_theory_atom,
+  .theory_atom_with_guard = obs_theory_atom_with_guard,
+};
+
+bool sharpsat_enabled(void) {
+  const char *e = getenv(SHARPSAT_ENV);
+  return !(e && !strcmp(e, "0"));
+}
+
+bool init_sharpsat(sharpsat_t *S) {
+  *S = (sharpsat_t) {0};
+  S->ok = true;
+  if (!(array_uint32_t_init(&S->H) && array_uint32_t_init(&S->R) && array_uint8_t_init(&S->Ch) &&
+        array_int32_t_init(&S->B) && array_int32_t_init(&S->L) && array_uint32_t_init(&S->C) &&
+        array_uint32_t_init(&S->stk_v) && array_uint32_t_init(&S->stk_c) &&
+        array_uint32_t_init(&S->stk_b))) {
+    free_sharpsat_contents(S);
+    return sharpsat_nomem();
+  }
+  return true;
+}
+
+static void sharpsat_clear_cache(sharpsat_t *S) {
+  if (!S->cache) return;
+  for (size_t i = 0; i < SHARPSAT_CACHE_BUCKETS; ++i) {
+    for (sharpsat_entry_t *e = S->cache[i], *n; e; e = n) {
+      n = e->next;
+      mem_free(MEM_STORAGE, e);
+    }
+    S->cache[i] = NULL;
+  }
+  S->cache_n = 0;
+}
+
+void free_sharpsat_contents(sharpsat_t *S) {
+  array_uint32_t_free_contents(&S->H); array_uint32_t_free_contents(&S->R);
+  array_uint8_t_free_contents(&S->Ch); array_int32_t_free_contents(&S->B);
+  array_int32_t_free_contents(&S->L); array_uint32_t_free_contents(&S->C);
+  array_uint32_t_free_contents(&S->stk_v); array_uint32_t_free_contents(&S->stk_c);
+  array_uint32_t_free_contents(&S->stk_b);
+  sharpsat_clear_cache(S);
+  mem_free(MEM_STORAGE, S->cache);
+  mem_free(MEM_STORAGE, S->WO); mem_free(MEM_STORAGE, S->W);
+  mem_free(MEM_STORAGE, S->val); mem_free(MEM_STORAGE, S->trail);
+  mem_free(MEM_STORAGE, S->seen_v); mem_free(MEM_STORAGE, S->seen_c);
+  S->cache = NULL; S->WO = S->W = S->trail = S->seen_v = S->seen_c = NULL; S->val = NULL;
+}
+
+static inline size_t rule_end(sharpsat_t *S, size_t i) {
+  return i+1 < S->R.n ? S->R.d[i+1] : S->B.n;
+}
+
+/* Whether the positive dependency graph of the observed program is acyclic. */
+static bool is_tight(sharpsat_t *S, bool *tight) {
+  size_t n = S->atoms + 1;
+  bool ok = false;
+  /* Positive body atoms of each head, in CSR form. */
+  uint32_t *O = (uint32_t*) mem_calloc(MEM_STORAGE, n+1, sizeof(uint32_t));
+  uint32_t *E = NULL, *stk = NULL, *it = NULL;
+  uint8_t *color = (uint8_t*) mem_calloc(MEM_STORAGE, n, sizeof(uint8_t));
+  if (!O || !color) goto cleanup;
+  for (size_t i = 0; i < S->H.n; ++i) {
+    if (!S->H.d[i]) continue;
+    for (size_t j = S->R.d[i]; j < rule_end(S, i); ++j) if (S->B.d[j] > 0) ++O[S->H.d[i]+1];
+  }
+  for (size_t a = 0; a < n; ++a) O[a+1] += O[a];
+  E = (uint32_t*) mem_malloc(MEM_STORAGE, (O[n] ? O[n] : 1)*sizeof(uint32_t));
+  stk = (uint32_t*) mem_malloc(MEM_STORAGE, n*sizeof(uint32_t));
+  it = (uint32_t*) mem_malloc(MEM_STORAGE, n*sizeof(uint32_t));
+  if (!E || !stk || !it) goto cleanup;
+  memcpy(it, O, n*sizeof(uint32_t));
+  for (size_t i = 0; i < S->H.n; ++i) {
+    if (!S->H.d[i]) continue;
+    for (size_t j = S->R.d[i]; j < rule_end(S, i); ++j)
+      if (S->B.d[j] > 0) E[it[S->H.d[i]]++] = S->B.d[j];
+  }
+  /* Iterative depth-first search: gray (1) atoms are on the stack, so reaching one closes a
+   * cycle. */
+  *tight = true;
+  for (size_t r = 1; r < n && *tight; ++r) {
+    size_t k = 0;
+    if (color[r]) continue;
+    color[r] = 1; it[r] = O[r]; stk[k++] = r;
+    while (k && *tight) {
+      uint32_t a = stk[k-1];
+      if (it[a] == O[a+1]) { color[a] = 2; --k; continue; }
+      uint32_t b = E[it[a]++];
+      if (color[b] == 1) *tight = false;
+      else if (!color[b]) { color[b] = 1; it[b] = O[b]; stk[k++] = b; }
+    }
+  }
+  ok = true;
+cleanup:
+  mem_free(MEM_STORAGE, O); mem_free(MEM_STORAGE, E); mem_free(MEM_STORAGE, stk);
+  mem_free(MEM_STORAGE, it); mem_free(MEM_STORAGE, color);
+  return ok ? true : sharpsat_nomem();
+}
+
+static bool add_clause(sharpsat_t *S, const int32_t *L, size_t n) {
+  if (!n) S->unsat = true;
+  if (!array_uint32_t_append(&S->C, S->L.n)) return false;
+  for (size_t i = 0; i < n; ++i) if (!array_int32_t_append(&S->L, L[i])) return false;
+  return true;
+}
+
+static inline void set_lit(sharpsat_t *S, int32_t l) {
+  S->val[VAR(l)] = l > 0 ? 1 : -1;
+  S->trail[S->trail_n++] = VAR(l);
+}
+
+static inline void undo(sharpsat_t *S, size_t mark) {
+  while (S->trail_n > mark) S->val[S->trail[--S->trail_n]] = 0;
+}
+
+static inline bool is_sat(sharpsat_t *S, uint32_t c) {
+  for (uint32_t j = S->C.d[c]; j < S->C.d[c+1]; ++j) {
+    int32_t m = S->L.d[j];
+    int8_t s = S->val[VAR(m)];
+    if (s && ((s > 0) == (m > 0))) return true;
+  }
+  return false;
+}
+
+/* Assigns literal l and everything it implies by unit propagation. Returns false on conflict,
+ * leaving the (partial) assignment on the trail to be undone by the caller. */
+static bool assign(sharpsat_t *S, int32_t l) {
+  size_t q = S->trail_n;
+  if (S->val[VAR(l)]) return S->val[VAR(l)] == (l > 0 ? 1 : -1);
+  set_lit(S, l);
+  while (q < S->trail_n) {
+    uint32_t x = S->trail[q++];
+    for (uint32_t k = S->WO[x]; k < S->WO[x+1]; ++k) {
+      uint32_t c = S->W[k];
+      int32_t u = 0;
+      size_t n = 0;
+      bool sat = false;
+      for (uint32_t j = S->C.d[c]; j < S->C.d[c+1]; ++j) {
+        int32_t m = S->L.d[j];
+        int8_t s = S->val[VAR(m)];
+        if (!s) { ++n; u = m; }
+        else if ((s > 0) == (m > 0)) { sat = true; break; }
+      }
+      if (sat) continue;
+      if (!n) return false;
+      if (n == 1) set_lit(S, u);
+    }
+  }
+  return true;
+}
+
+bool sharpsat_compile(sharpsat_t *S) {
+  bool tight, ok = false;
+  size_t n = S->atoms + 1, m = S->H.n;
+  int32_t *beta = NULL, *D = NULL;
+  uint32_t *O = NULL, *it = NULL, *Rs = NULL;
+
+  if (!S->ok) return true;
+  if (!is_tight(S, &tight)) return false;
+  if (!tight) { S->ok = false; return true; }
+
+  /* Literal standing for the body of each rule: 0 if empty, the only literal if a singleton, or
+   * a new variable equivalent to the conjunction otherwise. */
+  beta = (int32_t*) mem_malloc(MEM_STORAGE, (m ? m : 1)*sizeof(int32_t));
+  /* Scratch clause, large enough for any body or any set of rules plus one literal. */
+  D = (int32_t*) mem_malloc(MEM_STORAGE, (S->B.n + m + 1)*sizeof(int32_t));
+  /* Rules of each head, in CSR form. */
+  O = (uint32_t*) mem_calloc(MEM_STORAGE, n+1, sizeof(uint32_t));
+  it = (uint32_t*) mem_malloc(MEM_STORAGE, n*sizeof(uint32_t));
+  Rs = (uint32_t*) mem_malloc(MEM_STORAGE, (m ? m : 1)*sizeof(uint32_t));
+  if (!beta || !D || !O || !it || !Rs) goto cleanup;
+
+  S->V = S->atoms;
+  for (size_t i = 0; i < m; ++i) {
+    size_t b = S->R.d[i], e = rule_end(S, i), k = 0;
+    if (b == e) beta[i] = 0;
+    else if (e - b == 1) beta[i] = S->B.d[b];
+    else {
+      int32_t x = beta[i] = (int32_t) ++S->V;
+      /* x implies every literal of the body, and the body implies x. */
+      for (size_t j = b; j < e; ++j) {
+        D[0] = -x; D[1] = S->B.d[j];
+        if (!add_clause(S, D, 2)) goto cleanup;
+      }
+      for (size_t j = b; j < e; ++j) D[k++] = -S->B.d[j];
+      D[k++] = x;
+      if (!add_clause(S, D, k)) goto cleanup;
+      k = 0;
+    }
+    if (beta[i]) D[k++] = -beta[i];
+    if (S->H.d[i]) {
+      ++O[S->H.d[i]+1];
+      /* The body of a normal rule implies its head; choices impose nothing. */
+      if (S->Ch.d[i]) continue;
+      D[k++] = S->H.d[i];
+    }
+    /* Integrity constraints forbid their body. */
+    if (!add_clause(S, D, k)) goto cleanup;
+  }
+
+  /* Completion: an atom implies the body of one of its rules, and is false if it has none. */
+  for (size_t a = 0; a < n; ++a) O[a+1] += O[a];
+  memcpy(it, O, n*sizeof(uint32_t));
+  for (size_t i = 0; i < m; ++i) if (S->H.d[i]) Rs[it[S->H.d[i]]++] = i;
+  for (size_t a = 1; a < n; ++a) {
+    size_t k = 0;
+    bool fact = false;
+    D[k++] = -(int32_t) a;
+    for (uint32_t j = O[a]; (j < O[a+1]) && !fact; ++j) {
+      if (!beta[Rs[j]]) fact = true;
+      D[k++] = beta[Rs[j]];
+    }
+    if (!fact && !add_clause(S, D, k)) goto cleanup;
+  }
+  if (!array_uint32_t_append(&S->C, S->L.n)) goto cleanup;
+  /* The clauses are C[0..C.n-1), followed by a sentinel. */
+  --S->C.n;
+
+  /* Occurrence lists. */
+  S->WO = (uint32_t*) mem_calloc(MEM_STORAGE, S->V+2, sizeof(uint32_t));
+  S->W = (uint32_t*) mem_malloc(MEM_STORAGE, (S->L.n ? S->L.n : 1)*sizeof(uint32_t));
+  S->val = (int8_t*) mem_calloc(MEM_STORAGE, S->V+1, sizeof(int8_t));
+  S->trail = (uint32_t*) mem_malloc(MEM_STORAGE, (S->V+1)*sizeof(uint32_t));
+  S->seen_v = (uint32_t*) mem_calloc(MEM_STORAGE, S->V+1, sizeof(uint32_t));
+  S->seen_c = (uint32_t*) mem_calloc(MEM_STORAGE, S->C.n+1, sizeof(uint32_t));
+  S->cache = (sharpsat_entry_t**) mem_calloc(MEM_STORAGE, SHARPSAT_CACHE_BUCKETS,
+      sizeof(sharpsat_entry_t*));
+  if (!S->WO || !S->W || !S->val || !S->trail || !S->seen_v || !S->seen_c || !S->cache)
+    goto cleanup;
+  for (size_t j = 0; j < S->L.n; ++j) ++S->WO[VAR(S->L.d[j])+1];
+  for (size_t v = 0; v <= S->V; ++v) S->WO[v+1] += S->WO[v];
+  {
+    uint32_t *P = (uint32_t*) mem_malloc(MEM_STORAGE, (S->V+1)*sizeof(uint32_t));
+    if (!P) goto cleanup;
+    memcpy(P, S->WO, (S->V+1)*sizeof(uint32_t));
+    for (uint32_t c = 0; c < S->C.n; ++c)
+      for (uint32_t j = S->C.d[c]; j < S->C.d[c+1]; ++j) S->W[P[VAR(S->L.d[j])]++] = c;
+    mem_free(MEM_STORAGE, P);
+  }
+
+  /* Unit clauses hold in every model: propagate them once and for all. */
+  for (uint32_t c = 0; (c < S->C.n) && !S->unsat; ++c)
+    if ((S->C.d[c+1] - S->C.d[c] == 1) && !assign(S, S->L.d[S->C.d[c]])) S->unsat = true;
+
+  ok = true;
+cleanup:
+  mem_free(MEM_STORAGE, beta); mem_free(MEM_STORAGE, D); mem_free(MEM_STORAGE, O);
+  mem_free(MEM_STORAGE, it); mem_free(MEM_STORAGE, Rs);
+  return ok ? true : sharpsat_nomem();
+}
+
+bool sharpsat_literal(clingo_control_t *C, clingo_symbol_t x, bool s, clingo_literal_t *l,
+    bool *c) {
+  const clingo_symbolic_atoms_t *A;
+  clingo_symbolic_atom_iterator_t it;
+  bool valid, fact;
+  *l = 0;
+  if (!clingo_control_symbolic_atoms(C, &A)) return false;
+  if (!clingo_symbolic_atoms_find(A, x, &it)) return false;
+  if (!clingo_symbolic_atoms_is_valid(A, it, &valid)) return false;
+  /* Atoms that were not grounded are false in every model. */
+  if (!valid) { *c = !s; return true; }
+  if (!clingo_symbolic_atoms_is_fact(A, it, &fact)) return false;
+  if (fact) { *c = s; return true; }
+  if (!clingo_symbolic_atoms_literal(A, it, l)) return false;
+  if (!s) *l = -*l;
+  return true;
+}
+
+static int cmp_uint32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+  return (x > y) - (x < y);
+}
+
+static inline uint64_t hash_uint32(uint64_t h, const uint32_t *d, size_t n) {
+  for (size_t i = 0; i < n; ++i) h = (h ^ d[i]) * 0x100000001b3ULL;
+  return h;
+}
+
+static inline uint32_t next_stamp(sharpsat_t *S) {
+  if (!++S->stamp) {
+    memset(S->seen_v, 0, (S->V+1)*sizeof(uint32_t));
+    memset(S->seen_c, 0, (S->C.n+1)*sizeof(uint32_t));
+    S->stamp = 1;
+  }
+  return S->stamp;
+}
+
+static double count_vars(sharpsat_t *S, size_t vb, size_t ve);
+
+/* Counts the models of the component of variables stk_v[vb..ve) and clauses stk_c[cb..ce). */
+static double count_component(sharpsat_t *S, size_t vb, size_t ve, size_t cb, size_t ce) {
+  uint32_t *V = S->stk_v.d + vb, *K = S->stk_c.d + cb, nv = ve - vb, nc = ce - cb, x = 0;
+  size_t b = 0, mark = S->trail_n;
+  double r = 0;
+
+  /* Components are identified by their variables and (not yet satisfied) clauses: the literals
+   * left in those clauses are exactly those of the component's variables. */
+  qsort(V, nv, sizeof(uint32_t), cmp_uint32);
+  qsort(K, nc, sizeof(uint32_t), cmp_uint32);
+  uint64_t h = hash_uint32(hash_uint32(0xcbf29ce484222325ULL ^ nv, V, nv), K, nc);
+  sharpsat_entry_t **bucket = &S->cache[h % SHARPSAT_CACHE_BUCKETS];
+  for (sharpsat_entry_t *e = *bucket; e; e = e->next)
+    if ((e->h == h) && (e->nv == nv) && (e->nc == nc) &&
+        !memcmp(e->key, V, nv*sizeof(uint32_t)) && !memcmp(e->key + nv, K, nc*sizeof(uint32_t)))
+      return e->count;
+
+  /* Branch on the variable occurring in the most clauses. */
+  for (uint32_t i = 0; i < nv; ++i) {
+    uint32_t o = S->WO[V[i]+1] - S->WO[V[i]];
+    if (o >= b) { b = o; x = V[i]; }
+  }
+  for (int s = 1; s >= -1; s -= 2) {
+    if (assign(S, s*(int32_t) x)) {
+      double c = count_vars(S, vb, ve);
+      if (c < 0) { undo(S, mark); return -1; }
+      r += c;
+    }
+    undo(S, mark);
+  }
+
+  if (S->cache_n >= SHARPSAT_CACHE_MAX) sharpsat_clear_cache(S);
+  /* V and K may have moved while counting. */
+  V = S->stk_v.d + vb; K = S->stk_c.d + cb;
+  sharpsat_entry_t *e = (sharpsat_entry_t*) mem_malloc(MEM_STORAGE,
+      sizeof(sharpsat_entry_t) + (nv+nc)*sizeof(uint32_t));
+  /* Failing to cache only costs time. */
+  if (!e) return r;
+  e->h = h; e->nv = nv; e->nc = nc; e->count = r;
+  memcpy(e->key, V, nv*sizeof(uint32_t));
+  memcpy(e->key + nv, K, nc*sizeof(uint32_t));
+  e->next = *bucket; *bucket = e;
+  ++S->cache_n;
+  return r;
+}
+
+/* Counts the models over the unassigned variables among stk_v[vb..ve), multiplying the counts of
+ * the independent components they split into. Returns a negative count on failure. */
+static double count_vars(sharpsat_t *S, size_t vb, size_t ve) {
+  size_t nv = S->stk_v.n, nc = S->stk_c.n, nb = S->stk_b.n;
+  uint32_t stamp = next_stamp(S);
+  double r = 1;
+
+  for (size_t i = vb; i < ve; ++i) {
+    uint32_t v = S->stk_v.d[i];
+    size_t cv = S->stk_v.n, cc = S->stk_c.n;
+    if (S->val[v] || (S->seen_v[v] == stamp)) continue;
+    S->seen_v[v] = stamp;
+    if (!array_uint32_t_append(&S->stk_v, v)) goto nomem;
+    for (size_t k = cv; k < S->stk_v.n; ++k) {
+      uint32_t y = S->stk_v.d[k];
+      for (uint32_t o = S->WO[y]; o < S->WO[y+1]; ++o) {
+        uint32_t c = S->W[o];
+        if (S->seen_c[c] == stamp) continue;
+        S->seen_c[c] = stamp;
+        if (is_sat(S, c)) continue;
+        if (!array_uint32_t_append(&S->stk_c, c)) goto nomem;
+        for (uint32_t j = S->C.d[c]; j < S->C.d[c+1]; ++j) {
+          uint32_t z = VAR(S->L.d[j]);
+          if (S->val[z] || (S->seen_v[z] == stamp)) continue;
+          S->seen_v[z] = stamp;
+          if (!array_uint32_t_append(&S->stk_v, z)) goto nomem;
+        }
+      }
+    }
+    /* A variable left in no clause is free. */
+    if (S->stk_c.n == cc) { r *= 2; S->stk_v.n = cv; continue; }
+    if (!(array_uint32_t_append(&S->stk_b, cv) && array_uint32_t_append(&S->stk_b, S->stk_v.n) &&
+          array_uint32_t_append(&S->stk_b, cc) && array_uint32_t_append(&S->stk_b, S->stk_c.n)))
+      goto nomem;
+  }
+  for (size_t b = nb; (b < S->stk_b.n) && (r > 0); b += 4) {
+    uint32_t *B = S->stk_b.d + b;
+    double c = count_component(S, B[0], B[1], B[2], B[3]);
+    if (c < 0) { r = -1; break; }
+    r *= c;
+  }
+  S->stk_v.n = nv; S->stk_c.n = nc; S->stk_b.n = nb;
+  return r;
+nomem:
+  S->stk_v.n = nv; S->stk_c.n = nc; S->stk_b.n = nb;
+  sharpsat_nomem();
+  return -1;
+}
+
+double sharpsat_count(sharpsat_t *S, const clingo_literal_t *A, size_t n) {
+  size_t mark = S->trail_n, vb = S->stk_v.n;
+  double r = 0;
+  if (S->unsat) return 0;
+  for (size_t i = 0; i < n; ++i) {
+    /* Atoms beyond those observed occur in no rule, and are thus false. */
+    if (VAR(A[i]) > S->atoms) {
+      if (A[i] > 0) return 0;
+      continue;
+    }
+    if (!assign(S, A[i])) goto cleanup;
+  }
+  for (uint32_t v = 1; v <= S->V; ++v) {
+    if (S->val[v] || array_uint32_t_append(&S->stk_v, v)) continue;
+    sharpsat_nomem();
+    r = -1;
+    goto cleanup;
+  }
+  r = count_vars(S, vb, S->stk_v.n);
+cleanup:
+  S->stk_v.n = vb;
+  undo(S, mark);
+  return r;
+}
@@ -0,0 +1,82 @@
+#ifndef _PASP_CSHARPSAT
+#define _PASP_CSHARPSAT
+
+#include <clingo.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "carray.h"
+
+/* Environment variable that, if set to 0, disables counting models with the #SAT engine, so that
+ * models are always enumerated by clingo instead. */
+#define SHARPSAT_ENV "PASP_SHARPSAT"
+/* Maximum number of components kept in the cache before it is emptied. */
+#define SHARPSAT_CACHE_MAX (1 << 16)
+
+ARRAY_DECL(int32_t)
+ARRAY_DECL(uint32_t)
+
+typedef struct sharpsat_entry sharpsat_entry_t;
+
+/* Counts the stable models of a ground program without enumerating them. The ground program is
+ * observed while clingo grounds it (see SHARPSAT_OBSERVER); if it is normal (choice rules and
+ * integrity constraints aside) and tight, its stable models are exactly the models of its Clark
+ * completion, whose models are counted by a DPLL-style #SAT solver that splits the formula into
+ * independent components and caches the count of each. */
+typedef struct {
+  /* Whether every observed statement can be counted. Disjunctive heads, weight constraints,
+   * externals, assumptions, minimize, projection and theory statements are not. */
+  bool ok;
+  /* Whether the completion is unsatisfiable regardless of assumptions. */
+  bool unsat;
+  /* Observed rules: rule i has head H[i] (0 for integrity constraints), is a choice rule if Ch[i],
+   * and has body B[R[i]..R[i+1]). */
+  array_uint32_t_t H, R;
+  array_uint8_t_t Ch;
+  array_int32_t_t B;
+  /* Largest observed atom. Variables 1..atoms are atoms; the rest stand for rule bodies. */
+  uint32_t atoms;
+  /* Number of variables. */
+  uint32_t V;
+  /* Clauses: clause i is L[C[i]..C[i+1]). */
+  array_int32_t_t L;
+  array_uint32_t_t C;
+  /* Occurrence lists: clauses containing variable v are W[WO[v]..WO[v+1]). */
+  uint32_t *WO, *W;
+  /* Current assignment (1 true, -1 false, 0 unassigned) and trail of assigned variables. */
+  int8_t *val;
+  uint32_t *trail;
+  size_t trail_n;
+  /* Generation marks of visited variables and clauses. */
+  uint32_t *seen_v, *seen_c, stamp;
+  /* Stacks of component variables, component clauses and component bounds. */
+  array_uint32_t_t stk_v, stk_c, stk_b;
+  /* Component cache: a hash table of chained entries. */
+  sharpsat_entry_t **cache;
+  size_t cache_n;
+} sharpsat_t;
+
+/* Observer to register on a control before anything is added to it; its data is a sharpsat_t. */
+extern const clingo_ground_program_observer_t SHARPSAT_OBSERVER;
+
+/* Whether counting with the #SAT engine is enabled (see SHARPSAT_ENV). */
+bool sharpsat_enabled(void);
+
+bool init_sharpsat(sharpsat_t *S);
+void free_sharpsat_contents(sharpsat_t *S);
+
+/* Builds the completion of the observed program, leaving S->ok false if it is not tight. Returns
+ * false only if memory could not be allocated. */
+bool sharpsat_compile(sharpsat_t *S);
+
+/* Sets *l to the literal that holds exactly when atom x has truth value s in a stable model of
+ * the program grounded by C, or to 0 (and *c to whether the condition always holds) if that does
+ * not depend on the model. */
+bool sharpsat_literal(clingo_control_t *C, clingo_symbol_t x, bool s, clingo_literal_t *l, bool *c);
+
+/* Counts the models of the completion in which all n literals of A hold. Returns a negative count
+ * if memory could not be allocated. */
+double sharpsat_count(sharpsat_t *S, const clingo_literal_t *A, size_t n);
+
+#endif
@@ -0,0 +1,109 @@
+#include "ctrace.h"
+#include "cmem.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <wchar.h>
+
+bool trace_enabled = false;
+
+static const char *TRACE_EVENT_NAMES[TRACE_N] = { "job", "idle", "lock", "neural" };
+
+typedef struct {
+  trace_span_t *S;
+  /* Number of spans ever recorded; only the last TRACE_RING_SIZE are kept. */
+  uint64_t n;
+  /* Whether this is the thread that called trace_start, i.e. the dispatcher. */
+  bool main;
+} __attribute__((aligned(64))) trace_ring_t;
+
+static trace_ring_t trace_rings[TRACE_MAX_THREADS];
+static size_t trace_rings_n = 0;
+static const char *trace_path = NULL;
+static uint64_t trace_t0 = 0;
+static pthread_t trace_main;
+/* Bumped on every trace_start, so that threads claim a fresh ring in each traced run. */
+static unsigned trace_gen = 0;
+static __thread unsigned trace_tls_gen = 0;
+static __thread trace_ring_t *trace_tls = NULL;
+
+static trace_ring_t* trace_local(void) {
+  if (trace_tls_gen != __atomic_load_n(&trace_gen, __ATOMIC_RELAXED)) {
+    size_t i = __atomic_fetch_add(&trace_rings_n, 1, __ATOMIC_RELAXED);
+    trace_tls = NULL;
+    if (i < TRACE_MAX_THREADS) {
+      trace_ring_t *r = &trace_rings[i];
+      r->main = pthread_equal(pthread_self(), trace_main);
+      /* A thread that fails to allocate its ring simply goes untraced. */
+      r->S = (trace_span_t*) mem_malloc(MEM_INSTRUMENT, TRACE_RING_SIZE*sizeof(trace_span_t));
+      if (r->S) trace_tls = r;
+    }
+    trace_tls_gen = trace_gen;
+  }
+  return trace_tls;
+}
+
+void trace_add(trace_event_t type, uint64_t t0) {
+  trace_ring_t *r = trace_local();
+  if (!r) return;
+  trace_span_t *s = &r->S[r->n++ & (TRACE_RING_SIZE-1)];
+  s->ts = t0 - trace_t0;
+  s->dur = prof_now() - t0;
+  s->type = type;
+}
+
+static void free_rings(void) {
+  size_t n = trace_rings_n < TRACE_MAX_THREADS ? trace_rings_n : TRACE_MAX_THREADS;
+  for (size_t i = 0; i < n; ++i) {
+    mem_free(MEM_INSTRUMENT, trace_rings[i].S);
+    trace_rings[i].S = NULL;
+    trace_rings[i].n = 0;
+  }
+  trace_rings_n = 0;
+}
+
+void trace_start(void) {
+  trace_path = getenv(TRACE_ENV);
+  free_rings();
+  if (!trace_path || !*trace_path) { trace_enabled = false; return; }
+  trace_main = pthread_self();
+  trace_t0 = prof_now();
+  __atomic_add_fetch(&trace_gen, 1, __ATOMIC_RELAXED);
+  trace_enabled = true;
+}
+
+static bool write_trace(FILE *f) {
+  size_t n = trace_rings_n < TRACE_MAX_THREADS ? trace_rings_n : TRACE_MAX_THREADS;
+  int pid = getpid();
+  bool first = true;
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", f);
+  for (size_t i = 0; i < n; ++i) {
+    trace_ring_t *r = &trace_rings[i];
+    if (!r->S) continue;
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%zu,"
+        "\"args\":{\"name\":\"%s %zu\"}}", first ? "" : ",", pid, i,
+        r->main ? "dispatcher" : "worker", i);
+    first = false;
+    /* Oldest span first; if the ring wrapped, it starts right after the newest one. */
+    uint64_t k = r->n > TRACE_RING_SIZE ? r->n - TRACE_RING_SIZE : 0;
+    for (; k < r->n; ++k) {
+      trace_span_t *s = &r->S[k & (TRACE_RING_SIZE-1)];
+      fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%zu,\"ts\":%.3f,"
+          "\"dur\":%.3f}", TRACE_EVENT_NAMES[s->type], pid, i, s->ts*1e-3, s->dur*1e-3);
+    }
+  }
+  fputs("\n]}\n", f);
+  return !ferror(f);
+}
+
+void trace_stop(void) {
+  if (!trace_enabled) return;
+  trace_enabled = false;
+  FILE *f = fopen(trace_path, "w");
+  bool ok = f && write_trace(f);
+  if (f) ok = !fclose(f) && ok;
+  if (!ok) fwprintf(stderr, L"Warning: could not write trace to %s.\n", trace_path);
+  free_rings();
+}
@@ -0,0 +1,57 @@
+#ifndef _PASP_CTRACE
+#define _PASP_CTRACE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cprofile.h"
+
+/* Environment variable holding the path to write a Chrome trace JSON file to. */
+#define TRACE_ENV "PASP_TRACE"
+
+/* Kinds of spans recorded by the tracer. Keep TRACE_EVENT_NAMES (ctrace.c) in the same order. */
+typedef enum {
+  /* A worker running a total choice (or sample) job. */
+  TRACE_JOB,
+  /* The dispatcher waiting on avail for a free worker. */
+  TRACE_IDLE,
+  /* A worker waiting to acquire the shared storage mutex st->mu. */
+  TRACE_LOCK,
+  /* Neural network forward or backward passes. */
+  TRACE_NEURAL,
+  TRACE_N
+} trace_event_t;
+
+typedef struct {
+  /* Start of the span, in nanoseconds since trace_start. */
+  uint64_t ts;
+  /* Duration in nanoseconds. */
+  uint64_t dur;
+  trace_event_t type;
+} trace_span_t;
+
+/* Number of spans kept per thread (a power of two). Older spans are overwritten. */
+#define TRACE_RING_SIZE (1 << 15)
+/* Maximum number of threads traced separately; any further threads are not traced. */
+#define TRACE_MAX_THREADS 256
+
+extern bool trace_enabled;
+
+/* Enables tracing if the PASP_TRACE environment variable is set, discarding previous spans. */
+void trace_start(void);
+/* Disables tracing and, if it was enabled, writes all recorded spans to the path in PASP_TRACE in
+ * Chrome trace format (viewable in Perfetto or chrome://tracing). A failure to write is reported
+ * as a warning, since the results the trace describes are still valid. */
+void trace_stop(void);
+
+void trace_add(trace_event_t type, uint64_t t0);
+
+#ifdef PASP_NO_PROFILE
+#define TRACE_BEGIN(t)
+#define TRACE_END(type, t)
+#else
+#define TRACE_BEGIN(t) uint64_t t = trace_enabled ? prof_now() : 0
+#define TRACE_END(type, t) do { if (trace_enabled) trace_add(type, t); } while (0)
+#endif
+
+#endif
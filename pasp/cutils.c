@@ -6,6 +6,7 @@
 #include <stdlib.h>
 
 #include "cutils.h"
+#include "cmem.h"
 
 const clingo_part_t GROUND_DEFAULT_PARTS[] = {{"base", NULL, 0}};
 const char* const CONTROL_DEFAULT_ARGS[] = {"0"};
@@ -26,7 +27,7 @@ bool string_from_symbol(clingo_symbol_t sym, string_t *buf) {
 
   if (!clingo_symbol_to_string_size(sym, &n)) goto error;
   if (buf->n < n) {
-    if (!(s = (char*) realloc(buf->s, n*sizeof(char)))) {
+    if (!(s = (char*) mem_realloc(MEM_OTHER, buf->s, n*sizeof(char)))) {
       clingo_set_error(clingo_error_bad_alloc, "Could not allocate memory for symbol!");
       goto error;
     }
@@ -43,7 +44,7 @@ out:
 
 void string_free(string_t *s) {
   if (!s->s) return;
-  free(s->s);
+  mem_free(MEM_OTHER, s->s);
   s->s = NULL, s->n = 0;
 }
 
@@ -56,12 +57,12 @@ typedef struct model_buffer {
 
 void free_model_buffer(model_buffer_t *buf) {
   if (buf->symbols) {
-    free(buf->symbols);
+    mem_free(MEM_OTHER, buf->symbols);
     buf->symbols   = NULL;
     buf->symbols_n = 0;
   }
   if (buf->string) {
-    free(buf->string);
+    mem_free(MEM_OTHER, buf->string);
     buf->string   = NULL;
     buf->string_n = 0;
   }
@@ -75,7 +76,7 @@ bool print_symbol(clingo_symbol_t symbol, model_buffer_t *buf) {
   if (!clingo_symbol_to_string_size(symbol, &n)) { goto error; }
   if (buf->string_n < n) {
     // allocate required memory to hold the symbol's string
-    if (!(string = (char*)realloc(buf->string, sizeof(*buf->string) * n))) {
+    if (!(string = (char*)mem_realloc(MEM_OTHER, buf->string, sizeof(*buf->string) * n))) {
       clingo_set_error(clingo_error_bad_alloc, "could not allocate memory for symbol's string");
       goto error;
     }
@@ -101,7 +102,7 @@ bool print_model(const clingo_model_t *model, model_buffer_t *buf, const char *l
   if (!clingo_model_symbols_size(model, show, &n)) { goto error; }
   // allocate required memory to hold all the symbols
   if (buf->symbols_n < n) {
-    if (!(symbols = (clingo_symbol_t*)malloc(sizeof(*buf->symbols) * n))) {
+    if (!(symbols = (clingo_symbol_t*)mem_malloc(MEM_OTHER, sizeof(*buf->symbols) * n))) {
       clingo_set_error(clingo_error_bad_alloc, "could not allocate memory for atoms");
       goto error;
     }
@@ -0,0 +1,173 @@
+import pathlib, re
+import lark
+import numpy as np
+
+from .grammar import parse
+from .program import Query
+
+# Largest number of state atoms of a dynamic program; each step asks 4^k queries of its slice.
+DYNAMIC_MAX_STATE = 6
+
+class DynamicProgram:
+  """
+  A dynamic program is a PLP over discrete time, written as clingo's incremental programs: the text
+  before `#program step(t).` (or after `#program base.`) is the initial slice, at time `0`, and the
+  text after `#program step(t).` is the transition, instantiated at every step `t > 0` by replacing
+  the constant `t` with the step, and `t-k` or `t+k` with its value.
+
+  ```
+  0.5::rain(0).
+  #program step(t).
+  0.7::rain(t) :- rain(t-1).
+  0.3::rain(t) :- not rain(t-1).
+  0.9::umbrella(t) :- rain(t).
+  0.2::umbrella(t) :- not rain(t).
+  ```
+
+  State atoms are the atoms the transition refers to at time `t-1`, which must be ground but for the
+  time. Each slice is parsed, grounded and solved on its own, with the state atoms of the previous
+  step as independent fair coins, and the belief state carried from step to step is the joint
+  distribution of the state atoms given the evidence so far. A step thus costs the same regardless
+  of the horizon. The transition must not depend on the initial slice other than through the state
+  atoms, so that facts it needs from the initial slice are repeated in it.
+  """
+
+  def __init__(self, text: str, G: lark.Lark = None):
+    "Constructs a dynamic program out of its `text`, parsing slices with grammar `G`."
+    self.base, self.trans, self.t = DynamicProgram.split(text)
+    if self.trans is None: raise ValueError("dynamic programs need a #program step(t) part!")
+    if G is None:
+      with open(pathlib.Path(__file__).resolve().parent.joinpath("grammar.lark"), "r") as f:
+        G = lark.Lark(f, start = "plp")
+    self.G = G
+    self.state = self.state_atoms()
+    if len(self.state) > DYNAMIC_MAX_STATE:
+      raise ValueError(f"dynamic programs may have at most {DYNAMIC_MAX_STATE} state atoms, got "
+                       f"{len(self.state)}!")
+    self.reset()
+
+  @staticmethod
+  def split(text: str) -> tuple:
+    "Splits `text` into its initial slice, transition and the name of the time constant."
+    base, trans, t, part, last = [], [], None, "base", 0
+    for m in re.finditer(r"#program\s+(\w+)\s*(?:\(\s*(\w+)\s*\))?\s*\.", text):
+      (base if part == "base" else trans).append(text[last:m.start()])
+      part, last = m.group(1), m.end()
+      if part == "step":
+        if m.group(2) is None: raise ValueError("#program step must take the time constant!")
+        if t is not None and t != m.group(2):
+          raise ValueError("all #program step parts must take the same time constant!")
+        t = m.group(2)
+      elif part != "base" or m.group(2) is not None:
+        raise ValueError(f"unsupported program part {part}, must either be base or step(t)!")
+    (base if part == "base" else trans).append(text[last:])
+    return "\n".join(base), "\n".join(trans) if t is not None else None, t
+
+  def state_atoms(self) -> list:
+    "Templates of the atoms the transition refers to at the previous step, in order of appearance."
+    S, prev = [], re.compile(rf"^\s*{self.t}\s*-\s*1\s*$")
+    for m in re.finditer(r"\b([a-z]\w*)\(([^()]*)\)", self.trans):
+      A = m.group(2).split(",")
+      if not any(prev.match(a) for a in A): continue
+      if any(re.search(r"\b[A-Z_]", a) for a in A):
+        raise ValueError(f"state atom {m.group(0)} must be ground but for the time!")
+      s = f"{m.group(1)}({','.join('{}' if prev.match(a) else a.strip() for a in A)})"
+      if s not in S: S.append(s)
+    return S
+
+  def inst(self, s: str, t: int) -> str:
+    "Instantiates `s` at step `t`."
+    s = re.sub(rf"\b{self.t}\s*([+-])\s*(\d+)\b",
+               lambda m: str(t + int(m.group(2)) if m.group(1) == "+" else t - int(m.group(2))), s)
+    return re.sub(rf"\b{self.t}\b", str(t), s)
+
+  def slice(self, t: int, E: list, queries: list):
+    """Parses the slice of step `t` and asks, for every assignment `s` to the state atoms at `t-1`
+    and `u` to those at `t`, the probability of `s`, `u` and evidence `E`; then, for each `s` and
+    query `q`, that of `s`, `q` and `E`. Returns both as matrices."""
+    n = 1 << len(self.state)
+    def assign(s: int, t: int) -> list:
+      return [("" if (s >> j) & 1 else "not ") + a.format(t) for j, a in enumerate(self.state)]
+    if t == 0: text, prev = self.base, [[]]
+    else:
+      text = self.inst(self.trans, t) + "\n" + \
+             "\n".join(f"0.5::{a.format(t-1)}." for a in self.state)
+      prev = [assign(s, t-1) for s in range(n)]
+    L = [p + assign(u, t) + E for p in prev for u in range(n)] + \
+        [p + [q] + E for p in prev for q in queries]
+    P = parse(text, G = self.G, from_str = True)
+    P.Q = [Query(l, semantics = P.semantics) for l in L if len(l) > 0]
+    R, i = np.ones(len(L)), [j for j, l in enumerate(L) if len(l) > 0]
+    if len(P.Q) > 0:
+      from exact import exact
+      R[i] = exact(P, psemantics = "maxent", quiet = True)[:,0]
+    # The state atoms at t-1 are fair coins, so the probability of s is 1/2^k.
+    J, Q = R[:len(prev)*n].reshape(len(prev), n), R[len(prev)*n:].reshape(len(prev), len(queries))
+    return (J, Q) if t == 0 else (J*n, Q*n)
+
+  def reset(self):
+    "Forgets all steps, so that the next one is the initial slice."
+    self.steps, self.belief, self.transitions, self.ll = 0, None, None, 0.
+
+  def step(self, E: list = [], queries: list = []) -> np.ndarray:
+    """
+    Advances one step, observing the literals in `E`, and returns the probabilities of each state
+    atom and then of each query in `queries` given the evidence of all steps so far. The constant
+    `t` in `E` and `queries` is replaced by the step.
+    """
+    t = self.steps
+    E, queries = [self.inst(e, t) for e in E], [self.inst(q, t) for q in queries]
+    M, Q = self.slice(t, E, queries)
+    a = np.ones(1) if t == 0 else self.belief
+    b, q = a @ M, a @ Q
+    z = b.sum()
+    if z <= 0: raise ValueError(f"evidence at step {t} is impossible!")
+    self.belief, self.ll, self.steps = b/z, self.ll + np.log(z), t+1
+    self.transitions = M
+    return np.concatenate((self.marginals(self.belief), q/z))
+
+  def marginals(self, b: np.ndarray) -> np.ndarray:
+    "Marginal probability of each state atom under the joint distribution `b`."
+    S = np.arange(len(b))
+    return np.array([b[(S >> j) & 1 == 1].sum() for j in range(len(self.state))])
+
+  def filter(self, E: list, queries: list = []) -> np.ndarray:
+    """
+    Filters the evidence `E`, a list of the literals observed at each step, from the initial slice.
+    Returns a matrix whose row `t` holds the probabilities of each state atom at step `t`, followed
+    by those of each query in `queries` (instantiated at `t`), given the evidence up to `t`.
+    """
+    self.reset()
+    return np.array([self.step(e, queries) for e in E])
+
+  def smooth(self, E: list) -> np.ndarray:
+    """
+    Smooths the evidence `E` as in `filter`, returning a matrix whose row `t` holds the probability
+    of each state atom at step `t` given the evidence of all steps, by a backward pass over the
+    transitions of each step.
+    """
+    self.reset()
+    A, M = [], []
+    for e in E:
+      self.step(e)
+      A.append(self.belief); M.append(self.transitions)
+    b, R = np.ones(1 << len(self.state)), [None]*len(E)
+    for t in range(len(E)-1, -1, -1):
+      g = A[t]*b
+      R[t] = self.marginals(g/g.sum())
+      b = M[t] @ b
+      b /= b.sum()
+    return np.array(R)
+
+  def unroll(self, T: int) -> str:
+    "The text of the program unrolled up to step `T`, as a single static program."
+    return "\n".join([self.base] + [self.inst(self.trans, t) for t in range(1, T+1)])
+
+def dynamic(*files: str, from_str: bool = False) -> DynamicProgram:
+  """Either parses `files` as blocks of text containing a dynamic program when `from_str = True`, or
+  reads them as filenames; see `DynamicProgram`."""
+  if from_str: return DynamicProgram("\n".join(files))
+  T = []
+  for fname in files:
+    with open(fname, "r") as f: T.append(f.read())
+  return DynamicProgram("\n".join(T))
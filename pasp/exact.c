@@ -8,19 +8,78 @@
 #include "cprogram.h"
 #include "cground.h"
 #include "cinf.h"
+#include "cprofile.h"
+#include "ctrace.h"
+#include "cmem.h"
+#include "ccache.h"
+#include "cjtree.h"
+#include "cdecision.h"
+#include "cmarginal.h"
+#include "cutils.h"
+#include "cbp.h"
 
 static PyObject* exact(PyObject *self, PyObject *args, PyObject *kwargs) {
   program_t p = {0};
-  PyObject *py_P, *py_R = NULL;
+  PyObject *py_P, *py_R = NULL, *py_prof = NULL;
   double *R = NULL;
-  bool r = false, parallel = true, lstable_sat = true, quiet = false;
-  const char *psem_arg = "credal";
-  static char *kwlist[] = { "", "parallel", "lstable_sat", "psemantics", "quiet", NULL };
+  bool r = false, parallel = true, lstable_sat = true, quiet = false, profile = false;
+  const char *psem_arg = "credal", *ck_path = NULL, *ck_resume = NULL, *engine = "enum";
+  size_t ck_every = CHECKPOINT_DEFAULT_INTERVAL, memory_limit = 0;
+  PyObject *py_shard = Py_None, *py_progress = Py_None, *py_cache = Py_False;
+  double progress_every = PROGRESS_DEFAULT_INTERVAL;
+  static char *kwlist[] = { "", "parallel", "lstable_sat", "psemantics", "quiet", "checkpoint",
+    "checkpoint_every", "resume", "shard", "out", "profile", "progress", "progress_every",
+    "memory_limit", "cache", "engine", NULL };
   psemantics_t psem = CREDAL_SEMANTICS;
+  checkpoint_t ck;
+  shard_t sh = {0};
+  progress_t pg = {0};
+  /* Directory of the on-disk cache tier, if any. */
+  const char *cache_dir = NULL;
+  cache_key_t key;
+  bool use_cache;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|bbsb", kwlist, &py_P, &parallel, &lstable_sat,
-        &psem_arg, &quiet))
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|bbsbznzOzbOdnOs", kwlist, &py_P, &parallel,
+        &lstable_sat, &psem_arg, &quiet, &ck_path, &ck_every, &ck_resume, &py_shard, &sh.path,
+        &profile, &py_progress, &progress_every, &memory_limit, &py_cache, &engine))
+    return NULL;
+  bool jtree = !strcmp(engine, "jtree");
+  if (!jtree && strcmp(engine, "enum")) {
+    PyErr_SetString(PyExc_ValueError, "engine must either be \"enum\" or \"jtree\"!");
+    return NULL;
+  }
+  if (jtree && ((py_shard != Py_None) || ck_path || ck_resume)) {
+    PyErr_SetString(PyExc_ValueError, "junction trees cannot be sharded or checkpointed!");
     return NULL;
+  }
+  init_checkpoint(&ck, ck_path, ck_resume, ck_every);
+
+  if (PyUnicode_Check(py_cache)) {
+    if (!(cache_dir = PyUnicode_AsUTF8(py_cache))) return NULL;
+    use_cache = true;
+  } else {
+    int c = PyObject_IsTrue(py_cache);
+    if (c < 0) return NULL;
+    use_cache = c;
+  }
+  /* Sharded and checkpointed runs do not produce a result to cache. */
+  use_cache = use_cache && (py_shard == Py_None) && !ck_path && !ck_resume;
+
+  if (py_shard != Py_None) {
+    if (!PyArg_ParseTuple(py_shard, "nn", &sh.i, &sh.k)) return NULL;
+    if (!sh.k || sh.i >= sh.k) {
+      PyErr_SetString(PyExc_ValueError, "shard must be a pair (i, k) with 0 <= i < k!");
+      return NULL;
+    }
+    if (!sh.path) {
+      PyErr_SetString(PyExc_ValueError, "sharded inference requires an output path out!");
+      return NULL;
+    }
+    if (ck_path || ck_resume) {
+      PyErr_SetString(PyExc_ValueError, "cannot checkpoint sharded inference!");
+      return NULL;
+    }
+  }
 
   if (!strcmp(psem_arg, "maxent")) { psem = MAXENT_SEMANTICS; }
   else if (strcmp(psem_arg, "credal")) {
@@ -28,23 +87,56 @@ static PyObject* exact(PyObject *self, PyObject *args, PyObject *kwargs) {
     goto cleanup;
   }
 
-  if (!from_python_program(py_P, &p)) return NULL;
+  mem_start(memory_limit);
+  if (!from_python_program(py_P, &p)) { mem_stop(); return NULL; }
+  if (!init_progress(&pg, py_progress, progress_every, "Exact")) goto cleanup;
 
   if (psem == MAXENT_SEMANTICS && p.CF_n > 0) {
     PyErr_SetString(PyExc_ValueError, "cannot have MaxEntropy semantics together with credal facts!");
     goto cleanup;
   }
 
-  if (needs_ground(&p)) {
-    if (!ground_all(&p, NULL)) goto cleanup;
-    if (p.stable) if (!ground_all(p.stable, NULL)) goto cleanup;
+  if (py_shard != Py_None && p.NR_n + p.NA_n > 0) {
+    PyErr_SetString(PyExc_NotImplementedError, "sharded inference is not supported for neural programs!");
+    goto cleanup;
   }
 
+  if (profile) prof_start();
+  trace_start();
+  if (needs_ground(&p)) if (!ground_all(&p, NULL)) goto cleanup;
+
   lstable_sat = lstable_sat && (p.sem == LSTABLE_SEMANTICS);
-  if (!exact_enum(&p, &R, lstable_sat, psem, quiet)) goto cleanup;
+  bool has_neural = p.NR_n + p.NA_n > 0;
+  /* Results of neural programs depend on the test data, which is not part of the key. */
+  use_cache = use_cache && !has_neural;
+  size_t R_n = p.Q_n*(psem == MAXENT_SEMANTICS ? 1 : 2);
+  if (use_cache) {
+    if (!cache_key(&p, psem, lstable_sat, &key)) goto cleanup;
+    /* A hit prints exactly what the enumeration would have. */
+    if (cache_get(&key, cache_dir, R_n, &R)) { print_answers(&p, R, psem, quiet); goto result; }
+  }
+  if (jtree) {
+    bool done;
+    if (!exact_jtree(&p, &R, psem, quiet, &done)) goto cleanup;
+    if (!done) {
+      PyErr_Format(PyExc_NotImplementedError, "junction trees require a normal, acyclic program "
+          "without integrity constraints under the stable semantics, of treewidth at most %d!",
+          JTREE_MAX_WIDTH);
+      goto cleanup;
+    }
+  } else if (!exact_enum(&p, &R, lstable_sat, psem, quiet, (ck_path || ck_resume) ? &ck : NULL,
+        py_shard != Py_None ? &sh : NULL, &pg))
+    goto cleanup;
+  if (py_shard != Py_None) {
+    py_R = Py_None;
+    Py_INCREF(py_R);
+    r = true;
+    goto cleanup;
+  }
+  if (use_cache) cache_put(&key, cache_dir, R_n, R);
 
+result:;
   /* Return result as a numpy array. */
-  bool has_neural = p.NR_n + p.NA_n > 0;
   int nd;
   npy_intp dims[3];
   if (has_neural) {
@@ -63,6 +155,71 @@ static PyObject* exact(PyObject *self, PyObject *args, PyObject *kwargs) {
   r = true;
   goto cleanup;
 cleanup:
+  trace_stop();
+  free_progress_contents(&pg);
+  free_program_contents(&p);
+  if (profile) {
+    /* Always stop profiling, even on error, so that later calls run unprofiled. */
+    py_prof = prof_stop();
+    if (r && py_prof && !mem_stats_into(py_prof)) Py_CLEAR(py_prof);
+  }
+  mem_stop();
+  if (profile) {
+    if (r && py_prof) return Py_BuildValue("NN", py_R, py_prof);
+    Py_XDECREF(py_R); Py_XDECREF(py_prof);
+    return NULL;
+  }
+  return r ? py_R : NULL;
+}
+
+static PyObject* merge(PyObject *self, PyObject *args, PyObject *kwargs) {
+  program_t p = {0};
+  PyObject *py_P, *py_paths, *py_seq = NULL, *py_R = NULL;
+  const char **paths = NULL;
+  double *R = NULL;
+  bool r = false, lstable_sat = true, quiet = false;
+  const char *psem_arg = "credal";
+  psemantics_t psem = CREDAL_SEMANTICS;
+  static char *kwlist[] = { "", "", "lstable_sat", "psemantics", "quiet", NULL };
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|bsb", kwlist, &py_P, &py_paths, &lstable_sat,
+        &psem_arg, &quiet))
+    return NULL;
+
+  if (!strcmp(psem_arg, "maxent")) { psem = MAXENT_SEMANTICS; }
+  else if (strcmp(psem_arg, "credal")) {
+    PyErr_SetString(PyExc_ValueError, "psemantics must either be \"credal\" or \"maxent\"!");
+    return NULL;
+  }
+
+  if (!from_python_program(py_P, &p)) return NULL;
+  lstable_sat = lstable_sat && (p.sem == LSTABLE_SEMANTICS);
+
+  py_seq = PySequence_Fast(py_paths, "paths must be a list of shard file paths!");
+  if (!py_seq) goto cleanup;
+  size_t n = PySequence_Fast_GET_SIZE(py_seq);
+  paths = (const char**) mem_malloc(MEM_OTHER, n*sizeof(const char*));
+  if (!paths) {
+    PyErr_SetString(PyExc_MemoryError, "could not allocate memory for shard paths!");
+    goto cleanup;
+  }
+  for (size_t i = 0; i < n; ++i)
+    if (!(paths[i] = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(py_seq, i)))) goto cleanup;
+
+  if (needs_ground(&p)) if (!ground_all(&p, NULL)) goto cleanup;
+
+  if (!exact_merge(&p, paths, n, &R, psem, lstable_sat, quiet)) goto cleanup;
+
+  npy_intp dims[2] = {p.Q_n, psem == MAXENT_SEMANTICS ? 1 : 2};
+  py_R = PyArray_SimpleNewFromData(2, dims, NPY_DOUBLE, R);
+  if (!py_R) goto cleanup;
+  PyArray_ENABLEFLAGS((PyArrayObject*) py_R, NPY_ARRAY_OWNDATA);
+
+  r = true;
+cleanup:
+  if (!r) free(R);
+  mem_free(MEM_OTHER, paths);
+  Py_XDECREF(py_seq);
   free_program_contents(&p);
   return r ? py_R : NULL;
 }
@@ -73,18 +230,27 @@ static inline PyObject* count(PyObject *self, PyObject *args, PyObject *kwargs)
   count_storage_t C = {0};
   bool ok = false;
   bool lstable_sat = true;
-  static char *kwlist[] = { "", "lstable_sat", NULL };
+  PyObject *py_progress = Py_None;
+  double progress_every = PROGRESS_DEFAULT_INTERVAL;
+  progress_t pg = {0};
+  size_t memory_limit = 0;
+  static char *kwlist[] = { "", "lstable_sat", "progress", "progress_every", "memory_limit", NULL };
   PyObject *py_F, *py_I_F, *py_A, *py_I_A = py_A = py_I_F = py_F = NULL;
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|b", kwlist, &py_P, &lstable_sat)) return NULL;
-  if (!from_python_program(py_P, &P)) return NULL;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|bOdn", kwlist, &py_P, &lstable_sat, &py_progress,
+        &progress_every, &memory_limit))
+    return NULL;
+  mem_start(memory_limit);
+  if (!from_python_program(py_P, &P)) { mem_stop(); return NULL; }
+  if (!init_progress(&pg, py_progress, progress_every, "Counting")) goto cleanup;
 
   lstable_sat = lstable_sat && (P.sem == LSTABLE_SEMANTICS);
-  if (!count_models(&P, lstable_sat, &C)) goto cleanup;
+  trace_start();
+  if (!count_models(&P, lstable_sat, &C, &pg)) goto cleanup;
 
   npy_intp dims[2] = {C.n, 2};
   if (C.n > 0) {
-    py_F = PyArray_SimpleNewFromData(2, dims, NPY_UINT16, C.F);
+    py_F = PyArray_SimpleNewFromData(2, dims, NPY_UINT64, C.F);
     if (!py_F) goto cleanup;
     PyArray_ENABLEFLAGS((PyArrayObject*) py_F, NPY_ARRAY_OWNDATA);
     py_I_F = PyArray_SimpleNewFromData(1, dims, NPY_UINT16, C.I_F);
@@ -96,7 +262,7 @@ static inline PyObject* count(PyObject *self, PyObject *args, PyObject *kwargs)
     if (!py_A) goto cleanup;
     for (size_t i = 0; i < C.m; ++i) {
       dims[0] = P.AD[C.I_A[i]].n;
-      PyObject *py_A_i = PyArray_SimpleNewFromData(1, dims, NPY_UINT16, C.A[i]);
+      PyObject *py_A_i = PyArray_SimpleNewFromData(1, dims, NPY_UINT64, C.A[i]);
       if (!py_A_i) goto cleanup;
       PyArray_ENABLEFLAGS((PyArrayObject*) py_A_i, NPY_ARRAY_OWNDATA);
       PyTuple_SET_ITEM(py_A, i, py_A_i);
@@ -109,22 +275,358 @@ static inline PyObject* count(PyObject *self, PyObject *args, PyObject *kwargs)
 
   ok = true;
 cleanup:
+  trace_stop();
+  mem_stop();
+  free_progress_contents(&pg);
   free_program_contents(&P);
   if (!ok) {
     free_count_storage_contents(&C, true);
     Py_XDECREF(py_F); Py_XDECREF(py_I_F);
     Py_XDECREF(py_A); Py_XDECREF(py_I_A);
+    /* E.g. the progress callback raised. */
+    if (PyErr_Occurred()) return NULL;
     return Py_None;
   }
   return Py_BuildValue("OOOO", py_F ? py_F : Py_None, py_I_F ? py_I_F : Py_None,
       py_A ? py_A : Py_None, py_I_A ? py_I_A : Py_None);
 }
 
+static PyObject* decide(PyObject *self, PyObject *args, PyObject *kwargs) {
+  program_t P = {0};
+  decision_problem_t T = {0};
+  PyObject *py_P, *py_R = NULL, *py_d = NULL, *py_progress = Py_None, *py_prof = NULL;
+  double *R = NULL, progress_every = PROGRESS_DEFAULT_INTERVAL;
+  const char *psem_arg = "maxent";
+  psemantics_t psem = MAXENT_SEMANTICS;
+  size_t memory_limit = 0;
+  progress_t pg = {0};
+  bool ok = false, profile = false;
+  static char *kwlist[] = { "", "psemantics", "progress", "progress_every", "memory_limit",
+    "profile", NULL };
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|sOdnb", kwlist, &py_P, &psem_arg, &py_progress,
+        &progress_every, &memory_limit, &profile))
+    return NULL;
+  if (!strcmp(psem_arg, "credal")) { psem = CREDAL_SEMANTICS; }
+  else if (strcmp(psem_arg, "maxent")) {
+    PyErr_SetString(PyExc_ValueError, "psemantics must either be \"credal\" or \"maxent\"!");
+    return NULL;
+  }
+
+  mem_start(memory_limit);
+  if (!from_python_program(py_P, &P)) { mem_stop(); return NULL; }
+  if (!from_python_decision_problem(py_P, &T)) goto cleanup;
+  if (!init_progress(&pg, py_progress, progress_every, "Decision")) goto cleanup;
+
+  if (!T.D_n) {
+    PyErr_SetString(PyExc_ValueError, "program has no decision facts!");
+    goto cleanup;
+  }
+  if (T.D_n > DECISION_MAX) {
+    PyErr_Format(PyExc_ValueError, "programs can have at most %d decision facts!", DECISION_MAX);
+    goto cleanup;
+  }
+  if (P.sem != STABLE_SEMANTICS) {
+    PyErr_SetString(PyExc_NotImplementedError, "decisions are only supported under the stable "
+        "semantics!");
+    goto cleanup;
+  }
+  if (P.CF_n + P.NR_n + P.NA_n > 0) {
+    PyErr_SetString(PyExc_NotImplementedError, "decisions are not supported together with credal "
+        "facts or neural components!");
+    goto cleanup;
+  }
+
+  if (profile) prof_start();
+  trace_start();
+  if (needs_ground(&P)) if (!ground_all(&P, NULL)) goto cleanup;
+  if (!decision_enum(&P, &T, psem, &R, &pg)) goto cleanup;
+
+  long b = decision_best(&T, psem, R);
+  if (b < 0) {
+    PyErr_SetString(PyExc_ValueError, "every decision is inconsistent with the program!");
+    goto cleanup;
+  }
+  py_d = PyTuple_New(T.D_n);
+  if (!py_d) goto cleanup;
+  for (size_t i = 0; i < T.D_n; ++i) PyTuple_SET_ITEM(py_d, i, PyBool_FromLong((b >> i) & 1));
+
+  npy_intp dims[2] = {(npy_intp) 1 << T.D_n, psem == MAXENT_SEMANTICS ? 1 : 2};
+  py_R = PyArray_SimpleNewFromData(2, dims, NPY_DOUBLE, R);
+  if (!py_R) goto cleanup;
+  PyArray_ENABLEFLAGS((PyArrayObject*) py_R, NPY_ARRAY_OWNDATA);
+  R = NULL;
+
+  ok = true;
+cleanup:
+  trace_stop();
+  free_progress_contents(&pg);
+  free_decision_problem_contents(&T);
+  free_program_contents(&P);
+  mem_free(MEM_RESULTS, R);
+  if (profile) {
+    py_prof = prof_stop();
+    if (ok && py_prof && !mem_stats_into(py_prof)) Py_CLEAR(py_prof);
+    ok = ok && py_prof;
+  }
+  mem_stop();
+  if (!ok) {
+    Py_XDECREF(py_d); Py_XDECREF(py_R); Py_XDECREF(py_prof);
+    return NULL;
+  }
+  if (profile) return Py_BuildValue("NNN", py_d, py_R, py_prof);
+  return Py_BuildValue("NN", py_d, py_R);
+}
+
+/* Parses the atoms in the list of strings py_L into *A (of *n elements, allocated with MEM_PROGRAM).
+ * If S is not NULL, atoms may be prefixed with "not ", in which case (*S)[i] is false. */
+static bool atoms_from_python(PyObject *py_L, const char *what, clingo_symbol_t **A, bool **S,
+    size_t *n) {
+  PyObject *py_F = PySequence_Fast(py_L, "atoms must be given as a list or tuple of strings!");
+  bool ok = false;
+
+  if (!py_F) return false;
+  *n = PySequence_Fast_GET_SIZE(py_F);
+  *A = (clingo_symbol_t*) mem_malloc(MEM_PROGRAM, (*n ? *n : 1)*sizeof(clingo_symbol_t));
+  if (S) *S = (bool*) mem_malloc(MEM_PROGRAM, *n ? *n : 1);
+  if (!*A || (S && !*S)) {
+    mem_raise(what);
+    goto cleanup;
+  }
+  for (size_t i = 0; i < *n; ++i) {
+    const char *a = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(py_F, i));
+    if (!a) goto cleanup;
+    bool t = true;
+    if (S && !strncmp(a, "not ", 4)) { t = false; a += 4; }
+    if (!clingo_parse_term(a, NULL, NULL, 20, &(*A)[i])) {
+      raise_clingo_error(NULL);
+      goto cleanup;
+    }
+    if (S) (*S)[i] = t;
+  }
+
+  ok = true;
+cleanup:
+  Py_DECREF(py_F);
+  if (!ok) {
+    mem_free(MEM_PROGRAM, *A); *A = NULL;
+    if (S) { mem_free(MEM_PROGRAM, *S); *S = NULL; }
+  }
+  return ok;
+}
+
+static PyObject* marginals(PyObject *self, PyObject *args, PyObject *kwargs) {
+  program_t P = {0};
+  marginal_query_t M = {0};
+  PyObject *py_P, *py_atoms = Py_None, *py_evidence = Py_None, *py_progress = Py_None;
+  PyObject *py_A = NULL, *py_R = NULL, *py_prof = NULL;
+  double *R = NULL, progress_every = PROGRESS_DEFAULT_INTERVAL;
+  const char *psem_arg = "credal";
+  psemantics_t psem = CREDAL_SEMANTICS;
+  size_t memory_limit = 0;
+  progress_t pg = {0};
+  string_t buf = {0};
+  bool ok = false, profile = false;
+  static char *kwlist[] = { "", "atoms", "evidence", "psemantics", "progress", "progress_every",
+    "memory_limit", "profile", NULL };
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOsOdnb", kwlist, &py_P, &py_atoms,
+        &py_evidence, &psem_arg, &py_progress, &progress_every, &memory_limit, &profile))
+    return NULL;
+  if (!strcmp(psem_arg, "maxent")) { psem = MAXENT_SEMANTICS; }
+  else if (strcmp(psem_arg, "credal")) {
+    PyErr_SetString(PyExc_ValueError, "psemantics must either be \"credal\" or \"maxent\"!");
+    return NULL;
+  }
+
+  mem_start(memory_limit);
+  if (!from_python_program(py_P, &P)) { mem_stop(); return NULL; }
+  if (!init_progress(&pg, py_progress, progress_every, "Marginals")) goto cleanup;
+
+  if (P.sem != STABLE_SEMANTICS) {
+    PyErr_SetString(PyExc_NotImplementedError, "marginals are only supported under the stable "
+        "semantics!");
+    goto cleanup;
+  }
+  if (P.CF_n + P.NR_n + P.NA_n > 0) {
+    PyErr_SetString(PyExc_NotImplementedError, "marginals are not supported together with credal "
+        "facts or neural components!");
+    goto cleanup;
+  }
+  if ((py_evidence != Py_None) && !atoms_from_python(py_evidence, "evidence", &M.E, &M.E_s,
+        &M.E_n)) goto cleanup;
+
+  if (profile) prof_start();
+  trace_start();
+  if (needs_ground(&P)) if (!ground_all(&P, NULL)) goto cleanup;
+  if (py_atoms == Py_None) { if (!marginal_atoms(&P, &M.A, &M.n)) goto cleanup; }
+  else if (!atoms_from_python(py_atoms, "atoms", &M.A, NULL, &M.n)) goto cleanup;
+  if (!marginal_enum(&P, &M, psem, &R, &pg)) goto cleanup;
+
+  py_A = PyList_New(M.n);
+  if (!py_A) goto cleanup;
+  for (size_t i = 0; i < M.n; ++i) {
+    if (!string_from_symbol(M.A[i], &buf)) { raise_clingo_error(NULL); goto cleanup; }
+    PyObject *py_a = PyUnicode_FromString(buf.s);
+    if (!py_a) goto cleanup;
+    PyList_SET_ITEM(py_A, i, py_a);
+  }
+
+  npy_intp dims[2] = {M.n, psem == MAXENT_SEMANTICS ? 1 : 2};
+  py_R = PyArray_SimpleNewFromData(2, dims, NPY_DOUBLE, R);
+  if (!py_R) goto cleanup;
+  PyArray_ENABLEFLAGS((PyArrayObject*) py_R, NPY_ARRAY_OWNDATA);
+  R = NULL;
+
+  ok = true;
+cleanup:
+  trace_stop();
+  string_free(&buf);
+  free_progress_contents(&pg);
+  free_program_contents(&P);
+  mem_free(MEM_PROGRAM, M.A);
+  mem_free(MEM_PROGRAM, M.E);
+  mem_free(MEM_PROGRAM, M.E_s);
+  mem_free(MEM_RESULTS, R);
+  if (profile) {
+    py_prof = prof_stop();
+    if (ok && py_prof && !mem_stats_into(py_prof)) Py_CLEAR(py_prof);
+    ok = ok && py_prof;
+  }
+  mem_stop();
+  if (!ok) {
+    Py_XDECREF(py_A); Py_XDECREF(py_R); Py_XDECREF(py_prof);
+    return NULL;
+  }
+  if (profile) return Py_BuildValue("NNN", py_A, py_R, py_prof);
+  return Py_BuildValue("NN", py_A, py_R);
+}
+
+static PyObject* bp(PyObject *self, PyObject *args, PyObject *kwargs) {
+  program_t P = {0};
+  PyObject *py_P, *py_R = NULL;
+  double *R = NULL, damping = BP_DEFAULT_DAMPING, tol = BP_DEFAULT_TOL;
+  const char *psem_arg = "credal";
+  psemantics_t psem = CREDAL_SEMANTICS;
+  size_t max_iters = BP_DEFAULT_MAX_ITERS, memory_limit = 0, iters;
+  bool ok = false, quiet = false, done, converged;
+  static char *kwlist[] = { "", "psemantics", "damping", "max_iters", "tol", "quiet",
+    "memory_limit", NULL };
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|sdndbn", kwlist, &py_P, &psem_arg, &damping,
+        &max_iters, &tol, &quiet, &memory_limit))
+    return NULL;
+  if (!strcmp(psem_arg, "maxent")) { psem = MAXENT_SEMANTICS; }
+  else if (strcmp(psem_arg, "credal")) {
+    PyErr_SetString(PyExc_ValueError, "psemantics must either be \"credal\" or \"maxent\"!");
+    return NULL;
+  }
+  if (!(damping >= 0 && damping < 1)) {
+    PyErr_SetString(PyExc_ValueError, "damping must be in [0, 1)!");
+    return NULL;
+  }
+  if (!max_iters) {
+    PyErr_SetString(PyExc_ValueError, "max_iters must be positive!");
+    return NULL;
+  }
+
+  mem_start(memory_limit);
+  if (!from_python_program(py_P, &P)) { mem_stop(); return NULL; }
+
+  trace_start();
+  if (needs_ground(&P)) if (!ground_all(&P, NULL)) goto cleanup;
+  if (!approx_bp(&P, &R, psem, damping, max_iters, tol, quiet, &done, &iters, &converged))
+    goto cleanup;
+  if (!done) {
+    PyErr_SetString(PyExc_NotImplementedError, "belief propagation requires a normal, acyclic "
+        "program without integrity constraints, credal facts or neural components under the "
+        "stable semantics!");
+    goto cleanup;
+  }
+  if (!converged && !quiet)
+    wprintf(L"Warning: belief propagation did not converge within %zu iterations. Probabilities "
+        "may be inaccurate.\n", max_iters);
+
+  npy_intp dims[2] = {P.Q_n, psem == MAXENT_SEMANTICS ? 1 : 2};
+  py_R = PyArray_SimpleNewFromData(2, dims, NPY_DOUBLE, R);
+  if (!py_R) goto cleanup;
+  PyArray_ENABLEFLAGS((PyArrayObject*) py_R, NPY_ARRAY_OWNDATA);
+  R = NULL;
+
+  ok = true;
+cleanup:
+  trace_stop();
+  free_program_contents(&P);
+  mem_free(MEM_RESULTS, R);
+  mem_stop();
+  return ok ? py_R : NULL;
+}
+
+static PyObject* py_cache_stats(PyObject *self, PyObject *args) { return cache_stats(); }
+
+static PyObject* py_cache_clear(PyObject *self, PyObject *args) {
+  cache_clear();
+  Py_RETURN_NONE;
+}
+
 static PyMethodDef CexactMethods[] = {
   {"exact", (PyCFunction)(void(*)(void)) exact, METH_VARARGS | METH_KEYWORDS,
-    "Runs exact inference in order to answer the queries in `P`."},
+    "Runs exact inference in order to answer the queries in `P`. If `checkpoint` is a path, the "
+    "enumeration state is saved to it every `checkpoint_every` seconds; `resume` continues from "
+    "such a checkpoint. If `shard = (i, k)`, only the i-th of k slices of the total choices is "
+    "enumerated and its partial aggregates written to `out`; see `merge`. If `profile` is set, "
+    "returns a pair whose second element is a dict of per-phase timings and event counts (totals "
+    "under \"phases\", per thread under \"threads\") and of clingo statistics (under \"clingo\"). "
+    "If `progress` is True, a progressbar with throughput is shown on stderr; if it is a callable, "
+    "it is called every `progress_every` seconds with a dict of keys \"done\", \"total\", "
+    "\"mass\", \"models\", \"models_per_s\", \"elapsed\" and \"eta\". If `memory_limit` is "
+    "positive, at most that many bytes are allocated: when reached, credal polynomials are "
+    "compacted and fewer workers are used, and a MemoryError is raised if that does not suffice. "
+    "Peak and current bytes per subsystem are reported in the profile dict under \"memory\". "
+    "If `cache` is True, results are looked up in (and stored to) an in-process cache keyed by a "
+    "hash of the ground program, its parameters, queries and semantics; if it is a path to a "
+    "directory, results are also shared on disk across processes. See `cache_stats`. `engine` "
+    "selects how queries are answered: \"enum\" (the default) enumerates total choices, while "
+    "\"jtree\" propagates over a junction tree, which is exponential in the treewidth instead of "
+    "in the number of facts but requires a normal, acyclic program of small treewidth (else "
+    "NotImplementedError is raised) and reports no progress."},
+  {"merge", (PyCFunction)(void(*)(void)) merge, METH_VARARGS | METH_KEYWORDS,
+    "Merges the shard files written by `exact(P, shard = (i, k), out = path)` for every i and "
+    "answers the queries in `P`. `lstable_sat` and `psemantics` must match those the shards were "
+    "written with, and `P` the program they were written for; otherwise ValueError is raised."},
   {"count", (PyCFunction)(void(*)(void)) count, METH_VARARGS | METH_KEYWORDS,
-    "Counts the number of models for each possible learnable fact or annotated disjunction."},
+    "Counts the number of models for each possible learnable fact or annotated disjunction. "
+    "`progress`, `progress_every` and `memory_limit` are as in `exact`."},
+  {"decide", (PyCFunction)(void(*)(void)) decide, METH_VARARGS | METH_KEYWORDS,
+    "Finds the decision of highest expected utility of a program with utility attributes "
+    "`utility(l, v).` and decision facts `?::d.`. Returns a pair whose first element is a tuple "
+    "with the truth value of each decision in `P.D`, and whose second is the array of expected "
+    "utilities of every decision, where row k assigns true to the i-th decision iff the i-th bit "
+    "of k is set. Under `psemantics = \"credal\"`, rows hold the lower and upper expected "
+    "utilities, and the decision of highest lower expected utility is chosen. Inconsistent "
+    "decisions have NaN utility. `progress`, `progress_every`, `memory_limit` and `profile` are "
+    "as in `exact`; if `profile` is set, the profile is appended to the returned pair."},
+  {"marginals", (PyCFunction)(void(*)(void)) marginals, METH_VARARGS | METH_KEYWORDS,
+    "Computes the probability of every atom in `atoms` (by default, every atom of the Herbrand "
+    "base of `P` whose name does not start with an underscore) given `evidence`, a list of "
+    "atoms each optionally prefixed with \"not \", in a single enumeration of the total choices. "
+    "Returns a pair whose first element is the list of atoms and whose second is an array whose "
+    "i-th row holds the lower and upper probability of the i-th atom, or its sole probability "
+    "under `psemantics = \"maxent\"`. `progress`, `progress_every`, `memory_limit` and `profile` "
+    "are as in `exact`; if `profile` is set, the profile is appended to the returned pair."},
+  {"bp", (PyCFunction) (void(*)(void)) bp, METH_VARARGS | METH_KEYWORDS,
+    "Approximates the queries of a normal, acyclic program without integrity constraints by loopy "
+    "belief propagation over the factor graph of its ground program, returning an array as "
+    "`exact`. Each iteration mixes every message with a weight of `damping` of its previous "
+    "value, until no message changes by more than `tol` or `max_iters` is reached, in which case "
+    "a warning is printed unless `quiet` is set. Results are exact if the factor graph is a tree. "
+    "Raises NotImplementedError for other programs. `memory_limit` is as in `exact`."},
+  {"cache_stats", py_cache_stats, METH_NOARGS,
+    "Returns the counters of the result cache used by `exact(P, cache = ...)`: \"hits\" (in "
+    "process), \"disk_hits\", \"misses\", \"stores\", and the number of \"entries\" kept in "
+    "process out of \"capacity\"."},
+  {"cache_clear", py_cache_clear, METH_NOARGS,
+    "Empties the in-process result cache and resets its counters. Files on disk are kept."},
   {NULL, NULL, 0, NULL},
 };
 
@@ -2,7 +2,7 @@ import pathlib, enum, math, collections.abc
 import lark, lark.reconstruct, clingo, numpy
 from numpy import ascontiguousarray as contiguous
 from .program import ProbFact, Query, ProbRule, Program, CredalFact, unique_fact, Semantics, Data
-from .program import AnnotatedDisjunction, NeuralRule, NeuralAD, unique_pgrule_id
+from .program import AnnotatedDisjunction, NeuralRule, NeuralAD, unique_pgrule_id, Utility, Decision
 
 def read(*files: str, G: lark.Lark = None, from_str: bool = False, start = "plp") -> lark.Tree:
   "Read all `files` and parse them with grammar `G`, returning a single `lark.Tree`."
@@ -172,6 +172,7 @@ class StableTransformer(lark.Transformer):
     return self.pack("VAR", x, scope = X)
   def ID(self, i): return self.pack("ID", val = int(i))
   def OP(self, o): return self.pack("OP", str(o))
+  def SUB(self, s): return self.pack("SUB", str(s))
   def REAL(self, r): return self.pack("REAL", val = float(r))
   def frac(self, f): return self.pack("frac", val = f[0][2]/f[1][2])
   def prob(self, p): return self.pack("prob", val = p[0][2])
@@ -233,9 +234,18 @@ class StableTransformer(lark.Transformer):
     return self.pack("cfact", "", CredalFact(l, u, f))
   def lpfact(self, PF):
     if PF[0][0] == "prob": p, f = PF[0][2], PF[1][1]
-    else: p, f = 0.5, PF[0][1]
+    else:
+      # Without a prior, ?::f. is a decision in programs with utilities (see plp).
+      f = PF[0][1]
+      return self.pack("dfact", "", (ProbFact(0.5, f, learnable = True), Decision(f)))
     return self.pack("pfact", "", ProbFact(p, f, learnable = True))
 
+  # Utility attributes.
+  def utility(self, U):
+    neg = U[0][0] == "NEG"
+    v = U[-1][2]
+    return self.pack("utility", "", Utility(U[int(neg)][1], -v if U[-2][0] == "SUB" else v, neg))
+
   # Heads.
   def head(self, H): return self.pack("head", ", ".join(getnths(H, 1)), H, self.join_scope(H))
   def ohead(self, H): return self.pack("head", H[0][1], H[0][2], H[0][3])
@@ -485,17 +495,28 @@ class StableTransformer(lark.Transformer):
     D = {}
     # Actual neural rules and neural ADs.
     NR, NA = [], []
+    # Utility attributes and decision facts.
+    U, DF = [], []
     # Directives.
     directives = {}
     # Mapping.
-    M = {"pfact": PF, "prule": PR, "query": Q, "cfact": CF, "ad": AD, "nrule": TNR, "nad": TNA}
+    M = {"pfact": PF, "prule": PR, "query": Q, "cfact": CF, "ad": AD, "nrule": TNR, "nad": TNA,
+         "utility": U}
     for t, L, O, _ in C:
       if len(L) > 0: push(P, L)
       if t in M: push(M[t], O)
+      if t == "dfact": DF.append(O)
       if t == "data":
         if O.name in D: D[O.name].append(O)
         else: D[O.name] = [O]
       if t == "directive": directives[O[0]] = tup if len(tup := O[1:]) > 1 else tup[0]
+    # Decisions are chosen freely by every model, which then tells which decision it answers to.
+    DC = []
+    for pf, d in DF:
+      if len(U) > 0:
+        DC.append(d)
+        P.append(f"{{{d.f}}}.")
+      else: PF.append(pf)
     # Deal with ungrounded probabilistic rules.
     for r in PR:
       if r.is_prop: PF.append(r.prop_pf)
@@ -503,7 +524,7 @@ class StableTransformer(lark.Transformer):
     self.register_nrule(TNR, NR, D)
     self.register_nad(TNA, NA, D)
     return Program("\n".join(P), PF, PR, Q, CF, AD, NR, NA, semantics = self.sem, \
-                   directives = directives)
+                   directives = directives, U = U, D = DC)
 
 class PartialTransformer(StableTransformer):
   def __init__(self, sem: str, consts: dict = {}):
@@ -515,7 +536,6 @@ class PartialTransformer(StableTransformer):
       self.sem = Semantics.SMPROBLOG
     else:
       self.sem = Semantics.PARTIAL
-    self.o_tree = None
 
   @staticmethod
   def has_binop(x: str): return ("=" in x) or ("<" in x) or (">" in x)
@@ -530,6 +550,9 @@ class PartialTransformer(StableTransformer):
     self.PT.add(T[2].f)
     return T
 
+  def utility(self, U):
+    raise ValueError("utility attributes are only supported under the stable semantics!")
+
   def cfact(self, CF):
     T = super().cfact(CF)
     self.PT.add(T[2].f)
@@ -594,19 +617,19 @@ class PartialTransformer(StableTransformer):
     # Mapping.
     M = {"pfact": PF, "prule": PR, "query": Q, "cfact": CF, "ad": AD}
     for t, L, O, _ in C:
+      if t == "dfact": PF.append(O[0])
       if len(L) > 0: push(P, L)
       if t in M: push(M[t], O)
       if t == "prule" and isinstance(O, collections.abc.Iterable) and O[0].is_prop:
         PF.append(O[0].prop_pf)
       if t == "directive": directives[O[0]] = tup if len(tup := O[1:]) > 1 else tup[0]
     P.extend(f"_{x} :- {x}." for x in self.PT)
+    # Totality constraints, only active when the solver assumes __total_model. This lets a single
+    # grounding answer both whether a total model exists and which models to enumerate.
+    P.append("#external __total_model.")
+    P.extend(f":- __total_model, _{x}, not {x}." for x in self.PT)
     return Program("\n".join(P), PF, PR, Q, CF, AD, NR, NA, semantics = self.sem, \
-                   stable_p = self.stable_p, directives = directives)
-
-  def transform(self, tree):
-    self.o_tree = tree
-    self.stable_p = StableTransformer(self.sem).transform(tree)
-    return super().transform(tree)
+                   directives = directives)
 
 def parse(*files: str, G: lark.Lark = None, from_str: bool = False, semantics: str = "stable") -> Program:
   """Either parses `streams` as blocks of text containing the PLP when `from_str = True`, or
@@ -8,6 +8,8 @@
 
 #include "cground.h"
 #include "cprogram.h"
+#include "cprofile.h"
+#include "ctrace.h"
 
 #define ALG_FIXPOINT_S "fixpoint"
 #define ALG_LAGRANGE_S "lagrange"
@@ -22,15 +24,16 @@ static PyObject* learn(PyObject *self, PyObject *args, PyObject *kwargs) {
   PyObject *py_P, *py_obs, *py_obs_counts, *py_atoms;
   PyArrayObject *obs, *obs_counts, *atoms;
   bool ok = false;
-  bool lstable_sat = true;
+  bool lstable_sat = true, accel = false;
   size_t niters = 30;
   const char *alg_s = ALG_FIXPOINT_S, *display_s = DISPLAY_LOGLIKELIHOOD_S;
   uint8_t alg = ALG_LAGRANGE, display = DISPLAY_LOGLIKELIHOOD;
   double eta = 0.1;
-  static char *kwlist[] = { "", "", "", "", "niters", "alg", "lr", "lstable_sat", "display", NULL };
+  static char *kwlist[] = { "", "", "", "", "niters", "alg", "lr", "lstable_sat", "display", "accel",
+    NULL };
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOO|nsdbs", kwlist, &py_P, &py_obs,
-        &py_obs_counts, &py_atoms, &niters, &alg_s, &eta, &lstable_sat, &display_s))
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOO|nsdbsb", kwlist, &py_P, &py_obs,
+        &py_obs_counts, &py_atoms, &niters, &alg_s, &eta, &lstable_sat, &display_s, &accel))
     return NULL;
 
   if (!PyArray_Check(py_obs) || !PyArray_Check(py_obs_counts) || !PyArray_Check(py_atoms)) {
@@ -74,6 +77,10 @@ static PyObject* learn(PyObject *self, PyObject *args, PyObject *kwargs) {
     PyErr_SetString(PyExc_ValueError, "alg must either be \"fixpoint\", \"lagrange\" or \"neurasp\"!");
     return NULL;
   }
+  if (accel && alg != ALG_FIXPOINT) {
+    PyErr_SetString(PyExc_ValueError, "accel is only supported by alg = \"fixpoint\"!");
+    return NULL;
+  }
 
   if (!strcmp(display_s, DISPLAY_NONE_S)) display = DISPLAY_NONE;
   else if (!strcmp(display_s, DISPLAY_PROGRESS_S)) display = DISPLAY_PROGRESS;
@@ -85,10 +92,12 @@ static PyObject* learn(PyObject *self, PyObject *args, PyObject *kwargs) {
 
   if (!from_python_program(py_P, &P)) return NULL;
 
+  trace_start();
   lstable_sat = lstable_sat && (P.sem == LSTABLE_SEMANTICS);
   switch(alg) {
     case ALG_FIXPOINT:
-      if (!learn_fixpoint(&P, obs, obs_counts, atoms, niters, lstable_sat, display)) goto cleanup;
+      if (!learn_fixpoint(&P, obs, obs_counts, atoms, niters, lstable_sat, accel, display))
+        goto cleanup;
       break;
     case ALG_LAGRANGE:
       if (!learn_lagrange(&P, obs, obs_counts, atoms, niters, eta, lstable_sat, display)) goto cleanup;
@@ -100,6 +109,7 @@ static PyObject* learn(PyObject *self, PyObject *args, PyObject *kwargs) {
 
   ok = true;
 cleanup:
+  trace_stop();
   free_program_contents(&P);
   return ok ? Py_None : NULL;
 }
@@ -109,16 +119,23 @@ static PyObject* learn_batch(PyObject *self, PyObject *args, PyObject *kwargs) {
   PyObject *py_P, *py_obs;
   PyArrayObject *obs;
   bool ok = false, free_obs = false;
-  bool lstable_sat = true;
+  bool lstable_sat = true, profile = false, accel = false;
   size_t niters = 30, batch = 100;
   const char *alg_s = ALG_FIXPOINT_S, *display_s = DISPLAY_LOGLIKELIHOOD_S;
   uint8_t alg = ALG_FIXPOINT, display = DISPLAY_LOGLIKELIHOOD;
   double eta = 0.1, smooth = 1e-4;
-  static char *kwlist[] = { "", "", "niters", "alg", "lr", "batch", "smoothing", "lstable_sat", "display", NULL };
-
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|nsdndbs", kwlist, &py_P, &py_obs, &niters,
-        &alg_s, &eta, &batch, &smooth, &lstable_sat, &display_s))
+  const char *ck_path = NULL, *ck_resume = NULL;
+  size_t ck_every = CHECKPOINT_DEFAULT_INTERVAL;
+  checkpoint_t ck, *ck_p;
+  static char *kwlist[] = { "", "", "niters", "alg", "lr", "batch", "smoothing", "lstable_sat", "display",
+    "checkpoint", "checkpoint_every", "resume", "profile", "accel", NULL };
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|nsdndbsznzbb", kwlist, &py_P, &py_obs, &niters,
+        &alg_s, &eta, &batch, &smooth, &lstable_sat, &display_s, &ck_path, &ck_every, &ck_resume,
+        &profile, &accel))
     return NULL;
+  init_checkpoint(&ck, ck_path, ck_resume, ck_every);
+  ck_p = (ck_path || ck_resume) ? &ck : NULL;
 
   if (!PyArray_Check(py_obs)) {
     if (!ll2array(py_obs, &obs)) {
@@ -145,6 +162,10 @@ static PyObject* learn_batch(PyObject *self, PyObject *args, PyObject *kwargs) {
     PyErr_SetString(PyExc_ValueError, "alg must either be \"fixpoint\", \"lagrange\" or \"neurasp\"!");
     return NULL;
   }
+  if (accel && alg != ALG_FIXPOINT) {
+    PyErr_SetString(PyExc_ValueError, "accel is only supported by alg = \"fixpoint\"!");
+    return NULL;
+  }
 
   if (!strcmp(display_s, DISPLAY_NONE_S)) display = DISPLAY_NONE;
   else if (!strcmp(display_s, DISPLAY_PROGRESS_S)) display = DISPLAY_PROGRESS;
@@ -156,31 +177,45 @@ static PyObject* learn_batch(PyObject *self, PyObject *args, PyObject *kwargs) {
 
   if (!from_python_program(py_P, &P)) return NULL;
 
+  if (profile) prof_start();
+  trace_start();
   lstable_sat = lstable_sat && (P.sem == LSTABLE_SEMANTICS);
   switch(alg) {
     case ALG_FIXPOINT:
-      if (!learn_fixpoint_batch(&P, obs, niters, batch, smooth, lstable_sat, display)) goto cleanup;
+      if (!learn_fixpoint_batch(&P, obs, niters, batch, smooth, lstable_sat, accel, display, ck_p))
+        goto cleanup;
       break;
     case ALG_LAGRANGE:
-      if (!learn_lagrange_batch(&P, obs, niters, eta, batch, smooth, lstable_sat, display)) goto cleanup;
+      if (!learn_lagrange_batch(&P, obs, niters, eta, batch, smooth, lstable_sat, display, ck_p)) goto cleanup;
       break;
     case ALG_NEURASP:
-      if (!learn_neurasp_batch(&P, obs, niters, eta, batch, smooth, lstable_sat, display)) goto cleanup;
+      if (!learn_neurasp_batch(&P, obs, niters, eta, batch, smooth, lstable_sat, display, ck_p)) goto cleanup;
       break;
   }
 
   ok = true;
 cleanup:
+  trace_stop();
   free_program_contents(&P);
   if (free_obs) Py_XDECREF(obs);
+  if (profile) {
+    PyObject *py_prof = prof_stop();
+    if (ok) return py_prof;
+    Py_XDECREF(py_prof);
+    return NULL;
+  }
   return ok ? Py_None : NULL;
 }
 
 static PyMethodDef ClearnMethods[] = {
   {"learn", (PyCFunction) (void(*)(void)) learn, METH_VARARGS | METH_KEYWORDS,
-    "Learns a program given data."},
+    "Learns a program given data. If `accel` is set, fixpoint learning is accelerated by SQUAREM "
+    "extrapolation."},
   {"learn_batch", (PyCFunction) (void(*)(void)) learn_batch, METH_VARARGS | METH_KEYWORDS,
-    "Learns a program given data in batch mode."},
+    "Learns a program given data in batch mode. If `checkpoint` is a path, the learning state is "
+    "saved to it every `checkpoint_every` seconds; `resume` continues from such a checkpoint. If "
+    "`profile` is set, returns per-phase timings as in `exact`. `accel` is as in `learn`, and "
+    "requires a single batch."},
   {NULL, NULL, 0, NULL},
 };
 
@@ -75,6 +75,35 @@ class CredalFact:
   def __str__(self) -> str: return f"[{self.l}, {self.u}]::{self.f}"
   def __repr__(self) -> str: return self.__str__()
 
+class Utility:
+  """
+  A utility attribute `utility(l, v).` rewards every model where literal `l` holds with utility `v`.
+  The utility of a model is the sum of the utilities of the literals it satisfies.
+  """
+
+  def __init__(self, f: str, v: float, neg: bool = False):
+    self.f = f
+    self.v = float(v)
+    self.neg = neg
+    self.cl_f = clingo.parse_term(f)
+
+  def __str__(self) -> str: return f"utility({'not ' if self.neg else ''}{self.f}, {self.v})"
+  def __repr__(self) -> str: return self.__str__()
+
+class Decision:
+  """
+  A decision fact `?::d.` is a fact whose truth value is chosen by the decision maker, as opposed to
+  a probabilistic fact, chosen by nature. Outside programs with utility attributes, `?::d.` is a
+  learnable probabilistic fact instead.
+  """
+
+  def __init__(self, f: str):
+    self.f = f
+    self.cl_f = clingo.parse_term(f)
+
+  def __str__(self) -> str: return f"?::{self.f}"
+  def __repr__(self) -> str: return self.__str__()
+
 def _str_query_assignment(f: Function, t: bool) -> str:
   """
   String formats a query tuple `(f, t)`, where `f` is an atom and `t` is whether it should appear
@@ -305,8 +334,8 @@ class Program:
 
   def __init__(self, P: str, PF: list[ProbFact], PR: list[ProbRule], Q: list[Query], \
                CF: list[CredalFact], AD: list[AnnotatedDisjunction], NR: list[NeuralRule], \
-               NA: list[NeuralAD], semantics: Semantics = Semantics.STABLE, stable_p = None, \
-               directives: list = None):
+               NA: list[NeuralAD], semantics: Semantics = Semantics.STABLE, \
+               directives: list = None, U: list[Utility] = None, D: list[Decision] = None):
     """
     Constructs a PLP out of a logic program `P`, probabilistic facts `PF`, credal facts `CF` and
     queries `Q`.
@@ -319,6 +348,9 @@ class Program:
     self.AD = AD
     self.NR = NR
     self.NA = NA
+    # Utility attributes and decision facts.
+    self.U = [] if U is None else U
+    self.D = [] if D is None else D
 
     # Number of instances in data.
     self.m_test = 0
@@ -333,7 +365,6 @@ class Program:
     self.gr_P = ""
 
     self.semantics = semantics
-    self.stable = stable_p
 
     self.directives = directives
 
@@ -361,6 +392,8 @@ class Program:
            self.str_if_contains("Probabilistic Rules", self.PR) + \
            self.str_if_contains("Neural Rules", self.NR) + \
            self.str_if_contains("Neural Annotated Disjunctions", self.NA) + \
+           self.str_if_contains("Utilities", self.U) + \
+           self.str_if_contains("Decisions", self.D) + \
            f"\nQueries:\n{self.Q}>"
   def __repr__(self) -> str: return self.__str__()
 
@@ -6,19 +6,32 @@
 #include "csample.h"
 #include "cground.h"
 #include "cprogram.h"
+#include "cprofile.h"
+#include "ctrace.h"
+#include "cmem.h"
 
 static PyObject* sample(PyObject *self, PyObject *args, PyObject *kwargs) {
   program_t P = {0};
-  PyObject *py_P, *py_atoms, *ret;
-  PyArrayObject *atoms = NULL;
+  PyObject *py_P, *py_atoms, *ret = NULL, *py_prof, *py_params = Py_None;
+  PyArrayObject *atoms = NULL, *params = NULL;
   bool ok = false, free_atoms = false;
-  bool lstable_sat = true;
-  size_t n = 1;
-  static char *kwlist[] = { "", "", "n", "lstable_sat", NULL };
+  bool lstable_sat = true, profile = false;
+  size_t n = 1, memory_limit = 0;
+  static char *kwlist[] = { "", "", "n", "lstable_sat", "profile", "memory_limit", "params",
+    NULL };
 
-  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|nb", kwlist, &py_P, &py_atoms, &n, &lstable_sat))
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|nbbnO", kwlist, &py_P, &py_atoms, &n,
+        &lstable_sat, &profile, &memory_limit, &py_params))
     return NULL;
 
+  if (py_params != Py_None) {
+    params = (PyArrayObject*) PyArray_FROM_OTF(py_params, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    if (!params) {
+      PyErr_SetString(PyExc_ValueError, "could not parse params as a numpy.ndarray of floats!");
+      goto cleanup;
+    }
+  }
+
   if (!PyArray_Check(py_atoms)) {
     atoms = (PyArrayObject*) PyArray_FROM_OTF(py_atoms, NPY_STRING, NPY_ARRAY_IN_ARRAY);
     if (!atoms) {
@@ -38,25 +51,43 @@ static PyObject* sample(PyObject *self, PyObject *args, PyObject *kwargs) {
     goto cleanup;
   }
 
+  mem_start(memory_limit);
   if (!from_python_program(py_P, &P)) goto cleanup;
-  if (needs_ground(&P)) {
-    if (!ground_all(&P, NULL)) goto cleanup;
-    if (P.stable) if (!ground_all(P.stable, NULL)) goto cleanup;
-  }
+  if (profile) prof_start();
+  trace_start();
+  if (needs_ground(&P)) if (!ground_all(&P, NULL)) goto cleanup;
 
   lstable_sat = lstable_sat && (P.sem == LSTABLE_SEMANTICS);
-  if (!naive_sample(&P, n, atoms, lstable_sat, &ret)) goto cleanup;
+  if (params) { if (!crn_sample(&P, n, atoms, params, lstable_sat, &ret)) goto cleanup; }
+  else if (!naive_sample(&P, n, atoms, lstable_sat, &ret)) goto cleanup;
 
   ok = true;
 cleanup:
+  trace_stop();
   if (free_atoms) Py_DECREF(atoms);
+  Py_XDECREF(params);
   free_program_contents(&P);
+  if (profile) {
+    py_prof = prof_stop();
+    if (ok && py_prof && !mem_stats_into(py_prof)) Py_CLEAR(py_prof);
+  }
+  mem_stop();
+  if (profile) {
+    if (ok && py_prof) return Py_BuildValue("NN", ret, py_prof);
+    if (ok) Py_DECREF(ret);
+    Py_XDECREF(py_prof);
+    return NULL;
+  }
   return ok ? ret : NULL;
 }
 
 static PyMethodDef CsampleMethods[] = {
   {"sample", (PyCFunction) (void(*)(void)) sample, METH_VARARGS | METH_KEYWORDS,
-    "Samples atoms from a program."},
+    "Samples atoms from a program. If `profile` is set, also returns per-phase timings and "
+    "memory usage as in `exact`. If `memory_limit` is positive, a MemoryError is raised instead "
+    "of allocating more than that many bytes. If `params` is a matrix whose rows hold the "
+    "probabilities of every probabilistic fact and then of every annotated disjunction, samples "
+    "each row with common random numbers and returns one sample matrix per row."},
   {NULL, NULL, 0, NULL},
 };
 
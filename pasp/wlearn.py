@@ -2,7 +2,8 @@ import numpy as np
 
 def learn(P, D: np.ndarray, A: np.ndarray = None, niters: int = 30, alg: str = "fixpoint",
           lr: float = 0.001, batch: int = None, smoothing: float = 1e-4, lstable_sat: bool = True,
-          display: str = "loglikelihood"):
+          display: str = "loglikelihood", checkpoint: str = None, checkpoint_every: int = 300,
+          resume: str = None, profile: bool = False, accel: bool = False):
   # If batch is not given, set batch to the size of the dataset.
   if batch is None: batch = len(D)
   # Prepare training tensors.
@@ -26,12 +27,17 @@ def learn(P, D: np.ndarray, A: np.ndarray = None, niters: int = 30, alg: str = "
     else: data = D
     from learn import learn_batch as clearn_batch
     P.train()
-    clearn_batch(P, data, niters = niters, alg = alg, lr = lr, batch = batch,
-                 lstable_sat = lstable_sat, display = display, smoothing = smoothing)
+    R = clearn_batch(P, data, niters = niters, alg = alg, lr = lr, batch = batch,
+                     lstable_sat = lstable_sat, display = display, smoothing = smoothing,
+                     checkpoint = checkpoint, checkpoint_every = checkpoint_every, resume = resume,
+                     profile = profile, accel = accel)
     P.eval()
-    return
+    return R
 
   # Non-batch mode.
+  if (checkpoint is not None) or (resume is not None):
+    raise ValueError("checkpointing is only supported in batch mode!")
+  if profile: raise ValueError("profiling is only supported in batch mode!")
   if type(A) is not np.ndarray: atoms = np.array(A, dtype = bytes)
   else: atoms = A if np.issubdtype(A.dtype, bytes) else A.astype(bytes)
   if type(D) is not np.ndarray: data = np.array(D, dtype = np.uint8)
@@ -40,5 +46,6 @@ def learn(P, D: np.ndarray, A: np.ndarray = None, niters: int = 30, alg: str = "
   obs, obs_counts = np.unique(data, axis = 0, return_counts = True)
   from learn import learn as clearn
   P.train()
-  clearn(P, obs, obs_counts, atoms, niters = niters, alg = alg, lr = lr, lstable_sat = lstable_sat)
+  clearn(P, obs, obs_counts, atoms, niters = niters, alg = alg, lr = lr, lstable_sat = lstable_sat,
+         display = display, accel = accel)
   P.eval()
@@ -23,13 +23,22 @@ STD_MACROS = [("NUM_PROCS", str(nproc-1 if (nproc := os.cpu_count()) > 1 else np
               ("_GNU_SOURCE", None)]
 
 exact    = Extension("exact",
-                     libraries = ["m", "clingo", "pthread"],
+                     libraries = ["m", "clingo", "pthread", "ncurses"],
                      depends = ["pasp/cprogram.c", "pasp/coptimize.c", "pasp/cinf.c",
                                 "pasp/cutils.c", "pasp/carray.c", "pasp/cground.c",
-                                "pasp/cexact.c"],
+                                "pasp/cexact.c", "pasp/ccheckpoint.c", "pasp/cprofile.c",
+                                "pasp/ctrace.c", "pasp/cprogress.c", "progressbar/progressbar.c",
+                                "pasp/cmem.c", "pasp/ccache.c", "pasp/csharpsat.c",
+                                "pasp/creduce.c", "pasp/cdecision.c", "pasp/cmarginal.c",
+                                "pasp/cjtree.c", "pasp/cfactor.c", "pasp/cbp.c"],
                      sources = ["pasp/exact.c", "thpool/thpool.c", "pasp/cinf.c", "pasp/cground.c",
                                 "bitvector/bitvector.c", "pasp/cutils.c", "pasp/coptimize.c",
-                                "pasp/carray.c", "pasp/cprogram.c", "pasp/cexact.c"],
+                                "pasp/carray.c", "pasp/cprogram.c", "pasp/cexact.c",
+                                "pasp/ccheckpoint.c", "pasp/cprofile.c", "pasp/ctrace.c",
+                                "pasp/cprogress.c", "progressbar/progressbar.c", "pasp/cmem.c",
+                                "pasp/ccache.c", "pasp/csharpsat.c", "pasp/creduce.c",
+                                "pasp/cdecision.c", "pasp/cmarginal.c", "pasp/cjtree.c",
+                                "pasp/cfactor.c", "pasp/cbp.c"],
                      include_dirs = [np.get_include()],
                      extra_compile_args = ["-Wno-unused-function"],
                      define_macros = STD_MACROS)
@@ -37,21 +46,30 @@ ground   = Extension("ground",
                      libraries = ["clingo", "pthread"],
                      depends = ["pasp/cutils.c", "pasp/cprogram.c", "pasp/cground.c",
                                 "pasp/carray.c", "bitvector/bitvector.c", "pasp/cinf.c",
-                                "thpool/thpool.c"],
+                                "thpool/thpool.c", "pasp/cprofile.c", "pasp/ctrace.c",
+                                "pasp/cmem.c"],
                      sources = ["pasp/ground.c", "pasp/cground.c", "pasp/cutils.c",
                                 "pasp/carray.c", "pasp/cprogram.c", "bitvector/bitvector.c",
-                                "pasp/cinf.c", "thpool/thpool.c"],
+                                "pasp/cinf.c", "thpool/thpool.c", "pasp/cprofile.c",
+                                "pasp/ctrace.c", "pasp/cmem.c"],
                      include_dirs = [np.get_include()],
                      define_macros = STD_MACROS)
 learn    = Extension("learn",
                      libraries = ["clingo", "pthread", "ncurses"],
                      depends = ["pasp/cprogram.c", "pasp/cinf.c", "pasp/cutils.c", "pasp/carray.c",
                                 "pasp/cground.c", "pasp/cexact.c", "pasp/clearn.c", "pasp/cdata.c",
-                                "progressbar/progressbar.c"],
+                                "progressbar/progressbar.c", "pasp/ccheckpoint.c",
+                                "pasp/cprofile.c", "pasp/ctrace.c", "pasp/cprogress.c",
+                                "pasp/cmem.c", "pasp/ccache.c", "pasp/csharpsat.c",
+                                "pasp/creduce.c", "pasp/cjtree.c", "pasp/cfactor.c", "pasp/cbp.c"],
                      sources = ["pasp/learn.c", "thpool/thpool.c", "pasp/cinf.c", "pasp/cprogram.c",
                                 "bitvector/bitvector.c", "pasp/cutils.c", "pasp/clearn.c",
                                 "pasp/carray.c", "pasp/cdata.c", "pasp/cexact.c",
-                                "pasp/coptimize.c", "pasp/cground.c", "progressbar/progressbar.c"],
+                                "pasp/coptimize.c", "pasp/cground.c", "progressbar/progressbar.c",
+                                "pasp/ccheckpoint.c", "pasp/cprofile.c", "pasp/ctrace.c",
+                                "pasp/cprogress.c", "pasp/cmem.c", "pasp/ccache.c",
+                                "pasp/csharpsat.c", "pasp/creduce.c", "pasp/cjtree.c",
+                                "pasp/cfactor.c", "pasp/cbp.c"],
                      include_dirs = [np.get_include()],
                      extra_compile_args = ["-Wno-unused-function"],
                      define_macros = STD_MACROS)
@@ -59,10 +77,12 @@ learn    = Extension("learn",
 sample   = Extension("sample",
                      libraries = ["clingo", "pthread"],
                      depends = ["pasp/cprogram.c", "pasp/cinf.c", "pasp/cutils.c", "pasp/carray.c",
-                                "pasp/cground.c", "pasp/csample.c"],
+                                "pasp/cground.c", "pasp/csample.c", "pasp/cprofile.c",
+                                "pasp/ctrace.c", "pasp/cmem.c"],
                      sources = ["pasp/sample.c", "thpool/thpool.c", "pasp/cinf.c", "pasp/cprogram.c",
                                 "bitvector/bitvector.c", "pasp/cutils.c", "pasp/csample.c",
-                                "pasp/carray.c", "pasp/cground.c"],
+                                "pasp/carray.c", "pasp/cground.c", "pasp/cprofile.c",
+                                "pasp/ctrace.c", "pasp/cmem.c"],
                      include_dirs = [np.get_include()],
                      extra_compile_args = ["-Wno-unused-function"],
                      define_macros = STD_MACROS)
@@ -1,5 +1,5 @@
 import unittest
-from .utils import PaspTest
+from .utils import PaspTest, env
 import pasp
 import numpy as np
 
@@ -80,5 +80,19 @@ class TestCounting(PaspTest):
     self.assertIsNone(C[2])
     self.assertIsNone(C[3])
 
+  def test_many_models(self):
+    # 2^17 models per total choice, more than 16-bit counters hold.
+    P = pasp.parse("""
+    0.5::p.
+    n(1..17).
+    a(X) :- not b(X), n(X).
+    b(X) :- not a(X), n(X).
+    """, from_str = True)
+    TestCounting.all_learnable(P)
+    for sharp in ["0", "1"]:
+      with env(PASP_SHARPSAT = sharp): C = pasp.count(P)
+      self.assertEqual(C[0].dtype, np.uint64)
+      self.assertTrue(np.array_equal(C[0], [[1 << 17, 1 << 17]]))
+
 if __name__ == "__main__":
   unittest.main()
@@ -1,5 +1,6 @@
 import unittest
-from .utils import PaspTest
+import os
+from .utils import PaspTest, capture_stdout, env
 import numpy as np
 import pasp
 
@@ -254,5 +255,374 @@ class TestPlog(PaspTest):
     # ℙ(alarm | not burglary, earthquake(none))
     self.assertAlmostEqual(R[3], 0.0)
 
+class TestCheckpoint(PaspTest):
+  def test_exact_resume(self):
+    import tempfile
+    P = pasp.parse("examples/earthquake.plp")
+    R = pasp.exact(P, quiet = True)
+    with tempfile.TemporaryDirectory() as d:
+      path = os.path.join(d, "earthquake.ckpt")
+      # Checkpoint after every total choice; the last one holds the fully enumerated state.
+      S = pasp.exact(P, quiet = True, checkpoint = path, checkpoint_every = 0)
+      T = pasp.exact(P, quiet = True, resume = path)
+    self.assertApproxEqual(S.flatten(), R.flatten())
+    self.assertApproxEqual(T.flatten(), R.flatten())
+
+  def test_resume_mismatch(self):
+    import tempfile
+    P, Q = pasp.parse("examples/earthquake.plp"), pasp.parse("examples/asia.plp")
+    with tempfile.TemporaryDirectory() as d:
+      path = os.path.join(d, "earthquake.ckpt")
+      pasp.exact(P, quiet = True, checkpoint = path, checkpoint_every = 0)
+      with self.assertRaises(ValueError): pasp.exact(Q, quiet = True, resume = path)
+
+  def test_resume_settings(self):
+    import tempfile
+    P = pasp.parse("examples/earthquake.plp")
+    with tempfile.TemporaryDirectory() as d:
+      path = os.path.join(d, "earthquake.ckpt")
+      pasp.exact(P, quiet = True, checkpoint = path, checkpoint_every = 0)
+      # Same shape, but different probabilistic semantics or parameters.
+      with self.assertRaises(ValueError):
+        pasp.exact(P, quiet = True, psemantics = "maxent", resume = path)
+      P.PF[0].p = 0.5
+      with self.assertRaises(ValueError): pasp.exact(P, quiet = True, resume = path)
+
+class TestShard(PaspTest):
+  def shard_merge(self, P, k: int, **kwargs):
+    import tempfile
+    with tempfile.TemporaryDirectory() as d:
+      paths = [os.path.join(d, f"{i}.shard") for i in range(k)]
+      for i in range(k): self.assertIsNone(pasp.exact(P, quiet = True, shard = (i, k), out = paths[i], **kwargs))
+      return pasp.merge(P, paths, quiet = True, **kwargs)
+
+  def test_asia(self):
+    P = pasp.parse("examples/asia.plp")
+    R = pasp.exact(P, quiet = True)
+    # More shards than blocks leaves some shards empty.
+    for k in (1, 2, 3, 300): self.assertApproxEqual(self.shard_merge(P, k).flatten(), R.flatten())
+
+  def test_maxent(self):
+    P = pasp.parse("examples/asia.plp")
+    R = pasp.exact(P, quiet = True, psemantics = "maxent")
+    self.assertApproxEqual(self.shard_merge(P, 4, psemantics = "maxent").flatten(), R.flatten())
+
+  def test_missing_shard(self):
+    import tempfile
+    P = pasp.parse("examples/asia.plp")
+    with tempfile.TemporaryDirectory() as d:
+      path = os.path.join(d, "0.shard")
+      pasp.exact(P, quiet = True, shard = (0, 2), out = path)
+      with self.assertRaises(ValueError): pasp.merge(P, [path], quiet = True)
+
+  def test_mismatch(self):
+    import tempfile
+    P = pasp.parse("examples/asia.plp")
+    with tempfile.TemporaryDirectory() as d:
+      path = os.path.join(d, "0.shard")
+      pasp.exact(P, quiet = True, shard = (0, 1), out = path)
+      with self.assertRaises(ValueError): pasp.merge(P, [path], quiet = True, psemantics = "maxent")
+      P.PF[0].p = 1 - P.PF[0].p
+      with self.assertRaises(ValueError): pasp.merge(P, [path], quiet = True)
+
+class TestProfile(PaspTest):
+  def test_exact(self):
+    P = pasp.parse("examples/asia.plp")
+    R, S = pasp.exact(P, quiet = True, profile = True)
+    self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True).flatten())
+    self.assertGreater(S["phases"]["solve"]["count"], 0)
+    self.assertGreater(S["phases"]["probability"]["count"], 0)
+    self.assertGreater(S["clingo"]["controls"], 0)
+    self.assertGreater(len(S["threads"]), 0)
+
+  def test_trace(self):
+    import json, tempfile
+    P = pasp.parse("examples/asia.plp")
+    with tempfile.TemporaryDirectory() as d:
+      path = os.path.join(d, "trace.json")
+      with env(PASP_TRACE = path): pasp.exact(P, quiet = True)
+      E = json.load(open(path))["traceEvents"]
+    self.assertTrue(any(e["name"] == "job" and e["ph"] == "X" for e in E))
+
+class TestProgress(PaspTest):
+  def test_exact(self):
+    P = pasp.parse("examples/asia.plp")
+    D = []
+    R = pasp.exact(P, quiet = True, progress = D.append, progress_every = 0)
+    self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True).flatten())
+    self.assertEqual(D[-1]["done"], D[-1]["total"])
+    self.assertAlmostEqual(D[-1]["mass"], 1.0)
+
+  def test_callback_raises(self):
+    def stop(_): raise KeyboardInterrupt
+    with self.assertRaises(KeyboardInterrupt):
+      pasp.exact(pasp.parse("examples/asia.plp"), quiet = True, progress = stop)
+
+class TestMemory(PaspTest):
+  def test_stats(self):
+    P = pasp.parse("examples/asia.plp")
+    R, S = pasp.exact(P, quiet = True, profile = True, memory_limit = 1 << 30)
+    self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True).flatten())
+    self.assertGreater(S["memory"]["peak"], 0)
+    self.assertEqual(S["memory"]["limit"], 1 << 30)
+    self.assertGreater(S["memory"]["subsystems"]["program"]["peak"], 0)
+
+  def test_limit(self):
+    with self.assertRaises(MemoryError):
+      pasp.exact(pasp.parse("examples/asia.plp"), quiet = True, memory_limit = 64)
+    # The limit only applies to the call it was given to.
+    pasp.exact(pasp.parse("examples/asia.plp"), quiet = True)
+
+  @unittest.skipIf((os.cpu_count() or 1) < 3, "needs more than one worker thread")
+  def test_fewer_workers(self):
+    # Limits between what one and all workers need make enumeration fall back to fewer workers.
+    P = pasp.parse("examples/asia.plp")
+    R, S = pasp.exact(P, quiet = True, profile = True)
+    peak, fallbacks = S["memory"]["peak"], 0
+    for i in range(1, 64):
+      try: L, T = pasp.exact(P, quiet = True, profile = True, memory_limit = peak*i//64)
+      except MemoryError: continue
+      self.assertApproxEqual(L.flatten(), R.flatten())
+      fallbacks += T["memory"]["hit"]
+    self.assertGreater(fallbacks, 0)
+
+class TestSched(PaspTest):
+  def test_clingo_parallel(self):
+    # Few total choices, so that idle threads are handed to clingo.
+    P = pasp.parse("examples/simple.plp")
+    with env(PASP_CLINGO_PARALLEL = "0"): R = pasp.exact(P, quiet = True)
+    self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True).flatten())
+
+class TestSharpSat(PaspTest):
+  def test_maxent(self):
+    for eg in ["asia", "earthquake", "insomnia", "smokers", "game"]:
+      P = pasp.parse(f"examples/{eg}.plp")
+      with env(PASP_SHARPSAT = "0"): R = pasp.exact(P, psemantics = "maxent", quiet = True)
+      S = pasp.exact(P, psemantics = "maxent", quiet = True)
+      self.assertApproxEqual(R.flatten(), S.flatten())
+
+  def test_count(self):
+    P = pasp.parse("examples/insomnia.plp")
+    for pf in P.PF: pf.learnable = True
+    for ad in P.AD: ad.learnable = True
+    with env(PASP_SHARPSAT = "0"): C = pasp.count(P)
+    D = pasp.count(P)
+    self.assertTrue(np.array_equal(C[0], D[0]))
+
+class TestKernels(PaspTest):
+  def test_generic(self):
+    for f, sem in [("asia", "stable"), ("3coloring", "lstable"), ("3coloring", "smproblog"),
+                   ("3coloring", "partial")]:
+      P = pasp.parse(f"examples/{f}.plp", semantics = sem)
+      for psem in ["credal", "maxent"]:
+        with env(PASP_GENERIC_KERNELS = "1"): R = pasp.exact(P, psemantics = psem, quiet = True)
+        S = pasp.exact(P, psemantics = psem, quiet = True)
+        self.assertApproxEqual(R.flatten(), S.flatten())
+
+class TestReduce(PaspTest):
+  def test_threads(self):
+    # Thread results are merged by reduction only when there is more than one thread.
+    for eg in ["asia", "earthquake", "smokers"]:
+      P = pasp.parse(f"examples/{eg}.plp")
+      with env(PASP_NUM_PROCS = "1"): R = pasp.exact(P, quiet = True)
+      S = pasp.exact(P, quiet = True)
+      self.assertApproxEqual(R.flatten(), S.flatten())
+    P = pasp.parse("examples/insomnia.plp")
+    for pf in P.PF: pf.learnable = True
+    for ad in P.AD: ad.learnable = True
+    with env(PASP_NUM_PROCS = "1"): C = pasp.count(P)
+    D = pasp.count(P)
+    self.assertTrue(np.array_equal(C[0], D[0]))
+
+class TestCache(PaspTest):
+  def test_hits(self):
+    import tempfile
+    pasp.cache_clear()
+    P = pasp.parse("examples/asia.plp")
+    R = pasp.exact(P, quiet = True)
+    self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True, cache = True).flatten())
+    self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True, cache = True).flatten())
+    S = pasp.cache_stats()
+    self.assertEqual((S["hits"], S["misses"], S["entries"]), (1, 1, 1))
+    # Different psemantics are different entries.
+    pasp.exact(P, quiet = True, psemantics = "maxent", cache = True)
+    self.assertEqual(pasp.cache_stats()["misses"], 2)
+    with tempfile.TemporaryDirectory() as d:
+      pasp.exact(P, quiet = True, cache = d)
+      # A fresh in-process tier still finds the entry on disk.
+      pasp.cache_clear()
+      self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True, cache = d).flatten())
+      self.assertEqual(pasp.cache_stats()["disk_hits"], 1)
+    pasp.cache_clear()
+
+  def test_prints(self):
+    # A hit prints the same answers as the miss that filled the cache.
+    pasp.cache_clear()
+    P = pasp.parse("examples/asia.plp")
+    with capture_stdout() as miss: pasp.exact(P, cache = True)
+    with capture_stdout() as hit: pasp.exact(P, cache = True)
+    self.assertEqual(pasp.cache_stats()["hits"], 1)
+    self.assertIn("---", miss[0])
+    self.assertEqual(miss[0], hit[0])
+    pasp.cache_clear()
+
+class TestDecision(PaspTest):
+  def test_rain(self):
+    P = pasp.parse("examples/rain_decision.plp")
+    self.assertEqual(len(P.PF), 2)
+    self.assertEqual([str(d) for d in P.D], ["?::umbrella", "?::raincoat"])
+    d, E = pasp.decide(P)
+    self.assertEqual(d, (True, False))
+    # Rows are indexed by (raincoat, umbrella) in binary.
+    self.assertApproxEqual(E.flatten(), [42, 43, 40, 32])
+    # Every assignment has a single model per total choice, so credal bounds are tight.
+    d, E = pasp.decide(P, psemantics = "credal")
+    self.assertEqual(d, (True, False))
+    self.assertApproxEqual(E.flatten(), [42, 42, 43, 43, 40, 40, 32, 32])
+
+class TestMarginals(PaspTest):
+  def test_game(self):
+    P = pasp.parse("examples/game.plp")
+    A, R = pasp.marginals(P)
+    self.assertEqual(A, ["move(a,b)", "move(b,a)", "move(b,c)", "move(c,d)", "wins(a)", "wins(b)",
+                         "wins(c)"])
+    self.assertApproxEqual(R.flatten(), [1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.3, 0.3, 0.0, 0.3,
+                                         0.7, 1.0, 0.3, 0.3])
+    # Same as the queries answered by exact inference.
+    A, R = pasp.marginals(P, atoms = ["wins(b)", "wins(c)"])
+    self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True).flatten())
+    A, R = pasp.marginals(P, atoms = ["wins(b)", "wins(c)"], psemantics = "maxent")
+    self.assertApproxEqual(R.flatten(), [0.85, 0.3])
+    # ℙ(wins(c) | not wins(a))
+    A, R = pasp.marginals(P, atoms = ["wins(c)"], evidence = ["not wins(a)"])
+    self.assertApproxEqual(R.flatten(), [0.0, 0.3])
+    A, R = pasp.marginals(P, atoms = ["wins(c)"], evidence = ["not wins(a)"], psemantics = "maxent")
+    self.assertApproxEqual(R.flatten(), [0.15/0.85])
+
+class TestJunctionTree(PaspTest):
+  def test_bayesian_networks(self):
+    for eg in ["asia", "earthquake"]:
+      P = pasp.parse(f"examples/{eg}.plp")
+      for psem in ["credal", "maxent"]:
+        R = pasp.exact(P, psemantics = psem, quiet = True, engine = "jtree")
+        self.assertApproxEqual(R.flatten(), pasp.exact(P, psemantics = psem, quiet = True).flatten())
+
+  def test_not_applicable(self):
+    # Cyclic programs have more than one model per total choice.
+    with self.assertRaises(NotImplementedError):
+      pasp.exact(pasp.parse("examples/game.plp"), quiet = True, engine = "jtree")
+    with self.assertRaises(ValueError):
+      pasp.exact(pasp.parse("examples/asia.plp"), quiet = True, engine = "jtree", shard = (0, 2),
+                 out = "shard")
+
+class TestMonotone(PaspTest):
+  def test_credal(self):
+    # Queries monotone in some credal facts search fewer vertices, but must find the same bounds.
+    chain = pasp.parse("""
+    [0.2, 0.4]::c(1). [0.1, 0.6]::c(2). [0.3, 0.5]::c(3). 0.5::d(1). 0.7::d(2). 0.4::d(3).
+    e(1) :- c(1), d(1). e(2) :- c(2), d(2). e(2) :- e(1), d(2). e(3) :- c(3), d(3). e(3) :- e(2), not c(2).
+    #query(e(3)).
+    #query(e(3) | d(1)).
+    #query(c(2) | not e(3)).
+    """, from_str = True)
+    for P in [pasp.parse("examples/prisoners.plp"), chain]:
+      with env(PASP_MONOTONE = "0"): R = pasp.exact(P, quiet = True)
+      self.assertApproxEqual(R.flatten(), pasp.exact(P, quiet = True).flatten())
+
+class TestControlPool(PaspTest):
+  def test_exact(self):
+    # Choices assigned to the externals of a pooled control must give the same models as facts.
+    for eg, sem in [("game", "stable"), ("prisoners", "stable"), ("earthquake_ad", "stable"),
+                    ("barber", "lstable"), ("3coloring", "lstable")]:
+      P = pasp.parse(f"examples/{eg}.plp", semantics = sem)
+      for psem in ["credal", "maxent"]:
+        R = pasp.exact(P, psemantics = psem, quiet = True)
+        with env(PASP_CONTROL_POOL = "1"): S = pasp.exact(P, psemantics = psem, quiet = True)
+        self.assertApproxEqual(R.flatten(), S.flatten())
+
+  def test_dropped(self):
+    # The pooled grounding holds every b(X, Y), many more atoms than the grounding of any total
+    # choice with few a(X), so workers drop their pools.
+    P = pasp.parse("""
+    0.5::a(1). 0.5::a(2). 0.5::a(3). 0.5::a(4).
+    n(1..30).
+    b(X, Y) :- a(X), n(Y).
+    c :- b(1, 3).
+    #query(c).
+    """, from_str = True)
+    with env(PASP_CONTROL_POOL = "1"): R = pasp.exact(P, quiet = True)
+    self.assertApproxEqual(R.flatten(), [0.5, 0.5])
+
+  def test_marginals(self):
+    P = pasp.parse("examples/game.plp")
+    A, R = pasp.marginals(P)
+    with env(PASP_CONTROL_POOL = "1"): B, S = pasp.marginals(P)
+    self.assertEqual(A, B)
+    self.assertApproxEqual(R.flatten(), S.flatten())
+
+  def test_profile(self):
+    # Each call frees its workers' pooled controls, collecting their clingo statistics.
+    P, D = pasp.parse("examples/game.plp"), pasp.parse("examples/rain_decision.plp")
+    with env(PASP_CONTROL_POOL = "1"):
+      for _ in range(3):
+        A, R, S = pasp.marginals(P, profile = True)
+        self.assertGreater(S["clingo"]["controls"], 0)
+        self.assertGreater(S["clingo"]["summary.models.enumerated"], 0)
+        d, E, S = pasp.decide(D, profile = True)
+        self.assertGreater(S["clingo"]["controls"], 0)
+        self.assertGreater(S["clingo"]["summary.models.enumerated"], 0)
+
+class TestBeliefPropagation(PaspTest):
+  def test_trees(self):
+    # The factor graphs of these programs are trees, on which belief propagation is exact.
+    for eg in ["asia", "earthquake"]:
+      P = pasp.parse(f"examples/{eg}.plp")
+      for psem in ["credal", "maxent"]:
+        R = pasp.exact(P, psemantics = psem, quiet = True)
+        self.assertApproxEqual(R.flatten(), pasp.bp(P, psemantics = psem, quiet = True).flatten())
+
+  def test_chain_rule(self):
+    # Queries of several atoms clamp one more atom per propagation.
+    P = pasp.parse("""
+    0.3::a. 0.6::b.
+    c :- a.
+    d :- c, b.
+    #query(a, d | b).
+    #query(c, not d).
+    #query(c | not a).
+    """, from_str = True)
+    for psem in ["credal", "maxent"]:
+      R = pasp.exact(P, psemantics = psem, quiet = True)
+      self.assertApproxEqual(R.flatten(), pasp.bp(P, psemantics = psem, quiet = True).flatten())
+
+  def test_not_applicable(self):
+    # Cyclic programs have more than one model per total choice.
+    with self.assertRaises(NotImplementedError): pasp.bp(pasp.parse("examples/game.plp"))
+
+class TestDynamic(PaspTest):
+  E = [[], ["umbrella(t)"], ["umbrella(t)"], ["not umbrella(t)"], ["umbrella(t)"]]
+
+  def test_umbrella(self):
+    D = pasp.dynamic("examples/umbrella.plp")
+    self.assertEqual(D.state, ["rain({})"])
+    F, S = D.filter(TestDynamic.E[:3]), D.smooth(TestDynamic.E[:3])
+    self.assertApproxEqual(F[:,0], [1/2, 9/11, 621/703])
+    self.assertApproxEqual(S[1:,0], [621/703, 621/703])
+
+  def test_unrolled(self):
+    # Filtering and smoothing slice by slice agree with exact inference on the unrolled program.
+    D, E = pasp.dynamic("examples/umbrella.plp"), TestDynamic.E
+    F, S = D.filter(E, queries = ["umbrella(t)"]), D.smooth(E)
+    O = [D.inst(e, t) for t in range(len(E)) for e in E[t]]
+    U = D.unroll(len(E)-1).replace("#query", "%")
+    for t in range(len(E)):
+      seen = [D.inst(e, u) for u in range(t+1) for e in E[u]]
+      given = f" | {', '.join(seen)}" if seen else ""
+      Q = f"#query(rain({t}){given}).\n#query(rain({t}) | {', '.join(O)}).\n"
+      # There is no umbrella before the first step.
+      if t > 0: Q += f"#query(umbrella({t}){given}).\n"
+      R = pasp.exact(pasp.parse(U + "\n" + Q, from_str = True), psemantics = "maxent", quiet = True)
+      self.assertApproxEqual(R.flatten(), [F[t,0], S[t,0], F[t,1]][:len(R)])
+
 if __name__ == "__main__":
   unittest.main()
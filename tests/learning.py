@@ -40,6 +40,22 @@ class TestLearning(PaspTest):
 
     self.assertAlmostEqual(P.PF[0].p, Q.PF[0].p, delta = EPS)
 
+  def test_earthquake_accel(self):
+    which = "examples/earthquake_ad.plp"
+    A = ["alarm", "calls(a)", "calls(b)"]
+    S = pasp.sample(pasp.parse(which), A, n = N_SAMPLES)
+    def learned(niters: int, accel: bool):
+      P = pasp.parse(which)
+      P.PF[0].p = 0.5; P.PF[0].learnable = True
+      P.PR[-1].p = 0.5; P.PR[-1].learnable = True
+      P.PR[-2].p = 0.5; P.PR[-2].learnable = True
+      pasp.learn(P, S, A, niters = niters, accel = accel)
+      return [P.PF[0].p, P.PR[-1].p, P.PR[-2].p]
+    # SQUAREM reaches the fixpoint of plain EM in far fewer iterations.
+    self.assertTrue(np.allclose(learned(60, True), learned(1000, False), atol = 1e-3))
+    with self.assertRaises(ValueError):
+      pasp.learn(pasp.parse(which), S, A, alg = "lagrange", accel = True)
+
   def test_neural_minimal(self):
     R = pasp.parse("examples/neural_minimal.plp")(quiet = True)
     self.assertTrue(np.allclose(R.flatten(), [0.8, 0.1], atol=1e-3))
@@ -25,6 +25,25 @@ class SamplingCases(PaspTest):
 
       self.assertTrue(np.allclose(R, Q, atol = EPS))
 
+  def test_insomnia_ad_crn(self):
+    # The same sweep as above, but sampling all settings from one stream of uniforms.
+    W = [[0.3, 0.2, 0.5], [0.1, 0.6, 0.3], [0.9, 0.1, 0.0], [0.0, 0.5, 0.5], [0.3, 0.2, 0.5]]
+    P = pasp.parse("examples/insomnia_ad.plp")
+    A = ["insomnia(anna)", "insomnia(bill)", "work(anna)", "work(bill)", "sleep(anna)",
+         "sleep(bill)"]
+    S = pasp.sample(P, A, n = N_SAMPLES, params = W)
+    self.assertEqual(S.shape, (len(W), N_SAMPLES, len(A)))
+    for w, T in zip(W, S):
+      P.AD[0].P = w
+      R = pasp.exact(P, quiet = True, psemantics = "maxent").flatten()
+      self.assertTrue(np.allclose(R, np.sum(T, axis = 0) / N_SAMPLES, atol = EPS))
+    # Equal settings draw equal samples, and raising the probability of insomnia(anna) only turns
+    # it on in more samples.
+    self.assertTrue(np.all(S[0] == S[-1]))
+    self.assertTrue(np.all(S[2][:,0] >= S[0][:,0]))
+    with self.assertRaises(ValueError): pasp.sample(P, A, n = 10, params = [[0.5, 0.5]])
+    with self.assertRaises(ValueError): pasp.sample(P, A, n = 10, params = [[0.5, 0.6, 0.1]])
+
   def test_earthquake(self):
     P = pasp.parse("examples/earthquake.plp")
     A = ["alarm", "burglary", "earthquake"]
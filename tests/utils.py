@@ -1,5 +1,10 @@
 import unittest
+import contextlib
+import ctypes
 import math
+import os
+import sys
+import tempfile
 
 CONFIDENCE = 0.99
 
@@ -9,6 +14,34 @@ def hoeffding(n: int, tol: float = 1e-2) -> float:
   Takes the number of samples `n` and returns the probability error ϵ."""
   return math.sqrt(math.log(2/(1-CONFIDENCE))/(2*n))+tol
 
+@contextlib.contextmanager
+def env(**kw):
+  """ Sets the environment variables in `kw`, restoring their previous values on exit."""
+  old = {k: os.environ.get(k) for k in kw}
+  os.environ.update(kw)
+  try: yield
+  finally:
+    for k, v in old.items():
+      if v is None: del os.environ[k]
+      else: os.environ[k] = v
+
+@contextlib.contextmanager
+def capture_stdout():
+  """ Captures what is written to the standard output, including by the C extensions.
+
+  Yields a list that holds the captured text once the context exits."""
+  libc, out = ctypes.CDLL(None), []
+  with tempfile.TemporaryFile() as f:
+    sys.stdout.flush(); libc.fflush(None)
+    fd = os.dup(1)
+    os.dup2(f.fileno(), 1)
+    try: yield out
+    finally:
+      libc.fflush(None)
+      os.dup2(fd, 1); os.close(fd)
+      f.seek(0)
+      out.append(f.read().decode(errors = "replace"))
+
 class PaspTest(unittest.TestCase):
   def assertApproxEqual(self, X: list, Y: list, Z: list = None):
     self.assertEqual(len(X), len(Y))